@@ -42,9 +42,13 @@ const IS_STRING = 0x43;
 const IS_INTEGER = 0x44;
 const NOP_OP = 0x50;
 const REG_STORE = 0x51;
+const YIELD_OP = 0x52;
 const PEEK = 0x60;
 const POKE = 0x61;
 const MEMCPY = 0x62;
+const MEMSET = 0x63;
+const MEMCMP = 0x64;
+const MEMFIND = 0x65;
 const STACK_PUSH = 0x70;
 const STACK_POP = 0x71;
 const STACK_RET = 0x72;
@@ -294,12 +298,20 @@ const grammar: Grammar = {
     {"name": "cmd", "symbols": ["cmd$subexpression$43", "_", "address", "_", {"literal":","}, "_", "address"], "postprocess": function(d) { d[0] = POKE; return d.filter(e => e !== null && e !== ','); }},
     {"name": "cmd$subexpression$44", "symbols": [/[mM]/, /[eE]/, /[mM]/, /[cC]/, /[pP]/, /[yY]/], "postprocess": function(d) {return d.join(""); }},
     {"name": "cmd", "symbols": ["cmd$subexpression$44", "_", "address", "_", {"literal":","}, "_", "address", "_", {"literal":","}, "_", "address"], "postprocess": function(d) { d[0] = MEMCPY; return d.filter(e => e !== null && e !== ','); }},
-    {"name": "cmd$subexpression$45", "symbols": [/[pP]/, /[uU]/, /[sS]/, /[hH]/], "postprocess": function(d) {return d.join(""); }},
-    {"name": "cmd", "symbols": ["cmd$subexpression$45", "_", "address"], "postprocess": function(d) { d[0] = STACK_PUSH; return d.filter(e => e !== null); }},
-    {"name": "cmd$subexpression$46", "symbols": [/[pP]/, /[oO]/, /[pP]/], "postprocess": function(d) {return d.join(""); }},
-    {"name": "cmd", "symbols": ["cmd$subexpression$46", "_", "address"], "postprocess": function(d) { d[0] = STACK_POP; return d.filter(e => e !== null); }},
-    {"name": "cmd$subexpression$47", "symbols": [/[rR]/, /[eE]/, /[tT]/], "postprocess": function(d) {return d.join(""); }},
-    {"name": "cmd", "symbols": ["cmd$subexpression$47"], "postprocess": function(d) { d[0] = STACK_RET; return d.filter(e => e !== null); }},
+    {"name": "cmd$subexpression$45", "symbols": [/[mM]/, /[eE]/, /[mM]/, /[sS]/, /[eE]/, /[tT]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$45", "_", "address", "_", {"literal":","}, "_", "address", "_", {"literal":","}, "_", "address"], "postprocess": function(d) { d[0] = MEMSET; return d.filter(e => e !== null && e !== ','); }},
+    {"name": "cmd$subexpression$46", "symbols": [/[mM]/, /[eE]/, /[mM]/, /[cC]/, /[mM]/, /[pP]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$46", "_", "address", "_", {"literal":","}, "_", "address", "_", {"literal":","}, "_", "address"], "postprocess": function(d) { d[0] = MEMCMP; return d.filter(e => e !== null && e !== ','); }},
+    {"name": "cmd$subexpression$47", "symbols": [/[mM]/, /[eE]/, /[mM]/, /[fF]/, /[iI]/, /[nN]/, /[dD]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$47", "_", "address", "_", {"literal":","}, "_", "address", "_", {"literal":","}, "_", "address"], "postprocess": function(d) { d[0] = MEMFIND; return d.filter(e => e !== null && e !== ','); }},
+    {"name": "cmd$subexpression$48", "symbols": [/[pP]/, /[uU]/, /[sS]/, /[hH]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$48", "_", "address"], "postprocess": function(d) { d[0] = STACK_PUSH; return d.filter(e => e !== null); }},
+    {"name": "cmd$subexpression$49", "symbols": [/[pP]/, /[oO]/, /[pP]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$49", "_", "address"], "postprocess": function(d) { d[0] = STACK_POP; return d.filter(e => e !== null); }},
+    {"name": "cmd$subexpression$50", "symbols": [/[rR]/, /[eE]/, /[tT]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$50"], "postprocess": function(d) { d[0] = STACK_RET; return d.filter(e => e !== null); }},
+    {"name": "cmd$subexpression$51", "symbols": [/[yY]/, /[iI]/, /[eE]/, /[lL]/, /[dD]/], "postprocess": function(d) {return d.join(""); }},
+    {"name": "cmd", "symbols": ["cmd$subexpression$51"], "postprocess": function(d) { d[0] = YIELD_OP; return d.filter(e => e !== null); }},
     {"name": "comment", "symbols": []},
     {"name": "comment", "symbols": ["comment", /[^\n]/], "postprocess": function(d) { return d.join(''); }},
     {"name": "string", "symbols": ["dqstring"], "postprocess": function(d) { return d[0]; }},
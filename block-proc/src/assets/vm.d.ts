@@ -1,5 +1,61 @@
+/**
+ * Views of the process image, see vm-emscripten/src/image.js.  Read the
+ * arrays from it on every scan, they are replaced when the memory grows.
+ */
+export interface ProcessImage_t {
+    version: number;
+    readonly scans: number;
+    readonly analogIn: Float32Array;
+    readonly analogOut: Float32Array;
+    readonly binaryIn: Uint8Array;
+    readonly binaryOut: Uint8Array;
+    readonly variableWords: Int32Array;
+    readonly variableNumbers: Float32Array;
+    variableStride: number;
+    variableType: number;
+    getVariables: () => Array<number>;
+    setVariables: (values: Array<number>) => void;
+}
+
+/**
+ * What stopped a scan, see GetProgramError in vm-emscripten/src/main.cpp.
+ */
+export interface ProgramError_t {
+    code: number;
+    ip: number;
+    opcode: number;
+    message: string;
+}
+
+export interface Profile_t {
+    counts: Float64Array;
+    cycles: Float64Array;
+    offsets: Uint32Array;
+    names: (string | null)[];
+    groups: string[];
+}
+
 export interface VM_t {
     RunProgram: (program: Uint8Array) => void;
+    RunProgramBuffer: (size: number) => number;
+    LoadProgramBuffer: (size: number) => number;
+    programBuffer: (size: number) => Uint8Array;
+    getProcessImage: (handle?: number) => ProcessImage_t;
+    LoadProgram: (program: Uint8Array) => number;
+    SetProgramRetention: (handle: number, keepRegisters: boolean, keepStacks: boolean, keepMemory: boolean) => void;
+    SetWatchdog: (handle: number, maxInstructions: number, maxMilliseconds: number) => void;
+    SetOutputBuffer: (handle: number, capacity: number, dropWhenFull: boolean) => void;
+    RunScans: (handle: number, scans: number) => number;
+    StepProgram: (handle: number, budget: number) => number;
+    ResetProgram: (handle: number) => number;
+    GetProgramError: (handle: number) => ProgramError_t | null;
+    SetEventTrace: (handle: number, capacity: number) => void;
+    GetTraceEvents: (handle: number) => string;
+    SetProfiling: (handle: number, enabled: boolean) => void;
+    GetProfile: (handle: number) => Profile_t | null;
+    UnloadProgram: (handle: number) => void;
+    SetTraceLevel: (level: number) => void;
+    SetWasmCodegen: (enabled: boolean) => void;
 
     getAnalogInputs: () => Float32Array;
     getAnalogOuputs: () => Float32Array;
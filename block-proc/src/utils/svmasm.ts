@@ -11,7 +11,7 @@ function svmasm(hljs: HLJSApi) {
           /* mnemonic */
           'store exit nop print_int print_str print_num system goto jmp jmpz jmpnz call '
           + 'add and sub mul div or xor concat dec inc int2string num2string random string2int '
-          + 'cmp is_string is_integer peek poke memcpy push pop ret load save',
+          + 'cmp is_string is_integer peek poke memcpy memset memcmp memfind push pop ret yield load save',
       },
       contains: [
         hljs.COMMENT(
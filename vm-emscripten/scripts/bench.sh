@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+
+# The benchmark suite against the native library, with the same CFLAGS.
+# Arguments are passed on, e.g. `npm run bench -- -e jit -r 20`.
+
+DIR_OUTPUT="dist/native"
+CFLAGS=${CFLAGS:-"-O2 -g -fno-omit-frame-pointer"}
+PROGRAMS=$(ls examples/*.raw 2>/dev/null | grep -v system.raw)
+
+CFLAGS="$CFLAGS" ./scripts/makeNative.sh || exit 1
+
+gcc $CFLAGS tests/bench.c -L$DIR_OUTPUT -lsvm -lm -pthread -o $DIR_OUTPUT/bench || exit 1
+$DIR_OUTPUT/bench -o $DIR_OUTPUT/bench.json "$@" $PROGRAMS || exit 1
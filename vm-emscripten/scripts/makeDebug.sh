@@ -6,8 +6,16 @@ mkdir -p $DIR_OUTPUT
 
 export EMCC_DEBUG=1
 emcc src/vm/vm.c -c -o $DIR_OUTPUT/vm.o
+emcc src/vm/vm-engine.c -c -o $DIR_OUTPUT/vm-engine.o
+emcc src/vm/vm-decode.c -c -o $DIR_OUTPUT/vm-decode.o
 emcc src/vm/vm-ops.c -c -o $DIR_OUTPUT/vm-ops.o
+emcc src/vm/vm-ops-traced.c -c -o $DIR_OUTPUT/vm-ops-traced.o
+emcc src/vm/vm-ops-verified.c -c -o $DIR_OUTPUT/vm-ops-verified.o
+emcc src/vm/vm-verify.c -c -o $DIR_OUTPUT/vm-verify.o
+emcc src/vm/vm-trace.c -c -o $DIR_OUTPUT/vm-trace.o
+emcc src/vm/vm-jit-x64.c -c -o $DIR_OUTPUT/vm-jit-x64.o
+emcc src/vm/vm-wasm.c -c -o $DIR_OUTPUT/vm-wasm.o
 emcc src/vm/jsprintf.c -c -o $DIR_OUTPUT/jsprintf.o
-emcc -std=c++17 src/main.cpp -c -o $DIR_OUTPUT/main.o
-emcc -g4 -lembind --ts-typings $DIR_OUTPUT/vm.o $DIR_OUTPUT/vm-ops.o $DIR_OUTPUT/jsprintf.o $DIR_OUTPUT/main.o -sEXPORTED_RUNTIME_METHODS="cwrap,ccall,setValue,getValue,preRun" -sEXPORTED_FUNCTIONS='_malloc' -sEXPORT_ES6=0 -sMODULARIZE=1 -sEXPORT_NAME=VM -sUSE_ES6_IMPORT_META=1 -sERROR_ON_UNDEFINED_SYMBOLS=0 -sALLOW_MEMORY_GROWTH=1 -sIMPORTED_MEMORY=1 -o $DIR_OUTPUT/vm.html        # TESTS
-# emcc -O3 -lembind $DIR_OUTPUT/vm.o $DIR_OUTPUT/vm-ops.o $DIR_OUTPUT/main.o -sEXPORTED_RUNTIME_METHODS="cwrap,ccall" -sEXPORT_ES6=1 -sMODULARIZE=1 -sUSE_ES6_IMPORT_META=1 -sERROR_ON_UNDEFINED_SYMBOLS=0 -sALLOW_MEMORY_GROWTH=1 -o $DIR_OUTPUT/vm.html  # DEPLOY
+emcc -std=c++17 -DSVM_TRACE_LEVEL=SVM_TRACE_INSTRUCTIONS src/main.cpp -c -o $DIR_OUTPUT/main.o
+emcc -g4 -lembind --post-js src/image.js --ts-typings $DIR_OUTPUT/vm.o $DIR_OUTPUT/vm-engine.o $DIR_OUTPUT/vm-decode.o $DIR_OUTPUT/vm-ops.o $DIR_OUTPUT/vm-ops-traced.o $DIR_OUTPUT/vm-ops-verified.o $DIR_OUTPUT/vm-verify.o $DIR_OUTPUT/vm-trace.o $DIR_OUTPUT/vm-jit-x64.o $DIR_OUTPUT/vm-wasm.o $DIR_OUTPUT/jsprintf.o $DIR_OUTPUT/main.o -sEXPORTED_RUNTIME_METHODS="cwrap,ccall,setValue,getValue,preRun" -sEXPORTED_FUNCTIONS='_malloc' -sEXPORT_ES6=0 -sMODULARIZE=1 -sEXPORT_NAME=VM -sUSE_ES6_IMPORT_META=1 -sERROR_ON_UNDEFINED_SYMBOLS=0 -sALLOW_MEMORY_GROWTH=1 -sIMPORTED_MEMORY=1 -o $DIR_OUTPUT/vm.html        # TESTS
+# emcc -O3 -lembind --post-js src/image.js $DIR_OUTPUT/vm.o $DIR_OUTPUT/vm-engine.o $DIR_OUTPUT/vm-decode.o $DIR_OUTPUT/vm-ops.o $DIR_OUTPUT/vm-ops-traced.o $DIR_OUTPUT/vm-ops-verified.o $DIR_OUTPUT/vm-verify.o $DIR_OUTPUT/vm-trace.o $DIR_OUTPUT/vm-jit-x64.o $DIR_OUTPUT/vm-wasm.o $DIR_OUTPUT/main.o -sEXPORTED_RUNTIME_METHODS="cwrap,ccall" -sEXPORT_ES6=1 -sMODULARIZE=1 -sUSE_ES6_IMPORT_META=1 -sERROR_ON_UNDEFINED_SYMBOLS=0 -sALLOW_MEMORY_GROWTH=1 -o $DIR_OUTPUT/vm.html  # DEPLOY
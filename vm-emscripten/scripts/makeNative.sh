@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+
+# The virtual machine as a static library for native hosts, the `svm` runner
+# and the `svm2c` translator.  CFLAGS picks the engine of svm_run, e.g.
+# CFLAGS="-O2 -DSVM_USE_JIT=1" or -DSVM_DISPATCH=SVM_DISPATCH_CALL.
+
+DIR_OUTPUT="dist/native"
+DIR_OBJECTS="$DIR_OUTPUT/obj"
+CFLAGS=${CFLAGS:-"-O2 -g -fno-omit-frame-pointer"}
+. scripts/sources.sh
+MODULES="$VM_MODULES vm-runtime vm-sched"
+
+mkdir -p $DIR_OBJECTS
+
+rm -f $DIR_OUTPUT/libsvm.a
+for SOURCE in $MODULES; do
+    gcc $CFLAGS -pthread -c src/vm/$SOURCE.c -o $DIR_OBJECTS/$SOURCE.o || exit 1
+done
+ar rcs $DIR_OUTPUT/libsvm.a $(for SOURCE in $MODULES; do echo $DIR_OBJECTS/$SOURCE.o; done) || exit 1
+
+gcc $CFLAGS src/svm.c -L$DIR_OUTPUT -lsvm -lm -pthread -o $DIR_OUTPUT/svm || exit 1
+gcc $CFLAGS src/svm2c.c -L$DIR_OUTPUT -lsvm -lm -pthread -o $DIR_OUTPUT/svm2c || exit 1
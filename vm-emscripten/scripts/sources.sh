@@ -0,0 +1,6 @@
+# The sources of the virtual machine, sourced by the scripts which build it
+# natively: VM_MODULES names them for makeNative.sh, VM lists the files the
+# tests compile in.  vm-runtime and vm-sched are added where they're used.
+
+VM_MODULES="vm vm-engine vm-decode vm-ops vm-ops-traced vm-ops-verified vm-verify vm-trace vm-jit-x64 vm-wasm jsprintf"
+VM=$(for MODULE in $VM_MODULES; do printf 'src/vm/%s.c ' $MODULE; done)
@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+for ENGINE in -DSVM_DISPATCH=SVM_DISPATCH_CALL -DSVM_DISPATCH=SVM_DISPATCH_SWITCH -DSVM_DISPATCH=SVM_DISPATCH_THREADED -DSVM_USE_JIT=1; do
+    gcc -O2 $ENGINE $VM tests/arena.c -lm -o $DIR_OUTPUT/arena || exit 1
+    $DIR_OUTPUT/arena || exit 1
+done
+
+gcc -g -fsanitize=address,undefined $VM tests/arena.c -lm -o $DIR_OUTPUT/arena-asan || exit 1
+$DIR_OUTPUT/arena-asan || exit 1
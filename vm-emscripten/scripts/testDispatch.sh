@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+# system.in runs a shell command, keep it out of the benchmark loop
+PROGRAMS=$(ls examples/*.raw | grep -v system.raw)
+
+for DISPATCH in SVM_DISPATCH_THREADED SVM_DISPATCH_SWITCH; do
+    gcc -O2 -DSVM_DISPATCH=$DISPATCH $VM tests/dispatch.c -lm -o $DIR_OUTPUT/dispatch || exit 1
+    $DIR_OUTPUT/dispatch $PROGRAMS || exit 1
+done
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+gcc -O2 $VM tests/events.c -lm -o $DIR_OUTPUT/events || exit 1
+$DIR_OUTPUT/events $DIR_OUTPUT/events.json || exit 1
+node -e 'const t = JSON.parse(require("fs").readFileSync(process.argv[1])); console.log(`${process.argv[1]}: ${t.traceEvents.length} trace events`);' $DIR_OUTPUT/events.json || exit 1
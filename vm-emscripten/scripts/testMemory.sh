@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+gcc -O2 $VM tests/memory.c -lm -o $DIR_OUTPUT/memory || exit 1
+$DIR_OUTPUT/memory || exit 1
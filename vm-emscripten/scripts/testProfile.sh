@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+gcc -O2 $VM tests/profile.c -lm -o $DIR_OUTPUT/profile || exit 1
+$DIR_OUTPUT/profile examples/call.raw examples/concat.raw examples/bench.raw || exit 1
@@ -0,0 +1,12 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+# system.in runs a shell command, keep it out of the benchmark loop
+PROGRAMS=$(ls examples/*.raw | grep -v system.raw)
+
+gcc -O2 $VM tests/reset.c -lm -o $DIR_OUTPUT/reset || exit 1
+$DIR_OUTPUT/reset $PROGRAMS || exit 1
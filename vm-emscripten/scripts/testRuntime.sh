@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+VM="$VM src/vm/vm-runtime.c"
+
+mkdir -p $DIR_OUTPUT
+
+# system.in runs a shell command, keep it out of the benchmark loop
+PROGRAMS=$(ls examples/*.raw | grep -v system.raw)
+
+gcc -O2 -pthread $VM tests/runtime.c -lm -o $DIR_OUTPUT/runtime || exit 1
+$DIR_OUTPUT/runtime $PROGRAMS || exit 1
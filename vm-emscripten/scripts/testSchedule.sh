@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+VM="$VM src/vm/vm-sched.c"
+
+mkdir -p $DIR_OUTPUT
+
+gcc -O2 $VM tests/schedule.c -lm -o $DIR_OUTPUT/schedule || exit 1
+$DIR_OUTPUT/schedule || exit 1
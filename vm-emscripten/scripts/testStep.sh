@@ -0,0 +1,12 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+# system.in runs a shell command, keep it out of the test loop
+PROGRAMS=$(ls examples/*.raw | grep -v system.raw)
+
+gcc -O2 $VM tests/step.c -lm -o $DIR_OUTPUT/step || exit 1
+$DIR_OUTPUT/step $PROGRAMS || exit 1
@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT
+
+gcc -O2 $VM tests/strings.c -lm -o $DIR_OUTPUT/strings || exit 1
+$DIR_OUTPUT/strings examples/concat.raw examples/equal.raw examples/compare.raw || exit 1
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+
+mkdir -p $DIR_OUTPUT/translated
+
+# system.in runs a shell command, keep it out of the benchmark loop
+PROGRAMS=$(ls examples/*.raw | grep -v system.raw)
+
+gcc -O2 $VM src/svm2c.c -lm -o $DIR_OUTPUT/svm2c || exit 1
+
+printf "%-24s %8s %14s %14s %8s\n" "program" "trials" "call [i/s]" "translated" "speedup"
+
+for PROGRAM in $PROGRAMS; do
+    NAME=$(basename $PROGRAM .raw)
+    $DIR_OUTPUT/svm2c $PROGRAM svm_run_translated > $DIR_OUTPUT/translated/$NAME.c || exit 1
+    gcc -O2 -Isrc/vm $VM $DIR_OUTPUT/translated/$NAME.c tests/translate.c -lm -o $DIR_OUTPUT/translate-$NAME || exit 1
+    $DIR_OUTPUT/translate-$NAME $PROGRAM || exit 1
+done
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+
+DIR_OUTPUT="dist/native"
+. scripts/sources.sh
+PROGRAMS=$(ls examples/*.raw | grep -v system.raw)
+
+mkdir -p $DIR_OUTPUT
+
+gcc -O2 $VM tests/verify.c -lm -o $DIR_OUTPUT/verify || exit 1
+$DIR_OUTPUT/verify $PROGRAMS || exit 1
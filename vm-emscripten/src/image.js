@@ -0,0 +1,117 @@
+/**
+ * Linked into vm.js with --post-js: views of the process image and of the
+ * program buffer, so a scan doesn't go through an embind call per element.
+ *
+ * Typed arrays over the wasm memory are detached when the memory grows, the
+ * views are created again whenever that has happened, so keep the object
+ * returned by getProcessImage() and read its fields on every scan rather
+ * than keeping the arrays themselves.
+ *
+ * getProcessImage(handle) gives the image of a program loaded with
+ * LoadProgram, valid until it is unloaded, and getProcessImage() the one
+ * of RunProgram.  Inputs written to it are latched when the next scan
+ * starts, outputs appear when a scan ends and `scans` counts those.
+ */
+
+/**
+ * The layout of struct svm_process_image these views were written for,
+ * see src/vm/mem.h.
+ */
+var PROCESS_IMAGE_VERSION = 4;
+
+Module['getProcessImage'] = function (handle) {
+  var layout = Module['GetProcessImageLayout'](handle === undefined ? -1 : handle);
+  if (!layout)
+    throw new Error('invalid program handle ' + handle);
+  if (layout.version !== PROCESS_IMAGE_VERSION)
+    throw new Error('process image version ' + layout.version + ', expected ' + PROCESS_IMAGE_VERSION);
+
+  var buffer = null;
+  var views = {};
+
+  function view(Type, name) {
+    if (buffer !== HEAPU8.buffer) {
+      buffer = HEAPU8.buffer;
+      views = {};
+    }
+
+    var key = name + Type.name;
+    if (!views[key])
+      views[key] = new Type(buffer, layout.address + layout[name].offset, layout[name].length);
+    return views[key];
+  }
+
+  var stride = layout.variableStride;
+  var typeAt = layout.variableType;
+
+  return {
+    version: layout.version,
+
+    get scans() { return view(Uint32Array, 'scans')[0]; },
+
+    get analogIn() { return view(Float32Array, 'analogIn'); },
+    get analogOut() { return view(Float32Array, 'analogOut'); },
+    get binaryIn() { return view(Uint8Array, 'binaryIn'); },
+    get binaryOut() { return view(Uint8Array, 'binaryOut'); },
+
+    /**
+     * The raw variables, `variableStride` words each: the content, as an
+     * integer or a float, then the tag at `variableType` - 0 integer,
+     * 1 float, 2 string.
+     */
+    get variableWords() { return view(Int32Array, 'variables'); },
+    get variableNumbers() { return view(Float32Array, 'variables'); },
+    variableStride: stride,
+    variableType: typeAt,
+
+    /**
+     * The numeric variables as numbers, like getVariables().
+     */
+    getVariables: function () {
+      var words = this.variableWords;
+      var numbers = this.variableNumbers;
+      var values = [];
+
+      for (var i = 0; i < words.length; i += stride) {
+        if (words[i + typeAt] === 0)
+          values.push(words[i]);
+        else if (words[i + typeAt] === 1)
+          values.push(numbers[i]);
+      }
+      return values;
+    },
+
+    /**
+     * Store numbers in the variables, integers as integers and anything
+     * else as floats, like setVariables().
+     */
+    setVariables: function (values) {
+      var words = this.variableWords;
+      var numbers = this.variableNumbers;
+
+      for (var i = 0; i < values.length && i * stride < words.length; i++) {
+        var at = i * stride;
+        if (typeof values[i] !== 'number')
+          continue;
+
+        if (values[i] === (values[i] | 0)) {
+          words[at] = values[i];
+          words[at + typeAt] = 0;
+        } else {
+          numbers[at] = values[i];
+          words[at + typeAt] = 1;
+        }
+      }
+    }
+  };
+};
+
+/**
+ * A view of a buffer in the wasm heap with room for a program of `size`
+ * bytes.  Write the program into it, then call RunProgramBuffer(size) or
+ * LoadProgramBuffer(size) - before anything else can grow the memory.
+ */
+Module['programBuffer'] = function (size) {
+  var address = Module['ProgramBuffer'](size);
+  return new Uint8Array(HEAPU8.buffer, address, size);
+};
@@ -1,13 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string>
 #include <emscripten/emscripten.h>
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
 #include <emscripten.h>
 
 #include "vm/vm.h"
+#include "vm/vm-trace.h"
+#include "vm/vm-wasm.h"
 #include "vm/jsprintf.h"
 
+/**
+ * Trace level of RunProgram, debug builds pass
+ * -DSVM_TRACE_LEVEL=SVM_TRACE_INSTRUCTIONS.
+ */
+#ifndef SVM_TRACE_LEVEL
+#define SVM_TRACE_LEVEL SVM_TRACE_NONE
+#endif
+
+svm_tracer_t tracer{SVM_TRACE_LEVEL, svm_trace_jsprintf, nullptr};
+
 /**
  * Repetitive definitions
  */
@@ -35,38 +49,44 @@
     jsprintf("\n\n");                                      \
   }
 
+/**
+ * The process image of RunProgram, and of the getters and setters below.
+ * Programs loaded with LoadProgram have their own.
+ */
+svm_process_image process_image{SVM_PROCESS_IMAGE_VERSION};
+
 /**
  * Getters, setters and debug printing
  */
-DEFINE_GETTER(getAnalogInputs, ANALOG_IN_COUNT, ANALOG_IN)
-DEFINE_GETTER(getAnalogOuputs, ANALOG_OUT_COUNT, ANALOG_OUT)
-DEFINE_GETTER(getBinaryInputs, BINARY_IN_COUNT, BINARY_IN)
-DEFINE_GETTER(getBinaryOuputs, BINARY_OUT_COUNT, BINARY_OUT)
+DEFINE_GETTER(getAnalogInputs, ANALOG_IN_COUNT, process_image.in.analog)
+DEFINE_GETTER(getAnalogOuputs, ANALOG_OUT_COUNT, process_image.out.analog)
+DEFINE_GETTER(getBinaryInputs, BINARY_IN_COUNT, process_image.in.binary)
+DEFINE_GETTER(getBinaryOuputs, BINARY_OUT_COUNT, process_image.out.binary)
 
-DEFINE_SETTER(setAnalogInputs, float, ANALOG_IN)
-DEFINE_SETTER(setAnalogOuputs, float, ANALOG_OUT)
-DEFINE_SETTER(setBinaryInputs, uint8_t, BINARY_IN)
-DEFINE_SETTER(setBinaryOuputs, uint8_t, BINARY_OUT)
+DEFINE_SETTER(setAnalogInputs, float, process_image.in.analog)
+DEFINE_SETTER(setAnalogOuputs, float, process_image.out.analog)
+DEFINE_SETTER(setBinaryInputs, uint8_t, process_image.in.binary)
+DEFINE_SETTER(setBinaryOuputs, uint8_t, process_image.out.binary)
 
-DEFINE_DEBUG_PRINT(printAnalogInputs, ANALOG_IN_COUNT, ANALOG_IN, "%f, ")
-DEFINE_DEBUG_PRINT(printAnalogOuputs, ANALOG_OUT_COUNT, ANALOG_OUT, "%f, ")
-DEFINE_DEBUG_PRINT(printBinaryInputs, BINARY_IN_COUNT, BINARY_IN, "%x, ")
-DEFINE_DEBUG_PRINT(printBinaryOuputs, BINARY_OUT_COUNT, BINARY_OUT, "%x, ")
+DEFINE_DEBUG_PRINT(printAnalogInputs, ANALOG_IN_COUNT, process_image.in.analog, "%f, ")
+DEFINE_DEBUG_PRINT(printAnalogOuputs, ANALOG_OUT_COUNT, process_image.out.analog, "%f, ")
+DEFINE_DEBUG_PRINT(printBinaryInputs, BINARY_IN_COUNT, process_image.in.binary, "%x, ")
+DEFINE_DEBUG_PRINT(printBinaryOuputs, BINARY_OUT_COUNT, process_image.out.binary, "%x, ")
 
 emscripten::val getVariables()
 {
   emscripten::val new_array = emscripten::val::array();
   for (int i{0}; i < VARIABLE_COUNT; i++)
   {
-    switch (VARIABLE_IO[i].type)
+    switch (SVM_TYPE(process_image.variables[i]))
     {
-    case reg_t::FLOAT:
-      new_array.call<void>("push", VARIABLE_IO[i].content.number);
+    case FLOAT:
+      new_array.call<void>("push", process_image.variables[i].content.number);
       break;
-    case reg_t::INTEGER:
-      new_array.call<void>("push", VARIABLE_IO[i].content.integer);
+    case INTEGER:
+      new_array.call<void>("push", process_image.variables[i].content.integer);
       break;
-    case reg_t::STRING:
+    case STRING:
       break;
     }
   }
@@ -86,13 +106,13 @@ void setVariables(const emscripten::val &input)
         const double f = v.as<double>();
         if (f == (int)f)
         {
-          VARIABLE_IO[i].type = reg_t::INTEGER;
-          VARIABLE_IO[i].content.integer = (int)f;
+          process_image.variables[i].tag = INTEGER;
+          process_image.variables[i].content.integer = (int)f;
         }
         else
         {
-          VARIABLE_IO[i].type = reg_t::FLOAT;
-          VARIABLE_IO[i].content.number = (float)f;
+          process_image.variables[i].tag = FLOAT;
+          process_image.variables[i].content.number = (float)f;
         }
       }
     }
@@ -104,15 +124,15 @@ void printVariables()
   emscripten_log(EM_LOG_CONSOLE, "printVariables:");
   for (int i{0}; i < VARIABLE_COUNT; i++)
   {
-    switch (VARIABLE_IO[i].type)
+    switch (SVM_TYPE(process_image.variables[i]))
     {
-    case reg_t::FLOAT:
-      jsprintf("%f, ", VARIABLE_IO[i].content.number);
+    case FLOAT:
+      jsprintf("%f, ", process_image.variables[i].content.number);
       break;
-    case reg_t::INTEGER:
-      jsprintf("%d, ", VARIABLE_IO[i].content.integer);
+    case INTEGER:
+      jsprintf("%d, ", process_image.variables[i].content.integer);
       break;
-    case reg_t::STRING:
+    case STRING:
       break;
     }
   }
@@ -120,12 +140,13 @@ void printVariables()
 }
 
 /**
- * Handling errors from VM
+ * Handling errors from VM: the failing instruction is abandoned and the
+ * machine stopped, RunProgram and RunScans return 1 and GetProgramError
+ * says what went wrong - the page keeps running.
  */
 void error(char *msg)
 {
   emscripten_log(EM_LOG_ERROR, "ERROR running script - %s\n", msg);
-  emscripten_force_exit(1);
 }
 
 EM_JS(void, call_js_agrs, (const char *msg), {
@@ -141,6 +162,25 @@ void print(char *msg)
   // emscripten_log(EM_LOG_ERROR, "INFO - %s\n", msg);
 }
 
+/**
+ * The programs' own output, a whole scan of it at a time: both parts are
+ * decoded straight from the wasm heap, in one call into JS.
+ */
+EM_JS(void, call_js_output, (const char *text, uint32_t length, const char *more, uint32_t more_length), {
+  createStdoutQ8YQPV9U(UTF8ToString(text, length) + (more_length ? UTF8ToString(more, more_length) : ""));
+});
+
+void output(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+  call_js_output(text, length, more, more_length);
+}
+
+/**
+ * Output buffer of the machines RunProgram creates, see SetOutputBuffer.
+ */
+uint32_t output_capacity{SVM_OUTPUT_CAPACITY};
+int output_policy{SVM_OUTPUT_FLUSH};
+
 /**
  * Show the content of the various registers.
  */
@@ -152,17 +192,17 @@ void svm_dump_registers(svm_t *cpup)
 
   for (i = 0; i < REGISTER_COUNT; i++)
   {
-    if (cpup->registers[i].type == reg_t::STRING)
+    if (SVM_IS_STRING(cpup->registers[i]))
     {
-      jsprintf("\tRegister %02d - str: %s\n", i, cpup->registers[i].content.string);
+      jsprintf("\tRegister %02d - str: %s\n", i, SVM_STRING(cpup->registers[i]));
     }
-    else if (cpup->registers[i].type == reg_t::INTEGER)
+    else if (cpup->registers[i].tag == INTEGER)
     {
       jsprintf("\tRegister %02d - Decimal:%04d [Hex:%04X]\n", i,
                cpup->registers[i].content.integer,
                cpup->registers[i].content.integer);
     }
-    else if (cpup->registers[i].type == reg_t::FLOAT)
+    else if (cpup->registers[i].tag == FLOAT)
     {
       jsprintf("\tRegister %02d - Number:%04f [Hex:%04X]\n", i,
                cpup->registers[i].content.number,
@@ -185,30 +225,68 @@ void svm_dump_registers(svm_t *cpup)
 }
 
 /**
- * Main function to run one execution cycle.
+ * Change the trace level of the following RunProgram calls, 0 disables
+ * tracing.
  */
-int RunProgram(emscripten::val const &vmachine_code)
+void SetTraceLevel(int level)
 {
-  std::vector<uint8_t> code;
+  tracer.level = level;
+}
 
-  jsprintf_handler = print;
+/**
+ * Enable or disable running programs through generated WebAssembly in
+ * builds with SVM_USE_WASM, see vm/vm-wasm.c.
+ */
+void SetWasmCodegen(bool enabled)
+{
+  svm_wasm_enable(enabled);
+}
 
-  // Skopiowanie kodu z wejścia
-  code = emscripten::convertJSArrayToNumberVector<uint8_t>(vmachine_code);
+/**
+ * The error of the last RunProgram, its machine is gone by the time the
+ * JS side asks.
+ */
+svm_error last_error{};
 
-  setenv("DEBUG", "DEBUG", 1); // Disable on release
+/**
+ * Events recorded by RunProgram, see SetEventTrace, and those of its last
+ * call as trace-event JSON.
+ */
+uint32_t events_capacity{0};
+std::string last_events;
 
-  const char *str = getenv("DEBUG");
-  if (str)
-    emscripten_log(EM_LOG_CONSOLE, str);
+/**
+ * Trace-event JSON of the events recorded by a machine.
+ */
+std::string exportEvents(svm_t *cpu, int tid)
+{
+  std::string json(svm_events_export(cpu, tid, nullptr, 0), '\0');
+  svm_events_export(cpu, tid, json.data(), json.size() + 1);
+  return json;
+}
 
-  svm_t *cpu = svm_new(code.data(), code.size(), &error);
+/**
+ * Run one execution cycle of a program.
+ */
+int runProgram(uint8_t *code, uint32_t size)
+{
+  jsprintf_handler = print;
+
+  svm_t *cpu = svm_new(code, size, &error);
   if (!cpu)
   {
     emscripten_log(EM_LOG_ERROR, "Failed to create virtual machine instance.\n");
     return 1;
   }
 
+  svm_set_image(cpu, &process_image);
+  svm_set_output(cpu, output_capacity, output_policy, output);
+
+  if (tracer.level > SVM_TRACE_NONE)
+    svm_set_tracer(cpu, &tracer);
+  if (events_capacity)
+    svm_events_enable(cpu, events_capacity);
+
   /**
    * Run the bytecode.
    */
@@ -217,9 +295,13 @@ int RunProgram(emscripten::val const &vmachine_code)
   /**
    * Dump?
    */
-  if (getenv("DEBUG") != NULL)
+  if (tracer.level >= SVM_TRACE_SUMMARY)
     svm_dump_registers(cpu);
 
+  last_error = cpu->error;
+  int failed = cpu->faulted;
+  last_events = cpu->events ? exportEvents(cpu, 0) : "";
+
   /**
    * Cleanup.
    */
@@ -227,9 +309,455 @@ int RunProgram(emscripten::val const &vmachine_code)
 
   jsprintf("RunProgram ends\n\n");
 
+  return failed;
+}
+
+/**
+ * Main function to run one execution cycle.
+ */
+int RunProgram(emscripten::val const &vmachine_code)
+{
+  // Skopiowanie kodu z wejścia
+  std::vector<uint8_t> code = emscripten::convertJSArrayToNumberVector<uint8_t>(vmachine_code);
+
+  return runProgram(code.data(), code.size());
+}
+
+/**
+ * Buffer in the wasm heap the JS side writes programs into, see
+ * programBuffer() in image.js.
+ */
+std::vector<uint8_t> program_buffer;
+
+/**
+ * Make room for a program of the given size, returns its address.
+ */
+uintptr_t ProgramBuffer(uint32_t size)
+{
+  program_buffer.resize(size);
+  return (uintptr_t)program_buffer.data();
+}
+
+/**
+ * Run one execution cycle of the program written to the program buffer.
+ */
+int RunProgramBuffer(uint32_t size)
+{
+  if (size > program_buffer.size())
+    return 1;
+
+  return runProgram(program_buffer.data(), size);
+}
+
+/**
+ * Programs loaded with LoadProgram, indexed by their handle.  Unloaded
+ * slots are reused.
+ */
+struct LoadedProgram
+{
+  svm_t *cpu;
+
+  /**
+   * SVM_RESET_* flags, what is reset before each scan.
+   */
+  int reset;
+
+  /**
+   * Limits of each scan of RunScans, none when both are zero.
+   */
+  svm_watchdog watchdog;
+
+  /**
+   * In the middle of a scan StepProgram started.
+   */
+  bool stepping;
+};
+
+std::vector<LoadedProgram> programs;
+
+LoadedProgram *findProgram(int handle)
+{
+  if (handle < 0 || handle >= (int)programs.size() || !programs[handle].cpu)
+  {
+    emscripten_log(EM_LOG_ERROR, "Invalid program handle %d.\n", handle);
+    return nullptr;
+  }
+  return &programs[handle];
+}
+
+/**
+ * Load a program into a virtual machine which is kept until UnloadProgram,
+ * so the scans run by RunScans don't pay for creating it.
+ *
+ * Returns the handle of the program, or -1.
+ */
+int loadProgram(uint8_t *code, uint32_t size)
+{
+  svm_t *cpu = svm_new(code, size, &error);
+  if (!cpu)
+  {
+    emscripten_log(EM_LOG_ERROR, "Failed to create virtual machine instance.\n");
+    return -1;
+  }
+
+  svm_set_output(cpu, output_capacity, output_policy, output);
+
+  size_t handle{0};
+  while (handle < programs.size() && programs[handle].cpu)
+    handle++;
+  if (handle == programs.size())
+    programs.push_back({});
+
+  programs[handle] = {cpu, SVM_RESET_ALL, {0, 0}, false};
+  return handle;
+}
+
+/**
+ * LoadProgram for a program in a JS array.
+ */
+int LoadProgram(emscripten::val const &vmachine_code)
+{
+  std::vector<uint8_t> code = emscripten::convertJSArrayToNumberVector<uint8_t>(vmachine_code);
+
+  return loadProgram(code.data(), code.size());
+}
+
+/**
+ * LoadProgram for the program written to the program buffer.
+ */
+int LoadProgramBuffer(uint32_t size)
+{
+  if (size > program_buffer.size())
+    return -1;
+
+  return loadProgram(program_buffer.data(), size);
+}
+
+/**
+ * Choose what is kept from one scan to the next - everything is reset by
+ * default, like RunProgram does.
+ */
+void SetProgramRetention(int handle, bool keepRegisters, bool keepStacks, bool keepMemory)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return;
+
+  program->reset = (keepRegisters ? 0 : SVM_RESET_REGISTERS) |
+                   (keepStacks ? 0 : SVM_RESET_STACKS) |
+                   (keepMemory ? 0 : SVM_RESET_MEMORY);
+}
+
+/**
+ * Abort scans of a loaded program which run more instructions, or take
+ * longer, than this - zero for no limit.  A program stuck in a loop then
+ * no longer blocks the page.
+ */
+void SetWatchdog(int handle, uint32_t maxInstructions, double maxMilliseconds)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return;
+
+  program->watchdog.max_instructions = maxInstructions;
+  program->watchdog.max_ns = maxMilliseconds > 0 ? (uint64_t)(maxMilliseconds * 1e6) : 0;
+}
+
+/**
+ * Size of the buffer a loaded program prints into, which is passed on once
+ * a scan, and whether prints which don't fit are dropped rather than
+ * passed on early.  Handle -1 sets those of RunProgram and of programs
+ * loaded from then on.
+ */
+void SetOutputBuffer(int handle, uint32_t capacity, bool dropWhenFull)
+{
+  int policy = dropWhenFull ? SVM_OUTPUT_DROP : SVM_OUTPUT_FLUSH;
+
+  if (handle < 0)
+  {
+    output_capacity = capacity ? capacity : SVM_OUTPUT_CAPACITY;
+    output_policy = policy;
+    return;
+  }
+
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return;
+
+  svm_set_output(program->cpu, capacity, policy, output);
+}
+
+/**
+ * Run a number of scan cycles of a loaded program.
+ *
+ * Returns 0, 1 on failure - see GetProgramError - or 2 when the watchdog
+ * aborted a scan.  The outputs are those of the last scan which finished.
+ */
+int RunScans(int handle, int scans)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return 1;
+
+  bool watched = program->watchdog.max_instructions || program->watchdog.max_ns;
+  program->stepping = false;
+
+  jsprintf_handler = print;
+
+  svm_tracer_t *wanted = tracer.level > SVM_TRACE_NONE ? &tracer : nullptr;
+  if (program->cpu->tracer != wanted)
+    svm_set_tracer(program->cpu, wanted);
+
+  for (int i{0}; i < scans; i++)
+  {
+    if (svm_reset(program->cpu, program->reset) != 0)
+    {
+      emscripten_log(EM_LOG_ERROR, "Failed to reset virtual machine instance.\n");
+      return 1;
+    }
+
+    if (!watched)
+    {
+      svm_run(program->cpu);
+      if (program->cpu->faulted)
+        return 1;
+      continue;
+    }
+
+    int status = svm_run_watched(program->cpu, &program->watchdog);
+    if (status == SVM_STATUS_ABORTED)
+    {
+      emscripten_log(EM_LOG_ERROR, "Scan aborted by the watchdog after %u instructions.\n", program->cpu->iterations);
+      return 2;
+    }
+    if (status != SVM_STATUS_EXITED)
+      return 1;
+  }
+
+  if (tracer.level >= SVM_TRACE_SUMMARY)
+    svm_dump_registers(program->cpu);
+
   return 0;
 }
 
+/**
+ * Put a loaded program back the way LoadProgram left it.
+ */
+int ResetProgram(int handle)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return 1;
+
+  program->stepping = false;
+  return svm_reset(program->cpu, SVM_RESET_ALL) != 0;
+}
+
+/**
+ * Run at most `budget` instructions of a loaded program, so a host can
+ * spread a scan over several frames.  A scan starts - reset, inputs
+ * latched - on the first call after the previous one ended, and publishes
+ * its outputs when the program exits.
+ *
+ * Returns an SVM_STATUS_* value: 0 exited, 1 budget used up, 2 yielded,
+ * 3 failed - or -1 for an invalid handle.
+ */
+int StepProgram(int handle, uint32_t budget)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return -1;
+
+  jsprintf_handler = print;
+
+  if (!program->stepping)
+  {
+    if (svm_reset(program->cpu, program->reset) != 0)
+      return SVM_STATUS_ERROR;
+    program->cpu->iterations = 0;
+    svm_latch_inputs(program->cpu);
+    program->stepping = true;
+  }
+
+  int status = svm_step(program->cpu, budget);
+
+  if (status == SVM_STATUS_EXITED)
+    svm_publish_outputs(program->cpu);
+  if (status == SVM_STATUS_EXITED || status == SVM_STATUS_ERROR)
+    program->stepping = false;
+
+  return status;
+}
+
+/**
+ * Free a loaded program, its handle may be returned by a later LoadProgram.
+ */
+void UnloadProgram(int handle)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return;
+
+  svm_free(program->cpu);
+  program->cpu = nullptr;
+}
+
+/**
+ * Record scans, calls, latching and publishing and faults of a loaded
+ * program into a ring of `capacity` events, or stop with zero - handle -1
+ * for those of RunProgram.  Recording can be switched at any time.
+ */
+void SetEventTrace(int handle, uint32_t capacity)
+{
+  if (handle < 0)
+  {
+    events_capacity = capacity;
+    return;
+  }
+
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return;
+
+  if (svm_events_enable(program->cpu, capacity) != 0)
+    emscripten_log(EM_LOG_ERROR, "Failed to allocate %u events.\n", capacity);
+}
+
+/**
+ * The events recorded for a loaded program, or by the last RunProgram for
+ * -1, as Chrome trace-event JSON - for Perfetto, or chrome://tracing.
+ */
+std::string GetTraceEvents(int handle)
+{
+  if (handle < 0)
+    return last_events;
+
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return "";
+
+  return exportEvents(program->cpu, handle + 1);
+}
+
+/**
+ * Count the executions of each opcode and offset of a loaded program, and
+ * the time of each opcode - or stop and drop the counts.  Scans are slower
+ * while it is on, they run in the reference loop.
+ */
+void SetProfiling(int handle, bool enabled)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program)
+    return;
+
+  if (svm_profile_enable(program->cpu, enabled) != 0)
+    emscripten_log(EM_LOG_ERROR, "Failed to allocate the profile.\n");
+}
+
+/**
+ * The profile of a loaded program, null when it is off: `counts` and
+ * `cycles` by opcode, copied into Float64Arrays, `offsets` a Uint32Array
+ * view of the executions of each offset, and `names` and `groups` of the
+ * opcodes.  Cycles are nanoseconds in the WebAssembly build.
+ */
+emscripten::val GetProfile(int handle)
+{
+  LoadedProgram *program = findProgram(handle);
+  if (!program || !program->cpu->profile)
+    return emscripten::val::null();
+
+  svm_profile *profile = program->cpu->profile;
+  double counts[OPCODE_COUNT], cycles[OPCODE_COUNT];
+  emscripten::val names = emscripten::val::array();
+  emscripten::val groups = emscripten::val::array();
+
+  for (int op{0}; op < OPCODE_COUNT; op++)
+  {
+    const char *name = svm_opcode_name(op);
+
+    counts[op] = profile->counts[op];
+    cycles[op] = profile->cycles[op];
+    names.set(op, name ? emscripten::val(name) : emscripten::val::null());
+    groups.set(op, emscripten::val(svm_opcode_group(op)));
+  }
+
+  emscripten::val Float64Array = emscripten::val::global("Float64Array");
+  emscripten::val result = emscripten::val::object();
+  result.set("counts", Float64Array.new_(emscripten::typed_memory_view(OPCODE_COUNT, counts)));
+  result.set("cycles", Float64Array.new_(emscripten::typed_memory_view(OPCODE_COUNT, cycles)));
+  result.set("offsets", emscripten::val(emscripten::typed_memory_view(0xFFFF, profile->offsets)));
+  result.set("names", names);
+  result.set("groups", groups);
+  return result;
+}
+
+/**
+ * What stopped the last scan of a loaded program, or the last RunProgram
+ * for -1: the SVM_ERROR_* code, the offset and opcode of the failing
+ * instruction and the message.  Null when it didn't fail.
+ */
+emscripten::val GetProgramError(int handle)
+{
+  svm_error *failure = &last_error;
+  if (handle >= 0)
+  {
+    LoadedProgram *program = findProgram(handle);
+    if (!program)
+      return emscripten::val::null();
+    failure = &program->cpu->error;
+  }
+
+  if (failure->code == SVM_ERROR_NONE)
+    return emscripten::val::null();
+
+  emscripten::val result = emscripten::val::object();
+  result.set("code", failure->code);
+  result.set("ip", failure->ip);
+  result.set("opcode", failure->opcode);
+  result.set("message", emscripten::val(failure->message));
+  return result;
+}
+
+/**
+ * Where the fields of a process image are, for the views of image.js:
+ * the image of a loaded program, or the one of RunProgram for -1.  Offsets
+ * are from `address` in bytes, lengths in elements.
+ */
+emscripten::val GetProcessImageLayout(int handle)
+{
+  svm_process_image *image = &process_image;
+  if (handle >= 0)
+  {
+    LoadedProgram *program = findProgram(handle);
+    if (!program)
+      return emscripten::val::null();
+    image = program->cpu->image;
+  }
+
+  emscripten::val layout = emscripten::val::object();
+
+  auto field = [](size_t offset, size_t length)
+  {
+    emscripten::val f = emscripten::val::object();
+    f.set("offset", offset);
+    f.set("length", length);
+    return f;
+  };
+
+  layout.set("version", image->version);
+  layout.set("address", (uintptr_t)image);
+  layout.set("scans", field(offsetof(svm_process_image, scans), 1));
+  layout.set("analogIn", field(offsetof(svm_process_image, in.analog), ANALOG_IN_COUNT));
+  layout.set("analogOut", field(offsetof(svm_process_image, out.analog), ANALOG_OUT_COUNT));
+  layout.set("binaryIn", field(offsetof(svm_process_image, in.binary), BINARY_IN_COUNT));
+  layout.set("binaryOut", field(offsetof(svm_process_image, out.binary), BINARY_OUT_COUNT));
+  layout.set("variables", field(offsetof(svm_process_image, variables), VARIABLE_COUNT * sizeof(reg_t) / 4));
+  layout.set("variableStride", sizeof(reg_t) / 4);
+  layout.set("variableType", offsetof(reg_t, tag) / 4);
+
+  return layout;
+}
+
 /**
  * Used for tests.
  */
@@ -265,6 +793,25 @@ EMSCRIPTEN_BINDINGS(virtual_machine)
   emscripten::function("printVariables", &printVariables);
 
   emscripten::function("RunProgram", &RunProgram);
+  emscripten::function("ProgramBuffer", &ProgramBuffer);
+  emscripten::function("RunProgramBuffer", &RunProgramBuffer);
+  emscripten::function("GetProcessImageLayout", &GetProcessImageLayout);
+  emscripten::function("LoadProgram", &LoadProgram);
+  emscripten::function("LoadProgramBuffer", &LoadProgramBuffer);
+  emscripten::function("SetProgramRetention", &SetProgramRetention);
+  emscripten::function("SetWatchdog", &SetWatchdog);
+  emscripten::function("SetOutputBuffer", &SetOutputBuffer);
+  emscripten::function("RunScans", &RunScans);
+  emscripten::function("StepProgram", &StepProgram);
+  emscripten::function("ResetProgram", &ResetProgram);
+  emscripten::function("GetProgramError", &GetProgramError);
+  emscripten::function("SetEventTrace", &SetEventTrace);
+  emscripten::function("GetTraceEvents", &GetTraceEvents);
+  emscripten::function("SetProfiling", &SetProfiling);
+  emscripten::function("GetProfile", &GetProfile);
+  emscripten::function("UnloadProgram", &UnloadProgram);
+  emscripten::function("SetTraceLevel", &SetTraceLevel);
+  emscripten::function("SetWasmCodegen", &SetWasmCodegen);
 
   emscripten::function("print_message", &print_message);
 }
\ No newline at end of file
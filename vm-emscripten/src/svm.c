@@ -0,0 +1,175 @@
+/**
+ * svm - run a bytecode program natively.
+ *
+ *  svm [-n scans] [-s seed] [-q] [-v] [-p] [-t trace.json] program.raw
+ *
+ *  Loads the program into a machine and runs it for the given number of
+ * scans, one by default, resetting the machine before each one as
+ * `RunScans` does.  What the program prints is written to standard output
+ * with one writev(2) a scan, or dropped with -q.
+ *
+ *  -v prints the instructions, scans and time taken to standard error, -p
+ * the profile of the scans (see `svm_profile_report`) and -t writes the
+ * events of the last of them as Chrome trace-event JSON.  The engine is
+ * the one the library was built with, see scripts/makeNative.sh.
+ *
+ *  Exits with 1 when a scan fails, after printing where and why.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vm/vm-engine.h"
+#include "vm/vm-trace.h"
+
+/**
+ * Events kept for -t, the most recent ones when the ring is full.
+ */
+#define TRACE_EVENTS 65536
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-n scans] [-s seed] [-q] [-v] [-p] [-t trace.json] program.raw\n", name);
+    exit(1);
+}
+
+static void discard(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    (void)cpup;
+    (void)text;
+    (void)length;
+    (void)more;
+    (void)more_length;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_trace(svm_t *cpu, const char *path)
+{
+    size_t size = svm_events_export(cpu, 1, NULL, 0) + 1;
+    char *json = malloc(size);
+    FILE *fp = fopen(path, "w");
+
+    if (!json || !fp)
+    {
+        fprintf(stderr, "Failed to write %s\n", path);
+        free(json);
+        if (fp)
+            fclose(fp);
+        return 1;
+    }
+
+    svm_events_export(cpu, 1, json, size);
+    fputs(json, fp);
+    fclose(fp);
+    free(json);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char code[0xFFFF];
+    unsigned long scans = 1;
+    const char *trace = NULL;
+    int quiet = 0, verbose = 0, profiled = 0, seeded = 0;
+    uint32_t seed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:qvpt:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            scans = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            seeded = 1;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'p':
+            profiled = 1;
+            break;
+        case 't':
+            trace = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    const char *path = argv[optind];
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+    size_t size = fread(code, 1, sizeof(code), fp);
+    fclose(fp);
+
+    svm_t *cpu = svm_new(code, size, NULL);
+    if (!cpu)
+    {
+        fprintf(stderr, "Failed to load %s\n", path);
+        return 1;
+    }
+
+    svm_set_output(cpu, 0, SVM_OUTPUT_FLUSH, quiet ? discard : svm_output_writev);
+    if (seeded)
+        svm_seed(cpu, seed);
+    if (profiled)
+        svm_profile_enable(cpu, 1);
+    if (trace)
+        svm_events_enable(cpu, TRACE_EVENTS);
+
+    double instructions = 0;
+    double start = now();
+    unsigned long scan;
+
+    for (scan = 0; scan < scans && !cpu->faulted; scan++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+        instructions += cpu->iterations;
+    }
+
+    double elapsed = now() - start;
+    int status = 0;
+
+    if (cpu->faulted)
+    {
+        const char *name = svm_opcode_name(cpu->error.opcode);
+
+        fprintf(stderr, "%s: scan %lu failed at 0x%04X (%s): %s\n", path, scan, cpu->error.ip,
+                name ? name : "unknown", cpu->error.message ? cpu->error.message : "");
+        status = 1;
+    }
+
+    if (verbose)
+    {
+        fprintf(stderr, "%.0f instructions in %lu scans, %.6f s: %.0f instructions/s, %.0f scans/s\n",
+                instructions, scan, elapsed, instructions / elapsed, scan / elapsed);
+    }
+    if (profiled)
+        svm_profile_report(cpu, stderr, 16);
+    if (trace && write_trace(cpu, trace) != 0)
+        status = 1;
+
+    svm_free(cpu);
+    return status;
+}
@@ -0,0 +1,350 @@
+/**
+ * svm2c - ahead-of-time translation of a bytecode program into C.
+ *
+ *  svm2c program.raw function > program.c
+ *
+ *  Writes a C translation unit defining `void function(svm_t *svm)`, which
+ * has the same observable behaviour as svm_run for a machine loaded with
+ * the program.  Build it with -Isrc/vm and link it with the virtual machine
+ * sources, it uses the handlers and helpers of vm-ops.c for everything it
+ * doesn't do itself.  See src/vm/vm-translate.h.
+ *
+ *  The instructions are followed in sequence from offset zero, as
+ * svm_predecode() does.  Jumps to an offset which isn't the start of one
+ * of them, and writes to the code, hand the run to the inlined engine.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm/vm-decode.h"
+#include "vm/vm-trace.h"
+
+static FILE *out;
+static svm_t *svm;
+
+/**
+ * Which offsets start an instruction of the sequence.
+ */
+static uint8_t starts[0xFFFF];
+
+static void error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+/**
+ * Continue at the given offset.
+ */
+static void jump(const char *indent, uint32_t to)
+{
+    if (to < svm->size && starts[to])
+        fprintf(out, "%sgoto L_%04x;\n", indent, to);
+    else
+        fprintf(out, "%s{\n%s    ip = 0x%04x;\n%s    goto dispatch;\n%s}\n", indent, indent, to, indent, indent);
+}
+
+static void handler(uint32_t at, uint32_t next)
+{
+    fprintf(out, "        SVM_HANDLER(0x%04x, 0x%04x);\n", at, next);
+}
+
+/**
+ * Arithmetic, on two integers or - for `+`, `-` and `*` - any two numbers.
+ */
+static void math(uint32_t at, struct svm_insn *insn, const char *operator, int numbers)
+{
+    int r0 = insn->reg[0], r1 = insn->reg[1], r2 = insn->reg[2];
+
+    fprintf(out, "    if (R(%d).tag == INTEGER && R(%d).tag == INTEGER)\n", r1, r2);
+    fprintf(out, "        SVM_SET_INT(%d, (unsigned)R(%d).content.integer %s (unsigned)R(%d).content.integer);\n",
+            r0, r1, operator, r2);
+    if (numbers)
+    {
+        fprintf(out, "    else if (!SVM_IS_STRING(R(%d)) && !SVM_IS_STRING(R(%d)))\n", r1, r2);
+        fprintf(out, "        SVM_SET_FLOAT(%d, SVM_NUMBER(R(%d)) %s SVM_NUMBER(R(%d)));\n", r0, r1, operator, r2);
+    }
+    fprintf(out, "    else\n");
+    handler(at, insn->next);
+}
+
+/**
+ * Translate the instruction at `at`.
+ */
+static void translate(uint32_t at, struct svm_insn *insn)
+{
+    uint8_t opcode = svm->code[at];
+    uint32_t next = insn->next;
+    int r0 = insn->reg[0], r1 = insn->reg[1];
+
+    fprintf(out, "L_%04x: /* %s */\n", at, svm_opcode_name(opcode) ? svm_opcode_name(opcode) : "unknown");
+    fprintf(out, "    iterations++;\n");
+
+    if (insn->opcode == INSN_DELEGATE)
+    {
+        fprintf(out, "    {\n");
+        handler(at, next);
+        fprintf(out, "    }\n");
+        goto fall_through;
+    }
+
+    switch (opcode)
+    {
+    case EXIT:
+        fprintf(out, "    ip = 0x%04x;\n", at + 1);
+        fprintf(out, "    goto done;\n");
+        return;
+
+    case INT_STORE:
+        fprintf(out, "    R(%d).content.integer = %d;\n", r0, insn->imm.integer);
+        fprintf(out, "    R(%d).tag = INTEGER;\n", r0);
+        break;
+
+    case FLOAT_STORE:
+        fprintf(out, "    R(%d).content.integer = 0x%08x; /* %g */\n", r0, (unsigned)insn->imm.integer, insn->imm.number);
+        fprintf(out, "    R(%d).tag = FLOAT;\n", r0);
+        break;
+
+    case BINARY_LOAD:
+        fprintf(out, "    R(%d).tag = INTEGER;\n", r0);
+        fprintf(out, "    R(%d).content.integer = svm->io.in.binary[%d];\n", r0, r1);
+        break;
+
+    case BINARY_SAVE:
+        fprintf(out, "    if (R(%d).tag == INTEGER)\n", r0);
+        fprintf(out, "        svm->io.out.binary[%d] = R(%d).content.integer;\n", r1, r0);
+        break;
+
+    case ANALOG_LOAD:
+        fprintf(out, "    R(%d).tag = FLOAT;\n", r0);
+        fprintf(out, "    R(%d).content.number = svm->io.in.analog[%d];\n", r0, r1);
+        break;
+
+    case ANALOG_SAVE:
+        fprintf(out, "    if (R(%d).tag == FLOAT)\n", r0);
+        fprintf(out, "        svm->io.out.analog[%d] = R(%d).content.number;\n", r1, r0);
+        fprintf(out, "    if (R(%d).tag == INTEGER)\n", r0);
+        fprintf(out, "        svm->io.out.analog[%d] = R(%d).content.integer;\n", r1, r0);
+        break;
+
+    case VARIABLE_LOAD:
+        fprintf(out, "    R(%d) = svm->io.variables[%d];\n", r0, r1);
+        break;
+
+    case VARIABLE_SAVE:
+        fprintf(out, "    svm->io.variables[%d] = R(%d);\n", r1, r0);
+        break;
+
+    case JUMP_TO:
+        jump("    ", insn->target);
+        return;
+
+    case JUMP_Z:
+    case JUMP_NZ:
+        fprintf(out, "    if (%ssvm->jmp)\n", opcode == JUMP_Z ? "" : "!");
+        jump("        ", insn->target);
+        break;
+
+    case ADD:
+        math(at, insn, "+", 1);
+        break;
+    case SUB:
+        math(at, insn, "-", 1);
+        break;
+    case MUL:
+        math(at, insn, "*", 1);
+        break;
+    case AND:
+        math(at, insn, "&", 0);
+        break;
+    case OR:
+        math(at, insn, "|", 0);
+        break;
+    case XOR:
+        math(at, insn, "^", 0);
+        break;
+
+    case DIV:
+        fprintf(out, "    if (R(%d).tag == INTEGER && R(%d).tag == INTEGER && R(%d).content.integer != 0)\n",
+                r1, insn->reg[2], insn->reg[2]);
+        fprintf(out, "        SVM_SET_INT(%d, R(%d).content.integer / R(%d).content.integer);\n", r0, r1, insn->reg[2]);
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case INC:
+    case DEC:
+        fprintf(out, "    if (R(%d).tag == INTEGER)\n", r0);
+        fprintf(out, "        SVM_SET_INT(%d, (unsigned)R(%d).content.integer %s 1);\n", r0, r0, opcode == INC ? "+" : "-");
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case CMP_REG:
+        fprintf(out, "    if (!SVM_IS_STRING(R(%d)))\n", r0);
+        fprintf(out, "        svm->jmp = R(%d).tag == R(%d).tag && R(%d).content.integer == R(%d).content.integer;\n",
+                r0, r1, r0, r1);
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case CMP_IMMEDIATE:
+        fprintf(out, "    if (R(%d).tag == INTEGER)\n", r0);
+        fprintf(out, "        svm->jmp = R(%d).content.integer == %d;\n", r0, insn->imm.integer);
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case IS_STRING:
+    case IS_INTEGER:
+        fprintf(out, "    svm->jmp = SVM_TYPE(R(%d)) == %s;\n", r0, opcode == IS_STRING ? "STRING" : "INTEGER");
+        break;
+
+    case NOP:
+        break;
+
+    case STORE_REG:
+        fprintf(out, "    R(%d) = R(%d);\n", r0, r1);
+        break;
+
+    case PEEK:
+        fprintf(out, "    if (R(%d).tag == INTEGER && R(%d).content.integer >= 0 && R(%d).content.integer < 0xFFFF)\n",
+                r1, r1, r1);
+        fprintf(out, "    {\n");
+        fprintf(out, "        int v_ = svm->code[R(%d).content.integer];\n", r1);
+        fprintf(out, "        R(%d).content.integer = v_;\n", r0);
+        fprintf(out, "        R(%d).tag = INTEGER;\n", r0);
+        fprintf(out, "    }\n");
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case STACK_PUSH:
+        fprintf(out, "    if (svm->SP + 1 < STACK_COUNT)\n");
+        fprintf(out, "    {\n");
+        fprintf(out, "        svm->SP += 1;\n");
+        fprintf(out, "        svm->stack[svm->SP] = R(%d);\n", r0);
+        fprintf(out, "    }\n");
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case STACK_POP:
+        fprintf(out, "    if (svm->SP > 0)\n");
+        fprintf(out, "    {\n");
+        fprintf(out, "        struct reg_t v_ = svm->stack[svm->SP];\n");
+        fprintf(out, "        svm->SP -= 1;\n");
+        fprintf(out, "        R(%d) = v_;\n", r0);
+        fprintf(out, "    }\n");
+        fprintf(out, "    else\n");
+        handler(at, next);
+        break;
+
+    case STACK_RET:
+        fprintf(out, "    if (svm->CSP > 0)\n");
+        fprintf(out, "    {\n");
+        fprintf(out, "        ip = svm->call_stack[svm->CSP];\n");
+        fprintf(out, "        svm->CSP -= 1;\n");
+        fprintf(out, "        goto dispatch;\n");
+        fprintf(out, "    }\n");
+        handler(at, next);
+        break;
+
+    case STACK_CALL:
+        fprintf(out, "    if (svm->CSP + 1 < CALL_STACK_COUNT)\n");
+        fprintf(out, "    {\n");
+        fprintf(out, "        svm->CSP += 1;\n");
+        fprintf(out, "        svm->call_stack[svm->CSP] = 0x%04x;\n", at + 3);
+        jump("        ", insn->target);
+        fprintf(out, "    }\n");
+        handler(at, next);
+        break;
+
+    default:
+        fprintf(out, "    {\n");
+        handler(at, next);
+        fprintf(out, "    }\n");
+        break;
+    }
+
+fall_through:
+    /**
+     * The instruction after this one is translated next, unless this was
+     * the last.
+     */
+    if (next >= svm->size)
+        jump("    ", next);
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char code[0xFFFF];
+    struct svm_insn insn;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s program.raw function\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+    uint32_t size = fread(code, 1, sizeof(code), fp);
+    fclose(fp);
+
+    svm = svm_new(code, size, error);
+    if (!svm)
+    {
+        fprintf(stderr, "Failed to load %s\n", argv[1]);
+        return 1;
+    }
+
+    for (uint32_t ip = 0; ip < size;)
+    {
+        svm_decode_insn(svm, ip, &insn);
+        starts[ip] = 1;
+        ip = insn.next;
+    }
+
+    out = stdout;
+
+    fprintf(out, "/**\n * Translated from %s by svm2c, do not edit.\n */\n", argv[1]);
+    fprintf(out, "#include \"vm-translate.h\"\n\n");
+
+    fprintf(out, "static const unsigned char program[%u] = {", size);
+    for (uint32_t i = 0; i < size; i++)
+        fprintf(out, "%s0x%02x,", i % 12 ? " " : "\n    ", code[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "void %s(svm_t *svm)\n{\n", argv[2]);
+    fprintf(out, "    SVM_BEGIN(program, %u);\n\n", size);
+
+    for (uint32_t ip = 0; ip < size;)
+    {
+        svm_decode_insn(svm, ip, &insn);
+        translate(ip, &insn);
+        fprintf(out, "\n");
+        ip = insn.next;
+    }
+
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    if (ip >= %u)\n        goto done;\n", size);
+    fprintf(out, "    switch (ip)\n    {\n");
+    for (uint32_t ip = 0; ip < size; ip++)
+    {
+        if (starts[ip])
+            fprintf(out, "    case 0x%04x:\n        goto L_%04x;\n", ip, ip);
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "    goto bail;\n\n");
+
+    fprintf(out, "    SVM_END();\n}\n");
+
+    svm_free(svm);
+    return 0;
+}
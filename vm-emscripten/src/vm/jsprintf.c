@@ -2,22 +2,19 @@
 #include "jsprintf.h"
 
 
-static char buffer[1024];
-static char *next = buffer;
+/* One per thread, machines may print from several at once */
+static _Thread_local char buffer[1024];
 
 void (*jsprintf_handler) (char *msg) = NULL;
 
 int jsprintf(const char *fmt, ...) {
    va_list argp;
    va_start(argp, fmt);
-   const int ret = vsnprintf(next, sizeof buffer-(next-buffer), fmt, argp);
-   next += ret;
+   const int ret = vsnprintf(buffer, sizeof buffer, fmt, argp);
    va_end(argp);
 
    if (jsprintf_handler)
       jsprintf_handler(buffer);
 
-   next = buffer;
-
    return ret;
 }
\ No newline at end of file
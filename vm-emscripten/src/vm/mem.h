@@ -19,21 +19,53 @@ extern "C" {
 
 
 /**
- * A single register.
+ * The types of value a register can hold.
+ */
+enum { INTEGER, FLOAT, STRING };
+
+/**
+ * A single register, stack entry or variable: eight bytes on every host.
  *
- * Our registers contain a simple union which allows them to store either
- * a string or an integer.
+ * `content` holds the integer, the number or the lower half of the string
+ * pointer.  `tag` holds the type in its lower 16 bits and, for strings,
+ * bits 32 to 47 of the pointer in its upper 16 - pointers of the hosts we
+ * run on (wasm32, x86-64 and AArch64 user space) fit in 48 bits.  So the
+ * tag of an integer or a number is exactly INTEGER or FLOAT, and checking
+ * for a string is a mask and a compare.  All zeroes is the integer 0.
  *
+ * Copying a value is a single 8-byte move, and the 128 entries of the stack
+ * take half the space the union and enum of old did on 64-bit hosts.
  */
 struct reg_t {
     union {
         int integer;
         float number;
-        char *string;
+        uint32_t address;
     } content;
-    enum { INTEGER, FLOAT, STRING } type;
+    uint32_t tag;
 };
 
+#define SVM_TYPE_MASK 0xFFFFu
+
+/**
+ * The type of a register - INTEGER, FLOAT or STRING - and its string.
+ */
+#define SVM_TYPE(r) ((r).tag & SVM_TYPE_MASK)
+#define SVM_IS_STRING(r) (SVM_TYPE(r) == STRING)
+#define SVM_STRING(r) \
+    ((char *)(uintptr_t)(((uint64_t)((r).tag >> 16) << 32) | (r).content.address))
+
+/**
+ * Make a register hold a string, which it owns.
+ */
+static inline void svm_set_string(struct reg_t *r, char *string)
+{
+    uint64_t address = (uintptr_t)string;
+
+    r->content.address = (uint32_t)address;
+    r->tag = STRING | (uint32_t)(address >> 32) << 16;
+}
+
 
 /**
  * Internal memory objects
@@ -45,13 +77,62 @@ struct reg_t {
 #define VARIABLE_COUNT 8
 
 
-extern float ANALOG_IN[ANALOG_IN_COUNT];
-extern float ANALOG_OUT[ANALOG_OUT_COUNT];
+/**
+ * Layout version of the process image, changed whenever its fields are, so
+ * code outside the C sources (the JS views, see src/image.js) can tell
+ * whether it still knows the layout.
+ */
+#define SVM_PROCESS_IMAGE_VERSION 4
+
+/**
+ * Inputs and outputs of a program, each copied as a whole.
+ */
+struct svm_inputs {
+    float analog[ANALOG_IN_COUNT];
+    uint8_t binary[BINARY_IN_COUNT];
+};
+
+struct svm_outputs {
+    float analog[ANALOG_OUT_COUNT];
+    uint8_t binary[BINARY_OUT_COUNT];
+};
 
-extern uint8_t BINARY_IN[BINARY_IN_COUNT];
-extern uint8_t BINARY_OUT[BINARY_OUT_COUNT];
+/**
+ * Where the strings in the variables of a process image live, see
+ * `strings` below - defined in vm.c.
+ */
+struct svm_image_strings;
 
-extern struct reg_t VARIABLE_IO[VARIABLE_COUNT];
+/**
+ * A process image: the inputs, outputs and variables of a program, in one
+ * block of memory which the host reads and writes in place.
+ *
+ * Every virtual machine has one of its own, and works on a private copy of
+ * it during a scan: the inputs and variables are latched from the image
+ * when the scan starts and the outputs and variables published back when
+ * it ends, so the host never sees half a scan and whatever it writes in
+ * the meantime waits for the next one.  See svm_set_image() in vm.h.
+ */
+struct svm_process_image {
+    uint32_t version;
+
+    /**
+     * How many scans have published their outputs to this image.
+     */
+    uint32_t scans;
+
+    struct svm_inputs in;
+    struct svm_outputs out;
+
+    struct reg_t variables[VARIABLE_COUNT];
+
+    /**
+     * Copies of the strings in `variables`, owned by the image rather than
+     * by the machine which published them, so they outlive it.  NULL until
+     * a string is published; svm_image_release() frees them.
+     */
+    struct svm_image_strings *strings;
+};
 
 
 #ifdef __cplusplus
@@ -0,0 +1,450 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vm-decode.h"
+
+/**
+ * Maps the handler table in vm-ops.c.
+ */
+void opcode_select(svm_t *svm);
+
+/**
+ * Helper to convert a two-byte value to an integer in the range 0x0000-0xffff
+ */
+#define BYTES_TO_ADDR(one, two) (one + (256 * two))
+
+/**
+ * The operands each opcode reads after its opcode byte.
+ */
+enum operand_t
+{
+    NONE,
+    REG1,       /* register */
+    REG2,       /* register, register */
+    REG3,       /* register, register, register */
+    REG_IMM,    /* register, 16-bit value */
+    REG_FLOAT,  /* register, 16-bit exponent, 16-bit mantissa */
+    REG_PORT,   /* register, I/O index */
+    REG_STRING, /* register, 16-bit length, characters */
+    ADDR        /* 16-bit address */
+};
+
+/**
+ * How each opcode is decoded.
+ */
+struct opcode_info
+{
+    /**
+     * Operand layout, see operand_t.
+     */
+    uint8_t operands;
+
+    /**
+     * Number of entries in the I/O buffer indexed by a REG_PORT operand.
+     */
+    uint8_t ports;
+
+    /**
+     * Executed by the engine itself, rather than the vm-ops.c handler.
+     */
+    uint8_t inlined;
+};
+
+static const struct opcode_info opcodes[OPCODE_COUNT] = {
+    [EXIT] = {NONE, 0, 1},
+    [INT_STORE] = {REG_IMM, 0, 1},
+    [INT_PRINT] = {REG1, 0, 0},
+    [INT_TOSTRING] = {REG1, 0, 0},
+    [INT_RANDOM] = {REG1, 0, 0},
+    [FLOAT_STORE] = {REG_FLOAT, 0, 1},
+    [FLOAT_PRINT] = {REG1, 0, 0},
+    [FLOAT_TOSTRING] = {REG1, 0, 0},
+    [BINARY_LOAD] = {REG_PORT, BINARY_IN_COUNT, 1},
+    [BINARY_SAVE] = {REG_PORT, BINARY_OUT_COUNT, 1},
+    [ANALOG_LOAD] = {REG_PORT, ANALOG_IN_COUNT, 1},
+    [ANALOG_SAVE] = {REG_PORT, ANALOG_OUT_COUNT, 1},
+    [VARIABLE_LOAD] = {REG_PORT, VARIABLE_COUNT, 1},
+    [VARIABLE_SAVE] = {REG_PORT, VARIABLE_COUNT, 1},
+    [JUMP_TO] = {ADDR, 0, 1},
+    [JUMP_Z] = {ADDR, 0, 1},
+    [JUMP_NZ] = {ADDR, 0, 1},
+    [XOR] = {REG3, 0, 1},
+    [ADD] = {REG3, 0, 1},
+    [SUB] = {REG3, 0, 1},
+    [MUL] = {REG3, 0, 1},
+    [DIV] = {REG3, 0, 1},
+    [INC] = {REG1, 0, 1},
+    [DEC] = {REG1, 0, 1},
+    [AND] = {REG3, 0, 1},
+    [OR] = {REG3, 0, 1},
+    [STRING_STORE] = {REG_STRING, 0, 0},
+    [STRING_PRINT] = {REG1, 0, 0},
+    [STRING_CONCAT] = {REG3, 0, 0},
+    [STRING_SYSTEM] = {REG1, 0, 0},
+    [STRING_TOINT] = {REG1, 0, 0},
+    [CMP_REG] = {REG2, 0, 1},
+    [CMP_IMMEDIATE] = {REG_IMM, 0, 1},
+    [CMP_STRING] = {REG_STRING, 0, 0},
+    [IS_STRING] = {REG1, 0, 1},
+    [IS_INTEGER] = {REG1, 0, 1},
+    [NOP] = {NONE, 0, 1},
+    [STORE_REG] = {REG2, 0, 1},
+    [YIELD] = {NONE, 0, 0},
+    [PEEK] = {REG2, 0, 1},
+    [POKE] = {REG2, 0, 0},
+    [MEMCPY] = {REG3, 0, 0},
+    [MEMSET] = {REG3, 0, 0},
+    [MEMCMP] = {REG3, 0, 0},
+    [MEMFIND] = {REG3, 0, 0},
+    [STACK_PUSH] = {REG1, 0, 1},
+    [STACK_POP] = {REG1, 0, 1},
+    [STACK_RET] = {NONE, 0, 1},
+    [STACK_CALL] = {ADDR, 0, 1},
+};
+
+/**
+ * Where the literal of the string instruction at `ip` is in the pool, if
+ * the characters in the RAM are still the ones it was made from - else
+ * zero.
+ */
+static uint32_t find_literal(svm_t *svm, uint32_t ip, uint32_t length)
+{
+    uint32_t lo = 0;
+    uint32_t hi = svm->literal_count;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (svm->literals[mid].ip < ip)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == svm->literal_count || svm->literals[lo].ip != ip)
+        return 0;
+
+    uint32_t offset = svm->literals[lo].offset;
+    struct svm_string *s = SVM_STRING_OF(svm->literal_pool + offset);
+
+    if (s->length != length || memcmp(s->data, svm->code + ip + 4, length) != 0)
+        return 0;
+
+    return offset;
+}
+
+/**
+ * Bytes of each operand layout, before the characters of a string.
+ */
+static const uint8_t lengths[] = {
+    [NONE] = 1,
+    [REG1] = 2,
+    [REG2] = 3,
+    [REG3] = 4,
+    [REG_IMM] = 4,
+    [REG_FLOAT] = 6,
+    [REG_PORT] = 3,
+    [REG_STRING] = 4,
+    [ADDR] = 3,
+};
+
+/**
+ * Register operands of each layout, which come first.
+ */
+static const uint8_t registers[] = {
+    [NONE] = 0,
+    [REG1] = 1,
+    [REG2] = 2,
+    [REG3] = 3,
+    [REG_IMM] = 1,
+    [REG_FLOAT] = 1,
+    [REG_PORT] = 1,
+    [REG_STRING] = 1,
+    [ADDR] = 0,
+};
+
+/**
+ * The encoding of a bytecode opcode.
+ */
+int svm_operands(uint8_t opcode, struct svm_operands *operands)
+{
+    const struct opcode_info *info = &opcodes[opcode];
+
+    /**
+     * YIELD is the only opcode without operands which isn't inlined, the
+     * others are unknown.
+     */
+    if (info->operands == NONE && !info->inlined && opcode != YIELD)
+        return 0;
+
+    operands->length = lengths[info->operands];
+    operands->registers = registers[info->operands];
+    operands->ports = info->ports;
+    operands->string = info->operands == REG_STRING;
+    operands->address = info->operands == ADDR;
+    return 1;
+}
+
+/**
+ * Decode the instruction at `ip` into `insn`.
+ */
+static void decode(svm_t *svm, uint32_t ip, struct svm_insn *insn)
+{
+    unsigned char *code = svm->code;
+    const struct opcode_info *info = &opcodes[code[ip]];
+
+    uint32_t length = lengths[info->operands];
+
+    memset(insn, 0, sizeof(*insn));
+    insn->opcode = code[ip];
+
+    /**
+     * Unknown opcodes are handed to op_unknown().
+     */
+    if (info->operands == NONE && !info->inlined)
+    {
+        insn->opcode = INSN_DELEGATE;
+        insn->length = 1;
+        insn->next = ip + 1;
+        return;
+    }
+
+    /**
+     * The string characters follow the length, see string_from_stack().
+     */
+    if (info->operands == REG_STRING && ip + 3 < 0xFFFF)
+        length += BYTES_TO_ADDR(code[ip + 2], code[ip + 3]);
+
+    insn->length = length;
+    insn->next = ip + length;
+
+    /**
+     * The handler takes the literal from the pool, see string_from_stack().
+     */
+    if (info->operands == REG_STRING && ip + length <= 0xFFFF)
+    {
+        insn->imm.literal = find_literal(svm, ip, length - 4);
+        if (insn->imm.literal)
+        {
+            insn->opcode = INSN_DELEGATE;
+            return;
+        }
+    }
+
+    /**
+     * Operands which wrap around the 64k boundary are left to the
+     * byte-wise handler.
+     */
+    if (!info->inlined || ip + length > 0xFFFF)
+        goto delegate;
+
+    for (int i = 0; i < registers[info->operands]; i++)
+    {
+        insn->reg[i] = code[ip + 1 + i];
+        if (insn->reg[i] >= REGISTER_COUNT)
+            goto delegate;
+    }
+
+    switch (info->operands)
+    {
+    case REG_IMM:
+        insn->imm.integer = BYTES_TO_ADDR(code[ip + 2], code[ip + 3]);
+        break;
+
+    case REG_FLOAT:
+    {
+        int exp = BYTES_TO_ADDR(code[ip + 2], code[ip + 3]);
+        int mant = BYTES_TO_ADDR(code[ip + 4], code[ip + 5]);
+
+        insn->imm.number = ldexp((float)mant / 65535, exp);
+        break;
+    }
+
+    case REG_PORT:
+        insn->reg[1] = code[ip + 2];
+        if (insn->reg[1] >= info->ports)
+            goto delegate;
+        break;
+
+    case ADDR:
+        insn->target = BYTES_TO_ADDR(code[ip + 1], code[ip + 2]);
+        break;
+    }
+
+    return;
+
+delegate:
+    /**
+     * The handler reads its own operands, so only the opcode byte itself
+     * is covered by the record.  `next` is kept for the decoding sweep.
+     */
+    insn->opcode = INSN_DELEGATE;
+    insn->length = 1;
+}
+
+/**
+ * The superinstruction for a pair of record opcodes, or zero.
+ */
+static uint8_t superinstruction(uint8_t first, uint8_t second)
+{
+#define PAIR(a, b) (((a) << 8) | (b))
+
+    switch (PAIR(first, second))
+    {
+    case PAIR(ADD, JUMP_Z):
+        return INSN_ADD_JZ;
+    case PAIR(ADD, JUMP_NZ):
+        return INSN_ADD_JNZ;
+    case PAIR(SUB, JUMP_Z):
+        return INSN_SUB_JZ;
+    case PAIR(SUB, JUMP_NZ):
+        return INSN_SUB_JNZ;
+    case PAIR(INC, JUMP_Z):
+        return INSN_INC_JZ;
+    case PAIR(INC, JUMP_NZ):
+        return INSN_INC_JNZ;
+    case PAIR(DEC, JUMP_Z):
+        return INSN_DEC_JZ;
+    case PAIR(DEC, JUMP_NZ):
+        return INSN_DEC_JNZ;
+    case PAIR(CMP_REG, JUMP_Z):
+        return INSN_CMP_REG_JZ;
+    case PAIR(CMP_REG, JUMP_NZ):
+        return INSN_CMP_REG_JNZ;
+    case PAIR(CMP_IMMEDIATE, JUMP_Z):
+        return INSN_CMP_IMMEDIATE_JZ;
+    case PAIR(CMP_IMMEDIATE, JUMP_NZ):
+        return INSN_CMP_IMMEDIATE_JNZ;
+    case PAIR(STACK_POP, STACK_POP):
+        return INSN_POP_POP;
+    case PAIR(STACK_PUSH, STACK_RET):
+        return INSN_PUSH_RET;
+    }
+
+#undef PAIR
+
+    return 0;
+}
+
+/**
+ * Fuse a record with the instruction following it, if possible.
+ *
+ * `next` is left pointing at the second instruction, so the decoding sweep
+ * still gives it a record of its own.
+ */
+static void fuse(svm_t *svm, struct svm_insn *insn)
+{
+    struct svm_insn second;
+
+    if (insn->opcode >= INSN_DECODE || insn->next >= svm->size)
+        return;
+
+    decode(svm, insn->next, &second);
+
+    uint8_t opcode = superinstruction(insn->opcode, second.opcode);
+    if (!opcode)
+        return;
+
+    insn->opcode = opcode;
+    insn->length += second.length;
+
+    if (opcode == INSN_POP_POP)
+        insn->reg[1] = second.reg[0];
+    else
+        insn->target = second.target;
+}
+
+/**
+ * Decode the instruction starting at the given offset.
+ */
+struct svm_insn *svm_decode(svm_t *svm, uint32_t ip)
+{
+    struct svm_insn *insn = &svm->insns[ip];
+
+    decode(svm, ip, insn);
+    fuse(svm, insn);
+
+    if (insn->length > svm->insn_span)
+        svm->insn_span = insn->length;
+
+    return insn;
+}
+
+/**
+ * Decode the instruction starting at the given offset on its own.
+ */
+void svm_decode_insn(svm_t *svm, uint32_t ip, struct svm_insn *insn)
+{
+    decode(svm, ip, insn);
+}
+
+/**
+ * Allocate the records of a program, unless it has them already, and
+ * decode it.
+ */
+int svm_predecode(svm_t *svm)
+{
+    if (svm->insns == NULL)
+        svm->insns = malloc(svm->size * sizeof(struct svm_insn));
+    if (svm->insns == NULL)
+        return -1;
+
+    for (uint32_t i = 0; i < svm->size; i++)
+        svm->insns[i].opcode = INSN_DECODE;
+
+    svm->insn_span = 1;
+
+    /**
+     * Follow the instructions in sequence.  Anything reached another way,
+     * such as a jump into the middle of an instruction, is decoded on
+     * demand.
+     */
+    for (uint32_t ip = 0; ip < svm->size;)
+        ip = svm_decode(svm, ip)->next;
+
+    return 0;
+}
+
+/**
+ * Forget the records which were decoded from any byte in [addr, addr+len).
+ */
+void svm_invalidate(svm_t *svm, uint32_t addr, uint32_t len)
+{
+    if (len)
+        svm->memory_written = 1;
+
+    /**
+     * The code is no longer the one verified, back to the checked handlers.
+     */
+    if (len && addr < svm->size && svm->code_verified)
+    {
+        svm->code_verified = 0;
+        svm->verified = 0;
+        opcode_select(svm);
+    }
+
+    if (!svm->insns || addr >= svm->size || len == 0)
+        return;
+
+    svm->code_written = 1;
+    svm->jit_stale = 1;
+
+    uint32_t end = addr + len;
+    if (end > svm->size)
+        end = svm->size;
+
+    /**
+     * Records starting up to `insn_span - 1` bytes earlier may cover addr.
+     */
+    uint32_t start = addr >= svm->insn_span ? addr - svm->insn_span + 1 : 0;
+
+    for (uint32_t ip = start; ip < end; ip++)
+    {
+        struct svm_insn *insn = &svm->insns[ip];
+
+        if (insn->opcode != INSN_DECODE && ip + insn->length > addr)
+            insn->opcode = INSN_DECODE;
+    }
+}
@@ -0,0 +1,207 @@
+#ifndef P4HV8N2KD6WQ1XJ9ZT3MB7FRA
+#define P4HV8N2KD6WQ1XJ9ZT3MB7FRA
+
+#include <inttypes.h>
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Record opcodes which have no bytecode counterpart.
+ *
+ * Every other record opcode is the bytecode opcode it was decoded from.
+ */
+enum insn_opcode_t
+{
+    /**
+     * Not decoded yet, or invalidated by a write to the code.
+     */
+    INSN_DECODE = 0x80,
+
+    /**
+     * Run the byte-wise handler from vm-ops.c - used for unknown and rarely
+     * used opcodes, operands which are out of bounds and instructions which
+     * wrap around the 64k boundary.
+     *
+     * String instructions whose literal is in the pool are delegated too,
+     * but their records cover the whole instruction, so writing over the
+     * characters forgets the literal along with the record.
+     */
+    INSN_DELEGATE,
+
+    /**
+     * Superinstructions, an instruction fused with the one following it.
+     * The record keeps the operands of the first instruction and the
+     * destination of the jump, see svm_decode().
+     */
+    INSN_ADD_JZ,
+    INSN_ADD_JNZ,
+    INSN_SUB_JZ,
+    INSN_SUB_JNZ,
+    INSN_INC_JZ,
+    INSN_INC_JNZ,
+    INSN_DEC_JZ,
+    INSN_DEC_JNZ,
+    INSN_CMP_REG_JZ,
+    INSN_CMP_REG_JNZ,
+    INSN_CMP_IMMEDIATE_JZ,
+    INSN_CMP_IMMEDIATE_JNZ,
+
+    /**
+     * `pop` + `pop` and `push` + `ret`, as emitted for every block by the
+     * block compiler.  POP_POP keeps the second register in reg[1].
+     */
+    INSN_POP_POP,
+    INSN_PUSH_RET,
+
+    /**
+     * Arithmetic specialised for the operand types seen by the first
+     * execution of the record: both integers (II), both floats (FF), or one
+     * of each (MIXED).  The bitwise operations only distinguish integers
+     * from anything involving a float.  See vm-engine.c.
+     */
+    INSN_ADD_II,
+    INSN_ADD_FF,
+    INSN_ADD_MIXED,
+    INSN_SUB_II,
+    INSN_SUB_FF,
+    INSN_SUB_MIXED,
+    INSN_MUL_II,
+    INSN_MUL_FF,
+    INSN_MUL_MIXED,
+    INSN_AND_II,
+    INSN_AND_FLOAT,
+    INSN_OR_II,
+    INSN_OR_FLOAT,
+    INSN_XOR_II,
+    INSN_XOR_FLOAT
+};
+
+/**
+ * A decoded instruction.
+ *
+ * There is one record for each byte of the program, the record at offset
+ * N describes the instruction starting at N, so jump targets index the
+ * records directly.
+ */
+struct svm_insn
+{
+    /**
+     * The bytecode opcode, or one of insn_opcode_t.
+     */
+    uint8_t opcode;
+
+    /**
+     * Register and I/O operands, in encoding order.
+     */
+    uint8_t reg[3];
+
+    /**
+     * How many bytes of code this record was decoded from, both
+     * instructions for a superinstruction.
+     */
+    uint16_t length;
+
+    /**
+     * Jump and call destination.
+     */
+    uint16_t target;
+
+    /**
+     * The instruction-pointer after the instruction, when not jumping.
+     */
+    uint32_t next;
+
+    /**
+     * Immediate value, already converted - or for STRING_STORE and
+     * CMP_STRING the offset of their literal in `literal_pool`, zero when
+     * it isn't there.
+     */
+    union {
+        int integer;
+        float number;
+        uint32_t literal;
+    } imm;
+};
+
+/**
+ * How an opcode of the bytecode is encoded, see svm_operands().
+ */
+struct svm_operands
+{
+    /**
+     * Bytes of the instruction, before the characters of a string.
+     */
+    uint8_t length;
+
+    /**
+     * How many operands are registers, they follow the opcode.
+     */
+    uint8_t registers;
+
+    /**
+     * Entries of the I/O buffer indexed by the operand after the register,
+     * zero if there is none.
+     */
+    uint8_t ports;
+
+    /**
+     * Followed by a 16-bit length and as many characters.
+     */
+    uint8_t string;
+
+    /**
+     * A 16-bit jump or call destination follows the opcode.
+     */
+    uint8_t address;
+};
+
+/**
+ * The encoding of a bytecode opcode into `operands`.  Returns zero for the
+ * opcodes op_unknown() handles.
+ */
+int svm_operands(uint8_t opcode, struct svm_operands *operands);
+
+/**
+ * Allocate the records of a program, or reuse those it has, and decode
+ * it, following the instructions in sequence from offset zero.  String
+ * instructions are given their literal in `literal_pool`, made by
+ * svm_new() the same way, as long as the RAM still holds it.
+ *
+ * Returns zero on success.
+ */
+int svm_predecode(svm_t *cpup);
+
+/**
+ * Decode the instruction starting at the given offset, fusing it with the
+ * following instruction when the pair has a superinstruction.
+ *
+ * The following instruction keeps its own record, so jumps to it are not
+ * affected.
+ */
+struct svm_insn *svm_decode(svm_t *cpup, uint32_t ip);
+
+/**
+ * Decode the instruction starting at the given offset into `insn`, without
+ * fusing it or touching the records of the program.
+ */
+void svm_decode_insn(svm_t *cpup, uint32_t ip, struct svm_insn *insn);
+
+/**
+ * Forget the records which were decoded from any of the bytes in the
+ * given range, they are decoded again on their next execution.  Called
+ * for every write to the RAM, which it also records for svm_reset().
+ */
+void svm_invalidate(svm_t *cpup, uint32_t addr, uint32_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,731 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vm-engine.h"
+#include "vm-decode.h"
+#include "vm-trace.h"
+
+/**
+ * Operand access, from the decoded record of the current instruction.
+ */
+#define REG(n) (svm->registers[insn->reg[n]])
+
+/**
+ * Dispatch to the record at the instruction-pointer, stopping once we've
+ * run off the end of the program.  REDISPATCH() runs the current record
+ * again, after its opcode was rewritten.
+ */
+#if SVM_DISPATCH == SVM_DISPATCH_THREADED
+#define CASE(op) case op: L_##op
+#define DISPATCH()                      \
+    do                                  \
+    {                                   \
+        if (ip >= size)                 \
+            goto done;                  \
+        insn = &insns[ip];              \
+        goto *labels[insn->opcode];     \
+    } while (0)
+#define REDISPATCH() goto *labels[insn->opcode]
+#else
+#define CASE(op) case op
+#define DISPATCH() goto dispatch
+#define REDISPATCH() goto dispatch
+#endif
+
+/**
+ * Account for the instruction just handled and move on to `to`.
+ */
+#define NEXT(to)            \
+    do                      \
+    {                       \
+        ip = (to);          \
+        iterations++;       \
+        DISPATCH();         \
+    } while (0)
+
+/**
+ * Move on to the instruction following one of `len` bytes.
+ *
+ * The length of an inlined instruction is fixed by its opcode, so stepping
+ * over it doesn't have to wait for the record to be read.
+ */
+#define SKIP(len) NEXT(ip + (len))
+
+/**
+ * Account for both instructions of a superinstruction and move on to `to`.
+ */
+#define NEXT_FUSED(to) \
+    do                 \
+    {                  \
+        iterations++;  \
+        fused++;       \
+        NEXT(to);      \
+    } while (0)
+
+/**
+ * Set the Z-flag from an integer result.
+ */
+#define SET_Z(value) svm->jmp = ((value) == 0) ? 1 : 0
+
+/**
+ *  Inlined virtual machine execution loop.
+ *
+ *  This produces the same results as the reference loop in vm.c, but runs
+ * from the records decoded by svm_predecode(), keeps the instruction-pointer
+ * in a local and handles the common cases of the hot opcodes in place.
+ *
+ *  Every inlined handler guards the assumptions it makes which can't be
+ * checked when decoding (register types, stack space).  When a guard fails,
+ * or for the rarely used opcodes, the instruction is delegated to its
+ * handler in vm-ops.c, which keeps the reference behaviour - including
+ * error reporting - in one place.
+ */
+void svm_run_inline(svm_t *svm)
+{
+    /**
+     * If we're called without a valid CPU then we should abort.
+     */
+    if (!svm)
+        return;
+
+    /**
+     * The code will start executing from offset 0.
+     */
+    svm->ip = 0;
+    svm->iterations = 0;
+    svm->fused = 0;
+    svm->quick_hits = 0;
+    svm->quick_misses = 0;
+
+    svm_resume_inline(svm);
+}
+
+/**
+ *  Continue running from the instruction-pointer of the virtual machine,
+ * adding to the counters of the run.
+ */
+void svm_resume_inline(svm_t *svm)
+{
+    /**
+     * How many instructions have we handled?
+     */
+    uint32_t iterations = svm->iterations;
+
+    /**
+     * How many dispatches did superinstructions save?
+     */
+    uint32_t fused = svm->fused;
+
+    /**
+     * How often did type-specialised instructions pass, and fail, their
+     * guard?
+     */
+    uint32_t quick_hits = svm->quick_hits;
+    uint32_t quick_misses = svm->quick_misses;
+
+    struct svm_insn *insns = svm->insns;
+    struct svm_insn *insn;
+    uint32_t size = svm->size;
+    uint32_t ip = svm->ip;
+
+#if SVM_DISPATCH == SVM_DISPATCH_THREADED
+    static void *labels[OPCODE_COUNT] = {
+        [0 ... OPCODE_COUNT - 1] = &&delegate,
+        [INSN_DECODE] = &&decode,
+        [EXIT] = &&L_EXIT,
+        [INT_STORE] = &&L_INT_STORE,
+        [FLOAT_STORE] = &&L_FLOAT_STORE,
+        [BINARY_LOAD] = &&L_BINARY_LOAD,
+        [BINARY_SAVE] = &&L_BINARY_SAVE,
+        [ANALOG_LOAD] = &&L_ANALOG_LOAD,
+        [ANALOG_SAVE] = &&L_ANALOG_SAVE,
+        [VARIABLE_LOAD] = &&L_VARIABLE_LOAD,
+        [VARIABLE_SAVE] = &&L_VARIABLE_SAVE,
+        [JUMP_TO] = &&L_JUMP_TO,
+        [JUMP_Z] = &&L_JUMP_Z,
+        [JUMP_NZ] = &&L_JUMP_NZ,
+        [XOR] = &&L_XOR,
+        [ADD] = &&L_ADD,
+        [SUB] = &&L_SUB,
+        [MUL] = &&L_MUL,
+        [DIV] = &&L_DIV,
+        [INC] = &&L_INC,
+        [DEC] = &&L_DEC,
+        [AND] = &&L_AND,
+        [OR] = &&L_OR,
+        [CMP_REG] = &&L_CMP_REG,
+        [CMP_IMMEDIATE] = &&L_CMP_IMMEDIATE,
+        [IS_STRING] = &&L_IS_STRING,
+        [IS_INTEGER] = &&L_IS_INTEGER,
+        [NOP] = &&L_NOP,
+        [STORE_REG] = &&L_STORE_REG,
+        [PEEK] = &&L_PEEK,
+        [STACK_PUSH] = &&L_STACK_PUSH,
+        [STACK_POP] = &&L_STACK_POP,
+        [STACK_RET] = &&L_STACK_RET,
+        [STACK_CALL] = &&L_STACK_CALL,
+        [INSN_ADD_JZ] = &&L_INSN_ADD_JZ,
+        [INSN_ADD_JNZ] = &&L_INSN_ADD_JNZ,
+        [INSN_SUB_JZ] = &&L_INSN_SUB_JZ,
+        [INSN_SUB_JNZ] = &&L_INSN_SUB_JNZ,
+        [INSN_INC_JZ] = &&L_INSN_INC_JZ,
+        [INSN_INC_JNZ] = &&L_INSN_INC_JNZ,
+        [INSN_DEC_JZ] = &&L_INSN_DEC_JZ,
+        [INSN_DEC_JNZ] = &&L_INSN_DEC_JNZ,
+        [INSN_CMP_REG_JZ] = &&L_INSN_CMP_REG_JZ,
+        [INSN_CMP_REG_JNZ] = &&L_INSN_CMP_REG_JNZ,
+        [INSN_CMP_IMMEDIATE_JZ] = &&L_INSN_CMP_IMMEDIATE_JZ,
+        [INSN_CMP_IMMEDIATE_JNZ] = &&L_INSN_CMP_IMMEDIATE_JNZ,
+        [INSN_POP_POP] = &&L_INSN_POP_POP,
+        [INSN_PUSH_RET] = &&L_INSN_PUSH_RET,
+        [INSN_ADD_II] = &&L_INSN_ADD_II,
+        [INSN_ADD_FF] = &&L_INSN_ADD_FF,
+        [INSN_ADD_MIXED] = &&L_INSN_ADD_MIXED,
+        [INSN_SUB_II] = &&L_INSN_SUB_II,
+        [INSN_SUB_FF] = &&L_INSN_SUB_FF,
+        [INSN_SUB_MIXED] = &&L_INSN_SUB_MIXED,
+        [INSN_MUL_II] = &&L_INSN_MUL_II,
+        [INSN_MUL_FF] = &&L_INSN_MUL_FF,
+        [INSN_MUL_MIXED] = &&L_INSN_MUL_MIXED,
+        [INSN_AND_II] = &&L_INSN_AND_II,
+        [INSN_AND_FLOAT] = &&L_INSN_AND_FLOAT,
+        [INSN_OR_II] = &&L_INSN_OR_II,
+        [INSN_OR_FLOAT] = &&L_INSN_OR_FLOAT,
+        [INSN_XOR_II] = &&L_INSN_XOR_II,
+        [INSN_XOR_FLOAT] = &&L_INSN_XOR_FLOAT,
+    };
+#endif
+
+    if (!svm->running)
+        goto done;
+
+    DISPATCH();
+
+#if SVM_DISPATCH != SVM_DISPATCH_THREADED
+dispatch:
+    if (ip >= size)
+        goto done;
+    insn = &insns[ip];
+#endif
+
+    switch (insn->opcode)
+    {
+    case INSN_DECODE:
+        goto decode;
+
+    CASE(EXIT):
+    {
+        svm->running = 0;
+        ip += 1;
+        iterations++;
+        goto done;
+    }
+
+    CASE(INT_STORE):
+    {
+        REG(0).content.integer = insn->imm.integer;
+        REG(0).tag = INTEGER;
+        SKIP(4);
+    }
+
+    CASE(FLOAT_STORE):
+    {
+        REG(0).content.number = insn->imm.number;
+        REG(0).tag = FLOAT;
+        SKIP(6);
+    }
+
+    CASE(BINARY_LOAD):
+    {
+        REG(0).tag = INTEGER;
+        REG(0).content.integer = svm->io.in.binary[insn->reg[1]];
+        SKIP(3);
+    }
+
+    CASE(BINARY_SAVE):
+    {
+        if (REG(0).tag == INTEGER)
+            svm->io.out.binary[insn->reg[1]] = REG(0).content.integer;
+        SKIP(3);
+    }
+
+    CASE(ANALOG_LOAD):
+    {
+        REG(0).tag = FLOAT;
+        REG(0).content.number = svm->io.in.analog[insn->reg[1]];
+        SKIP(3);
+    }
+
+    CASE(ANALOG_SAVE):
+    {
+        if (REG(0).tag == FLOAT)
+            svm->io.out.analog[insn->reg[1]] = REG(0).content.number;
+        if (REG(0).tag == INTEGER)
+            svm->io.out.analog[insn->reg[1]] = REG(0).content.integer;
+        SKIP(3);
+    }
+
+    CASE(VARIABLE_LOAD):
+    {
+        REG(0) = svm->io.variables[insn->reg[1]];
+        SKIP(3);
+    }
+
+    CASE(VARIABLE_SAVE):
+    {
+        svm->io.variables[insn->reg[1]] = REG(0);
+        SKIP(3);
+    }
+
+    CASE(JUMP_TO):
+    {
+        NEXT(insn->target);
+    }
+
+    CASE(JUMP_Z):
+    {
+        NEXT(svm->jmp ? insn->target : ip + 3);
+    }
+
+    CASE(JUMP_NZ):
+    {
+        NEXT(!svm->jmp ? insn->target : ip + 3);
+    }
+
+/**
+ * Quickening of math_operation().
+ *
+ *  The first execution of an ADD, SUB, MUL, AND, OR or XOR record rewrites
+ * it in place into the variant specialised for the operand types it saw.
+ * The variants only check that the types still match, when they don't the
+ * record goes back to the generic opcode, which picks a variant for the
+ * new types.  Operands which aren't numbers are left to vm-ops.c, which
+ * reports the error.
+ */
+#define QUICKEN(ii, ff, mixed)                                          \
+    {                                                                   \
+        if (REG(1).tag == INTEGER && REG(2).tag == INTEGER)           \
+            insn->opcode = (ii);                                        \
+        else if (REG(1).tag == FLOAT && REG(2).tag == FLOAT)          \
+            insn->opcode = (ff);                                        \
+        else if (!SVM_IS_STRING(REG(1)) && !SVM_IS_STRING(REG(2)))        \
+            insn->opcode = (mixed);                                     \
+        else                                                            \
+            goto delegate;                                              \
+                                                                        \
+        REDISPATCH();                                                   \
+    }
+
+/**
+ * The bitwise operations work on the integer content of both registers as
+ * soon as one is a float, so there is one variant for all of those cases.
+ */
+#define QUICKEN_BITWISE(ii, any)                                        \
+    {                                                                   \
+        if (REG(1).tag == INTEGER && REG(2).tag == INTEGER)           \
+            insn->opcode = (ii);                                        \
+        else if (REG(1).tag == FLOAT || REG(2).tag == FLOAT)          \
+            insn->opcode = (any);                                       \
+        else                                                            \
+            goto delegate;                                              \
+                                                                        \
+        REDISPATCH();                                                   \
+    }
+
+    CASE(ADD):
+        QUICKEN(INSN_ADD_II, INSN_ADD_FF, INSN_ADD_MIXED)
+    CASE(SUB):
+        QUICKEN(INSN_SUB_II, INSN_SUB_FF, INSN_SUB_MIXED)
+    CASE(MUL):
+        QUICKEN(INSN_MUL_II, INSN_MUL_FF, INSN_MUL_MIXED)
+    CASE(AND):
+        QUICKEN_BITWISE(INSN_AND_II, INSN_AND_FLOAT)
+    CASE(OR):
+        QUICKEN_BITWISE(INSN_OR_II, INSN_OR_FLOAT)
+    CASE(XOR):
+        QUICKEN_BITWISE(INSN_XOR_II, INSN_XOR_FLOAT)
+
+#undef QUICKEN
+#undef QUICKEN_BITWISE
+
+/**
+ * A failed guard, go back to the generic opcode.
+ */
+#define DEOPT(generic)                 \
+    {                                  \
+        quick_misses++;                \
+        insn->opcode = (generic);      \
+        REDISPATCH();                  \
+    }
+
+/**
+ * The value of an integer or float register, as a float.
+ */
+#define NUMBER(r) ((r).tag == FLOAT ? (r).content.number : (float)(r).content.integer)
+
+/**
+ * Store a result, setting the Z-flag from its integer content the way
+ * math_operation() does - for floats that's their bit pattern.
+ */
+#define RESULT(kind, field, value)           \
+    {                                        \
+        REG(0).tag = (kind);                \
+        REG(0).content.field = (value);      \
+        SET_Z(REG(0).content.integer);       \
+        quick_hits++;                        \
+        SKIP(4);                             \
+    }
+
+#define MATH_II(generic, operator)                                            \
+    {                                                                         \
+        if (REG(1).tag != INTEGER || REG(2).tag != INTEGER)                 \
+            DEOPT(generic)                                                    \
+                                                                              \
+        int result = REG(1).content.integer operator REG(2).content.integer;  \
+        RESULT(INTEGER, integer, result)                                      \
+    }
+
+#define MATH_FF(generic, operator)                                            \
+    {                                                                         \
+        if (REG(1).tag != FLOAT || REG(2).tag != FLOAT)                     \
+            DEOPT(generic)                                                    \
+                                                                              \
+        float result = REG(1).content.number operator REG(2).content.number;  \
+        RESULT(FLOAT, number, result)                                         \
+    }
+
+#define MATH_MIXED(generic, operator)                                         \
+    {                                                                         \
+        if (SVM_IS_STRING(REG(1)) || SVM_IS_STRING(REG(2)) ||                 \
+            REG(1).tag == REG(2).tag)                                       \
+            DEOPT(generic)                                                    \
+                                                                              \
+        float result = NUMBER(REG(1)) operator NUMBER(REG(2));                \
+        RESULT(FLOAT, number, result)                                         \
+    }
+
+#define BITWISE_FLOAT(generic, operator)                                      \
+    {                                                                         \
+        if (REG(1).tag != FLOAT && REG(2).tag != FLOAT)                     \
+            DEOPT(generic)                                                    \
+                                                                              \
+        int result = REG(1).content.integer operator REG(2).content.integer;  \
+        RESULT(FLOAT, number, result)                                         \
+    }
+
+    CASE(INSN_ADD_II):
+        MATH_II(ADD, +)
+    CASE(INSN_ADD_FF):
+        MATH_FF(ADD, +)
+    CASE(INSN_ADD_MIXED):
+        MATH_MIXED(ADD, +)
+    CASE(INSN_SUB_II):
+        MATH_II(SUB, -)
+    CASE(INSN_SUB_FF):
+        MATH_FF(SUB, -)
+    CASE(INSN_SUB_MIXED):
+        MATH_MIXED(SUB, -)
+    CASE(INSN_MUL_II):
+        MATH_II(MUL, *)
+    CASE(INSN_MUL_FF):
+        MATH_FF(MUL, *)
+    CASE(INSN_MUL_MIXED):
+        MATH_MIXED(MUL, *)
+    CASE(INSN_AND_II):
+        MATH_II(AND, &)
+    CASE(INSN_AND_FLOAT):
+        BITWISE_FLOAT(AND, &)
+    CASE(INSN_OR_II):
+        MATH_II(OR, |)
+    CASE(INSN_OR_FLOAT):
+        BITWISE_FLOAT(OR, |)
+    CASE(INSN_XOR_II):
+        MATH_II(XOR, ^)
+    CASE(INSN_XOR_FLOAT):
+        BITWISE_FLOAT(XOR, ^)
+
+#undef DEOPT
+#undef NUMBER
+#undef RESULT
+#undef MATH_II
+#undef MATH_FF
+#undef MATH_MIXED
+#undef BITWISE_FLOAT
+
+    CASE(DIV):
+    {
+        if (REG(1).tag != INTEGER || REG(2).tag != INTEGER ||
+            REG(2).content.integer == 0)
+            goto delegate;
+
+        int result = REG(1).content.integer / REG(2).content.integer;
+
+        REG(0).content.integer = result;
+        REG(0).tag = INTEGER;
+        SET_Z(result);
+        SKIP(4);
+    }
+
+    CASE(INC):
+    {
+        if (REG(0).tag != INTEGER)
+            goto delegate;
+
+        REG(0).content.integer += 1;
+        SET_Z(REG(0).content.integer);
+        SKIP(2);
+    }
+
+    CASE(DEC):
+    {
+        if (REG(0).tag != INTEGER)
+            goto delegate;
+
+        REG(0).content.integer -= 1;
+        SET_Z(REG(0).content.integer);
+        SKIP(2);
+    }
+
+    CASE(CMP_REG):
+    {
+        if (SVM_IS_STRING(REG(0)))
+            svm->jmp = SVM_IS_STRING(REG(1)) &&
+                       svm_string_equal(SVM_STRING(REG(0)), SVM_STRING(REG(1)));
+        else
+            svm->jmp = (REG(0).tag == REG(1).tag &&
+                        REG(0).content.integer == REG(1).content.integer)
+                           ? 1
+                           : 0;
+        SKIP(3);
+    }
+
+    CASE(CMP_IMMEDIATE):
+    {
+        if (REG(0).tag != INTEGER)
+            goto delegate;
+
+        svm->jmp = (REG(0).content.integer == insn->imm.integer) ? 1 : 0;
+        SKIP(4);
+    }
+
+    CASE(IS_STRING):
+    {
+        svm->jmp = (SVM_IS_STRING(REG(0))) ? 1 : 0;
+        SKIP(2);
+    }
+
+    CASE(IS_INTEGER):
+    {
+        svm->jmp = (REG(0).tag == INTEGER) ? 1 : 0;
+        SKIP(2);
+    }
+
+    CASE(NOP):
+    {
+        SKIP(1);
+    }
+
+    CASE(STORE_REG):
+    {
+        REG(0) = REG(1);
+        SKIP(3);
+    }
+
+    CASE(PEEK):
+    {
+        if (REG(1).tag != INTEGER || REG(1).content.integer < 0 ||
+            REG(1).content.integer >= 0xFFFF)
+            goto delegate;
+
+        int val = svm->code[REG(1).content.integer];
+
+        REG(0).content.integer = val;
+        REG(0).tag = INTEGER;
+        SKIP(3);
+    }
+
+    CASE(STACK_PUSH):
+    {
+        if (svm->SP + 1 >= STACK_COUNT)
+            goto delegate;
+
+        svm->SP += 1;
+        svm->stack[svm->SP] = REG(0);
+        SKIP(2);
+    }
+
+    CASE(STACK_POP):
+    {
+        if (svm->SP <= 0)
+            goto delegate;
+
+        struct reg_t val = svm->stack[svm->SP];
+        svm->SP -= 1;
+
+        REG(0) = val;
+        SKIP(2);
+    }
+
+    CASE(STACK_RET):
+    {
+        if (svm->CSP <= 0)
+            goto delegate;
+
+        uint32_t to = svm->call_stack[svm->CSP];
+        svm->CSP -= 1;
+        SVM_EVENT(svm, SVM_EVENT_RET, ip, to);
+        NEXT(to);
+    }
+
+    CASE(STACK_CALL):
+    {
+        if (svm->CSP + 1 >= CALL_STACK_COUNT)
+            goto delegate;
+
+        svm->CSP += 1;
+        svm->call_stack[svm->CSP] = ip + 3;
+        SVM_EVENT(svm, SVM_EVENT_CALL, ip, insn->target);
+        NEXT(insn->target);
+    }
+
+/**
+ * Superinstructions, see svm_decode().
+ *
+ *  The Z-flag is still written as the jump may not be the only reader, but
+ * the branch is taken on the local result.  A failing guard delegates the
+ * first instruction only, the jump then runs from its own record.
+ */
+#define MATH_INT_JUMP(operator, taken)                                       \
+    {                                                                        \
+        if (REG(1).tag != INTEGER || REG(2).tag != INTEGER)                \
+            goto delegate;                                                   \
+                                                                             \
+        int result = REG(1).content.integer operator REG(2).content.integer; \
+                                                                             \
+        REG(0).tag = INTEGER;                                               \
+        REG(0).content.integer = result;                                     \
+        SET_Z(result);                                                       \
+        NEXT_FUSED((result == 0) == (taken) ? insn->target : ip + 7);        \
+    }
+
+#define STEP_JUMP(delta, taken)                                       \
+    {                                                                 \
+        if (REG(0).tag != INTEGER)                                   \
+            goto delegate;                                            \
+                                                                      \
+        int result = REG(0).content.integer + (delta);                \
+                                                                      \
+        REG(0).content.integer = result;                              \
+        SET_Z(result);                                                \
+        NEXT_FUSED((result == 0) == (taken) ? insn->target : ip + 5); \
+    }
+
+    CASE(INSN_ADD_JZ):
+        MATH_INT_JUMP(+, 1)
+    CASE(INSN_ADD_JNZ):
+        MATH_INT_JUMP(+, 0)
+    CASE(INSN_SUB_JZ):
+        MATH_INT_JUMP(-, 1)
+    CASE(INSN_SUB_JNZ):
+        MATH_INT_JUMP(-, 0)
+    CASE(INSN_INC_JZ):
+        STEP_JUMP(1, 1)
+    CASE(INSN_INC_JNZ):
+        STEP_JUMP(1, 0)
+    CASE(INSN_DEC_JZ):
+        STEP_JUMP(-1, 1)
+    CASE(INSN_DEC_JNZ):
+        STEP_JUMP(-1, 0)
+
+#undef MATH_INT_JUMP
+#undef STEP_JUMP
+
+    CASE(INSN_CMP_REG_JZ):
+    CASE(INSN_CMP_REG_JNZ):
+    {
+        if (SVM_IS_STRING(REG(0)))
+            goto delegate;
+
+        int equal = REG(0).tag == REG(1).tag &&
+                    REG(0).content.integer == REG(1).content.integer;
+
+        svm->jmp = equal ? 1 : 0;
+        NEXT_FUSED(equal == (insn->opcode == INSN_CMP_REG_JZ) ? insn->target : ip + 6);
+    }
+
+    CASE(INSN_CMP_IMMEDIATE_JZ):
+    CASE(INSN_CMP_IMMEDIATE_JNZ):
+    {
+        if (REG(0).tag != INTEGER)
+            goto delegate;
+
+        int equal = REG(0).content.integer == insn->imm.integer;
+
+        svm->jmp = equal ? 1 : 0;
+        NEXT_FUSED(equal == (insn->opcode == INSN_CMP_IMMEDIATE_JZ) ? insn->target : ip + 7);
+    }
+
+    CASE(INSN_POP_POP):
+    {
+        if (svm->SP <= 1)
+            goto delegate;
+
+        struct reg_t first = svm->stack[svm->SP];
+        struct reg_t second = svm->stack[svm->SP - 1];
+        svm->SP -= 2;
+
+        REG(0) = first;
+        REG(1) = second;
+        NEXT_FUSED(ip + 4);
+    }
+
+    CASE(INSN_PUSH_RET):
+    {
+        if (svm->SP + 1 >= STACK_COUNT || svm->CSP <= 0)
+            goto delegate;
+
+        svm->SP += 1;
+        svm->stack[svm->SP] = REG(0);
+
+        uint32_t to = svm->call_stack[svm->CSP];
+        svm->CSP -= 1;
+        SVM_EVENT(svm, SVM_EVENT_RET, ip + 2, to);
+        NEXT_FUSED(to);
+    }
+
+    default:
+        goto delegate;
+    }
+
+decode:
+    /**
+     * First execution of this offset, or the code was written to.
+     */
+    insn = svm_decode(svm, ip);
+    REDISPATCH();
+
+delegate:
+    /**
+     * Hand the instruction to its vm-ops.c implementation.
+     */
+    svm->ip = ip;
+    svm->handler_ip = ip;
+    svm->opcodes[svm->code[ip]](svm);
+    ip = svm->ip;
+    iterations++;
+
+    if (!svm->running)
+        goto done;
+
+    DISPATCH();
+
+done:
+    svm->ip = ip;
+    svm->running = 0;
+    svm->iterations = iterations;
+    svm->fused = fused;
+    svm->quick_hits = quick_hits;
+    svm->quick_misses = quick_misses;
+}
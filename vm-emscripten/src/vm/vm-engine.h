@@ -0,0 +1,74 @@
+#ifndef K7QW2M4XN9B3FJ8TZ5RD1HCLE
+#define K7QW2M4XN9B3FJ8TZ5RD1HCLE
+
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Execution engines, one of which is selected at build time with
+ * -DSVM_DISPATCH=<value>:
+ *
+ *   SVM_DISPATCH_CALL     - the reference loop, an indirect call through
+ *                           the opcodes[] table for every instruction.
+ *
+ *   SVM_DISPATCH_SWITCH   - the inlined engine, dispatching with a switch.
+ *
+ *   SVM_DISPATCH_THREADED - the inlined engine, dispatching with computed
+ *                           goto (labels-as-values).  This is the default.
+ */
+#define SVM_DISPATCH_CALL 0
+#define SVM_DISPATCH_SWITCH 1
+#define SVM_DISPATCH_THREADED 2
+
+#ifndef SVM_DISPATCH
+#define SVM_DISPATCH SVM_DISPATCH_THREADED
+#endif
+
+/**
+ * Labels-as-values is a GNU extension, other compilers get the switch.
+ */
+#if (SVM_DISPATCH == SVM_DISPATCH_THREADED) && !defined(__GNUC__)
+#undef SVM_DISPATCH
+#define SVM_DISPATCH SVM_DISPATCH_SWITCH
+#endif
+
+/**
+ * The reference loop from vm.c.
+ */
+void svm_run_call(svm_t *cpup);
+
+/**
+ * The reference loop, reporting to the tracer attached with
+ * svm_set_tracer().  svm_run uses it whenever a tracer is attached.
+ */
+void svm_run_traced(svm_t *cpup);
+
+/**
+ * The reference loop, counting each instruction in the profile started
+ * with svm_profile_enable().  svm_run uses it whenever one is.
+ */
+void svm_run_profiled(svm_t *cpup);
+
+/**
+ * The inlined engine from vm-engine.c.
+ */
+void svm_run_inline(svm_t *cpup);
+
+/**
+ * The inlined engine, continuing from the current instruction-pointer and
+ * counters - used by the JIT to finish a run it can't.
+ */
+void svm_resume_inline(svm_t *cpup);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
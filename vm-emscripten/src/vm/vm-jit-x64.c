@@ -0,0 +1,1019 @@
+/**
+ * x86-64 template JIT.
+ *
+ *  svm_jit_compile() follows the instructions of a program in sequence from
+ * offset zero, as svm_predecode() does, and emits one code template for
+ * each of them.  The registers, flags and stacks stay in the svm_t, the
+ * generated code addresses them relative to rbx, so the handlers in
+ * vm-ops.c can be called from it at any point:
+ *
+ *   rbx - the svm_t.
+ *   r12 - instructions handled, stored to svm->iterations on the way out.
+ *   r13 - the native address of every instruction start, or NULL.
+ *
+ *  Jumps and calls to a known instruction start are patched to branch
+ * directly to its code.  Only returns, and instructions run by a handler
+ * which may change the instruction-pointer, look the destination up in
+ * the r13 table.
+ *
+ *  Like the inlined engine, the templates guard the register types and
+ * stack space they rely on.  When a guard fails, and for the string, print,
+ * random, division and memory opcodes, the handler from vm-ops.c runs the
+ * instruction - this keeps the reference behaviour, including error
+ * reporting, in one place.
+ *
+ *  Jumps to an offset which isn't an instruction start, and writes to the
+ * code by POKE, MEMCPY or MEMSET, leave the native code; the run is
+ * finished by the inlined engine, which decodes such code on demand.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm-jit.h"
+#include "vm-decode.h"
+#include "vm-engine.h"
+
+#if SVM_JIT
+
+#include <sys/mman.h>
+
+/**
+ * Compiled code of a virtual machine.
+ */
+struct svm_jit
+{
+    /**
+     * The executable mapping, and its size.
+     */
+    uint8_t *code;
+    size_t size;
+
+    /**
+     * Native address of each instruction start, indexed by offset.
+     */
+    void **targets;
+
+    /**
+     * Runs the code from svm->ip, returns non-zero when the run has to be
+     * finished by the inlined engine.
+     */
+    int (*entry)(svm_t *svm, void **targets);
+};
+
+/**
+ * Sections of the generated code.  The templates go to HOT, in program
+ * order, so that execution falls through from one to the next.  Slow paths
+ * and exits go to COLD, which is placed after it.
+ */
+enum section_t
+{
+    HOT,
+    COLD,
+    SECTION_COUNT
+};
+
+/**
+ * A position in the generated code.
+ */
+struct label
+{
+    uint8_t bound;
+    uint8_t section;
+    uint32_t offset;
+};
+
+/**
+ * A rel32 operand to be patched with the address of a label.
+ */
+struct fixup
+{
+    uint8_t section;
+    uint32_t offset;
+    uint32_t label;
+};
+
+/**
+ * State of a compilation.
+ */
+struct assembler
+{
+    svm_t *svm;
+
+    /**
+     * Which offsets start an instruction of the sequence.
+     */
+    uint8_t *starts;
+
+    /**
+     * Code of each section.
+     */
+    uint8_t *code[SECTION_COUNT];
+    uint32_t len[SECTION_COUNT];
+    uint32_t cap[SECTION_COUNT];
+    int section;
+
+    /**
+     * Labels, the first `svm->size` of which are the instructions at those
+     * offsets.
+     */
+    struct label *labels;
+    uint32_t label_count;
+    uint32_t label_cap;
+
+    struct fixup *fixups;
+    uint32_t fixup_count;
+    uint32_t fixup_cap;
+
+    /**
+     * The shared exits, see emit_exits().
+     */
+    uint32_t dispatch;
+    uint32_t stop;
+    uint32_t exit;
+    uint32_t bail;
+
+    int failed;
+};
+
+/**
+ * x86 registers, as encoded in ModRM.
+ */
+enum
+{
+    EAX = 0,
+    ECX = 1
+};
+
+/**
+ * x86 condition codes, as encoded in Jcc and SETcc.
+ */
+enum
+{
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_LE = 0xE,
+    CC_G = 0xF
+};
+
+/**
+ * Offsets of the machine state, relative to rbx.
+ */
+#define OFF_IP offsetof(svm_t, ip)
+#define OFF_HANDLER_IP offsetof(svm_t, handler_ip)
+#define OFF_JMP offsetof(svm_t, jmp)
+#define OFF_RUNNING offsetof(svm_t, running)
+#define OFF_WRITTEN offsetof(svm_t, code_written)
+#define OFF_ITERATIONS offsetof(svm_t, iterations)
+#define OFF_SP offsetof(svm_t, SP)
+#define OFF_CSP offsetof(svm_t, CSP)
+#define OFF_STACK offsetof(svm_t, stack)
+#define OFF_CALL_STACK offsetof(svm_t, call_stack)
+#define OFF_HANDLER(opcode) (offsetof(svm_t, opcodes) + (opcode) * sizeof(opcode_implementation *))
+#define OFF_INT(reg) (offsetof(svm_t, registers) + (reg) * sizeof(struct reg_t) + offsetof(struct reg_t, content))
+#define OFF_TAG(reg) (offsetof(svm_t, registers) + (reg) * sizeof(struct reg_t) + offsetof(struct reg_t, tag))
+#define OFF_IO(field, n) (offsetof(svm_t, io.field) + (n) * sizeof(((svm_t *)0)->io.field[0]))
+
+/**
+ * Grow an array to hold at least `need` elements.
+ */
+static int grow(struct assembler *a, void **array, uint32_t *cap, uint32_t need, size_t size)
+{
+    if (need <= *cap)
+        return 0;
+
+    uint32_t n = *cap ? *cap : 256;
+    while (n < need)
+        n *= 2;
+
+    void *p = realloc(*array, n * size);
+    if (p == NULL)
+    {
+        a->failed = 1;
+        return -1;
+    }
+
+    *array = p;
+    *cap = n;
+    return 0;
+}
+
+static void emit(struct assembler *a, const uint8_t *bytes, uint32_t len)
+{
+    int s = a->section;
+
+    if (grow(a, (void **)&a->code[s], &a->cap[s], a->len[s] + len, 1) != 0)
+        return;
+
+    memcpy(a->code[s] + a->len[s], bytes, len);
+    a->len[s] += len;
+}
+
+#define EMIT(...)                                  \
+    do                                             \
+    {                                              \
+        const uint8_t bytes_[] = {__VA_ARGS__};    \
+        emit(a, bytes_, sizeof(bytes_));           \
+    } while (0)
+
+static void emit32(struct assembler *a, uint32_t value)
+{
+    EMIT(value, value >> 8, value >> 16, value >> 24);
+}
+
+/**
+ * ModRM and displacement of a [rbx + disp32] operand.
+ */
+static void rbx_disp(struct assembler *a, int reg, size_t disp)
+{
+    EMIT(0x80 | reg << 3 | 3);
+    emit32(a, disp);
+}
+
+/**
+ * ModRM, SIB and displacement of a [rbx + index*scale + disp32] operand,
+ * where `scale` is the shift count.
+ */
+static void rbx_index_disp(struct assembler *a, int reg, int index, int scale, size_t disp)
+{
+    EMIT(0x80 | reg << 3 | 4, scale << 6 | index << 3 | 3);
+    emit32(a, disp);
+}
+
+/**
+ * Create a label, not bound to a position yet.
+ */
+static uint32_t new_label(struct assembler *a)
+{
+    if (grow(a, (void **)&a->labels, &a->label_cap, a->label_count + 1, sizeof(struct label)) != 0)
+        return 0;
+
+    a->labels[a->label_count].bound = 0;
+    return a->label_count++;
+}
+
+/**
+ * Bind a label to the current position.
+ */
+static void bind(struct assembler *a, uint32_t label)
+{
+    a->labels[label].bound = 1;
+    a->labels[label].section = a->section;
+    a->labels[label].offset = a->len[a->section];
+}
+
+/**
+ * A rel32 operand branching to a label.
+ */
+static void rel32(struct assembler *a, uint32_t label)
+{
+    if (grow(a, (void **)&a->fixups, &a->fixup_cap, a->fixup_count + 1, sizeof(struct fixup)) != 0)
+        return;
+
+    struct fixup *f = &a->fixups[a->fixup_count++];
+    f->section = a->section;
+    f->offset = a->len[a->section];
+    f->label = label;
+    emit32(a, 0);
+}
+
+static void jmp(struct assembler *a, uint32_t label)
+{
+    EMIT(0xE9);
+    rel32(a, label);
+}
+
+static void jcc(struct assembler *a, int cc, uint32_t label)
+{
+    EMIT(0x0F, 0x80 | cc);
+    rel32(a, label);
+}
+
+/**
+ * A short forward branch within a template, patched by short_bind().
+ */
+static uint32_t short_jcc(struct assembler *a, int cc)
+{
+    EMIT(0x70 | cc, 0);
+    return a->len[a->section];
+}
+
+static uint32_t short_jmp(struct assembler *a)
+{
+    EMIT(0xEB, 0);
+    return a->len[a->section];
+}
+
+static void short_bind(struct assembler *a, uint32_t from)
+{
+    if (!a->failed)
+        a->code[a->section][from - 1] = a->len[a->section] - from;
+}
+
+/**
+ * mov reg, dword [rbx + disp]
+ */
+static void load(struct assembler *a, int reg, size_t disp)
+{
+    EMIT(0x8B);
+    rbx_disp(a, reg, disp);
+}
+
+/**
+ * mov dword [rbx + disp], reg
+ */
+static void store(struct assembler *a, int reg, size_t disp)
+{
+    EMIT(0x89);
+    rbx_disp(a, reg, disp);
+}
+
+/**
+ * mov dword [rbx + disp], imm32
+ */
+static void store_imm(struct assembler *a, size_t disp, uint32_t imm)
+{
+    EMIT(0xC7);
+    rbx_disp(a, 0, disp);
+    emit32(a, imm);
+}
+
+/**
+ * mov byte [rbx + disp], imm8
+ */
+static void store_byte(struct assembler *a, size_t disp, uint8_t imm)
+{
+    EMIT(0xC6);
+    rbx_disp(a, 0, disp);
+    EMIT(imm);
+}
+
+/**
+ * cmp dword [rbx + disp], imm8
+ */
+static void cmp_imm(struct assembler *a, size_t disp, int8_t imm)
+{
+    EMIT(0x83);
+    rbx_disp(a, 7, disp);
+    EMIT(imm);
+}
+
+/**
+ * cmp byte [rbx + disp], imm8
+ */
+static void cmp_byte(struct assembler *a, size_t disp, uint8_t imm)
+{
+    EMIT(0x80);
+    rbx_disp(a, 7, disp);
+    EMIT(imm);
+}
+
+/**
+ * setcc byte [rbx + jmp], the Z-flag of the virtual machine.
+ */
+static void set_flag(struct assembler *a, int cc)
+{
+    EMIT(0x0F, 0x90 | cc);
+    rbx_disp(a, 0, OFF_JMP);
+}
+
+/**
+ * Count the instruction: add r12d, 1
+ */
+static void count(struct assembler *a)
+{
+    EMIT(0x41, 0x83, 0xC4, 0x01);
+}
+
+/**
+ * lea rax, [rbx + disp32]
+ */
+static void load_address(struct assembler *a, size_t disp)
+{
+    EMIT(0x48, 0x8D);
+    rbx_disp(a, 0, disp);
+}
+
+/**
+ * Continue at the given offset: a branch to its code when it starts an
+ * instruction, or an exit to the inlined engine when it doesn't.  Offsets
+ * past the end of the program stop it, as in the reference loop.
+ */
+static uint32_t destination(struct assembler *a, uint32_t ip)
+{
+    if (ip < a->svm->size && a->starts[ip])
+        return ip;
+
+    int section = a->section;
+    uint32_t label = new_label(a);
+
+    a->section = COLD;
+    bind(a, label);
+    store_imm(a, OFF_IP, ip);
+    jmp(a, ip >= a->svm->size ? a->stop : a->bail);
+    a->section = section;
+
+    return label;
+}
+
+/**
+ * Continue with the instruction after this one, which is emitted next
+ * unless this was the last.
+ */
+static void fall_through(struct assembler *a, uint32_t next)
+{
+    if (next >= a->svm->size)
+        jmp(a, destination(a, next));
+}
+
+/**
+ * Run an instruction with its vm-ops.c handler, then carry on from
+ * wherever it left the instruction-pointer.
+ */
+static void call_handler(struct assembler *a, uint32_t ip, uint8_t opcode, uint32_t next)
+{
+    store_imm(a, OFF_IP, ip);
+    store_imm(a, OFF_HANDLER_IP, ip);
+    EMIT(0x48, 0x89, 0xDF); /* mov rdi, rbx */
+    EMIT(0xFF);             /* call [rbx + opcodes[opcode]] */
+    rbx_disp(a, 2, OFF_HANDLER(opcode));
+    count(a);
+
+    cmp_byte(a, OFF_RUNNING, 0);
+    jcc(a, CC_E, a->exit);
+
+    /**
+     * The handler invalidated the records of the code it wrote to, the
+     * inlined engine decodes them again.
+     */
+    if (opcode == POKE || opcode == MEMCPY || opcode == MEMSET)
+    {
+        cmp_byte(a, OFF_WRITTEN, 0);
+        jcc(a, CC_NE, a->bail);
+    }
+
+    load(a, EAX, OFF_IP);
+    if (next < a->svm->size)
+    {
+        EMIT(0x3D); /* cmp eax, next */
+        emit32(a, next);
+        jcc(a, CC_E, next);
+    }
+    jmp(a, a->dispatch);
+}
+
+/**
+ * Emit the shared exits.
+ *
+ *  dispatch - continue at svm->ip, through the r13 table.
+ *  stop     - the program ran off its end.
+ *  exit     - the program has finished.
+ *  bail     - finish the run in the inlined engine, from svm->ip.
+ */
+static void emit_exits(struct assembler *a)
+{
+    a->section = COLD;
+
+    bind(a, a->dispatch);
+    load(a, EAX, OFF_IP);
+    EMIT(0x3D); /* cmp eax, size */
+    emit32(a, a->svm->size);
+    jcc(a, CC_AE, a->stop);
+    EMIT(0x49, 0x8B, 0x44, 0xC5, 0x00); /* mov rax, [r13 + rax*8] */
+    EMIT(0x48, 0x85, 0xC0);             /* test rax, rax */
+    jcc(a, CC_E, a->bail);
+    EMIT(0xFF, 0xE0); /* jmp rax */
+
+    bind(a, a->stop);
+    store_byte(a, OFF_RUNNING, 0);
+
+    bind(a, a->exit);
+    EMIT(0x31, 0xC0); /* xor eax, eax */
+    uint32_t out = short_jmp(a);
+
+    bind(a, a->bail);
+    EMIT(0xB8, 0x01, 0x00, 0x00, 0x00); /* mov eax, 1 */
+
+    short_bind(a, out);
+    EMIT(0x44); /* mov [rbx + iterations], r12d */
+    store(a, 4, OFF_ITERATIONS);
+    EMIT(0x41, 0x5D); /* pop r13 */
+    EMIT(0x41, 0x5C); /* pop r12 */
+    EMIT(0x5B);       /* pop rbx */
+    EMIT(0xC3);       /* ret */
+}
+
+/**
+ * Emit the template of one instruction.
+ */
+static void compile(struct assembler *a, uint32_t ip, struct svm_insn *insn)
+{
+    uint8_t opcode = a->svm->code[ip];
+    uint32_t next = insn->next;
+    uint32_t slow = 0;
+    int r0 = insn->reg[0], r1 = insn->reg[1], r2 = insn->reg[2];
+
+/**
+ * Leave the template for the handler when a condition holds.
+ */
+#define GUARD(cc)                     \
+    do                                \
+    {                                 \
+        if (!slow)                    \
+            slow = new_label(a);      \
+        jcc(a, cc, slow);             \
+    } while (0)
+
+/**
+ * Strings compare by content, in the handler.  The tag of a string is
+ * STRING or above, it carries pointer bits.
+ */
+#define GUARD_NOT_STRING(reg)         \
+    do                                \
+    {                                 \
+        cmp_imm(a, OFF_TAG(reg), STRING); \
+        GUARD(CC_AE);                 \
+    } while (0)
+
+    if (insn->opcode == INSN_DELEGATE)
+    {
+        call_handler(a, ip, opcode, next);
+        return;
+    }
+
+    switch (opcode)
+    {
+    case EXIT:
+        count(a);
+        store_byte(a, OFF_RUNNING, 0);
+        store_imm(a, OFF_IP, ip + 1);
+        jmp(a, a->exit);
+        return;
+
+    case INT_STORE:
+    case FLOAT_STORE:
+        store_imm(a, OFF_INT(r0), insn->imm.integer);
+        store_imm(a, OFF_TAG(r0), opcode == INT_STORE ? INTEGER : FLOAT);
+        break;
+
+    case BINARY_LOAD:
+        load_address(a, OFF_IO(in.binary, r1));
+        EMIT(0x0F, 0xB6, 0x08); /* movzx ecx, byte [rax] */
+        store(a, ECX, OFF_INT(r0));
+        store_imm(a, OFF_TAG(r0), INTEGER);
+        break;
+
+    case BINARY_SAVE:
+    {
+        cmp_imm(a, OFF_TAG(r0), INTEGER);
+        uint32_t skip = short_jcc(a, CC_NE);
+        load_address(a, OFF_IO(out.binary, r1));
+        load(a, ECX, OFF_INT(r0));
+        EMIT(0x88, 0x08); /* mov [rax], cl */
+        short_bind(a, skip);
+        break;
+    }
+
+    case ANALOG_LOAD:
+        load_address(a, OFF_IO(in.analog, r1));
+        EMIT(0x8B, 0x08); /* mov ecx, [rax] */
+        store(a, ECX, OFF_INT(r0));
+        store_imm(a, OFF_TAG(r0), FLOAT);
+        break;
+
+    case ANALOG_SAVE:
+    {
+        load_address(a, OFF_IO(out.analog, r1));
+        load(a, ECX, OFF_TAG(r0));
+        EMIT(0x83, 0xF9, FLOAT); /* cmp ecx, FLOAT */
+        uint32_t integer = short_jcc(a, CC_NE);
+        load(a, ECX, OFF_INT(r0));
+        EMIT(0x89, 0x08); /* mov [rax], ecx */
+        uint32_t done = short_jmp(a);
+        short_bind(a, integer);
+        EMIT(0x85, 0xC9); /* test ecx, ecx */
+        uint32_t other = short_jcc(a, CC_NE);
+        EMIT(0xF3, 0x0F, 0x2A); /* cvtsi2ss xmm0, [rbx + int] */
+        rbx_disp(a, 0, OFF_INT(r0));
+        EMIT(0xF3, 0x0F, 0x11, 0x00); /* movss [rax], xmm0 */
+        short_bind(a, done);
+        short_bind(a, other);
+        break;
+    }
+
+    case VARIABLE_LOAD:
+        load_address(a, OFF_IO(variables, r1));
+        EMIT(0xF3, 0x0F, 0x7E, 0x00); /* movq xmm0, [rax] */
+        EMIT(0x66, 0x0F, 0xD6);       /* movq [rbx + reg], xmm0 */
+        rbx_disp(a, 0, OFF_INT(r0));
+        break;
+
+    case VARIABLE_SAVE:
+        load_address(a, OFF_IO(variables, r1));
+        EMIT(0xF3, 0x0F, 0x7E); /* movq xmm0, [rbx + reg] */
+        rbx_disp(a, 0, OFF_INT(r0));
+        EMIT(0x66, 0x0F, 0xD6, 0x00); /* movq [rax], xmm0 */
+        break;
+
+    case JUMP_TO:
+        count(a);
+        jmp(a, destination(a, insn->target));
+        return;
+
+    case JUMP_Z:
+    case JUMP_NZ:
+        count(a);
+        cmp_byte(a, OFF_JMP, 0);
+        jcc(a, opcode == JUMP_Z ? CC_NE : CC_E, destination(a, insn->target));
+        fall_through(a, next);
+        return;
+
+    case ADD:
+    case SUB:
+    case MUL:
+    case AND:
+    case OR:
+    case XOR:
+        cmp_imm(a, OFF_TAG(r1), INTEGER);
+        GUARD(CC_NE);
+        cmp_imm(a, OFF_TAG(r2), INTEGER);
+        GUARD(CC_NE);
+        load(a, EAX, OFF_INT(r1));
+        switch (opcode)
+        {
+        case ADD:
+            EMIT(0x03);
+            break;
+        case SUB:
+            EMIT(0x2B);
+            break;
+        case MUL:
+            EMIT(0x0F, 0xAF);
+            break;
+        case AND:
+            EMIT(0x23);
+            break;
+        case OR:
+            EMIT(0x0B);
+            break;
+        case XOR:
+            EMIT(0x33);
+            break;
+        }
+        rbx_disp(a, EAX, OFF_INT(r2));
+        store(a, EAX, OFF_INT(r0));
+        store_imm(a, OFF_TAG(r0), INTEGER);
+        EMIT(0x85, 0xC0); /* test eax, eax */
+        set_flag(a, CC_E);
+        break;
+
+    case INC:
+    case DEC:
+        cmp_imm(a, OFF_TAG(r0), INTEGER);
+        GUARD(CC_NE);
+        EMIT(0x83); /* add/sub dword [rbx + reg], 1 */
+        rbx_disp(a, opcode == INC ? 0 : 5, OFF_INT(r0));
+        EMIT(0x01);
+        set_flag(a, CC_E);
+        break;
+
+    case CMP_REG:
+    {
+        GUARD_NOT_STRING(r0);
+        load(a, EAX, OFF_TAG(r0));
+        EMIT(0x31, 0xC9); /* xor ecx, ecx */
+        EMIT(0x3B);       /* cmp eax, [rbx + type] */
+        rbx_disp(a, EAX, OFF_TAG(r1));
+        uint32_t differ = short_jcc(a, CC_NE);
+        load(a, EAX, OFF_INT(r0));
+        EMIT(0x3B); /* cmp eax, [rbx + int] */
+        rbx_disp(a, EAX, OFF_INT(r1));
+        EMIT(0x0F, 0x94, 0xC1); /* sete cl */
+        short_bind(a, differ);
+        EMIT(0x88); /* mov [rbx + jmp], cl */
+        rbx_disp(a, ECX, OFF_JMP);
+        break;
+    }
+
+    case CMP_IMMEDIATE:
+        cmp_imm(a, OFF_TAG(r0), INTEGER);
+        GUARD(CC_NE);
+        EMIT(0x81); /* cmp dword [rbx + int], imm32 */
+        rbx_disp(a, 7, OFF_INT(r0));
+        emit32(a, insn->imm.integer);
+        set_flag(a, CC_E);
+        break;
+
+    case IS_STRING:
+        cmp_imm(a, OFF_TAG(r0), STRING);
+        set_flag(a, CC_AE);
+        break;
+
+    case IS_INTEGER:
+        cmp_imm(a, OFF_TAG(r0), INTEGER);
+        set_flag(a, CC_E);
+        break;
+
+    case NOP:
+        break;
+
+    case STORE_REG:
+        load(a, EAX, OFF_TAG(r1));
+        load(a, ECX, OFF_INT(r1));
+        store(a, EAX, OFF_TAG(r0));
+        store(a, ECX, OFF_INT(r0));
+        break;
+
+    case STACK_PUSH:
+        load(a, EAX, OFF_SP);
+        EMIT(0x83, 0xF8, STACK_COUNT - 2); /* cmp eax, STACK_COUNT - 2 */
+        GUARD(CC_G);
+        EMIT(0xFF, 0xC0); /* inc eax */
+        store(a, EAX, OFF_SP);
+        EMIT(0x89, 0xC1);       /* mov ecx, eax */
+        EMIT(0xC1, 0xE1, 0x03); /* shl ecx, 3 */
+        EMIT(0xF3, 0x0F, 0x7E); /* movq xmm0, [rbx + reg] */
+        rbx_disp(a, 0, OFF_INT(r0));
+        EMIT(0x66, 0x0F, 0xD6); /* movq [rbx + rcx + stack], xmm0 */
+        rbx_index_disp(a, 0, ECX, 0, OFF_STACK);
+        break;
+
+    case STACK_POP:
+        load(a, EAX, OFF_SP);
+        EMIT(0x85, 0xC0); /* test eax, eax */
+        GUARD(CC_LE);
+        EMIT(0x89, 0xC1);       /* mov ecx, eax */
+        EMIT(0xC1, 0xE1, 0x03); /* shl ecx, 3 */
+        EMIT(0xF3, 0x0F, 0x7E); /* movq xmm0, [rbx + rcx + stack] */
+        rbx_index_disp(a, 0, ECX, 0, OFF_STACK);
+        EMIT(0xFF, 0xC8); /* dec eax */
+        store(a, EAX, OFF_SP);
+        EMIT(0x66, 0x0F, 0xD6); /* movq [rbx + reg], xmm0 */
+        rbx_disp(a, 0, OFF_INT(r0));
+        break;
+
+    case STACK_RET:
+        load(a, EAX, OFF_CSP);
+        EMIT(0x85, 0xC0); /* test eax, eax */
+        GUARD(CC_LE);
+        EMIT(0x8B); /* mov ecx, [rbx + rax*4 + call_stack] */
+        rbx_index_disp(a, ECX, EAX, 2, OFF_CALL_STACK);
+        EMIT(0xFF, 0xC8); /* dec eax */
+        store(a, EAX, OFF_CSP);
+        store(a, ECX, OFF_IP);
+        count(a);
+        jmp(a, a->dispatch);
+        goto slow_path;
+
+    case STACK_CALL:
+        load(a, EAX, OFF_CSP);
+        EMIT(0x83, 0xF8, CALL_STACK_COUNT - 2); /* cmp eax, CALL_STACK_COUNT - 2 */
+        GUARD(CC_G);
+        EMIT(0xFF, 0xC0); /* inc eax */
+        store(a, EAX, OFF_CSP);
+        EMIT(0xC7); /* mov dword [rbx + rax*4 + call_stack], ip + 3 */
+        rbx_index_disp(a, 0, EAX, 2, OFF_CALL_STACK);
+        emit32(a, ip + 3);
+        count(a);
+        jmp(a, destination(a, insn->target));
+        goto slow_path;
+
+    default:
+        call_handler(a, ip, opcode, next);
+        return;
+    }
+
+#undef GUARD_NOT_STRING
+#undef GUARD
+
+    count(a);
+    fall_through(a, next);
+
+slow_path:
+    if (slow)
+    {
+        int section = a->section;
+
+        a->section = COLD;
+        bind(a, slow);
+        call_handler(a, ip, opcode, next);
+        a->section = section;
+    }
+}
+
+/**
+ * Copy the sections into an executable mapping and patch the branches.
+ */
+static struct svm_jit *link(struct assembler *a)
+{
+    struct svm_jit *jit = calloc(1, sizeof(struct svm_jit));
+    if (jit == NULL)
+        return NULL;
+
+    jit->size = a->len[HOT] + a->len[COLD];
+    jit->targets = calloc(a->svm->size, sizeof(void *));
+    jit->code = mmap(NULL, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (jit->targets == NULL || jit->code == MAP_FAILED)
+        goto fail;
+
+    uint32_t base[SECTION_COUNT] = {0, a->len[HOT]};
+
+    memcpy(jit->code, a->code[HOT], a->len[HOT]);
+    memcpy(jit->code + base[COLD], a->code[COLD], a->len[COLD]);
+
+    for (uint32_t i = 0; i < a->fixup_count; i++)
+    {
+        struct fixup *f = &a->fixups[i];
+        struct label *l = &a->labels[f->label];
+
+        if (!l->bound)
+            goto fail;
+
+        int32_t from = base[f->section] + f->offset + 4;
+        int32_t to = base[l->section] + l->offset;
+        int32_t rel = to - from;
+
+        memcpy(jit->code + base[f->section] + f->offset, &rel, sizeof(rel));
+    }
+
+    for (uint32_t ip = 0; ip < a->svm->size; ip++)
+    {
+        if (a->starts[ip])
+            jit->targets[ip] = jit->code + base[a->labels[ip].section] + a->labels[ip].offset;
+    }
+
+    if (mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC) != 0)
+        goto fail;
+
+    jit->entry = (int (*)(svm_t *, void **))jit->code;
+    return jit;
+
+fail:
+    if (jit->code != MAP_FAILED && jit->code != NULL)
+        munmap(jit->code, jit->size);
+    free(jit->targets);
+    free(jit);
+    return NULL;
+}
+
+/**
+ * Compile the program loaded in a virtual machine into native code.
+ */
+int svm_jit_compile(svm_t *svm)
+{
+    struct assembler asm_state;
+    struct assembler *a = &asm_state;
+    struct svm_insn insn;
+
+    if (!svm)
+        return -1;
+    if (svm->jit)
+        return 0;
+
+    svm->jit_stale = 0;
+
+    /**
+     * The templates copy registers and stack entries with 8-byte moves.
+     */
+    if (sizeof(struct reg_t) != 8 || sizeof(((struct reg_t *)0)->tag) != 4)
+        return -1;
+
+    memset(a, 0, sizeof(*a));
+    a->svm = svm;
+    a->starts = calloc(svm->size, 1);
+    if (a->starts == NULL)
+        return -1;
+
+    for (uint32_t ip = 0; ip < svm->size;)
+    {
+        svm_decode_insn(svm, ip, &insn);
+        a->starts[ip] = 1;
+        ip = insn.next;
+    }
+
+    /**
+     * One label for every offset, then the shared exits.
+     */
+    if (grow(a, (void **)&a->labels, &a->label_cap, svm->size, sizeof(struct label)) == 0)
+    {
+        memset(a->labels, 0, svm->size * sizeof(struct label));
+        a->label_count = svm->size;
+    }
+    a->dispatch = new_label(a);
+    a->stop = new_label(a);
+    a->exit = new_label(a);
+    a->bail = new_label(a);
+
+    /**
+     * Prologue, entered with rdi = svm and rsi = targets.
+     */
+    a->section = HOT;
+    EMIT(0x53);             /* push rbx */
+    EMIT(0x41, 0x54);       /* push r12 */
+    EMIT(0x41, 0x55);       /* push r13 */
+    EMIT(0x48, 0x89, 0xFB); /* mov rbx, rdi */
+    EMIT(0x49, 0x89, 0xF5); /* mov r13, rsi */
+    EMIT(0x45, 0x31, 0xE4); /* xor r12d, r12d */
+    jmp(a, a->dispatch);
+
+    for (uint32_t ip = 0; ip < svm->size && !a->failed;)
+    {
+        svm_decode_insn(svm, ip, &insn);
+        bind(a, ip);
+        compile(a, ip, &insn);
+        ip = insn.next;
+    }
+
+    emit_exits(a);
+
+    if (!a->failed)
+        svm->jit = link(a);
+
+    free(a->starts);
+    free(a->code[HOT]);
+    free(a->code[COLD]);
+    free(a->labels);
+    free(a->fixups);
+
+    return svm->jit ? 0 : -1;
+}
+
+/**
+ * Release the native code of a virtual machine.
+ */
+void svm_jit_free(svm_t *svm)
+{
+    if (!svm || !svm->jit)
+        return;
+
+    munmap(svm->jit->code, svm->jit->size);
+    free(svm->jit->targets);
+    free(svm->jit);
+    svm->jit = NULL;
+}
+
+/**
+ * Run the native code of a virtual machine.
+ */
+void svm_run_jit(svm_t *svm)
+{
+    if (!svm)
+        return;
+
+    /**
+     * The code was written to since it was compiled, outside of it.
+     */
+    if (svm->jit_stale)
+        svm_jit_free(svm);
+
+    if (!svm->running || svm_jit_compile(svm) != 0)
+    {
+        svm_run_inline(svm);
+        return;
+    }
+
+    /**
+     * The native code matches the code as it is now, any write from here
+     * on makes it leave.
+     */
+    svm->ip = 0;
+    svm->iterations = 0;
+    svm->fused = 0;
+    svm->quick_hits = 0;
+    svm->quick_misses = 0;
+    svm->code_written = 0;
+
+    if (svm->jit->entry(svm, svm->jit->targets))
+    {
+        /**
+         * The native code no longer matches a program which modified
+         * itself.
+         */
+        if (svm->code_written)
+            svm_jit_free(svm);
+
+        svm_resume_inline(svm);
+    }
+}
+
+#else
+
+int svm_jit_compile(svm_t *svm)
+{
+    (void)svm;
+    return -1;
+}
+
+void svm_jit_free(svm_t *svm)
+{
+    (void)svm;
+}
+
+void svm_run_jit(svm_t *svm)
+{
+    svm_run_inline(svm);
+}
+
+#endif
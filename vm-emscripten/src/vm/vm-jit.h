@@ -0,0 +1,58 @@
+#ifndef W2XC9HJ4TQ7LBN5ZK1RVE8MDA
+#define W2XC9HJ4TQ7LBN5ZK1RVE8MDA
+
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * The JIT is built for x86-64 hosts with mmap(), see vm-jit-x64.c.
+ * Everywhere else - including the WebAssembly build - svm_jit_compile()
+ * fails and svm_run_jit() runs the inlined engine instead.
+ */
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__) && (defined(__linux__) || defined(__APPLE__))
+#define SVM_JIT 1
+#else
+#define SVM_JIT 0
+#endif
+
+/**
+ * Native builds can have svm_run use the JIT with -DSVM_USE_JIT=1.
+ */
+#ifndef SVM_USE_JIT
+#define SVM_USE_JIT 0
+#endif
+
+/**
+ * Compile the program loaded in a virtual machine into native code.
+ *
+ * Returns zero on success, or when the program was already compiled.
+ */
+int svm_jit_compile(svm_t *cpup);
+
+/**
+ * Release the native code of a virtual machine, if any.
+ */
+void svm_jit_free(svm_t *cpup);
+
+/**
+ * Run the native code of a virtual machine, compiling it first if needed.
+ *
+ * Execution continues in the inlined engine when the program jumps to an
+ * offset which isn't the start of a compiled instruction, or writes to its
+ * own code.  Programs which can't be compiled are run by the inlined engine
+ * from the start.
+ */
+void svm_run_jit(svm_t *cpup);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
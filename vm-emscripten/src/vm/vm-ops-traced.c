@@ -0,0 +1,9 @@
+/**
+ * The opcode handlers again, this time reporting each instruction to the
+ * tracer attached with svm_set_tracer().
+ *
+ * Keeping them apart means the handlers used by untraced runs don't test
+ * for a tracer at all.
+ */
+#define SVM_TRACED 1
+#include "vm-ops.c"
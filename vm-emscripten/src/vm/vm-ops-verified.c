@@ -0,0 +1,16 @@
+/**
+ * The opcode handlers again, this time for programs svm_verify() accepted:
+ * their register operands, I/O indices and stack depths were checked once
+ * when they were loaded, rather than by every instruction.
+ *
+ * The machine switches back to the checked handlers when the program
+ * writes to its own code.
+ *
+ *  The engines which call the handler of every instruction - the reference
+ * loop and the call loop - are the ones to gain from it.  The inlined
+ * engine and the JIT run the common cases of the hot opcodes in place,
+ * with checks of their own, and call through this table only for the
+ * rest, so they gain little.
+ */
+#define SVM_VERIFIED 1
+#include "vm-ops.c"
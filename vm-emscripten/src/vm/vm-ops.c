@@ -5,101 +5,157 @@
 #include <math.h>
 
 #include "vm.h"
+#include "vm-decode.h"
+#include "vm-trace.h"
 
 
 /**
- * Internal memory objects
-*/
-float ANALOG_IN[ANALOG_IN_COUNT];
-float ANALOG_OUT[ANALOG_OUT_COUNT];
+ * vm-ops-traced.c compiles this file a second time with SVM_TRACED set,
+ * giving the handlers used while a tracer is attached, and vm-ops-verified.c
+ * a third time with SVM_VERIFIED set, giving those of programs svm_verify()
+ * accepted - without the checks of register operands, I/O indices and
+ * stack depths it made once for all of them.  The helpers and memory
+ * objects are only defined by the first copy.
+ */
+#ifndef SVM_TRACED
+#define SVM_TRACED 0
+#endif
 
-uint8_t BINARY_IN[BINARY_IN_COUNT];
-uint8_t BINARY_OUT[BINARY_OUT_COUNT];
+#ifndef SVM_VERIFIED
+#define SVM_VERIFIED 0
+#endif
 
-struct reg_t VARIABLE_IO[BINARY_IN_COUNT];
+#define SVM_VARIANT (SVM_TRACED || SVM_VERIFIED)
 
+#if SVM_TRACED
+#define TRACE(level, ...) svm_trace(svm, level, __VA_ARGS__)
+#else
+#define TRACE(level, ...)
+#endif
 
 /**
  * Helper to convert a two-byte value to an integer in the range 0x0000-0xffff
  */
 #define BYTES_TO_ADDR(one, two) (one + (256 * two))
 
+#if SVM_VERIFIED
+#define BOUNDS_TEST_REGISTER(r)
+#define BOUNDS_TEST_PORT(p, count)
+#else
+#define BOUNDS_TEST_REGISTER(r) \
+    if (bound_test(svm, r, REGISTER_COUNT) != 0) \
+        return;
+#define BOUNDS_TEST_PORT(p, count) \
+    if (bound_test(svm, p, count) != 0) \
+        return;
+#endif
+
+/**
+ * Foward declarations for code in this module which is not exported.
+ */
+char *string_from_stack(svm_t *svm);
+int string_equals_stack(svm_t *svm, const char *str);
+void reg_add(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs);
+void reg_and(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs);
+void reg_sub(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs);
+void reg_mul(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs);
+void reg_xor(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs);
+void reg_or(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs);
+void opcode_map(svm_t *svm);
+void opcode_map_traced(svm_t *svm);
+void opcode_map_verified(svm_t *svm);
+void opcode_select(svm_t *svm);
+
+/**
+ * The helpers every instruction uses are defined by each copy, to be
+ * inlined into its handlers.
+ */
+
+#if !SVM_VERIFIED
+
 /**
  * Trivial helper to test arrays are not out of bounds.
  */
-int bound_test(svm_t *svm, uint32_t test, uint32_t count)
+static int bound_test(svm_t *svm, uint32_t test, uint32_t count)
 {
     if (test >= count)
     {
-        svm_default_error_handler(svm, "Register out of bounds");
+        svm_fault(svm, SVM_ERROR_REGISTER, "Register out of bounds");
         return -1; // Should never happen
     }
     return 0;
 }
 
-#define BOUNDS_TEST_REGISTER(r) \
-    bound_test(svm, r, REGISTER_COUNT);
-
-/**
- * Foward declarations for code in this module which is not exported.
- */
-char *get_string_reg(svm_t *cpu, int reg);
-int get_int_reg(svm_t *cpu, int reg);
-char *string_from_stack(svm_t *svm);
-uint8_t next_byte(svm_t *svm);
+#endif
 
 /**
  * Helper to return the string-content of a register.
- *
- * NOTE: This function is not exported outside this compilation-unit.
  */
-char *get_string_reg(svm_t *cpu, int reg)
+static char *get_string_reg(svm_t *cpu, int reg)
 {
-    if (cpu->registers[reg].type == STRING)
-        return (cpu->registers[reg].content.string);
+    if (SVM_IS_STRING(cpu->registers[reg]))
+        return SVM_STRING(cpu->registers[reg]);
 
-    svm_default_error_handler(cpu, "The register deesn't contain a string");
+    svm_fault(cpu, SVM_ERROR_TYPE, "The register deesn't contain a string");
     return NULL;
 }
 
 /**
  * Helper to return the integer-content of a register.
- *
- * NOTE: This function is not exported outside this compilation-unit.
  */
-int get_int_reg(svm_t *cpu, int reg)
+static int get_int_reg(svm_t *cpu, int reg)
 {
-    if (cpu->registers[reg].type == INTEGER)
+    if (cpu->registers[reg].tag == INTEGER)
         return (cpu->registers[reg].content.integer);
 
-    svm_default_error_handler(cpu, "The register doesn't contain an integer");
+    svm_fault(cpu, SVM_ERROR_TYPE, "The register doesn't contain an integer");
     return 0;
 }
 
 /**
  * Helper to return the number-content of a register.
- *
- * NOTE: This function is not exported outside this compilation-unit.
  */
-float get_float_reg(svm_t *cpu, int reg)
+static float get_float_reg(svm_t *cpu, int reg)
 {
-    if (cpu->registers[reg].type == FLOAT)
+    if (cpu->registers[reg].tag == FLOAT)
         return (cpu->registers[reg].content.number);
 
-    svm_default_error_handler(cpu, "The register doesn't contain an number");
+    svm_fault(cpu, SVM_ERROR_TYPE, "The register doesn't contain an number");
     return 0;
 }
 
 /**
- * Helper to clear the string-content of a register.
+ * Read and return the next byte from the current instruction-pointer.
  *
- * NOTE: This function is not exported outside this compilation-unit.
+ * This function ensures that reading will wrap around the address-space
+ * of the virtual CPU.
  */
-void clear_string_reg(svm_t *cpu, int reg)
+static uint8_t next_byte(svm_t *svm)
 {
-    /* Free the existing string, if present */
-    if ((cpu->registers[reg].type == STRING) && (cpu->registers[reg].content.string))
-        free(cpu->registers[reg].content.string);
+    svm->ip += 1;
+
+    if (svm->ip >= 0xFFFF)
+        svm->ip = 0;
+
+    return (svm->code[svm->ip]);
+}
+
+#if !SVM_VARIANT
+
+
+/**
+ * The literal of the string instruction being run, from the pool, while
+ * its record still has it - the IP is on the register operand.  See
+ * svm_predecode().
+ */
+static char *pooled_literal(svm_t *svm)
+{
+    uint32_t at = svm->ip - 1;
+
+    if (at >= svm->size || svm->insns[at].opcode != INSN_DELEGATE || !svm->insns[at].imm.literal)
+        return NULL;
+
+    return svm->literal_pool + svm->insns[at].imm.literal;
 }
 
 /**
@@ -117,12 +173,22 @@ void clear_string_reg(svm_t *cpu, int reg)
  * the string, and bump the IP as we go.
  *
  * The end result should be we've updated the IP to point past the end
- * of the string, and we've copied it into newly allocated RAM.
+ * of the string, and we've copied it into the machine's string arena -
+ * or found it there already, see svm_string_intern().  Literals the
+ * program hasn't written over are taken from its pool instead, without
+ * reading them at all.
  *
  * NOTE: This function is not exported outside this compilation-unit.
  */
 char *string_from_stack(svm_t *svm)
 {
+    char *literal = pooled_literal(svm);
+    if (literal)
+    {
+        svm->ip += 2 + SVM_STRING_OF(literal)->length;
+        return literal;
+    }
+
     /* the string length */
     uint32_t len1 = next_byte(svm);
     uint32_t len2 = next_byte(svm);
@@ -133,17 +199,23 @@ char *string_from_stack(svm_t *svm)
     /* bump IP one more to point to the start of the string-data. */
     svm->ip += 1;
 
+    /* unless it wraps around the end of RAM, read the string where it is */
+    if (svm->ip + len <= 0xFFFF)
+    {
+        svm->ip += len - 1;
+        return svm_string_make(svm, (const char *)svm->code + svm->ip + 1 - len, len);
+    }
+
     /* allocate enough RAM to contain the string. */
-    char *tmp = (char *)malloc(len + 1);
+    char *tmp = svm_string_alloc(svm, len);
     if (tmp == NULL)
-        svm_default_error_handler(svm, "RAM allocation failure.");
+        return NULL;
 
     /**
-     * Zero the allocated memory, and copy the string-contents over.
+     * Copy the string-contents over.
      *
      * The copy is inefficient - but copes with embedded NULL.
      */
-    memset(tmp, '\0', len + 1);
     for (int i = 0; i < (int)len; i++)
     {
         if (svm->ip >= 0xFFFF)
@@ -154,34 +226,60 @@ char *string_from_stack(svm_t *svm)
     }
 
     svm->ip--;
-    return tmp;
+    return svm_string_intern(svm, tmp);
 }
 
 /**
- * Read and return the next byte from the current instruction-pointer.
+ * Compare a string with the one inline in the program-RAM, read the way
+ * string_from_stack() reads it but without making a copy.
  *
- * This function ensures that reading will wrap around the address-space
- * of the virtual CPU.
+ * NOTE: This function is not exported outside this compilation-unit.
  */
-uint8_t next_byte(svm_t *svm)
+int string_equals_stack(svm_t *svm, const char *str)
 {
+    char *literal = pooled_literal(svm);
+    if (literal)
+    {
+        svm->ip += 2 + SVM_STRING_OF(literal)->length;
+        return svm_string_equal(str, literal);
+    }
+
+    /* the string length */
+    uint32_t len1 = next_byte(svm);
+    uint32_t len2 = next_byte(svm);
+    uint32_t len = BYTES_TO_ADDR(len1, len2);
+
+    /* bump IP one more to point to the start of the string-data. */
     svm->ip += 1;
 
-    if (svm->ip >= 0xFFFF)
-        svm->ip = 0;
+    /* strings of different lengths only need skipping */
+    int equal = SVM_STRING_OF(str)->length == len;
 
-    return (svm->code[svm->ip]);
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (svm->ip >= 0xFFFF)
+            svm->ip = 0;
+
+        if (equal && str[i] != (char)svm->code[svm->ip])
+            equal = 0;
+        svm->ip++;
+    }
+
+    svm->ip--;
+    return equal;
 }
 
+#endif
+
 /**
  ** Start implementation of virtual machine opcodes.
  **
  **/
 
-void op_unknown(svm_t *svm)
+static void op_unknown(svm_t *svm)
 {
     int instruction = svm->code[svm->ip];
-    jsprintf("%04X - op_unknown(%02X)\n", svm->ip, instruction);
+    svm_printf(svm, "%04X - op_unknown(%02X)\n", svm->ip, instruction);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -190,7 +288,7 @@ void op_unknown(svm_t *svm)
 /**
  * Break out of our main intepretter loop.
  */
-void op_exit(struct svm *svm)
+static void op_exit(struct svm *svm)
 {
     svm->running = 0;
 
@@ -201,18 +299,29 @@ void op_exit(struct svm *svm)
 /**
  * No-operation / NOP.
  */
-void op_nop(struct svm *svm)
+static void op_nop(struct svm *svm)
 {
     (void)svm;
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("nop()\n");
+    TRACE(SVM_TRACE_INSTRUCTIONS, "nop()\n");
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
-void op_divide(struct svm *svm)
+/**
+ * Yield - a point where a host stepping the machine with svm_step() gets
+ * control back, elsewhere the same as NOP.
+ */
+static void op_yield(struct svm *svm)
+{
+    TRACE(SVM_TRACE_INSTRUCTIONS, "yield()\n");
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+static void op_divide(struct svm *svm)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
@@ -220,17 +329,13 @@ void op_divide(struct svm *svm)
 
     /* get the source register */
     uint32_t src1 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src1);
 
     /* get the source register */
     uint32_t src2 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("DIV(Register:%d = Register:%d / Register:%d)\n", reg, src1, src2);
-
-    /* if the result-register stores a string .. free it */
-    clear_string_reg(svm, reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "DIV(Register:%d = Register:%d / Register:%d)\n", reg, src1, src2);
 
     /*
      * Ensure both source registers have integer values.
@@ -240,7 +345,7 @@ void op_divide(struct svm *svm)
 
     if (val2 == 0)
     {
-        svm_default_error_handler(svm, "Division by zero!");
+        svm_fault(svm, SVM_ERROR_DIVISION, "Division by zero!");
         return;
     }
 
@@ -248,7 +353,7 @@ void op_divide(struct svm *svm)
      * Store the result.
      */
     svm->registers[reg].content.integer = val1 / val2;
-    svm->registers[reg].type = INTEGER;
+    svm->registers[reg].tag = INTEGER;
 
     /**
      * Zero result?
@@ -265,7 +370,7 @@ void op_divide(struct svm *svm)
 /**
  * Store the contents of one register in another.
  */
-void op_reg_store(struct svm *svm)
+static void op_reg_store(struct svm *svm)
 {
     (void)svm;
 
@@ -277,23 +382,10 @@ void op_reg_store(struct svm *svm)
     uint32_t src = next_byte(svm);
     BOUNDS_TEST_REGISTER(src);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Reg%02x will be set to contents of Reg%02x)\n", dst, src);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Reg%02x will be set to contents of Reg%02x)\n", dst, src);
 
-    /* Free the existing string, if present */
-    clear_string_reg(svm, dst);
-
-    /* if storing a string - then use strdup */
-    if (svm->registers[src].type == STRING)
-    {
-        svm->registers[dst].type = STRING;
-        svm->registers[dst].content.string = strdup(svm->registers[src].content.string);
-    }
-    else
-    {
-        svm->registers[dst].type = svm->registers[src].type;
-        svm->registers[dst].content.integer = svm->registers[src].content.integer;
-    }
+    /* strings are never written once made, so both registers share one */
+    svm->registers[dst] = svm->registers[src];
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -302,7 +394,7 @@ void op_reg_store(struct svm *svm)
 /**
  * Store an integer in a register.
  */
-void op_int_store(struct svm *svm)
+static void op_int_store(struct svm *svm)
 {
     /* get the register number to store in */
     uint32_t reg = next_byte(svm);
@@ -313,14 +405,10 @@ void op_int_store(struct svm *svm)
     uint32_t val2 = next_byte(svm);
     int value = BYTES_TO_ADDR(val1, val2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE_INT(Reg:%02x) => %04d [Hex:%04x]\n", reg, value, value);
-
-    /* if the register stores a string .. free it */
-    clear_string_reg(svm, reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE_INT(Reg:%02x) => %04d [Hex:%04x]\n", reg, value, value);
 
     svm->registers[reg].content.integer = value;
-    svm->registers[reg].type = INTEGER;
+    svm->registers[reg].tag = INTEGER;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -329,22 +417,19 @@ void op_int_store(struct svm *svm)
 /**
  * Print the integer contents of the given register.
  */
-void op_int_print(struct svm *svm)
+static void op_int_print(struct svm *svm)
 {
     /* get the register number to print */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("INT_PRINT(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "INT_PRINT(Register %d)\n", reg);
 
     /* get the register contents. */
     int val = get_int_reg(svm, reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("[STDOUT] Register R%02d => %d [Hex:%04x]\n", reg, val, val);
-    else
-        jsprintf("0x%04X", val);
+    svm_printf(svm, "0x%04X", val);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "[STDOUT] Register R%02d => %d [Hex:%04x]\n", reg, val, val);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -353,25 +438,24 @@ void op_int_print(struct svm *svm)
 /**
  * Convert the integer contents of a register to a string
  */
-void op_int_tostring(struct svm *svm)
+static void op_int_tostring(struct svm *svm)
 {
     /* get the register number to convert */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("INT_TOSTRING(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "INT_TOSTRING(Register %d)\n", reg);
 
     /* get the contents of the register */
     int cur = get_int_reg(svm, reg);
 
-    /* allocate a buffer. */
-    svm->registers[reg].type = STRING;
-    svm->registers[reg].content.string = malloc(10);
-
-    /* store the string-value */
-    memset(svm->registers[reg].content.string, '\0', 10);
-    sprintf(svm->registers[reg].content.string, "%d", cur);
+    /* format it, then make the string-value */
+    char buffer[64];
+    int len = snprintf(buffer, sizeof(buffer), "%d", cur);
+    char *str = svm_string_make(svm, buffer, len);
+    if (str == NULL)
+        return;
+    svm_set_string(&svm->registers[reg], str);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -380,23 +464,24 @@ void op_int_tostring(struct svm *svm)
 /**
  * Generate a random integer and store in the specified register.
  */
-void op_int_random(struct svm *svm)
+static void op_int_random(struct svm *svm)
 {
     /* get the register to save the output to */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("INT_RANDOM(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "INT_RANDOM(Register %d)\n", reg);
 
-    /**
-     * If we already have a string in the register delete it.
-     */
-    clear_string_reg(svm, reg);
+    /* xorshift32, on the machine's own state */
+    uint32_t x = svm->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    svm->random = x;
 
     /* set the value. */
-    svm->registers[reg].type = INTEGER;
-    svm->registers[reg].content.integer = rand() % 0xFFFF;
+    svm->registers[reg].tag = INTEGER;
+    svm->registers[reg].content.integer = x % 0xFFFF;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -405,7 +490,7 @@ void op_int_random(struct svm *svm)
 /**
  * Store an integer in a register.
  */
-void op_float_store(struct svm *svm)
+static void op_float_store(struct svm *svm)
 {
     /* get the register number to store in */
     uint32_t reg = next_byte(svm);
@@ -421,14 +506,10 @@ void op_float_store(struct svm *svm)
 
     float value = ldexp((float)mant / 65535, exp);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE_FLOAT(Reg:%02x) => %04f [Hex:%04x]\n", reg, value, *(int *)(&value));
-
-    /* if the register stores a string .. free it */
-    clear_string_reg(svm, reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE_FLOAT(Reg:%02x) => %04f [Hex:%04x]\n", reg, value, *(int *)(&value));
 
     svm->registers[reg].content.number = value;
-    svm->registers[reg].type = FLOAT;
+    svm->registers[reg].tag = FLOAT;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -437,22 +518,19 @@ void op_float_store(struct svm *svm)
 /**
  * Print the integer contents of the given register.
  */
-void op_float_print(struct svm *svm)
+static void op_float_print(struct svm *svm)
 {
     /* get the register number to print */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("FLOAT_PRINT(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "FLOAT_PRINT(Register %d)\n", reg);
 
     /* get the register contents. */
     float val = get_float_reg(svm, reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("[STDOUT] Register R%02d => %f [Hex:%04x]\n", reg, val, *(int *)(&val));
-    else
-        jsprintf("%04f", val);
+    svm_printf(svm, "%04f", val);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "[STDOUT] Register R%02d => %f [Hex:%04x]\n", reg, val, *(int *)(&val));
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -461,25 +539,24 @@ void op_float_print(struct svm *svm)
 /**
  * Convert the integer contents of a register to a string
  */
-void op_float_tostring(struct svm *svm)
+static void op_float_tostring(struct svm *svm)
 {
     /* get the register number to convert */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("FLOAT_TOSTRING(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "FLOAT_TOSTRING(Register %d)\n", reg);
 
     /* get the contents of the register */
     float cur = get_float_reg(svm, reg);
 
-    /* allocate a buffer. */
-    svm->registers[reg].type = STRING;
-    svm->registers[reg].content.string = malloc(10);
-
-    /* store the string-value */
-    memset(svm->registers[reg].content.string, '\0', 10);
-    sprintf(svm->registers[reg].content.string, "%f", cur);
+    /* format it, then make the string-value */
+    char buffer[64];
+    int len = snprintf(buffer, sizeof(buffer), "%f", cur);
+    char *str = svm_string_make(svm, buffer, len);
+    if (str == NULL)
+        return;
+    svm_set_string(&svm->registers[reg], str);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -488,7 +565,7 @@ void op_float_tostring(struct svm *svm)
 /**
  * Store a string in a register.
  */
-void op_string_store(struct svm *svm)
+static void op_string_store(struct svm *svm)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
@@ -496,20 +573,15 @@ void op_string_store(struct svm *svm)
 
     /* get the string to store */
     char *str = string_from_stack(svm);
-
-    /**
-     * If we already have a string in the register delete it.
-     */
-    clear_string_reg(svm, reg);
+    if (str == NULL)
+        return;
 
     /**
      * Now store the new string.
      */
-    svm->registers[reg].type = STRING;
-    svm->registers[reg].content.string = str;
+    svm_set_string(&svm->registers[reg], str);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STRING_STORE(Register %d) = '%s'\n", reg, str);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STRING_STORE(Register %d) = '%s'\n", reg, str);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -518,23 +590,22 @@ void op_string_store(struct svm *svm)
 /**
  * Print the (string) contents of a register.
  */
-void op_string_print(struct svm *svm)
+static void op_string_print(struct svm *svm)
 {
     /* get the reg number to print */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STRING_PRINT(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STRING_PRINT(Register %d)\n", reg);
 
     /* get the contents of the register */
     char *str = get_string_reg(svm, reg);
+    if (str == NULL)
+        return;
 
     /* print */
-    if (getenv("DEBUG") != NULL)
-        jsprintf("[stdout] register R%02d => %s\n", reg, str);
-    else
-        jsprintf("%s", str);
+    svm_printf(svm, "%s", str);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "[stdout] register R%02d => %s\n", reg, str);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -543,7 +614,7 @@ void op_string_print(struct svm *svm)
 /**
  * Concatenate two strings, and store the result.
  */
-void op_string_concat(struct svm *svm)
+static void op_string_concat(struct svm *svm)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
@@ -551,43 +622,41 @@ void op_string_concat(struct svm *svm)
 
     /* get the source register */
     uint32_t src1 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src1);
 
     /* get the source register */
     uint32_t src2 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STRING_CONCAT(Register:%d = Register:%d + Register:%d)\n",
-               reg, src1, src2);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STRING_CONCAT(Register:%d = Register:%d + Register:%d)\n",
+          reg, src1, src2);
 
     /*
      * Ensure both source registers have string values.
      */
     char *str1 = get_string_reg(svm, src1);
+    if (str1 == NULL)
+        return;
     char *str2 = get_string_reg(svm, src2);
+    if (str2 == NULL)
+        return;
 
     /**
      * Allocate RAM for two strings.
      */
-    int len = strlen(str1) + strlen(str2) + 1;
-
-    /**
-     * Zero.
-     */
-    char *tmp = malloc(len);
-    memset(tmp, '\0', len);
+    uint32_t len1 = SVM_STRING_OF(str1)->length;
+    uint32_t len2 = SVM_STRING_OF(str2)->length;
+    char *tmp = svm_string_alloc(svm, len1 + len2);
+    if (tmp == NULL)
+        return;
 
     /**
      * Assign.
      */
-    sprintf(tmp, "%s%s", str1, str2);
-
-    /* if the destination-register currently contains a string .. free it */
-    clear_string_reg(svm, reg);
+    memcpy(tmp, str1, len1);
+    memcpy(tmp + len1, str2, len2);
 
-    svm->registers[reg].content.string = tmp;
-    svm->registers[reg].type = STRING;
+    svm_set_string(&svm->registers[reg], svm_string_intern(svm, tmp));
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -596,24 +665,28 @@ void op_string_concat(struct svm *svm)
 /**
  * Invoke the C system() function against a string register.
  */
-void op_string_system(struct svm *svm)
+static void op_string_system(struct svm *svm)
 {
     /* get the reg */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STRING_SYSTEM(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STRING_SYSTEM(Register %d)\n", reg);
 
     /* Get the value we're to execute */
     char *str = get_string_reg(svm, reg);
+    if (str == NULL)
+        return;
 
     if (getenv("FUZZ") != NULL)
     {
-        jsprintf("Fuzzing - skipping execution of: %s\n", str);
+        svm_printf(svm, "Fuzzing - skipping execution of: %s\n", str);
         return;
     }
 
+    /* what the program printed comes before what the command does */
+    svm_flush_output(svm);
+
     int result = 0;
     result = system(str);
 
@@ -624,24 +697,22 @@ void op_string_system(struct svm *svm)
 /**
  * Convert a string to an int.
  */
-void op_string_toint(struct svm *svm)
+static void op_string_toint(struct svm *svm)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STRING_TOINT(Register:%d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STRING_TOINT(Register:%d)\n", reg);
 
     /* get the string and convert to integer */
     char *str = get_string_reg(svm, reg);
+    if (str == NULL)
+        return;
     int i = atoi(str);
 
-    /* free the old version */
-    free(svm->registers[reg].content.string);
-
     /* set the int. */
-    svm->registers[reg].type = INTEGER;
+    svm->registers[reg].tag = INTEGER;
     svm->registers[reg].content.integer = i;
 
     /* handle the next instruction */
@@ -651,7 +722,7 @@ void op_string_toint(struct svm *svm)
 /**
  * Unconditional jump
  */
-void op_jump_to(struct svm *svm)
+static void op_jump_to(struct svm *svm)
 {
     /**
      * Read the two bytes which will build up the destination
@@ -664,8 +735,7 @@ void op_jump_to(struct svm *svm)
      */
     int offset = BYTES_TO_ADDR(off1, off2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("JUMP_TO(Offset:%d [Hex:%04X]\n", offset, offset);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "JUMP_TO(Offset:%d [Hex:%04X]\n", offset, offset);
 
     svm->ip = offset;
 }
@@ -673,7 +743,7 @@ void op_jump_to(struct svm *svm)
 /**
  * Jump to the given address if the Z-flag is set.
  */
-void op_jump_z(struct svm *svm)
+static void op_jump_z(struct svm *svm)
 {
     /**
      * Read the two bytes which will build up the destination
@@ -686,8 +756,7 @@ void op_jump_z(struct svm *svm)
      */
     int offset = BYTES_TO_ADDR(off1, off2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("JUMP_Z(Offset:%d [Hex:%04X]\n", offset, offset);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "JUMP_Z(Offset:%d [Hex:%04X]\n", offset, offset);
 
     if (svm->jmp)
     {
@@ -703,7 +772,7 @@ void op_jump_z(struct svm *svm)
 /**
  * Jump to the given address if the Z flag is NOT set.
  */
-void op_jump_nz(struct svm *svm)
+static void op_jump_nz(struct svm *svm)
 {
     /**
      * Read the two bytes which will build up the destination
@@ -716,8 +785,7 @@ void op_jump_nz(struct svm *svm)
      */
     int offset = BYTES_TO_ADDR(off1, off2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("JUMP_NZ(Offset:%d [Hex:%04X]\n", offset, offset);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "JUMP_NZ(Offset:%d [Hex:%04X]\n", offset, offset);
 
     if (!svm->jmp)
     {
@@ -730,93 +798,97 @@ void op_jump_nz(struct svm *svm)
     }
 }
 
+#if !SVM_VARIANT
+
 void reg_add(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
 {
-    if (svm->registers[lhs].type == FLOAT || svm->registers[rhs].type == FLOAT)
+    if (svm->registers[lhs].tag == FLOAT || svm->registers[rhs].tag == FLOAT)
     {
         svm->registers[out].content.number =
-            (svm->registers[lhs].type == FLOAT ? get_float_reg(svm, lhs) : get_int_reg(svm, lhs)) + (svm->registers[rhs].type == FLOAT ? get_float_reg(svm, rhs) : get_int_reg(svm, rhs));
-        svm->registers[out].type = FLOAT;
+            (svm->registers[lhs].tag == FLOAT ? get_float_reg(svm, lhs) : get_int_reg(svm, lhs)) + (svm->registers[rhs].tag == FLOAT ? get_float_reg(svm, rhs) : get_int_reg(svm, rhs));
+        svm->registers[out].tag = FLOAT;
     }
     else
     {
-        svm->registers[out].type = INTEGER;
+        svm->registers[out].tag = INTEGER;
         svm->registers[out].content.integer = get_int_reg(svm, lhs) + get_int_reg(svm, rhs);
     }
 }
 
 void reg_and(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
 {
-    if (svm->registers[lhs].type == FLOAT || svm->registers[rhs].type == FLOAT)
+    if (svm->registers[lhs].tag == FLOAT || svm->registers[rhs].tag == FLOAT)
     {
         svm->registers[out].content.number = svm->registers[lhs].content.integer & svm->registers[rhs].content.integer;
-        svm->registers[out].type = FLOAT;
+        svm->registers[out].tag = FLOAT;
     }
     else
     {
-        svm->registers[out].type = INTEGER;
+        svm->registers[out].tag = INTEGER;
         svm->registers[out].content.integer = get_int_reg(svm, lhs) & get_int_reg(svm, rhs);
     }
 }
 
 void reg_sub(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
 {
-    if (svm->registers[lhs].type == FLOAT || svm->registers[rhs].type == FLOAT)
+    if (svm->registers[lhs].tag == FLOAT || svm->registers[rhs].tag == FLOAT)
     {
         svm->registers[out].content.number =
-            (svm->registers[lhs].type == FLOAT ? get_float_reg(svm, lhs) : get_int_reg(svm, lhs)) - (svm->registers[rhs].type == FLOAT ? get_float_reg(svm, rhs) : get_int_reg(svm, rhs));
-        svm->registers[out].type = FLOAT;
+            (svm->registers[lhs].tag == FLOAT ? get_float_reg(svm, lhs) : get_int_reg(svm, lhs)) - (svm->registers[rhs].tag == FLOAT ? get_float_reg(svm, rhs) : get_int_reg(svm, rhs));
+        svm->registers[out].tag = FLOAT;
     }
     else
     {
-        svm->registers[out].type = INTEGER;
+        svm->registers[out].tag = INTEGER;
         svm->registers[out].content.integer = get_int_reg(svm, lhs) - get_int_reg(svm, rhs);
     }
 }
 
 void reg_mul(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
 {
-    if (svm->registers[lhs].type == FLOAT || svm->registers[rhs].type == FLOAT)
+    if (svm->registers[lhs].tag == FLOAT || svm->registers[rhs].tag == FLOAT)
     {
         svm->registers[out].content.number =
-            (svm->registers[lhs].type == FLOAT ? get_float_reg(svm, lhs) : get_int_reg(svm, lhs)) * (svm->registers[rhs].type == FLOAT ? get_float_reg(svm, rhs) : get_int_reg(svm, rhs));
-        svm->registers[out].type = FLOAT;
+            (svm->registers[lhs].tag == FLOAT ? get_float_reg(svm, lhs) : get_int_reg(svm, lhs)) * (svm->registers[rhs].tag == FLOAT ? get_float_reg(svm, rhs) : get_int_reg(svm, rhs));
+        svm->registers[out].tag = FLOAT;
     }
     else
     {
-        svm->registers[out].type = INTEGER;
+        svm->registers[out].tag = INTEGER;
         svm->registers[out].content.integer = get_int_reg(svm, lhs) * get_int_reg(svm, rhs);
     }
 }
 
 void reg_xor(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
 {
-    if (svm->registers[lhs].type == FLOAT || svm->registers[rhs].type == FLOAT)
+    if (svm->registers[lhs].tag == FLOAT || svm->registers[rhs].tag == FLOAT)
     {
         svm->registers[out].content.number = svm->registers[lhs].content.integer ^ svm->registers[rhs].content.integer;
-        svm->registers[out].type = FLOAT;
+        svm->registers[out].tag = FLOAT;
     }
     else
     {
-        svm->registers[out].type = INTEGER;
+        svm->registers[out].tag = INTEGER;
         svm->registers[out].content.integer = get_int_reg(svm, lhs) ^ get_int_reg(svm, rhs);
     }
 }
 
 void reg_or(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
 {
-    if (svm->registers[lhs].type == FLOAT || svm->registers[rhs].type == FLOAT)
+    if (svm->registers[lhs].tag == FLOAT || svm->registers[rhs].tag == FLOAT)
     {
         svm->registers[out].content.number = svm->registers[lhs].content.integer | svm->registers[rhs].content.integer;
-        svm->registers[out].type = FLOAT;
+        svm->registers[out].tag = FLOAT;
     }
     else
     {
-        svm->registers[out].type = INTEGER;
+        svm->registers[out].tag = INTEGER;
         svm->registers[out].content.integer = get_int_reg(svm, lhs) | get_int_reg(svm, rhs);
     }
 }
 
+#endif
+
 /**
  * This is a macro definition for a "math" operation.
  *
@@ -824,7 +896,7 @@ void reg_or(struct svm *svm, uint8_t out, uint8_t lhs, uint8_t rhs)
  * all the typing and redundency defining: add, sub, div, mod, xor, or.
  *
  */
-void math_operation(struct svm *svm, void (*operator)(struct svm *, uint8_t, uint8_t, uint8_t), const char *ope)
+static void math_operation(struct svm *svm, void (*operator)(struct svm *, uint8_t, uint8_t, uint8_t), const char *ope)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
@@ -832,17 +904,13 @@ void math_operation(struct svm *svm, void (*operator)(struct svm *, uint8_t, uin
 
     /* get the source register */
     uint32_t src1 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src1);
 
     /* get the source register */
     uint32_t src2 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("(Register:%d = Register:%d %s Register:%d)\n", reg, src1, ope, src2);
-
-    /* if the result-register stores a string .. free it */
-    clear_string_reg(svm, reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "(Register:%d = Register:%d %s Register:%d)\n", reg, src1, ope, src2);
 
     /*
      * Ensure both source registers have integer values.
@@ -861,37 +929,37 @@ void math_operation(struct svm *svm, void (*operator)(struct svm *, uint8_t, uin
     svm->ip += 1;
 }
 
-void op_add(struct svm *in)
+static void op_add(struct svm *in)
 {
     // reg_result = reg1 + reg2 ;
     math_operation(in, reg_add, "add");
 }
 
-void op_and(struct svm *in)
+static void op_and(struct svm *in)
 {
     // reg_result = reg1 & reg2 ;
     math_operation(in, reg_and, "and");
 }
 
-void op_sub(struct svm *in)
+static void op_sub(struct svm *in)
 {
     // reg_result = reg1 - reg2 ;
     math_operation(in, reg_sub, "sub");
 }
 
-void op_mul(struct svm *in)
+static void op_mul(struct svm *in)
 {
     // reg_result = reg1 * reg2 ;
     math_operation(in, reg_mul, "mul");
 }
 
-void op_xor(struct svm *in)
+static void op_xor(struct svm *in)
 {
     // reg_result = reg1 ^ reg2 ;
     math_operation(in, reg_xor, "xor");
 }
 
-void op_or(struct svm *in)
+static void op_or(struct svm *in)
 {
     // reg_result = reg1 | reg2 ;
     math_operation(in, reg_or, "or");
@@ -900,14 +968,13 @@ void op_or(struct svm *in)
 /**
  * Increment the given (integer) register.
  */
-void op_inc(struct svm *svm)
+static void op_inc(struct svm *svm)
 {
     /* get the register number to increment */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("INC_OP(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "INC_OP(Register %d)\n", reg);
 
     /* get, incr, set */
     int cur = get_int_reg(svm, reg);
@@ -926,14 +993,13 @@ void op_inc(struct svm *svm)
 /**
  * Decrement the given (integer) register.
  */
-void op_dec(struct svm *svm)
+static void op_dec(struct svm *svm)
 {
     /* get the register number to decrement */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("DEC_OP(Register %d)\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "DEC_OP(Register %d)\n", reg);
 
     /* get, decr, set */
     int cur = get_int_reg(svm, reg);
@@ -952,7 +1018,7 @@ void op_dec(struct svm *svm)
 /**
  * Compare two registers.  Set the Z-flag if equal.
  */
-void op_cmp_reg(struct svm *svm)
+static void op_cmp_reg(struct svm *svm)
 {
     /* get the source register */
     uint32_t reg1 = next_byte(svm);
@@ -962,17 +1028,16 @@ void op_cmp_reg(struct svm *svm)
     uint32_t reg2 = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("CMP(Register:%d vs Register:%d)\n", reg1, reg2);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "CMP(Register:%d vs Register:%d)\n", reg1, reg2);
 
     svm->jmp = 0;
 
-    if (svm->registers[reg1].type == svm->registers[reg2].type)
+    if (SVM_TYPE(svm->registers[reg1]) == SVM_TYPE(svm->registers[reg2]))
     {
-        if (svm->registers[reg1].type == STRING)
+        if (SVM_IS_STRING(svm->registers[reg1]))
         {
-            if (strcmp(svm->registers[reg1].content.string,
-                       svm->registers[reg2].content.string) == 0)
+            if (svm_string_equal(SVM_STRING(svm->registers[reg1]),
+                                 SVM_STRING(svm->registers[reg2])))
                 svm->jmp = 1;
         }
         else
@@ -990,7 +1055,7 @@ void op_cmp_reg(struct svm *svm)
 /**
  * Compare a register contents with a constant integer.
  */
-void op_cmp_immediate(struct svm *svm)
+static void op_cmp_immediate(struct svm *svm)
 {
     /* get the source register */
     uint32_t reg = next_byte(svm);
@@ -1001,8 +1066,7 @@ void op_cmp_immediate(struct svm *svm)
     uint32_t val2 = next_byte(svm);
     int val = BYTES_TO_ADDR(val1, val2);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("CMP_IMMEDIATE(Register:%d vs %d [Hex:%04X])\n", reg, val, val);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "CMP_IMMEDIATE(Register:%d vs %d [Hex:%04X])\n", reg, val, val);
 
     svm->jmp = 0;
 
@@ -1018,23 +1082,21 @@ void op_cmp_immediate(struct svm *svm)
 /**
  * Compare a register contents with the given string.
  */
-void op_cmp_string(struct svm *svm)
+static void op_cmp_string(struct svm *svm)
 {
     /* get the source register */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    /* Now we get the string to compare against from the stack */
-    char *str = string_from_stack(svm);
-
     /* get the string content from the register */
     char *cur = get_string_reg(svm, reg);
+    if (cur == NULL)
+        return;
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("Comparing register-%d ('%s') - with string '%s'\n", reg, cur, str);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "Comparing register-%d ('%s') - with string at %04X\n", reg, cur, svm->ip + 1);
 
-    /* compare */
-    if (strcmp(cur, str) == 0)
+    /* compare against the string on the stack, where it is */
+    if (string_equals_stack(svm, cur))
         svm->jmp = 1;
     else
         svm->jmp = 0;
@@ -1046,16 +1108,15 @@ void op_cmp_string(struct svm *svm)
 /**
  * Does the given register contain a string?  Set the Z-flag if so.
  */
-void op_is_string(struct svm *svm)
+static void op_is_string(struct svm *svm)
 {
     /* get the register to test */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("is register %02X a string?\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "is register %02X a string?\n", reg);
 
-    if (svm->registers[reg].type == STRING)
+    if (SVM_IS_STRING(svm->registers[reg]))
         svm->jmp = 1;
     else
         svm->jmp = 0;
@@ -1067,16 +1128,15 @@ void op_is_string(struct svm *svm)
 /**
  * Does the given register contain an integer?  Set the Z-flag if so.
  */
-void op_is_integer(struct svm *svm)
+static void op_is_integer(struct svm *svm)
 {
     /* get the register to test */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("is register %02X an integer?\n", reg);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "is register %02X an integer?\n", reg);
 
-    if (svm->registers[reg].type == INTEGER)
+    if (svm->registers[reg].tag == INTEGER)
         svm->jmp = 1;
     else
         svm->jmp = 0;
@@ -1088,7 +1148,7 @@ void op_is_integer(struct svm *svm)
 /**
  * Read from a given address into the specified register.
  */
-void op_peek(struct svm *svm)
+static void op_peek(struct svm *svm)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
@@ -1098,23 +1158,22 @@ void op_peek(struct svm *svm)
     uint32_t addr = next_byte(svm);
     BOUNDS_TEST_REGISTER(addr);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("LOAD_FROM_RAM(Register:%d will contain contents of address %04X)\n",
-               reg, addr);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "LOAD_FROM_RAM(Register:%d will contain contents of address %04X)\n",
+          reg, addr);
 
     /* get the address from the register */
     int adr = get_int_reg(svm, addr);
-    if (adr < 0 || adr > 0xffff)
-        svm_default_error_handler(svm, "Reading from outside RAM");
+    if (adr < 0 || adr >= 0xffff)
+    {
+        svm_fault(svm, SVM_ERROR_MEMORY, "Reading from outside RAM");
+        return;
+    }
 
     /* Read the value from RAM */
     int val = svm->code[adr];
 
-    /* if the destination currently contains a string .. free it */
-    clear_string_reg(svm, reg);
-
     svm->registers[reg].content.integer = val;
-    svm->registers[reg].type = INTEGER;
+    svm->registers[reg].tag = INTEGER;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1123,7 +1182,7 @@ void op_peek(struct svm *svm)
 /**
  * Write a register-contents to memory.
  */
-void op_poke(struct svm *svm)
+static void op_poke(struct svm *svm)
 {
     /* get the destination register */
     uint32_t reg = next_byte(svm);
@@ -1139,23 +1198,137 @@ void op_poke(struct svm *svm)
     /* Get the address we're to store it in. */
     int adr = get_int_reg(svm, addr);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE_IN_RAM(Address %04X set to %02X)\n", adr, val);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE_IN_RAM(Address %04X set to %02X)\n", adr, val);
 
-    if (adr < 0 || adr > 0xffff)
-        svm_default_error_handler(svm, "Writing outside RAM");
+    if (adr < 0 || adr >= 0xffff)
+    {
+        svm_fault(svm, SVM_ERROR_MEMORY, "Writing outside RAM");
+        return;
+    }
 
     /* do the necessary */
     svm->code[adr] = val;
+    svm_invalidate(svm, adr, 1);
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
+/**
+ * Addresses wrap around at the end of the RAM.
+ */
+#define RAM_WRAP(adr) ((adr) >= 0xFFFF ? (adr) - 0xFFFF : (adr))
+
+/**
+ * The bytes from `adr` which can be handled in one go, at most `size` and
+ * not past the end of the RAM.
+ */
+#define RAM_RUN(adr, size) ((size) < 0xFFFF - (adr) ? (size) : 0xFFFF - (adr))
+
+/**
+ * The address and size operands of the memory operations.  Addresses
+ * beyond the RAM wrap around, negative ones fault - the caller returns
+ * when `faulted` is set; sizes are capped to the whole RAM, negative ones
+ * are empty.
+ */
+static uint32_t ram_address(struct svm *svm, uint32_t reg, const char *msg)
+{
+    int adr = get_int_reg(svm, reg);
+
+    if (adr < 0)
+        svm_fault(svm, SVM_ERROR_MEMORY, msg);
+
+    return (uint32_t)adr % 0xFFFF;
+}
+
+static uint32_t ram_size(struct svm *svm, uint32_t reg)
+{
+    int size = get_int_reg(svm, reg);
+
+    if (size < 0)
+        return 0;
+    return size < 0xFFFF ? (uint32_t)size : 0xFFFF;
+}
+
+/**
+ * Copy `size` bytes within the RAM the way memmove() would, in runs which
+ * don't cross its end: from the first byte when the destination doesn't
+ * start inside the source, from the last byte when the source doesn't
+ * start inside the destination, or else - the two overlap at both ends,
+ * which takes over half the RAM - through `scratch`.
+ */
+static void ram_move(struct svm *svm, uint32_t dest, uint32_t src, uint32_t size)
+{
+    uint32_t ahead = RAM_WRAP(dest + 0xFFFF - src);
+    uint32_t n;
+
+    if (ahead == 0 || size == 0)
+        return;
+
+    if (ahead >= size)
+    {
+        for (; size; size -= n)
+        {
+            n = RAM_RUN(dest, RAM_RUN(src, size));
+            TRACE(SVM_TRACE_DETAIL, "\tCopying %4x bytes from %04x to %04X\n", n, src, dest);
+
+            memmove(svm->code + dest, svm->code + src, n);
+            svm_invalidate(svm, dest, n);
+            src = RAM_WRAP(src + n);
+            dest = RAM_WRAP(dest + n);
+        }
+    }
+    else if (0xFFFF - ahead >= size)
+    {
+        for (; size; size -= n)
+        {
+            uint32_t src_end = RAM_WRAP(src + size - 1) + 1;
+            uint32_t dest_end = RAM_WRAP(dest + size - 1) + 1;
+
+            n = size < src_end ? size : src_end;
+            n = n < dest_end ? n : dest_end;
+            TRACE(SVM_TRACE_DETAIL, "\tCopying %4x bytes from %04x to %04X\n", n, src_end - n, dest_end - n);
+
+            memmove(svm->code + dest_end - n, svm->code + src_end - n, n);
+            svm_invalidate(svm, dest_end - n, n);
+        }
+    }
+    else
+    {
+        if (!svm->scratch)
+            svm->scratch = malloc(0xFFFF);
+        if (!svm->scratch)
+        {
+            svm_fault(svm, SVM_ERROR_ALLOCATION, "RAM allocation failure.");
+            return;
+        }
+
+        for (uint32_t done = 0; done < size; done += n)
+        {
+            n = RAM_RUN(src, size - done);
+            memcpy(svm->scratch + done, svm->code + src, n);
+            src = RAM_WRAP(src + n);
+        }
+        for (uint32_t done = 0; done < size; done += n)
+        {
+            n = RAM_RUN(dest, size - done);
+            TRACE(SVM_TRACE_DETAIL, "\tCopying %4x bytes through scratch to %04X\n", n, dest);
+
+            memcpy(svm->code + dest, svm->scratch + done, n);
+            svm_invalidate(svm, dest, n);
+            dest = RAM_WRAP(dest + n);
+        }
+    }
+}
+
 /**
  * Copy a chunk of memory.
+ *
+ * Overlapping chunks are copied as memmove() would, and a chunk which
+ * runs past the end of the RAM wraps around to its start - so copying
+ * 0x00FF bytes from 0xFFFE will actually wrap around to 0x00FE.
  */
-void op_memcpy(struct svm *svm)
+static void op_memcpy(struct svm *svm)
 {
     /* get the register number to store to */
     uint32_t dest_reg = next_byte(svm);
@@ -1172,44 +1345,141 @@ void op_memcpy(struct svm *svm)
     /**
      * Now handle the copy.
      */
-    int src = get_int_reg(svm, src_reg);
-    int dest = get_int_reg(svm, dest_reg);
-    int size = get_int_reg(svm, size_reg);
+    uint32_t src = ram_address(svm, src_reg, "cannot copy to/from negative addresses");
+    uint32_t dest = ram_address(svm, dest_reg, "cannot copy to/from negative addresses");
+    uint32_t size = ram_size(svm, size_reg);
+    if (svm->faulted)
+        return;
 
-    if ((src < 0) || (dest < 0))
-    {
-        svm_default_error_handler(svm, "cannot copy to/from negative addresses");
+    TRACE(SVM_TRACE_INSTRUCTIONS, "Copying %4x bytes from %04x to %04X\n", size, src, dest);
+
+    ram_move(svm, dest, src, size);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+/**
+ * Fill a chunk of memory with the low byte of a register.
+ */
+static void op_memset(struct svm *svm)
+{
+    /* get the register number to store to */
+    uint32_t dest_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(dest_reg);
+
+    /* get the register number with the value */
+    uint32_t val_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(val_reg);
+
+    /* get the register number with the size */
+    uint32_t size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint32_t dest = ram_address(svm, dest_reg, "cannot fill negative addresses");
+    int val = get_int_reg(svm, val_reg);
+    uint32_t size = ram_size(svm, size_reg);
+    if (svm->faulted)
         return;
-    }
+    uint32_t n;
+
+    TRACE(SVM_TRACE_INSTRUCTIONS, "Filling %4x bytes at %04X with %02X\n", size, dest, val & 0xFF);
 
-    if (getenv("DEBUG") != NULL)
+    for (; size; size -= n)
     {
-        jsprintf("Copying %4x bytes from %04x to %04X\n", size, src, dest);
+        n = RAM_RUN(dest, size);
+        memset(svm->code + dest, val, n);
+        svm_invalidate(svm, dest, n);
+        dest = RAM_WRAP(dest + n);
     }
 
-    /** Slow, but copes with nulls and allows debugging. */
-    for (int i = 0; i < size; i++)
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+/**
+ * Compare two chunks of memory, setting the Z-flag when they are equal.
+ */
+static void op_memcmp(struct svm *svm)
+{
+    /* get the register numbers with the two addresses */
+    uint32_t lhs_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(lhs_reg);
+
+    uint32_t rhs_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(rhs_reg);
+
+    /* get the register number with the size */
+    uint32_t size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint32_t lhs = ram_address(svm, lhs_reg, "cannot compare negative addresses");
+    uint32_t rhs = ram_address(svm, rhs_reg, "cannot compare negative addresses");
+    uint32_t size = ram_size(svm, size_reg);
+    if (svm->faulted)
+        return;
+    uint32_t n;
+
+    TRACE(SVM_TRACE_INSTRUCTIONS, "Comparing %4x bytes at %04x with %04X\n", size, lhs, rhs);
+
+    svm->jmp = 1;
+    for (; size; size -= n)
     {
-        int sc = src + i;
-        int dt = dest + i;
-
-        /*
-         * Handle wrap-around.
-         *
-         * So copying 0x00FF bytes from 0xFFFE will actually
-         * wrap around to 0x00FE.
-         */
-        while (sc >= 0xFFFF)
-            sc -= 0xFFFF;
-        while (dt >= 0xFFFF)
-            dt -= 0xFFFF;
-
-        if (getenv("DEBUG") != NULL)
+        n = RAM_RUN(lhs, RAM_RUN(rhs, size));
+        if (memcmp(svm->code + lhs, svm->code + rhs, n) != 0)
         {
-            jsprintf("\tCopying from: %04x Copying-to %04X\n", sc, dt);
+            svm->jmp = 0;
+            break;
         }
+        lhs = RAM_WRAP(lhs + n);
+        rhs = RAM_WRAP(rhs + n);
+    }
 
-        svm->code[dt] = svm->code[sc];
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+/**
+ * Find the low byte of a register in a chunk of memory.  When it is there
+ * the Z-flag is set and the address register moved to it, otherwise the
+ * flag is cleared and the register left alone.
+ */
+static void op_memfind(struct svm *svm)
+{
+    /* get the register number with the address, and the result */
+    uint32_t adr_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(adr_reg);
+
+    /* get the register number with the value */
+    uint32_t val_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(val_reg);
+
+    /* get the register number with the size */
+    uint32_t size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint32_t adr = ram_address(svm, adr_reg, "cannot search negative addresses");
+    int val = get_int_reg(svm, val_reg);
+    uint32_t size = ram_size(svm, size_reg);
+    if (svm->faulted)
+        return;
+    uint32_t n;
+
+    TRACE(SVM_TRACE_INSTRUCTIONS, "Finding %02X in %4x bytes at %04X\n", val & 0xFF, size, adr);
+
+    svm->jmp = 0;
+    for (; size; size -= n)
+    {
+        n = RAM_RUN(adr, size);
+
+        unsigned char *found = memchr(svm->code + adr, val & 0xFF, n);
+        if (found)
+        {
+            svm->registers[adr_reg].content.integer = found - svm->code;
+            svm->jmp = 1;
+            break;
+        }
+        adr = RAM_WRAP(adr + n);
     }
 
     /* handle the next instruction */
@@ -1219,40 +1489,40 @@ void op_memcpy(struct svm *svm)
 /**
  * Push the contents of a given register onto the stack.
  */
-void op_stack_push(struct svm *svm)
+static void op_stack_push(struct svm *svm)
 {
     /* get the register to push */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    /* Get the value we're to store. */
+    /* Get the value we're to store, strings are shared with the register. */
     struct reg_t val = svm->registers[reg];
-    if (svm->registers[reg].type == STRING)
-    {
-        val.content.string = strdup(svm->registers[reg].content.string);
-    }
 
-    if (getenv("DEBUG") != NULL)
+#if SVM_TRACED
+    if (val.tag == INTEGER)
+        TRACE(SVM_TRACE_INSTRUCTIONS, "PUSH(Register %d integer[=%04x])\n", reg, val.content.integer);
+    if (val.tag == FLOAT)
+        TRACE(SVM_TRACE_INSTRUCTIONS, "PUSH(Register %d number[=%f])\n", reg, val.content.number);
+    if (SVM_IS_STRING(val))
+        TRACE(SVM_TRACE_INSTRUCTIONS, "PUSH(Register %d string[=%s])\n", reg, SVM_STRING(val));
+#endif
+
+    /**
+     * Ensure the stack won't overflow.
+     */
+#if !SVM_VERIFIED
+    int sp_size = sizeof(svm->stack) / sizeof(svm->stack[0]);
+    if (svm->SP + 1 >= sp_size)
     {
-        if (val.type == INTEGER)
-            jsprintf("PUSH(Register %d integer[=%04x])\n", reg, val.content.integer);
-        if (val.type == FLOAT)
-            jsprintf("PUSH(Register %d number[=%f])\n", reg, val.content.number);
-        if (val.type == STRING)
-            jsprintf("PUSH(Register %d string[=%s])\n", reg, val.content.string);
+        svm_fault(svm, SVM_ERROR_STACK, "stack overflow - stack is full");
+        return;
     }
+#endif
 
     /* store it */
     svm->SP += 1;
     svm->stack[svm->SP] = val;
 
-    /**
-     * Ensure the stack hasn't overflown.
-     */
-    int sp_size = sizeof(svm->stack) / sizeof(svm->stack[0]);
-    if (svm->SP >= sp_size)
-        svm_default_error_handler(svm, "stack overflow - stack is full");
-
     /* handle the next instruction */
     svm->ip += 1;
 }
@@ -1260,32 +1530,33 @@ void op_stack_push(struct svm *svm)
 /**
  * Pop the topmost entry from the stack into the given register.
  */
-void op_stack_pop(struct svm *svm)
+static void op_stack_pop(struct svm *svm)
 {
     /* get the register to pop */
     uint32_t reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
     /* ensure we're not outside the stack. */
+#if !SVM_VERIFIED
     if (svm->SP <= 0)
-        svm_default_error_handler(svm, "stack overflow - stack is empty");
+    {
+        svm_fault(svm, SVM_ERROR_STACK, "stack overflow - stack is empty");
+        return;
+    }
+#endif
 
     /* Get the value from the stack. */
     struct reg_t val = svm->stack[svm->SP];
     svm->SP -= 1;
 
-    if (getenv("DEBUG") != NULL)
-    {
-        if (val.type == INTEGER)
-            jsprintf("POP(Register %d integer[=%04x])\n", reg, val.content.integer);
-        if (val.type == FLOAT)
-            jsprintf("POP(Register %d number[=%f])\n", reg, val.content.number);
-        if (val.type == STRING)
-            jsprintf("POP(Register %d string[=%s])\n", reg, val.content.string);
-    }
-
-    /* if the register stores a string .. free it */
-    clear_string_reg(svm, reg);
+#if SVM_TRACED
+    if (val.tag == INTEGER)
+        TRACE(SVM_TRACE_INSTRUCTIONS, "POP(Register %d integer[=%04x])\n", reg, val.content.integer);
+    if (val.tag == FLOAT)
+        TRACE(SVM_TRACE_INSTRUCTIONS, "POP(Register %d number[=%f])\n", reg, val.content.number);
+    if (SVM_IS_STRING(val))
+        TRACE(SVM_TRACE_INSTRUCTIONS, "POP(Register %d string[=%s])\n", reg, SVM_STRING(val));
+#endif
 
     svm->registers[reg] = val;
 
@@ -1297,20 +1568,23 @@ void op_stack_pop(struct svm *svm)
  * Return from a call - by popping the return address from the stack
  * and jumping to it.
  */
-void op_stack_ret(struct svm *svm)
+static void op_stack_ret(struct svm *svm)
 {
     /* ensure we're not outside the stack. */
+#if !SVM_VERIFIED
     if (svm->CSP <= 0)
-        svm_default_error_handler(svm, "stack overflow - stack is empty");
+    {
+        svm_fault(svm, SVM_ERROR_STACK, "stack overflow - stack is empty");
+        return;
+    }
+#endif
 
     /* Get the value from the stack. */
     int val = svm->call_stack[svm->CSP];
     svm->CSP -= 1;
 
-    if (getenv("DEBUG") != NULL)
-    {
-        jsprintf("RET() => %04x\n", val);
-    }
+    TRACE(SVM_TRACE_INSTRUCTIONS, "RET() => %04x\n", val);
+    SVM_EVENT(svm, SVM_EVENT_RET, svm->handler_ip, val);
 
     /* update our instruction pointer. */
     svm->ip = val;
@@ -1319,7 +1593,7 @@ void op_stack_ret(struct svm *svm)
 /**
  * Call a routine - push the return address onto the stack.
  */
-void op_stack_call(struct svm *svm)
+static void op_stack_call(struct svm *svm)
 {
     /**
      * Read the two bytes which will build up the destination
@@ -1332,11 +1606,16 @@ void op_stack_call(struct svm *svm)
      */
     int offset = BYTES_TO_ADDR(off1, off2);
 
+#if !SVM_VERIFIED
     int sp_size = sizeof(svm->call_stack) / sizeof(svm->call_stack[0]);
-    svm->CSP += 1;
+    if (svm->CSP + 1 >= sp_size)
+    {
+        svm_fault(svm, SVM_ERROR_STACK, "stack overflow - stack is full!");
+        return;
+    }
+#endif
 
-    if (svm->CSP >= sp_size)
-        svm_default_error_handler(svm, "stack overflow - stack is full!");
+    svm->CSP += 1;
 
     /**
      * Now we've got to save the address past this instruction
@@ -1344,6 +1623,7 @@ void op_stack_call(struct svm *svm)
      * to the correct place.
      */
     svm->call_stack[svm->CSP] = svm->ip + 1;
+    SVM_EVENT(svm, SVM_EVENT_CALL, svm->handler_ip, offset);
 
     /**
      * Now we've saved the return-address we can update the IP
@@ -1354,7 +1634,7 @@ void op_stack_call(struct svm *svm)
 /**
  * Load an binary values in a register.
  */
-void op_binary_load(struct svm *svm)
+static void op_binary_load(struct svm *svm)
 {
     /* get the destination register */
     uint32_t dst = next_byte(svm);
@@ -1362,17 +1642,13 @@ void op_binary_load(struct svm *svm)
 
     /* get the source binary address */
     uint32_t src = next_byte(svm);
-    bound_test(svm, src, BINARY_IN_COUNT);
-
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Reg%02x will be set to contents of Binary%02x)\n", dst, src);
+    BOUNDS_TEST_PORT(src, BINARY_IN_COUNT);
 
-    /* Free the existing string, if present */
-    clear_string_reg(svm, dst);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Reg%02x will be set to contents of Binary%02x)\n", dst, src);
 
     /* storing a binary (0xFF - 8-bits) as integer */
-    svm->registers[dst].type = INTEGER;
-    svm->registers[dst].content.integer = BINARY_IN[src];
+    svm->registers[dst].tag = INTEGER;
+    svm->registers[dst].content.integer = svm->io.in.binary[src];
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1381,7 +1657,7 @@ void op_binary_load(struct svm *svm)
 /**
  * Store an register integer value in a binary output.
  */
-void op_binary_save(struct svm *svm)
+static void op_binary_save(struct svm *svm)
 {
     /* get the destination register */
     uint32_t src = next_byte(svm);
@@ -1389,14 +1665,13 @@ void op_binary_save(struct svm *svm)
 
     /* get the source binary address */
     uint32_t dst = next_byte(svm);
-    bound_test(svm, dst, BINARY_OUT_COUNT);
+    BOUNDS_TEST_PORT(dst, BINARY_OUT_COUNT);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Binary%02x will be set to contents of Reg%02x)\n", dst, src);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Binary%02x will be set to contents of Reg%02x)\n", dst, src);
 
     /* storing a binary (0xFF - 8-bits) as integer */
-    if (svm->registers[src].type == INTEGER)
-        BINARY_OUT[dst] = svm->registers[src].content.integer;
+    if (svm->registers[src].tag == INTEGER)
+        svm->io.out.binary[dst] = svm->registers[src].content.integer;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1405,7 +1680,7 @@ void op_binary_save(struct svm *svm)
 /**
  * Load an analog value in a register.
  */
-void op_analog_load(struct svm *svm)
+static void op_analog_load(struct svm *svm)
 {
     /* get the destination register */
     uint32_t dst = next_byte(svm);
@@ -1413,17 +1688,13 @@ void op_analog_load(struct svm *svm)
 
     /* get the source analog address */
     uint32_t src = next_byte(svm);
-    bound_test(svm, src, ANALOG_IN_COUNT);
-
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Reg%02x will be set to contents of Analog%02x)\n", dst, src);
+    BOUNDS_TEST_PORT(src, ANALOG_IN_COUNT);
 
-    /* Free the existing string, if present */
-    clear_string_reg(svm, dst);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Reg%02x will be set to contents of Analog%02x)\n", dst, src);
 
     /* storing a analog as float */
-    svm->registers[dst].type = FLOAT;
-    svm->registers[dst].content.number = ANALOG_IN[src];
+    svm->registers[dst].tag = FLOAT;
+    svm->registers[dst].content.number = svm->io.in.analog[src];
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1432,7 +1703,7 @@ void op_analog_load(struct svm *svm)
 /**
  * Store an register integer value in a binary output.
  */
-void op_analog_save(struct svm *svm)
+static void op_analog_save(struct svm *svm)
 {
     /* get the destination register */
     uint32_t src = next_byte(svm);
@@ -1440,16 +1711,15 @@ void op_analog_save(struct svm *svm)
 
     /* get the source analog address */
     uint32_t dst = next_byte(svm);
-    bound_test(svm, dst, ANALOG_OUT_COUNT);
+    BOUNDS_TEST_PORT(dst, ANALOG_OUT_COUNT);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Analog%02x will be set to contents of Reg%02x)\n", dst, src);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Analog%02x will be set to contents of Reg%02x)\n", dst, src);
 
     /* storing a analog as float */
-    if (svm->registers[src].type == FLOAT)
-        ANALOG_OUT[dst] = svm->registers[src].content.number;
-    if (svm->registers[src].type == INTEGER)
-        ANALOG_OUT[dst] = svm->registers[src].content.integer;
+    if (svm->registers[src].tag == FLOAT)
+        svm->io.out.analog[dst] = svm->registers[src].content.number;
+    if (svm->registers[src].tag == INTEGER)
+        svm->io.out.analog[dst] = svm->registers[src].content.integer;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1458,7 +1728,7 @@ void op_analog_save(struct svm *svm)
 /**
  * Load an variable value in a register.
  */
-void op_variable_load(struct svm *svm)
+static void op_variable_load(struct svm *svm)
 {
     /* get the destination register */
     uint32_t dst = next_byte(svm);
@@ -1466,16 +1736,12 @@ void op_variable_load(struct svm *svm)
 
     /* get the source binary address */
     uint32_t src = next_byte(svm);
-    bound_test(svm, src, ANALOG_IN_COUNT);
+    BOUNDS_TEST_PORT(src, VARIABLE_COUNT);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Reg%02x will be set to contents of Variable%02x)\n", dst, src);
-
-    /* Free the existing string, if present */
-    clear_string_reg(svm, dst);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Reg%02x will be set to contents of Variable%02x)\n", dst, src);
 
     /* storing a variable in register */
-    svm->registers[dst] = VARIABLE_IO[src];
+    svm->registers[dst] = svm->io.variables[src];
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1484,7 +1750,7 @@ void op_variable_load(struct svm *svm)
 /**
  * Store an register integer value in a binary output.
  */
-void op_variable_save(struct svm *svm)
+static void op_variable_save(struct svm *svm)
 {
     /* get the destination register */
     uint32_t src = next_byte(svm);
@@ -1492,13 +1758,15 @@ void op_variable_save(struct svm *svm)
 
     /* get the source binary address */
     uint32_t dst = next_byte(svm);
-    bound_test(svm, dst, ANALOG_OUT_COUNT);
+    BOUNDS_TEST_PORT(dst, VARIABLE_COUNT);
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("STORE(Variable%02x will be set to contents of Reg%02x)\n", dst, src);
+    TRACE(SVM_TRACE_INSTRUCTIONS, "STORE(Variable%02x will be set to contents of Reg%02x)\n", dst, src);
 
-    /* storing a variable */
-    VARIABLE_IO[dst] = svm->registers[src];
+    /**
+     * Storing a variable.  A string stays where it is, the end of the scan
+     * copies it to the image - see svm_publish_outputs().
+     */
+    svm->io.variables[dst] = svm->registers[src];
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1512,17 +1780,18 @@ void op_variable_save(struct svm *svm)
 /**
  * Map the opcodes to the handlers.
  */
-void opcode_init(svm_t *svm)
+#if SVM_TRACED
+void opcode_map_traced(svm_t *svm)
+#elif SVM_VERIFIED
+void opcode_map_verified(svm_t *svm)
+#else
+void opcode_map(svm_t *svm)
+#endif
 {
-    /**
-     * Initialize the random seed for the rendom opcode (INT_RANDOM)
-     */
-    srand(time(NULL));
-
     /**
      * All instructions will default to unknown.
      */
-    for (int i = 0; i <= 255; i++)
+    for (int i = 0; i < OPCODE_COUNT; i++)
         svm->opcodes[i] = op_unknown;
 
     /* early opcodes */
@@ -1578,11 +1847,15 @@ void opcode_init(svm_t *svm)
     /* misc */
     svm->opcodes[NOP] = op_nop;
     svm->opcodes[STORE_REG] = op_reg_store;
+    svm->opcodes[YIELD] = op_yield;
 
     /* PEEK/POKE */
     svm->opcodes[PEEK] = op_peek;
     svm->opcodes[POKE] = op_poke;
     svm->opcodes[MEMCPY] = op_memcpy;
+    svm->opcodes[MEMSET] = op_memset;
+    svm->opcodes[MEMCMP] = op_memcmp;
+    svm->opcodes[MEMFIND] = op_memfind;
 
     /* stack */
     svm->opcodes[STACK_PUSH] = op_stack_push;
@@ -1590,3 +1863,35 @@ void opcode_init(svm_t *svm)
     svm->opcodes[STACK_RET] = op_stack_ret;
     svm->opcodes[STACK_CALL] = op_stack_call;
 }
+
+#if !SVM_VARIANT
+
+/**
+ * Setup the handlers of a new virtual machine.
+ */
+void opcode_init(svm_t *svm)
+{
+    /**
+     * Initialize the random seed for the rendom opcode (INT_RANDOM), the
+     * address keeps machines created in the same second apart.
+     */
+    svm_seed(svm, (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)svm);
+
+    opcode_select(svm);
+}
+
+/**
+ * Map the handlers for the state of the machine: traced ones while a
+ * tracer is attached, else the verified ones when `verified` is set.
+ */
+void opcode_select(svm_t *svm)
+{
+    if (svm->tracer)
+        opcode_map_traced(svm);
+    else if (svm->verified)
+        opcode_map_verified(svm);
+    else
+        opcode_map(svm);
+}
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * Scan cycles of many virtual machines on a work-stealing thread pool.
+ *
+ *  At the start of a cycle every thread is handed an equal, contiguous
+ * share of the machines.  A thread scans its share from the front; once it
+ * runs out it steals the back half of the share of another thread which
+ * still has machines left, and carries on with that.  Programs of very
+ * different lengths thereby keep all threads busy until the end of the
+ * cycle, without a shared queue every scan has to go through.
+ *
+ *  A share is the range [begin, end) of machine indices, packed into one
+ * 64-bit word: the owner taking a machine from the front and a thief taking
+ * half from the back each do so with a single compare-and-swap.  Indices
+ * only ever move from one share to another, so a share never holds the same
+ * range twice during a cycle and the swaps are free of ABA problems.
+ *
+ *  The thread calling svm_runtime_scan() is one of the workers, the others
+ * sleep on a condition variable between cycles.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vm-runtime.h"
+
+/**
+ * A machine and what the runtime keeps about it.
+ */
+struct instance
+{
+    svm_t *cpu;
+    int reset;
+    struct svm_instance_stats stats;
+};
+
+/**
+ * A thread of the pool, on its own cache line as the others steal from it.
+ */
+struct worker
+{
+    _Alignas(64) _Atomic uint64_t share;
+    struct svm_runtime *rt;
+    int index;
+    pthread_t thread;
+};
+
+struct svm_runtime
+{
+    struct instance *instances;
+    uint32_t count;
+    uint32_t capacity;
+
+    struct worker *workers;
+    int threads;
+
+    /**
+     * Cycles are started by bumping `cycle`, and over when `busy` - the
+     * workers other than the caller still scanning - drops to zero.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t cycle;
+    int busy;
+    int stopping;
+};
+
+#define SHARE(begin, end) ((uint64_t)(end) << 32 | (uint32_t)(begin))
+#define SHARE_BEGIN(share) ((uint32_t)(share))
+#define SHARE_END(share) ((uint32_t)((share) >> 32))
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * Reset and run one machine, and account for it.
+ */
+static void scan(struct instance *in)
+{
+    uint64_t start = now_ns();
+
+    svm_reset(in->cpu, in->reset);
+    svm_run(in->cpu);
+
+    uint64_t ns = now_ns() - start;
+
+    in->stats.scans++;
+    in->stats.instructions += in->cpu->iterations;
+    in->stats.total_ns += ns;
+    in->stats.last_ns = ns;
+    if (ns > in->stats.max_ns)
+        in->stats.max_ns = ns;
+}
+
+/**
+ * Take the machine at the front of a worker's own share.
+ */
+static int take(struct worker *w, uint32_t *index)
+{
+    uint64_t share = atomic_load(&w->share);
+
+    while (SHARE_BEGIN(share) < SHARE_END(share))
+    {
+        uint64_t rest = SHARE(SHARE_BEGIN(share) + 1, SHARE_END(share));
+        if (atomic_compare_exchange_weak(&w->share, &share, rest))
+        {
+            *index = SHARE_BEGIN(share);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Move the back half of another worker's share into the empty share of
+ * `w`.  Returns zero when no worker had anything left.
+ */
+static int steal(struct worker *w)
+{
+    struct svm_runtime *rt = w->rt;
+
+    for (int i = 1; i < rt->threads; i++)
+    {
+        struct worker *victim = &rt->workers[(w->index + i) % rt->threads];
+        uint64_t share = atomic_load(&victim->share);
+
+        while (SHARE_BEGIN(share) < SHARE_END(share))
+        {
+            uint32_t begin = SHARE_BEGIN(share);
+            uint32_t end = SHARE_END(share);
+            uint32_t half = end - (end - begin + 1) / 2;
+
+            if (atomic_compare_exchange_weak(&victim->share, &share, SHARE(begin, half)))
+            {
+                atomic_store(&w->share, SHARE(half, end));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * A worker's part of a cycle: its own share, then whatever it can steal.
+ */
+static void work(struct worker *w)
+{
+    uint32_t index;
+
+    do
+    {
+        while (take(w, &index))
+            scan(&w->rt->instances[index]);
+    } while (steal(w));
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct svm_runtime *rt = w->rt;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&rt->lock);
+    for (;;)
+    {
+        while (rt->cycle == seen && !rt->stopping)
+            pthread_cond_wait(&rt->start, &rt->lock);
+        if (rt->stopping)
+            break;
+        seen = rt->cycle;
+        pthread_mutex_unlock(&rt->lock);
+
+        work(w);
+
+        pthread_mutex_lock(&rt->lock);
+        if (--rt->busy == 0)
+            pthread_cond_signal(&rt->done);
+    }
+    pthread_mutex_unlock(&rt->lock);
+
+    return NULL;
+}
+
+svm_runtime_t *svm_runtime_new(int threads)
+{
+    if (threads <= 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+
+    svm_runtime_t *rt = calloc(1, sizeof(svm_runtime_t));
+    if (!rt)
+        return NULL;
+
+    rt->workers = aligned_alloc(_Alignof(struct worker), sizeof(struct worker) * threads);
+    if (!rt->workers)
+    {
+        free(rt);
+        return NULL;
+    }
+
+    pthread_mutex_init(&rt->lock, NULL);
+    pthread_cond_init(&rt->start, NULL);
+    pthread_cond_init(&rt->done, NULL);
+
+    /**
+     * Worker zero is the thread calling svm_runtime_scan().
+     */
+    for (int i = 0; i < threads; i++)
+    {
+        struct worker *w = &rt->workers[i];
+
+        atomic_init(&w->share, 0);
+        w->rt = rt;
+        w->index = i;
+
+        if (i > 0 && pthread_create(&w->thread, NULL, worker_main, w) != 0)
+        {
+            rt->threads = i;
+            svm_runtime_free(rt);
+            return NULL;
+        }
+    }
+    rt->threads = threads;
+
+    return rt;
+}
+
+int svm_runtime_threads(svm_runtime_t *rt)
+{
+    return rt ? rt->threads : 0;
+}
+
+int svm_runtime_add(svm_runtime_t *rt, unsigned char *code, uint32_t size, void (*error) (char *msg))
+{
+    if (!rt)
+        return -1;
+
+    if (rt->count == rt->capacity)
+    {
+        uint32_t capacity = rt->capacity ? rt->capacity * 2 : 16;
+        struct instance *instances = realloc(rt->instances, sizeof(struct instance) * capacity);
+        if (!instances)
+            return -1;
+
+        rt->instances = instances;
+        rt->capacity = capacity;
+    }
+
+    svm_t *cpu = svm_new(code, size, error);
+    if (!cpu)
+        return -1;
+
+    struct instance *in = &rt->instances[rt->count];
+    memset(in, 0, sizeof(*in));
+    in->cpu = cpu;
+    in->reset = SVM_RESET_ALL;
+
+    return rt->count++;
+}
+
+uint32_t svm_runtime_count(svm_runtime_t *rt)
+{
+    return rt ? rt->count : 0;
+}
+
+svm_t *svm_runtime_instance(svm_runtime_t *rt, uint32_t index)
+{
+    if (!rt || index >= rt->count)
+        return NULL;
+
+    return rt->instances[index].cpu;
+}
+
+void svm_runtime_set_reset(svm_runtime_t *rt, uint32_t index, int what)
+{
+    if (!rt || index >= rt->count)
+        return;
+
+    rt->instances[index].reset = what;
+}
+
+uint64_t svm_runtime_scan(svm_runtime_t *rt)
+{
+    if (!rt)
+        return 0;
+
+    uint64_t start = now_ns();
+
+    for (int i = 0; i < rt->threads; i++)
+    {
+        uint32_t begin = (uint64_t)rt->count * i / rt->threads;
+        uint32_t end = (uint64_t)rt->count * (i + 1) / rt->threads;
+        atomic_store(&rt->workers[i].share, SHARE(begin, end));
+    }
+
+    if (rt->threads > 1)
+    {
+        pthread_mutex_lock(&rt->lock);
+        rt->busy = rt->threads - 1;
+        rt->cycle++;
+        pthread_cond_broadcast(&rt->start);
+        pthread_mutex_unlock(&rt->lock);
+    }
+
+    work(&rt->workers[0]);
+
+    if (rt->threads > 1)
+    {
+        pthread_mutex_lock(&rt->lock);
+        while (rt->busy > 0)
+            pthread_cond_wait(&rt->done, &rt->lock);
+        pthread_mutex_unlock(&rt->lock);
+    }
+
+    return now_ns() - start;
+}
+
+const struct svm_instance_stats *svm_runtime_stats(svm_runtime_t *rt, uint32_t index)
+{
+    if (!rt || index >= rt->count)
+        return NULL;
+
+    return &rt->instances[index].stats;
+}
+
+void svm_runtime_free(svm_runtime_t *rt)
+{
+    if (!rt)
+        return;
+
+    pthread_mutex_lock(&rt->lock);
+    rt->stopping = 1;
+    pthread_cond_broadcast(&rt->start);
+    pthread_mutex_unlock(&rt->lock);
+
+    for (int i = 1; i < rt->threads; i++)
+        pthread_join(rt->workers[i].thread, NULL);
+
+    for (uint32_t i = 0; i < rt->count; i++)
+        svm_free(rt->instances[i].cpu);
+
+    pthread_cond_destroy(&rt->done);
+    pthread_cond_destroy(&rt->start);
+    pthread_mutex_destroy(&rt->lock);
+
+    free(rt->instances);
+    free(rt->workers);
+    free(rt);
+}
@@ -0,0 +1,98 @@
+#ifndef N7QF2KX9BW4MZC1TJR6HVD8LP
+#define N7QF2KX9BW4MZC1TJR6HVD8LP
+
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * A native host for many virtual machines, see vm-runtime.c.
+ *
+ *  The runtime owns its machines and runs their scan cycles on a pool of
+ * threads: `svm_runtime_scan` resets and runs every machine once, each on
+ * a single thread, and returns when all of them are done.  Machines don't
+ * share state - each has its own registers, RAM, process image and random
+ * generator - so the order they run in doesn't change what they compute.
+ *
+ *  Built with -pthread, it isn't part of the WebAssembly build.
+ */
+typedef struct svm_runtime svm_runtime_t;
+
+/**
+ * Timing of one machine's scans, in nanoseconds.  A scan is the reset
+ * followed by the run.
+ */
+struct svm_instance_stats
+{
+    uint64_t scans;
+    uint64_t instructions;
+    uint64_t total_ns;
+    uint64_t last_ns;
+    uint64_t max_ns;
+};
+
+/**
+ * Create a runtime with `threads` threads, counting the caller of
+ * `svm_runtime_scan`, or one per online core when `threads` is zero or
+ * less.
+ */
+svm_runtime_t *svm_runtime_new(int threads);
+
+/**
+ * The number of threads scans run on.
+ */
+int svm_runtime_threads(svm_runtime_t *rt);
+
+/**
+ * Load a program into a new machine of the runtime, which is reset with
+ * SVM_RESET_ALL before every scan.
+ *
+ * Returns the index of the machine, or -1 when it couldn't be created.
+ * Not to be called while a scan is running.
+ */
+int svm_runtime_add(svm_runtime_t *rt, unsigned char *code, uint32_t size, void (*error) (char *msg));
+
+/**
+ * The number of machines.
+ */
+uint32_t svm_runtime_count(svm_runtime_t *rt);
+
+/**
+ * A machine of the runtime - to seed it, attach a process image, or read
+ * its results between scans - or NULL for an invalid index.
+ */
+svm_t *svm_runtime_instance(svm_runtime_t *rt, uint32_t index);
+
+/**
+ * Choose what is reset before each scan of a machine, any of the
+ * SVM_RESET_ flags.
+ */
+void svm_runtime_set_reset(svm_runtime_t *rt, uint32_t index, int what);
+
+/**
+ * Scan every machine once.  Returns the wall time of the whole cycle, in
+ * nanoseconds.
+ */
+uint64_t svm_runtime_scan(svm_runtime_t *rt);
+
+/**
+ * The timing of a machine's scans so far, or NULL for an invalid index.
+ */
+const struct svm_instance_stats *svm_runtime_stats(svm_runtime_t *rt, uint32_t index);
+
+/**
+ * Stop the threads and free the runtime with all of its machines.
+ */
+void svm_runtime_free(svm_runtime_t *rt);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
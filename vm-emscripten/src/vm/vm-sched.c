@@ -0,0 +1,290 @@
+/**
+ * Cyclic tasks with periods and priorities, on a virtual clock.
+ *
+ *  The scheduler repeats three steps until the clock reaches the end of
+ * the run: release the tasks which are due, pick the ready task with the
+ * highest priority, and run it until it exits or the next release is due -
+ * whichever comes first.  A release is the only thing which can make a
+ * higher priority task ready, so checking at releases is the same as
+ * checking at every instruction boundary.  With no task ready the clock
+ * skips to the next release.
+ *
+ *  Machines are run a slice at a time with svm_step(), so a scan can stop
+ * after any instruction and carry on later from its instruction-pointer.
+ * A `yield` changes nothing here, tasks give up the processor at every
+ * release anyway.  A scan which fails ends there, without publishing its
+ * outputs.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm-sched.h"
+
+struct task
+{
+    svm_t *cpu;
+    uint64_t period;
+    int priority;
+    int reset;
+
+    /**
+     * When the task is next released, and - while `active` - when the scan
+     * which is pending or in progress was.
+     */
+    uint64_t next_release;
+    uint64_t released;
+    uint8_t active;
+    uint8_t started;
+
+    struct svm_task_stats stats;
+};
+
+struct svm_scheduler
+{
+    struct task *tasks;
+    uint32_t count;
+    uint32_t capacity;
+
+    uint64_t instruction_ns;
+    uint64_t now;
+
+    /**
+     * The task the last slice ran, if its scan is still in progress.
+     */
+    struct task *current;
+};
+
+/**
+ * Release every task which is due.  A task whose previous scan hasn't
+ * finished has overrun, and keeps the release it has.
+ */
+static void release(svm_scheduler_t *s)
+{
+    for (uint32_t i = 0; i < s->count; i++)
+    {
+        struct task *t = &s->tasks[i];
+
+        while (t->next_release <= s->now)
+        {
+            t->stats.releases++;
+
+            if (t->active)
+                t->stats.overruns++;
+            else
+            {
+                t->active = 1;
+                t->started = 0;
+                t->released = t->next_release;
+            }
+
+            t->next_release += t->period;
+        }
+    }
+}
+
+/**
+ * The ready task to run: highest priority, then earliest release, then
+ * first added.
+ */
+static struct task *pick(svm_scheduler_t *s)
+{
+    struct task *best = NULL;
+
+    for (uint32_t i = 0; i < s->count; i++)
+    {
+        struct task *t = &s->tasks[i];
+
+        if (!t->active)
+            continue;
+        if (!best || t->priority > best->priority ||
+            (t->priority == best->priority && t->released < best->released))
+            best = t;
+    }
+    return best;
+}
+
+/**
+ * When the next task is released.
+ */
+static uint64_t next_event(svm_scheduler_t *s)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (uint32_t i = 0; i < s->count; i++)
+    {
+        if (s->tasks[i].next_release < next)
+            next = s->tasks[i].next_release;
+    }
+    return next;
+}
+
+static void start(svm_scheduler_t *s, struct task *t)
+{
+    uint64_t jitter = s->now - t->released;
+
+    svm_reset(t->cpu, t->reset);
+    t->cpu->iterations = 0;
+    svm_latch_inputs(t->cpu);
+
+    t->started = 1;
+    t->stats.jitter_total_ns += jitter;
+    if (jitter > t->stats.jitter_max_ns)
+        t->stats.jitter_max_ns = jitter;
+}
+
+static void finish(svm_scheduler_t *s, struct task *t, int status)
+{
+    uint64_t response = s->now - t->released;
+
+    if (status == SVM_STATUS_ERROR)
+        t->stats.errors++;
+    else
+        svm_publish_outputs(t->cpu);
+
+    t->active = 0;
+    t->stats.completions++;
+    t->stats.response_total_ns += response;
+    if (response > t->stats.response_max_ns)
+        t->stats.response_max_ns = response;
+}
+
+svm_scheduler_t *svm_scheduler_new(uint64_t instruction_ns)
+{
+    svm_scheduler_t *s = calloc(1, sizeof(svm_scheduler_t));
+    if (!s)
+        return NULL;
+
+    s->instruction_ns = instruction_ns ? instruction_ns : 1;
+    return s;
+}
+
+int svm_scheduler_add(svm_scheduler_t *s, unsigned char *code, uint32_t size, void (*error) (char *msg),
+                      uint64_t period_ns, int priority)
+{
+    if (!s || !period_ns)
+        return -1;
+
+    if (s->count == s->capacity)
+    {
+        uint32_t capacity = s->capacity ? s->capacity * 2 : 8;
+        struct task *tasks = realloc(s->tasks, sizeof(struct task) * capacity);
+        if (!tasks)
+            return -1;
+
+        /**
+         * `current` points into the array.
+         */
+        if (s->current)
+            s->current = tasks + (s->current - s->tasks);
+        s->tasks = tasks;
+        s->capacity = capacity;
+    }
+
+    svm_t *cpu = svm_new(code, size, error);
+    if (!cpu)
+        return -1;
+
+    struct task *t = &s->tasks[s->count];
+    memset(t, 0, sizeof(*t));
+    t->cpu = cpu;
+    t->period = period_ns;
+    t->priority = priority;
+    t->reset = SVM_RESET_ALL;
+
+    /**
+     * Added while the clock runs, the task is first released right away.
+     */
+    t->next_release = s->now;
+
+    return s->count++;
+}
+
+svm_t *svm_scheduler_instance(svm_scheduler_t *s, uint32_t task)
+{
+    if (!s || task >= s->count)
+        return NULL;
+
+    return s->tasks[task].cpu;
+}
+
+void svm_scheduler_set_reset(svm_scheduler_t *s, uint32_t task, int what)
+{
+    if (!s || task >= s->count)
+        return;
+
+    s->tasks[task].reset = what;
+}
+
+void svm_scheduler_run(svm_scheduler_t *s, uint64_t until_ns)
+{
+    if (!s)
+        return;
+
+    while (s->now < until_ns)
+    {
+        release(s);
+
+        uint64_t next = next_event(s);
+        if (next > until_ns)
+            next = until_ns;
+
+        struct task *t = pick(s);
+        if (!t)
+        {
+            s->now = next;
+            continue;
+        }
+
+        if (s->current && s->current != t)
+            s->current->stats.preemptions++;
+        s->current = t;
+
+        if (!t->started)
+            start(s, t);
+
+        /**
+         * Up to the first instruction boundary at or after the next event.
+         */
+        uint64_t budget = (next - s->now + s->instruction_ns - 1) / s->instruction_ns;
+        if (budget > UINT32_MAX)
+            budget = UINT32_MAX;
+
+        uint32_t before = t->cpu->iterations;
+        int status = svm_step(t->cpu, budget);
+        uint32_t ran = t->cpu->iterations - before;
+
+        s->now += ran * s->instruction_ns;
+        t->stats.instructions += ran;
+
+        if (status == SVM_STATUS_EXITED || status == SVM_STATUS_ERROR)
+        {
+            finish(s, t, status);
+            s->current = NULL;
+        }
+    }
+}
+
+uint64_t svm_scheduler_now(svm_scheduler_t *s)
+{
+    return s ? s->now : 0;
+}
+
+const struct svm_task_stats *svm_scheduler_stats(svm_scheduler_t *s, uint32_t task)
+{
+    if (!s || task >= s->count)
+        return NULL;
+
+    return &s->tasks[task].stats;
+}
+
+void svm_scheduler_free(svm_scheduler_t *s)
+{
+    if (!s)
+        return;
+
+    for (uint32_t i = 0; i < s->count; i++)
+        svm_free(s->tasks[i].cpu);
+
+    free(s->tasks);
+    free(s);
+}
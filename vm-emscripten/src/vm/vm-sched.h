@@ -0,0 +1,104 @@
+#ifndef C5RM8TZ1QH7XK3WV9JDN2BFLA
+#define C5RM8TZ1QH7XK3WV9JDN2BFLA
+
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * A cyclic task scheduler on a virtual clock, see vm-sched.c.
+ *
+ *  Every task is a program on a machine of its own, released every
+ * `period_ns` from time zero.  A released task is scanned once: reset,
+ * inputs latched, run until it exits, outputs published.  The ready task
+ * with the highest priority runs, preempting a lower one at the next
+ * instruction boundary, equal priorities run in the order they were
+ * released.  A task released again before its previous scan finished has
+ * overrun, that release is dropped.  Scans which fail count as done,
+ * without publishing their outputs.
+ *
+ *  Time is virtual: every instruction takes `instruction_ns`, so the same
+ * tasks always produce the same schedule, whatever the host.
+ */
+typedef struct svm_scheduler svm_scheduler_t;
+
+/**
+ * What happened to a task so far.  Jitter is the time from a release to
+ * the start of its scan, response the time from a release to its end.
+ */
+struct svm_task_stats
+{
+    uint64_t releases;
+    uint64_t completions;
+    uint64_t overruns;
+    uint64_t errors;
+    uint64_t preemptions;
+    uint64_t instructions;
+
+    uint64_t jitter_max_ns;
+    uint64_t jitter_total_ns;
+    uint64_t response_max_ns;
+    uint64_t response_total_ns;
+};
+
+/**
+ * Create a scheduler whose clock advances `instruction_ns` for every
+ * instruction run, zero is taken as one.
+ */
+svm_scheduler_t *svm_scheduler_new(uint64_t instruction_ns);
+
+/**
+ * Load a program into a new machine as a task.  `period_ns` must be at
+ * least one; higher `priority` values run first.
+ *
+ * Returns the index of the task, or -1 when it couldn't be created.
+ */
+int svm_scheduler_add(svm_scheduler_t *s, unsigned char *code, uint32_t size, void (*error) (char *msg),
+                      uint64_t period_ns, int priority);
+
+/**
+ * The machine of a task - to seed it or attach a process image - or NULL
+ * for an invalid index.  It is in the middle of a scan whenever the task
+ * was preempted.
+ */
+svm_t *svm_scheduler_instance(svm_scheduler_t *s, uint32_t task);
+
+/**
+ * Choose what is reset before each scan of a task, any of the SVM_RESET_
+ * flags, SVM_RESET_ALL by default.
+ */
+void svm_scheduler_set_reset(svm_scheduler_t *s, uint32_t task, int what);
+
+/**
+ * Run the tasks until the clock reaches `until_ns`, or a little past it:
+ * the instruction running at that time is finished first.  Tasks in the
+ * middle of a scan carry on with the next call.
+ */
+void svm_scheduler_run(svm_scheduler_t *s, uint64_t until_ns);
+
+/**
+ * The virtual time, in nanoseconds.
+ */
+uint64_t svm_scheduler_now(svm_scheduler_t *s);
+
+/**
+ * The statistics of a task, or NULL for an invalid index.
+ */
+const struct svm_task_stats *svm_scheduler_stats(svm_scheduler_t *s, uint32_t task);
+
+/**
+ * Free the scheduler with all of its machines.
+ */
+void svm_scheduler_free(svm_scheduler_t *s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
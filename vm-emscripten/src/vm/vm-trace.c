@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm-trace.h"
+#include "jsprintf.h"
+
+/**
+ * Maps the handler table in vm-ops.c.
+ */
+void opcode_select(svm_t *svm);
+
+/**
+ * Attach a tracer to a virtual machine, or detach it with NULL.
+ */
+void svm_set_tracer(svm_t *cpup, svm_tracer_t *tracer)
+{
+    if (!cpup)
+        return;
+
+    cpup->tracer = tracer;
+    opcode_select(cpup);
+}
+
+/**
+ * Format a message and hand it to the attached tracer.
+ */
+void svm_trace(svm_t *cpup, int level, const char *fmt, ...)
+{
+    svm_tracer_t *tracer = cpup->tracer;
+    char msg[1024];
+    va_list argp;
+
+    if (!tracer || level > tracer->level)
+        return;
+
+    va_start(argp, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, argp);
+    va_end(argp);
+
+    tracer->trace(tracer, level, msg);
+}
+
+/**
+ * Pass trace messages on to jsprintf().
+ */
+void svm_trace_jsprintf(svm_tracer_t *tracer, int level, const char *msg)
+{
+    (void)tracer;
+    (void)level;
+
+    jsprintf("%s", msg);
+}
+
+/**
+ * Nanoseconds on the monotonic clock, which the events are stamped with.
+ */
+uint64_t svm_events_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * Start or stop recording events.
+ */
+int svm_events_enable(svm_t *cpup, uint32_t capacity)
+{
+    struct svm_events *events;
+    uint32_t n = 1;
+
+    if (!cpup)
+        return -1;
+
+    if (cpup->events)
+    {
+        free(cpup->events->ring);
+        free(cpup->events);
+        cpup->events = NULL;
+    }
+
+    if (!capacity)
+        return 0;
+
+    while (n < capacity && n < 0x80000000u)
+        n <<= 1;
+
+    events = malloc(sizeof(struct svm_events));
+    if (!events)
+        return -1;
+
+    events->ring = malloc(n * sizeof(struct svm_event));
+    if (!events->ring)
+    {
+        free(events);
+        return -1;
+    }
+    events->mask = n - 1;
+    events->count = 0;
+
+    cpup->events = events;
+    return 0;
+}
+
+/**
+ * Record an event, writing over the oldest once the ring is full.
+ */
+void svm_event(svm_t *cpup, int type, uint32_t ip, uint32_t arg)
+{
+    struct svm_events *events = cpup->events;
+    struct svm_event *event = &events->ring[events->count & events->mask];
+
+    events->count++;
+
+    event->ns = svm_events_now();
+    event->arg = arg;
+    event->ip = ip;
+    event->type = type;
+}
+
+/**
+ * JSON being written by svm_events_export(), which counts what didn't fit.
+ */
+struct json
+{
+    char *buf;
+    size_t size;
+    size_t length;
+};
+
+static void put(struct json *json, const char *fmt, ...)
+{
+    size_t room = json->length < json->size ? json->size - json->length : 0;
+    va_list argp;
+
+    va_start(argp, fmt);
+    int n = vsnprintf(room ? json->buf + json->length : NULL, room, fmt, argp);
+    va_end(argp);
+
+    if (n > 0)
+        json->length += n;
+}
+
+/**
+ * One trace event, with the fields they all have.
+ */
+static void put_event(struct json *json, int *first, const char *ph, double us, int tid)
+{
+    put(json, "%s\n{\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", *first ? "" : ",", ph, us, tid);
+    *first = 0;
+}
+
+/**
+ * The events as Chrome trace-event JSON.
+ *
+ *  Slices have to nest, so the end of a scan also ends the calls a fault
+ * left open, and ends whose beginning was written over are left out.
+ */
+size_t svm_events_export(svm_t *cpup, int tid, char *buf, size_t size)
+{
+    struct json json = {buf, size, 0};
+    int first = 1;
+    int scan = 0;
+    uint32_t calls = 0;
+
+    if (size)
+        buf[0] = '\0';
+
+    put(&json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    struct svm_events *events = cpup ? cpup->events : NULL;
+    uint64_t start = 0;
+
+    if (events && events->count > (uint64_t)events->mask + 1)
+        start = events->count - events->mask - 1;
+
+    for (uint64_t i = start; events && i < events->count; i++)
+    {
+        const struct svm_event *event = &events->ring[i & events->mask];
+        double us = event->ns / 1e3;
+
+        switch (event->type)
+        {
+        case SVM_EVENT_SCAN_BEGIN:
+        case SVM_EVENT_SCAN_END:
+            for (; calls > 0; calls--)
+            {
+                put_event(&json, &first, "E", us, tid);
+                put(&json, "}");
+            }
+            if (scan)
+            {
+                put_event(&json, &first, "E", us, tid);
+                if (event->type == SVM_EVENT_SCAN_END)
+                    put(&json, ",\"args\":{\"instructions\":%u}", event->arg);
+                put(&json, "}");
+            }
+            scan = event->type == SVM_EVENT_SCAN_BEGIN;
+            if (scan)
+            {
+                put_event(&json, &first, "B", us, tid);
+                put(&json, ",\"name\":\"scan\",\"cat\":\"scan\",\"args\":{\"scan\":%u}}", event->arg);
+            }
+            break;
+
+        case SVM_EVENT_CALL:
+            put_event(&json, &first, "B", us, tid);
+            put(&json, ",\"name\":\"0x%04X\",\"cat\":\"call\",\"args\":{\"from\":%u}}", event->arg, event->ip);
+            calls++;
+            break;
+
+        case SVM_EVENT_RET:
+            if (calls == 0)
+                break;
+            put_event(&json, &first, "E", us, tid);
+            put(&json, ",\"args\":{\"to\":%u}}", event->arg);
+            calls--;
+            break;
+
+        case SVM_EVENT_LATCH:
+        case SVM_EVENT_PUBLISH:
+            put_event(&json, &first, "X", (event->ns - event->arg) / 1e3, tid);
+            put(&json, ",\"dur\":%.3f,\"name\":\"%s\",\"cat\":\"io\"}", event->arg / 1e3,
+                event->type == SVM_EVENT_LATCH ? "latch inputs" : "publish outputs");
+            break;
+
+        case SVM_EVENT_FAULT:
+            put_event(&json, &first, "i", us, tid);
+            put(&json, ",\"s\":\"t\",\"name\":\"fault\",\"cat\":\"error\",\"args\":{\"code\":%u,\"ip\":%u}}",
+                event->arg, event->ip);
+            break;
+
+        case SVM_EVENT_ABORT:
+            put_event(&json, &first, "i", us, tid);
+            put(&json, ",\"s\":\"t\",\"name\":\"watchdog\",\"cat\":\"error\",\"args\":{\"ip\":%u}}", event->ip);
+            break;
+        }
+    }
+
+    put(&json, "\n]}\n");
+    return json.length;
+}
+
+/**
+ * Opcode names, for profiles and the comments of svm2c.
+ */
+static const char *names[OPCODE_COUNT] = {
+    [EXIT] = "EXIT",
+    [INT_STORE] = "INT_STORE",
+    [INT_PRINT] = "INT_PRINT",
+    [INT_TOSTRING] = "INT_TOSTRING",
+    [INT_RANDOM] = "INT_RANDOM",
+    [FLOAT_STORE] = "FLOAT_STORE",
+    [FLOAT_PRINT] = "FLOAT_PRINT",
+    [FLOAT_TOSTRING] = "FLOAT_TOSTRING",
+    [BINARY_LOAD] = "BINARY_LOAD",
+    [BINARY_SAVE] = "BINARY_SAVE",
+    [ANALOG_LOAD] = "ANALOG_LOAD",
+    [ANALOG_SAVE] = "ANALOG_SAVE",
+    [VARIABLE_LOAD] = "VARIABLE_LOAD",
+    [VARIABLE_SAVE] = "VARIABLE_SAVE",
+    [JUMP_TO] = "JUMP_TO",
+    [JUMP_Z] = "JUMP_Z",
+    [JUMP_NZ] = "JUMP_NZ",
+    [XOR] = "XOR",
+    [ADD] = "ADD",
+    [SUB] = "SUB",
+    [MUL] = "MUL",
+    [DIV] = "DIV",
+    [INC] = "INC",
+    [DEC] = "DEC",
+    [AND] = "AND",
+    [OR] = "OR",
+    [STRING_STORE] = "STRING_STORE",
+    [STRING_PRINT] = "STRING_PRINT",
+    [STRING_CONCAT] = "STRING_CONCAT",
+    [STRING_SYSTEM] = "STRING_SYSTEM",
+    [STRING_TOINT] = "STRING_TOINT",
+    [CMP_REG] = "CMP_REG",
+    [CMP_IMMEDIATE] = "CMP_IMMEDIATE",
+    [CMP_STRING] = "CMP_STRING",
+    [IS_STRING] = "IS_STRING",
+    [IS_INTEGER] = "IS_INTEGER",
+    [NOP] = "NOP",
+    [STORE_REG] = "STORE_REG",
+    [YIELD] = "YIELD",
+    [PEEK] = "PEEK",
+    [POKE] = "POKE",
+    [MEMCPY] = "MEMCPY",
+    [MEMSET] = "MEMSET",
+    [MEMCMP] = "MEMCMP",
+    [MEMFIND] = "MEMFIND",
+    [STACK_PUSH] = "STACK_PUSH",
+    [STACK_POP] = "STACK_POP",
+    [STACK_RET] = "STACK_RET",
+    [STACK_CALL] = "STACK_CALL",
+};
+
+const char *svm_opcode_name(int opcode)
+{
+    return opcode >= 0 && opcode < OPCODE_COUNT ? names[opcode] : NULL;
+}
+
+/**
+ * The groups are the sections of `enum opcode_t`.
+ */
+const char *svm_opcode_group(int opcode)
+{
+    if (!svm_opcode_name(opcode))
+        return "unknown";
+    if (opcode == EXIT)
+        return "base";
+    if (opcode <= INT_RANDOM)
+        return "integer";
+    if (opcode <= FLOAT_TOSTRING)
+        return "number";
+    if (opcode <= VARIABLE_SAVE)
+        return "I/O";
+
+    switch (opcode & 0xF0)
+    {
+    case JUMP_TO:
+        return "jump";
+    case XOR:
+        return "math";
+    case STRING_STORE:
+        return "string";
+    case CMP_REG:
+        return "comparison";
+    case NOP:
+        return "misc";
+    case PEEK:
+        return "peek/poke";
+    default:
+        return "stack";
+    }
+}
+
+/**
+ * Start or stop profiling.
+ */
+int svm_profile_enable(svm_t *cpup, int enabled)
+{
+    if (!cpup)
+        return -1;
+
+    free(cpup->profile);
+    cpup->profile = NULL;
+
+    if (!enabled)
+        return 0;
+
+    cpup->profile = calloc(1, sizeof(struct svm_profile));
+    return cpup->profile ? 0 : -1;
+}
+
+/**
+ * Groups of the report, at most one per section of `enum opcode_t`.
+ */
+#define REPORT_GROUPS 16
+
+void svm_profile_report(svm_t *cpup, FILE *fp, int hot)
+{
+    struct svm_profile *profile = cpup ? cpup->profile : NULL;
+    const char *groups[REPORT_GROUPS];
+    uint64_t group_counts[REPORT_GROUPS] = {0};
+    uint64_t group_cycles[REPORT_GROUPS] = {0};
+    int group_count = 0;
+    int order[OPCODE_COUNT];
+    int used = 0;
+    uint64_t count = 0;
+    uint64_t cycles = 0;
+
+    if (!profile)
+    {
+        fprintf(fp, "No profile.\n");
+        return;
+    }
+
+    for (int op = 0; op < OPCODE_COUNT; op++)
+    {
+        if (!profile->counts[op])
+            continue;
+
+        count += profile->counts[op];
+        cycles += profile->cycles[op];
+
+        /**
+         * Kept sorted by time, most first.
+         */
+        int i = used++;
+        for (; i > 0 && profile->cycles[order[i - 1]] < profile->cycles[op]; i--)
+            order[i] = order[i - 1];
+        order[i] = op;
+
+        const char *group = svm_opcode_group(op);
+        int g = 0;
+        while (g < group_count && strcmp(groups[g], group) != 0)
+            g++;
+        if (g == group_count)
+            groups[group_count++] = group;
+        group_counts[g] += profile->counts[op];
+        group_cycles[g] += profile->cycles[op];
+    }
+
+    double total = cycles ? (double)cycles : 1;
+
+    fprintf(fp, "%-16s %-12s %14s %16s %10s %7s\n", "opcode", "group", "count", "cycles", "[c/op]", "[%]");
+    for (int i = 0; i < used; i++)
+    {
+        int op = order[i];
+        const char *name = svm_opcode_name(op);
+        char unknown[8];
+
+        if (!name)
+        {
+            snprintf(unknown, sizeof(unknown), "0x%02X", op);
+            name = unknown;
+        }
+        fprintf(fp, "%-16s %-12s %14llu %16llu %10.1f %7.1f\n", name, svm_opcode_group(op),
+                (unsigned long long)profile->counts[op], (unsigned long long)profile->cycles[op],
+                (double)profile->cycles[op] / profile->counts[op], 100.0 * profile->cycles[op] / total);
+    }
+    fprintf(fp, "%-16s %-12s %14llu %16llu\n\n", "total", "", (unsigned long long)count, (unsigned long long)cycles);
+
+    fprintf(fp, "%-16s %14s %16s %7s\n", "group", "count", "cycles", "[%]");
+    for (int g = 0; g < group_count; g++)
+        fprintf(fp, "%-16s %14llu %16llu %7.1f\n", groups[g], (unsigned long long)group_counts[g],
+                (unsigned long long)group_cycles[g], 100.0 * group_cycles[g] / total);
+
+    /**
+     * The hottest offsets, a pass over them for each.
+     */
+    fprintf(fp, "\n%-16s %-16s %14s %7s\n", "offset", "opcode", "count", "[%]");
+    uint32_t above = UINT32_MAX;
+    uint32_t from = 0;
+    for (int n = 0; n < hot; n++)
+    {
+        uint32_t best = 0, at = 0;
+
+        for (uint32_t i = 0; i < 0xFFFF; i++)
+        {
+            uint32_t c = profile->offsets[i];
+            if ((c < above || (c == above && i >= from)) && c > best)
+            {
+                best = c;
+                at = i;
+            }
+        }
+        if (!best)
+            break;
+
+        const char *name = svm_opcode_name(cpup->code[at]);
+        fprintf(fp, "0x%04X           %-16s %14u %7.1f\n", at, name ? name : "?", best, 100.0 * best / (count ? count : 1));
+        above = best;
+        from = at + 1;
+    }
+}
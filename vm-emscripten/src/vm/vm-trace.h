@@ -0,0 +1,241 @@
+#ifndef RH61KWOGLMIYT943XD815UNOQ
+#define RH61KWOGLMIYT943XD815UNOQ
+
+#include <stdio.h>
+
+#include "vm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * How much a tracer wants to be told.  Each level includes the ones
+ * before it.
+ */
+enum svm_trace_level_t
+{
+    SVM_TRACE_NONE = 0,
+
+    /**
+     * Once per run, the number of instructions executed.
+     */
+    SVM_TRACE_SUMMARY,
+
+    /**
+     * Every instruction, with its operands.
+     */
+    SVM_TRACE_INSTRUCTIONS,
+
+    /**
+     * Everything, down to each run of bytes MEMCPY copies in one go.
+     */
+    SVM_TRACE_DETAIL
+};
+
+/**
+ * Receives the trace of a virtual machine, see svm_set_tracer().
+ */
+typedef struct svm_tracer
+{
+    /**
+     * Messages above this level are not even formatted.
+     */
+    int level;
+
+    /**
+     * Called with each message.
+     */
+    void (*trace)(struct svm_tracer *tracer, int level, const char *msg);
+
+    /**
+     * For the owner of the tracer.
+     */
+    void *user;
+} svm_tracer_t;
+
+/**
+ * Attach a tracer to a virtual machine, or detach it with NULL.
+ *
+ * The choice is made here, once: while a tracer is attached `svm_run`
+ * uses the traced reference loop and handlers, otherwise the engine
+ * selected at build time, which contains no tracing at all.
+ */
+void svm_set_tracer(svm_t *cpup, svm_tracer_t *tracer);
+
+/**
+ * Format a message and hand it to the attached tracer, if its level
+ * includes the message.
+ */
+void svm_trace(svm_t *cpup, int level, const char *fmt, ...);
+
+/**
+ * A `trace` callback which passes messages on to jsprintf(), giving the
+ * output previously enabled by the DEBUG environment variable.
+ */
+void svm_trace_jsprintf(svm_tracer_t *tracer, int level, const char *msg);
+
+/**
+ * What a recorded event is, see svm_events_enable().
+ *
+ *  SVM_EVENT_SCAN_BEGIN - `svm_run` or `svm_run_watched` starting a scan.
+ *  SVM_EVENT_SCAN_END   - and ending it, `arg` the instructions it ran.
+ *  SVM_EVENT_CALL       - a `call` at `ip`, to `arg`.
+ *  SVM_EVENT_RET        - a `ret` at `ip`, to `arg`.
+ *  SVM_EVENT_LATCH      - inputs latched, `arg` nanoseconds it took.
+ *  SVM_EVENT_PUBLISH    - outputs published, `arg` nanoseconds it took.
+ *  SVM_EVENT_FAULT      - an instruction at `ip` failed, `arg` the error.
+ *  SVM_EVENT_ABORT      - the watchdog stopped the scan at `ip`.
+ */
+enum svm_event_type
+{
+    SVM_EVENT_SCAN_BEGIN,
+    SVM_EVENT_SCAN_END,
+    SVM_EVENT_CALL,
+    SVM_EVENT_RET,
+    SVM_EVENT_LATCH,
+    SVM_EVENT_PUBLISH,
+    SVM_EVENT_FAULT,
+    SVM_EVENT_ABORT
+};
+
+/**
+ * One recorded event, `ns` from the monotonic clock.
+ */
+struct svm_event
+{
+    uint64_t ns;
+    uint32_t arg;
+    uint16_t ip;
+    uint8_t type;
+};
+
+/**
+ * The last `mask + 1` events of a machine, `count` the number recorded
+ * since it was enabled - the oldest are written over once it is more.
+ */
+struct svm_events
+{
+    struct svm_event *ring;
+    uint32_t mask;
+    uint64_t count;
+};
+
+/**
+ * Start recording events into a ring of `capacity` of them, rounded up to
+ * a power of two, or stop and drop them with zero.  Returns 0, or -1 when
+ * out of memory.
+ *
+ * Recording is a binary write with a timestamp, no formatting: cheap
+ * enough to leave on in a slow scan.  While it is on `svm_run` uses the
+ * inline engine, the JIT and the generated WebAssembly don't record calls.
+ */
+int svm_events_enable(svm_t *cpup, uint32_t capacity);
+
+/**
+ * The clock the events are stamped with, in nanoseconds.
+ */
+uint64_t svm_events_now(void);
+
+/**
+ * Record an event, see SVM_EVENT() for the instructions.
+ */
+void svm_event(svm_t *cpup, int type, uint32_t ip, uint32_t arg);
+
+/**
+ * Record an event if recording is on, costing a test of `events` when it
+ * is off.
+ */
+#define SVM_EVENT(cpup, type, ip, arg)                  \
+    do                                                  \
+    {                                                   \
+        if ((cpup)->events)                             \
+            svm_event((cpup), (type), (ip), (arg));     \
+    } while (0)
+
+/**
+ * The recorded events as Chrome trace-event JSON, for Perfetto or
+ * chrome://tracing, with `tid` as the thread of all of them: scans and
+ * calls become slices, latching and publishing complete events, faults
+ * and aborts instant ones.  Writes at most `size` bytes including the
+ * terminator, and returns the length of the whole of it, like snprintf().
+ */
+size_t svm_events_export(svm_t *cpup, int tid, char *buf, size_t size);
+
+/**
+ * Executions and time of each opcode, and executions of each offset, see
+ * svm_profile_enable().  Time is in ticks of svm_cycles().
+ */
+struct svm_profile
+{
+    uint64_t counts[OPCODE_COUNT];
+    uint64_t cycles[OPCODE_COUNT];
+    uint32_t offsets[0xFFFF];
+};
+
+/**
+ * A cheap, increasing counter: the time-stamp counter on x86, the virtual
+ * counter on ARM64, and nanoseconds elsewhere - such as WebAssembly.
+ */
+static inline uint64_t svm_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return svm_events_now();
+#endif
+}
+
+/**
+ * Start profiling with counters all zero, or stop and drop them.  Returns
+ * 0, or -1 when out of memory.
+ *
+ * While it is on `svm_run` and `svm_step` use the reference loop, reading
+ * the counter once per instruction: the time of an instruction is the
+ * time from the end of the one before, so the loop's own share is spread
+ * over all of them.  A tracer attached takes precedence.
+ */
+int svm_profile_enable(svm_t *cpup, int enabled);
+
+/**
+ * Add the instruction just handled, and return the counter.
+ */
+static inline uint64_t svm_profile_count(struct svm_profile *profile, int opcode, uint32_t at, uint64_t before)
+{
+    uint64_t now = svm_cycles();
+
+    profile->counts[opcode]++;
+    profile->cycles[opcode] += now - before;
+    profile->offsets[at]++;
+    return now;
+}
+
+/**
+ * Name of an opcode, or NULL, and the group it belongs to in vm.h.
+ */
+const char *svm_opcode_name(int opcode);
+const char *svm_opcode_group(int opcode);
+
+/**
+ * Write the profile as text: the opcodes by time, the groups, and the
+ * `hot` offsets executed most.
+ */
+void svm_profile_report(svm_t *cpup, FILE *fp, int hot);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
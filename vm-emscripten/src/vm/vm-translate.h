@@ -0,0 +1,126 @@
+#ifndef F6NB1QZ8VK3XRJ5TWM2HC9LDE
+#define F6NB1QZ8VK3XRJ5TWM2HC9LDE
+
+#include <string.h>
+#include "vm-engine.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Support for the C translation units written by svm2c, see src/svm2c.c.
+ *
+ *  A translated program is one function with a label for every instruction
+ * and the same observable behaviour as svm_run.  It handles the common
+ * cases the way the inlined engine does and calls the vm-ops.c handler for
+ * everything else, so the whole scan cycle is visible to the C compiler.
+ * Like the other engines it works on the machine's copy of the process
+ * image, call svm_latch_inputs() before it and svm_publish_outputs() after.
+ */
+
+/**
+ * Register access.
+ */
+#define R(n) (svm->registers[n])
+
+/**
+ * The value of an integer or float register, as a float.
+ */
+#define SVM_NUMBER(r) ((r).tag == FLOAT ? (r).content.number : (float)(r).content.integer)
+
+/**
+ * Store an arithmetic result, setting the Z-flag from its integer content
+ * the way math_operation() does - for floats that's their bit pattern.
+ */
+#define SVM_SET_INT(n, value)                   \
+    do                                          \
+    {                                           \
+        int v_ = (int)(value);                  \
+        R(n).content.integer = v_;              \
+        R(n).tag = INTEGER;                    \
+        svm->jmp = v_ == 0;                     \
+    } while (0)
+
+#define SVM_SET_FLOAT(n, value)                 \
+    do                                          \
+    {                                           \
+        float v_ = (value);                     \
+        R(n).content.number = v_;               \
+        R(n).tag = FLOAT;                      \
+        svm->jmp = R(n).content.integer == 0;   \
+    } while (0)
+
+/**
+ * Run the instruction at `at` with its vm-ops.c handler, then carry on
+ * with the instruction at `next` - or wherever the handler left the
+ * instruction-pointer.
+ */
+#define SVM_HANDLER(at, next)                   \
+    do                                          \
+    {                                           \
+        svm->ip = (at);                         \
+        svm->handler_ip = (at);                 \
+        svm->opcodes[svm->code[at]](svm);       \
+        ip = svm->ip;                           \
+        if (!svm->running)                      \
+            goto done;                          \
+        if (svm->code_written)                  \
+            goto bail;                          \
+        if (ip != (next))                       \
+            goto dispatch;                      \
+    } while (0)
+
+/**
+ * Start of a translated program.  A machine which was loaded with some
+ * other program, or has already finished, is run by the inlined engine.
+ */
+#define SVM_BEGIN(program, length)                                   \
+    uint32_t ip = 0;                                                 \
+    uint32_t iterations = 0;                                         \
+                                                                     \
+    if (!svm)                                                        \
+        return;                                                      \
+    if (!svm->running || svm->size != (length) ||                    \
+        memcmp(svm->code, (program), (length)) != 0)                 \
+    {                                                                \
+        svm_run_inline(svm);                                         \
+        return;                                                      \
+    }                                                                \
+    svm->code_written = 0
+
+/**
+ * End of a translated program.
+ *
+ *  done - the program has finished, or ran off its end.
+ *  bail - the program jumped to an offset which isn't the start of a
+ *         translated instruction, or wrote to its own code; the inlined
+ *         engine finishes the run.
+ */
+#define SVM_END()                        \
+    done:                                \
+    svm->ip = ip;                        \
+    svm->running = 0;                    \
+    svm->iterations = iterations;        \
+    svm->fused = 0;                      \
+    svm->quick_hits = 0;                 \
+    svm->quick_misses = 0;               \
+    return;                              \
+                                         \
+    bail:                                \
+    svm->ip = ip;                        \
+    svm->iterations = iterations;        \
+    svm->fused = 0;                      \
+    svm->quick_hits = 0;                 \
+    svm->quick_misses = 0;               \
+    svm_resume_inline(svm)
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm-verify.h"
+#include "vm-decode.h"
+
+/**
+ * Helper to convert a two-byte value to an integer in the range 0x0000-0xffff
+ */
+#define BYTES_TO_ADDR(one, two) (one + (256 * two))
+
+/**
+ * What a routine does to the stacks, relative to the depth of the stack
+ * it is called at.  The program itself is the routine at offset zero,
+ * called at depth zero.
+ */
+struct routine
+{
+    /**
+     * Being verified, which a call to it makes a recursion, or done.
+     */
+    uint8_t busy;
+
+    /**
+     * Whether any path reaches a `ret`, and the depth it returns with.
+     */
+    uint8_t returns;
+    int32_t delta;
+
+    /**
+     * The deepest and shallowest the stack gets in it, and where - the
+     * shallowest is below zero when it pops what its caller pushed.
+     */
+    int32_t rise;
+    int32_t dip;
+    uint32_t rise_at;
+    uint32_t dip_at;
+
+    /**
+     * The deepest nesting of the calls it makes, and the call at the
+     * bottom of it.
+     */
+    uint32_t calls;
+    uint32_t calls_at;
+};
+
+/**
+ * The state of a verification.  There is an entry for each byte of the
+ * program in every array but the routines, of which there can't be more
+ * than one for every call instruction.
+ */
+struct verifier
+{
+    const unsigned char *code;
+    uint32_t size;
+
+    /**
+     * The start of the instruction covering each byte, plus one.
+     */
+    uint32_t *cover;
+
+    /**
+     * The routine each instruction reached belongs to, plus one, and the
+     * depth of the stack it is reached with.
+     */
+    uint16_t *owner;
+    int32_t *depth;
+
+    /**
+     * The routine starting at each offset, plus one.
+     */
+    uint16_t *entry;
+
+    struct routine *routines;
+    uint32_t routine_count;
+
+    /**
+     * Instructions still to be checked, the top ones belonging to the
+     * routine being verified.  Each is added once.
+     */
+    uint32_t *work;
+    uint32_t top;
+
+    struct svm_verification *result;
+};
+
+static int fail(struct verifier *v, int code, uint32_t ip)
+{
+    v->result->code = code;
+    v->result->ip = ip;
+    return -1;
+}
+
+/**
+ * Carry on from `from` to `ip` of the routine `index`, with the stack at
+ * `depth`.
+ */
+static int follow(struct verifier *v, uint32_t index, uint32_t from, uint32_t ip, int32_t depth)
+{
+    struct routine *r = &v->routines[index];
+
+    if (depth > r->rise)
+    {
+        r->rise = depth;
+        r->rise_at = from;
+    }
+    if (depth < r->dip)
+    {
+        r->dip = depth;
+        r->dip_at = from;
+    }
+
+    /**
+     * Running past the end of the program ends it.
+     */
+    if (ip == v->size)
+        return 0;
+
+    if (v->owner[ip] == 0)
+    {
+        v->owner[ip] = index + 1;
+        v->depth[ip] = depth;
+        v->work[v->top++] = ip;
+        return 0;
+    }
+
+    if (v->owner[ip] != index + 1 || v->depth[ip] != depth)
+        return fail(v, SVM_VERIFY_STACK, ip);
+    return 0;
+}
+
+static int verify_routine(struct verifier *v, uint32_t start, uint32_t level);
+
+/**
+ * A call from `ip` of the routine `index`, with the stack at `depth`.
+ */
+static int verify_call(struct verifier *v, uint32_t index, uint32_t ip, uint32_t target, int32_t depth,
+                       uint32_t level)
+{
+    int callee = v->entry[target] - 1;
+
+    if (callee >= 0 && v->routines[callee].busy)
+        return fail(v, SVM_VERIFY_CALLS, ip);
+
+    if (callee < 0)
+    {
+        if (level + 1 >= CALL_STACK_COUNT)
+            return fail(v, SVM_VERIFY_CALLS, ip);
+        callee = verify_routine(v, target, level + 1);
+        if (callee < 0)
+            return -1;
+    }
+
+    struct routine *r = &v->routines[index];
+    struct routine *c = &v->routines[callee];
+
+    if (depth + c->rise > r->rise)
+    {
+        r->rise = depth + c->rise;
+        r->rise_at = c->rise_at;
+    }
+    if (depth + c->dip < r->dip)
+    {
+        r->dip = depth + c->dip;
+        r->dip_at = c->dip_at;
+    }
+    if (c->calls + 1 > r->calls)
+    {
+        r->calls = c->calls + 1;
+        r->calls_at = c->calls ? c->calls_at : ip;
+    }
+
+    if (c->returns)
+        return follow(v, index, ip, ip + 3, depth + c->delta);
+    return 0;
+}
+
+/**
+ * Check one instruction of the routine `index`, and carry on to the ones
+ * it leads to.
+ */
+static int verify_insn(struct verifier *v, uint32_t index, uint32_t ip, uint32_t level)
+{
+    const unsigned char *code = v->code;
+    int32_t depth = v->depth[ip];
+    struct svm_operands operands;
+
+    if (v->cover[ip])
+        return fail(v, SVM_VERIFY_TARGET, ip);
+    if (!svm_operands(code[ip], &operands))
+        return fail(v, SVM_VERIFY_OPCODE, ip);
+
+    uint32_t length = operands.length;
+    if (operands.string && ip + length <= v->size)
+        length += BYTES_TO_ADDR(code[ip + 2], code[ip + 3]);
+    if (ip + length > v->size)
+        return fail(v, SVM_VERIFY_TRUNCATED, ip);
+
+    for (uint32_t at = ip; at < ip + length; at++)
+    {
+        if (v->cover[at])
+            return fail(v, SVM_VERIFY_TARGET, ip);
+        v->cover[at] = ip + 1;
+    }
+    v->result->instructions++;
+
+    for (int i = 0; i < operands.registers; i++)
+    {
+        if (code[ip + 1 + i] >= REGISTER_COUNT)
+            return fail(v, SVM_VERIFY_REGISTER, ip);
+    }
+    if (operands.ports && code[ip + 2] >= operands.ports)
+        return fail(v, SVM_VERIFY_PORT, ip);
+
+    uint32_t next = ip + length;
+    uint32_t target = 0;
+
+    if (operands.address)
+    {
+        target = BYTES_TO_ADDR(code[ip + 1], code[ip + 2]);
+        if (target >= v->size)
+            return fail(v, SVM_VERIFY_TARGET, ip);
+    }
+
+    switch (code[ip])
+    {
+    case EXIT:
+        return 0;
+
+    case STACK_RET:
+    {
+        struct routine *r = &v->routines[index];
+
+        if (index == 0)
+            return fail(v, SVM_VERIFY_CALLS, ip);
+        if (r->returns && r->delta != depth)
+            return fail(v, SVM_VERIFY_STACK, ip);
+        r->returns = 1;
+        r->delta = depth;
+        return 0;
+    }
+
+    case JUMP_TO:
+        return follow(v, index, ip, target, depth);
+
+    case JUMP_Z:
+    case JUMP_NZ:
+        if (follow(v, index, ip, target, depth) != 0)
+            return -1;
+        return follow(v, index, ip, next, depth);
+
+    case STACK_CALL:
+        return verify_call(v, index, ip, target, depth, level);
+
+    case STACK_PUSH:
+        return follow(v, index, ip, next, depth + 1);
+
+    case STACK_POP:
+        return follow(v, index, ip, next, depth - 1);
+
+    default:
+        return follow(v, index, ip, next, depth);
+    }
+}
+
+/**
+ * Verify the routine at `start`, called `level` calls deep.  Returns its
+ * index, or -1.
+ */
+static int verify_routine(struct verifier *v, uint32_t start, uint32_t level)
+{
+    uint32_t index = v->routine_count++;
+    uint32_t base = v->top;
+    struct routine *r = &v->routines[index];
+
+    memset(r, 0, sizeof(*r));
+    r->busy = 1;
+    r->rise_at = r->dip_at = start;
+    v->entry[start] = index + 1;
+
+    if (v->owner[start])
+        return fail(v, SVM_VERIFY_STACK, start);
+    v->owner[start] = index + 1;
+    v->depth[start] = 0;
+    v->work[v->top++] = start;
+
+    while (v->top > base)
+    {
+        if (verify_insn(v, index, v->work[--v->top], level) != 0)
+            return -1;
+    }
+
+    v->routines[index].busy = 0;
+    return index;
+}
+
+int svm_verify(svm_t *cpup, struct svm_verification *result)
+{
+    struct verifier v;
+    uint32_t size = cpup->size;
+
+    memset(result, 0, sizeof(*result));
+    if (size == 0)
+        return 0;
+
+    v.code = cpup->code;
+    v.size = size;
+    v.cover = calloc(size, sizeof(uint32_t));
+    v.owner = calloc(size, sizeof(uint16_t));
+    v.depth = malloc(size * sizeof(int32_t));
+    v.entry = calloc(size, sizeof(uint16_t));
+    v.routines = malloc((size / 3 + 1) * sizeof(struct routine));
+    v.routine_count = 0;
+    v.work = malloc(size * sizeof(uint32_t));
+    v.top = 0;
+    v.result = result;
+
+    int status = -1;
+
+    if (v.cover && v.owner && v.depth && v.entry && v.routines && v.work)
+    {
+        status = 0;
+
+        if (verify_routine(&v, 0, 0) == 0)
+        {
+            struct routine *program = &v.routines[0];
+
+            if (program->dip < 0)
+                fail(&v, SVM_VERIFY_STACK, program->dip_at);
+            else if (program->rise >= STACK_COUNT)
+                fail(&v, SVM_VERIFY_STACK, program->rise_at);
+            else if (program->calls >= CALL_STACK_COUNT)
+                fail(&v, SVM_VERIFY_CALLS, program->calls_at);
+
+            result->max_stack = program->rise;
+            result->max_calls = program->calls;
+        }
+    }
+
+    free(v.cover);
+    free(v.owner);
+    free(v.depth);
+    free(v.entry);
+    free(v.routines);
+    free(v.work);
+    return status;
+}
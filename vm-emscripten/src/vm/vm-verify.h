@@ -0,0 +1,44 @@
+#ifndef NO0BJX0HVH8URRFGH5X9676HY
+#define NO0BJX0HVH8URRFGH5X9676HY
+
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Verify the program of a machine, as svm_new() does when it loads it.
+ *
+ * Every path from offset zero is followed - both ways at a conditional
+ * jump, into the routine at a call and on past it when the routine
+ * returns - and each instruction reached is checked: a known opcode, its
+ * registers and I/O index in range, all of it within the program, and its
+ * jump or call destination the start of an instruction.  Two instructions
+ * may not overlap.
+ *
+ * The depth of the stack is followed too, relative to the depth each
+ * routine is called at, and has to be the same whichever path reaches an
+ * instruction: a loop which pushes more than it pops, or a routine which
+ * returns with different depths, isn't verified.  Neither are recursion
+ * and `ret` outside of a routine.  The deepest the stack and the call
+ * stack get must fit them, and the stack may never be popped when empty.
+ *
+ * A verified program runs on the handlers of vm-ops-verified.c, which
+ * speeds up the reference and call loops; the inlined engine and the JIT
+ * keep their own checks and gain little.
+ *
+ * The verdict goes into `result`, see `struct svm_verification`.  Returns
+ * zero, or -1 when out of memory.
+ */
+int svm_verify(svm_t *cpup, struct svm_verification *result);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
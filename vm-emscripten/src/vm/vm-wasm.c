@@ -0,0 +1,1156 @@
+/**
+ * WebAssembly code generation.
+ *
+ *  In the WebAssembly build the interpreter is itself WebAssembly, so every
+ * bytecode is dispatched twice.  svm_wasm_emit() instead generates a small
+ * module for the loaded program, with one function for the whole program:
+ *
+ *   block $bail
+ *     block $done
+ *       loop $dispatch
+ *         ip >= size ? br $done
+ *         block $insn[n-1] ... block $insn[0]
+ *           br_table ip -> $insn[...], default $bail
+ *         end  ;; code of instruction 0
+ *         end  ;; code of instruction 1
+ *         ...
+ *
+ *  Execution falls through from one instruction to the next, forward jumps
+ * branch directly to the end of the block of their destination, and other
+ * jumps set `ip` and go round the dispatch loop.
+ *
+ *  The registers, flags and stacks stay in the svm_t, which the module
+ * reaches through the memory it imports from the main module.  Like the
+ * inlined engine, the generated code guards the register types and stack
+ * space it relies on; when a guard fails, and for the opcodes it doesn't
+ * compile, it calls the vm-ops.c handler through the imported function
+ * table.  Jumps to an offset which isn't the start of an instruction, and
+ * writes to the code, leave the module and the inlined engine finishes
+ * the run.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm-wasm.h"
+#include "vm-decode.h"
+#include "vm-engine.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#endif
+
+/**
+ * The type, function and local indices of the module.
+ */
+enum
+{
+    TYPE_RUN,     /* (i32) -> i32 */
+    TYPE_HANDLER, /* (i32) -> () */
+};
+
+enum
+{
+    LOCAL_SVM,
+    LOCAL_IP,
+    LOCAL_ITERATIONS,
+    LOCAL_TEMP,
+    LOCAL_COUNT
+};
+
+/**
+ * Levels of the enclosing constructs, the block of instruction N is at
+ * level FIRST_INSN + (count - 1 - N).
+ */
+enum
+{
+    LEVEL_BAIL,
+    LEVEL_DONE,
+    LEVEL_DISPATCH,
+    LEVEL_FIRST_INSN
+};
+
+/**
+ * WebAssembly opcodes.
+ */
+enum
+{
+    W_BLOCK = 0x02,
+    W_LOOP = 0x03,
+    W_IF = 0x04,
+    W_ELSE = 0x05,
+    W_END = 0x0B,
+    W_BR = 0x0C,
+    W_BR_IF = 0x0D,
+    W_BR_TABLE = 0x0E,
+    W_RETURN = 0x0F,
+    W_CALL_INDIRECT = 0x11,
+    W_LOCAL_GET = 0x20,
+    W_LOCAL_SET = 0x21,
+    W_LOCAL_TEE = 0x22,
+    W_I32_LOAD = 0x28,
+    W_I32_LOAD8_U = 0x2D,
+    W_I32_STORE = 0x36,
+    W_F32_STORE = 0x38,
+    W_I32_STORE8 = 0x3A,
+    W_I32_CONST = 0x41,
+    W_I32_EQZ = 0x45,
+    W_I32_EQ = 0x46,
+    W_I32_NE = 0x47,
+    W_I32_LE_S = 0x4C,
+    W_I32_GE_S = 0x4E,
+    W_I32_GE_U = 0x4F,
+    W_I32_ADD = 0x6A,
+    W_I32_SUB = 0x6B,
+    W_I32_MUL = 0x6C,
+    W_I32_DIV_S = 0x6D,
+    W_I32_AND = 0x71,
+    W_I32_OR = 0x72,
+    W_I32_XOR = 0x73,
+    W_F32_CONVERT_I32_S = 0xB2,
+    W_VOID = 0x40,
+    W_TYPE_I32 = 0x7F
+};
+
+/**
+ * Offsets of the machine state.
+ */
+#define OFF_IP offsetof(svm_t, ip)
+#define OFF_HANDLER_IP offsetof(svm_t, handler_ip)
+#define OFF_JMP offsetof(svm_t, jmp)
+#define OFF_RUNNING offsetof(svm_t, running)
+#define OFF_WRITTEN offsetof(svm_t, code_written)
+#define OFF_ITERATIONS offsetof(svm_t, iterations)
+#define OFF_SP offsetof(svm_t, SP)
+#define OFF_CSP offsetof(svm_t, CSP)
+#define OFF_STACK offsetof(svm_t, stack)
+#define OFF_CALL_STACK offsetof(svm_t, call_stack)
+#define OFF_HANDLER(opcode) (offsetof(svm_t, opcodes) + (opcode) * sizeof(opcode_implementation *))
+#define OFF_REG(reg) (offsetof(svm_t, registers) + (reg) * sizeof(struct reg_t))
+#define OFF_INT(reg) (OFF_REG(reg) + offsetof(struct reg_t, content))
+#define OFF_TAG(reg) (OFF_REG(reg) + offsetof(struct reg_t, tag))
+#define OFF_IO(field, n) (offsetof(svm_t, io.field) + (n) * sizeof(((svm_t *)0)->io.field[0]))
+
+/**
+ * A growing byte buffer.
+ */
+struct buffer
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t cap;
+    int failed;
+};
+
+/**
+ * State of a code generation.
+ */
+struct codegen
+{
+    svm_t *svm;
+
+    /**
+     * The function body.
+     */
+    struct buffer body;
+
+    /**
+     * Index of the instruction starting at each offset, or NO_INSN.
+     */
+    uint32_t *index;
+    uint32_t count;
+
+    /**
+     * The instruction being generated, and the number of constructs open
+     * around it.
+     */
+    uint32_t current;
+    uint32_t depth;
+};
+
+#define NO_INSN UINT32_MAX
+
+static void byte(struct buffer *b, uint8_t value)
+{
+    if (b->failed)
+        return;
+
+    if (b->len == b->cap)
+    {
+        uint32_t cap = b->cap ? b->cap * 2 : 1024;
+        uint8_t *data = realloc(b->data, cap);
+        if (data == NULL)
+        {
+            b->failed = 1;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+
+    b->data[b->len++] = value;
+}
+
+static void bytes(struct buffer *b, const void *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+        byte(b, ((const uint8_t *)data)[i]);
+}
+
+static void uleb(struct buffer *b, uint32_t value)
+{
+    do
+    {
+        uint8_t low = value & 0x7F;
+        value >>= 7;
+        byte(b, value ? low | 0x80 : low);
+    } while (value);
+}
+
+static void sleb(struct buffer *b, int32_t value)
+{
+    for (;;)
+    {
+        uint8_t low = value & 0x7F;
+        value >>= 7;
+        if ((value == 0 && !(low & 0x40)) || (value == -1 && (low & 0x40)))
+        {
+            byte(b, low);
+            return;
+        }
+        byte(b, low | 0x80);
+    }
+}
+
+static void name(struct buffer *b, const char *s)
+{
+    uleb(b, strlen(s));
+    bytes(b, s, strlen(s));
+}
+
+/**
+ * Append a section, given its contents.
+ */
+static void section(struct buffer *module, uint8_t id, struct buffer *contents)
+{
+    byte(module, id);
+    uleb(module, contents->len);
+    bytes(module, contents->data, contents->len);
+    if (contents->failed)
+        module->failed = 1;
+
+    free(contents->data);
+    memset(contents, 0, sizeof(*contents));
+}
+
+/**
+ * Instructions of the function body.
+ */
+static void op(struct codegen *g, uint8_t opcode)
+{
+    byte(&g->body, opcode);
+}
+
+static void i32_const(struct codegen *g, int32_t value)
+{
+    op(g, W_I32_CONST);
+    sleb(&g->body, value);
+}
+
+static void local_get(struct codegen *g, uint32_t local)
+{
+    op(g, W_LOCAL_GET);
+    uleb(&g->body, local);
+}
+
+static void local_set(struct codegen *g, uint32_t local)
+{
+    op(g, W_LOCAL_SET);
+    uleb(&g->body, local);
+}
+
+static void local_tee(struct codegen *g, uint32_t local)
+{
+    op(g, W_LOCAL_TEE);
+    uleb(&g->body, local);
+}
+
+/**
+ * A load or store, with its alignment as a power of two.
+ */
+static void memory(struct codegen *g, uint8_t opcode, uint32_t align, size_t offset)
+{
+    op(g, opcode);
+    uleb(&g->body, align);
+    uleb(&g->body, offset);
+}
+
+/**
+ * Push a field of the svm_t.
+ */
+static void load32(struct codegen *g, size_t offset)
+{
+    local_get(g, LOCAL_SVM);
+    memory(g, W_I32_LOAD, 2, offset);
+}
+
+static void load8(struct codegen *g, size_t offset)
+{
+    local_get(g, LOCAL_SVM);
+    memory(g, W_I32_LOAD8_U, 0, offset);
+}
+
+/**
+ * Store to a field of the svm_t, after `local.get svm` and the value.
+ */
+static void store32(struct codegen *g, size_t offset)
+{
+    memory(g, W_I32_STORE, 2, offset);
+}
+
+static void store8(struct codegen *g, size_t offset)
+{
+    memory(g, W_I32_STORE8, 0, offset);
+}
+
+/**
+ * Store a constant to a field of the svm_t.
+ */
+static void store32_const(struct codegen *g, size_t offset, int32_t value)
+{
+    local_get(g, LOCAL_SVM);
+    i32_const(g, value);
+    store32(g, offset);
+}
+
+/**
+ * Structured control.
+ */
+static void enter(struct codegen *g, uint8_t opcode)
+{
+    op(g, opcode);
+    op(g, W_VOID);
+    g->depth++;
+}
+
+static void otherwise(struct codegen *g)
+{
+    op(g, W_ELSE);
+}
+
+static void end(struct codegen *g)
+{
+    op(g, W_END);
+    g->depth--;
+}
+
+static uint32_t insn_level(struct codegen *g, uint32_t n)
+{
+    return LEVEL_FIRST_INSN + (g->count - 1 - n);
+}
+
+static void br(struct codegen *g, uint8_t opcode, uint32_t level)
+{
+    op(g, opcode);
+    uleb(&g->body, g->depth - 1 - level);
+}
+
+/**
+ * Continue at the given offset.
+ */
+static void jump(struct codegen *g, uint32_t to)
+{
+    if (to < g->svm->size && g->index[to] != NO_INSN && g->index[to] > g->current)
+    {
+        br(g, W_BR, insn_level(g, g->index[to]));
+        return;
+    }
+
+    i32_const(g, to);
+    local_set(g, LOCAL_IP);
+    br(g, W_BR, to < g->svm->size ? LEVEL_DISPATCH : LEVEL_DONE);
+}
+
+/**
+ * Run an instruction with its vm-ops.c handler, then carry on with the
+ * instruction after it - or wherever the handler left the
+ * instruction-pointer.
+ */
+static void handler(struct codegen *g, uint32_t at, uint32_t next)
+{
+    store32_const(g, OFF_IP, at);
+    store32_const(g, OFF_HANDLER_IP, at);
+
+    local_get(g, LOCAL_SVM);
+    load32(g, OFF_HANDLER(g->svm->code[at]));
+    op(g, W_CALL_INDIRECT);
+    uleb(&g->body, TYPE_HANDLER);
+    uleb(&g->body, 0);
+
+    load32(g, OFF_IP);
+    local_set(g, LOCAL_IP);
+
+    load8(g, OFF_RUNNING);
+    op(g, W_I32_EQZ);
+    br(g, W_BR_IF, LEVEL_DONE);
+
+    load8(g, OFF_WRITTEN);
+    br(g, W_BR_IF, LEVEL_BAIL);
+
+    local_get(g, LOCAL_IP);
+    i32_const(g, next);
+    op(g, W_I32_NE);
+    br(g, W_BR_IF, LEVEL_DISPATCH);
+}
+
+/**
+ * Guarded code: the condition is on the stack, when it holds the handler
+ * runs the instruction, otherwise the code up to guard_end() does.
+ */
+static void guard(struct codegen *g, uint32_t at, uint32_t next)
+{
+    enter(g, W_IF);
+    handler(g, at, next);
+    otherwise(g);
+}
+
+static void guard_end(struct codegen *g)
+{
+    end(g);
+}
+
+/**
+ * Push (register type == type), or != when `equal` is zero.
+ */
+static void type_is(struct codegen *g, int reg, int type, int equal)
+{
+    load32(g, OFF_TAG(reg));
+    i32_const(g, SVM_TYPE_MASK);
+    op(g, W_I32_AND);
+    i32_const(g, type);
+    op(g, equal ? W_I32_EQ : W_I32_NE);
+}
+
+/**
+ * Store the integer in LOCAL_TEMP to a register and set the Z-flag from it.
+ */
+static void set_int(struct codegen *g, int reg)
+{
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_TEMP);
+    store32(g, OFF_INT(reg));
+    store32_const(g, OFF_TAG(reg), INTEGER);
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_TEMP);
+    op(g, W_I32_EQZ);
+    store8(g, OFF_JMP);
+}
+
+/**
+ * Push the address of the stack entry LOCAL_TEMP, less the svm_t.
+ */
+static void stack_entry(struct codegen *g)
+{
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_TEMP);
+    i32_const(g, sizeof(struct reg_t));
+    op(g, W_I32_MUL);
+    op(g, W_I32_ADD);
+}
+
+/**
+ * Copy a register to or from the stack entry LOCAL_TEMP, a word at a time.
+ */
+static void push_register(struct codegen *g, int reg)
+{
+    for (size_t w = 0; w < sizeof(struct reg_t); w += 4)
+    {
+        stack_entry(g);
+        load32(g, OFF_REG(reg) + w);
+        store32(g, OFF_STACK + w);
+    }
+}
+
+static void pop_register(struct codegen *g, int reg)
+{
+    for (size_t w = 0; w < sizeof(struct reg_t); w += 4)
+    {
+        local_get(g, LOCAL_SVM);
+        stack_entry(g);
+        memory(g, W_I32_LOAD, 2, OFF_STACK + w);
+        store32(g, OFF_REG(reg) + w);
+    }
+}
+
+/**
+ * Copy a register to or from another field of the svm_t.
+ */
+static void save_register(struct codegen *g, int reg, size_t to)
+{
+    for (size_t w = 0; w < sizeof(struct reg_t); w += 4)
+    {
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_REG(reg) + w);
+        store32(g, to + w);
+    }
+}
+
+static void load_register(struct codegen *g, int reg, size_t from)
+{
+    for (size_t w = 0; w < sizeof(struct reg_t); w += 4)
+    {
+        local_get(g, LOCAL_SVM);
+        load32(g, from + w);
+        store32(g, OFF_REG(reg) + w);
+    }
+}
+
+/**
+ * Generate the code of one instruction.
+ */
+static void generate(struct codegen *g, uint32_t at, struct svm_insn *insn)
+{
+    uint8_t opcode = g->svm->code[at];
+    uint32_t next = insn->next;
+    int r0 = insn->reg[0], r1 = insn->reg[1], r2 = insn->reg[2];
+
+    /**
+     * Count the instruction.
+     */
+    local_get(g, LOCAL_ITERATIONS);
+    i32_const(g, 1);
+    op(g, W_I32_ADD);
+    local_set(g, LOCAL_ITERATIONS);
+
+    if (insn->opcode == INSN_DELEGATE)
+    {
+        handler(g, at, next);
+        goto fall_through;
+    }
+
+    switch (opcode)
+    {
+    case EXIT:
+        i32_const(g, at + 1);
+        local_set(g, LOCAL_IP);
+        br(g, W_BR, LEVEL_DONE);
+        return;
+
+    case INT_STORE:
+    case FLOAT_STORE:
+        type_is(g, r0, STRING, 1);
+        guard(g, at, next);
+        store32_const(g, OFF_INT(r0), insn->imm.integer);
+        store32_const(g, OFF_TAG(r0), opcode == INT_STORE ? INTEGER : FLOAT);
+        guard_end(g);
+        break;
+
+    case BINARY_LOAD:
+    case ANALOG_LOAD:
+        type_is(g, r0, STRING, 1);
+        guard(g, at, next);
+        local_get(g, LOCAL_SVM);
+        if (opcode == BINARY_LOAD)
+            load8(g, OFF_IO(in.binary, r1));
+        else
+            load32(g, OFF_IO(in.analog, r1));
+        store32(g, OFF_INT(r0));
+        store32_const(g, OFF_TAG(r0), opcode == BINARY_LOAD ? INTEGER : FLOAT);
+        guard_end(g);
+        break;
+
+    case BINARY_SAVE:
+        type_is(g, r0, INTEGER, 1);
+        enter(g, W_IF);
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_INT(r0));
+        store8(g, OFF_IO(out.binary, r1));
+        end(g);
+        break;
+
+    case ANALOG_SAVE:
+        type_is(g, r0, FLOAT, 1);
+        enter(g, W_IF);
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_INT(r0));
+        store32(g, OFF_IO(out.analog, r1));
+        end(g);
+        type_is(g, r0, INTEGER, 1);
+        enter(g, W_IF);
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_INT(r0));
+        op(g, W_F32_CONVERT_I32_S);
+        memory(g, W_F32_STORE, 2, OFF_IO(out.analog, r1));
+        end(g);
+        break;
+
+    case VARIABLE_LOAD:
+        type_is(g, r0, STRING, 1);
+        guard(g, at, next);
+        load_register(g, r0, OFF_IO(variables, r1));
+        guard_end(g);
+        break;
+
+    case VARIABLE_SAVE:
+        save_register(g, r0, OFF_IO(variables, r1));
+        break;
+
+    case JUMP_TO:
+        jump(g, insn->target);
+        return;
+
+    case JUMP_Z:
+    case JUMP_NZ:
+        load8(g, OFF_JMP);
+        if (opcode == JUMP_NZ)
+            op(g, W_I32_EQZ);
+        enter(g, W_IF);
+        jump(g, insn->target);
+        end(g);
+        break;
+
+    case ADD:
+    case SUB:
+    case MUL:
+    case DIV:
+    case AND:
+    case OR:
+    case XOR:
+    {
+        static const uint8_t operators[] = {
+            [ADD - XOR] = W_I32_ADD,
+            [SUB - XOR] = W_I32_SUB,
+            [MUL - XOR] = W_I32_MUL,
+            [DIV - XOR] = W_I32_DIV_S,
+            [AND - XOR] = W_I32_AND,
+            [OR - XOR] = W_I32_OR,
+            [XOR - XOR] = W_I32_XOR,
+        };
+
+        type_is(g, r1, INTEGER, 0);
+        type_is(g, r2, INTEGER, 0);
+        op(g, W_I32_OR);
+        type_is(g, r0, STRING, 1);
+        op(g, W_I32_OR);
+        if (opcode == DIV)
+        {
+            load32(g, OFF_INT(r2));
+            op(g, W_I32_EQZ);
+            op(g, W_I32_OR);
+        }
+        guard(g, at, next);
+        load32(g, OFF_INT(r1));
+        load32(g, OFF_INT(r2));
+        op(g, operators[opcode - XOR]);
+        local_set(g, LOCAL_TEMP);
+        set_int(g, r0);
+        guard_end(g);
+        break;
+    }
+
+    case INC:
+    case DEC:
+        type_is(g, r0, INTEGER, 0);
+        guard(g, at, next);
+        load32(g, OFF_INT(r0));
+        i32_const(g, 1);
+        op(g, opcode == INC ? W_I32_ADD : W_I32_SUB);
+        local_set(g, LOCAL_TEMP);
+        set_int(g, r0);
+        guard_end(g);
+        break;
+
+    case CMP_REG:
+        type_is(g, r0, STRING, 1);
+        guard(g, at, next);
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_TAG(r0));
+        load32(g, OFF_TAG(r1));
+        op(g, W_I32_EQ);
+        load32(g, OFF_INT(r0));
+        load32(g, OFF_INT(r1));
+        op(g, W_I32_EQ);
+        op(g, W_I32_AND);
+        store8(g, OFF_JMP);
+        guard_end(g);
+        break;
+
+    case CMP_IMMEDIATE:
+        type_is(g, r0, INTEGER, 0);
+        guard(g, at, next);
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_INT(r0));
+        i32_const(g, insn->imm.integer);
+        op(g, W_I32_EQ);
+        store8(g, OFF_JMP);
+        guard_end(g);
+        break;
+
+    case IS_STRING:
+    case IS_INTEGER:
+        local_get(g, LOCAL_SVM);
+        type_is(g, r0, opcode == IS_STRING ? STRING : INTEGER, 1);
+        store8(g, OFF_JMP);
+        break;
+
+    case NOP:
+        break;
+
+    case STORE_REG:
+        type_is(g, r1, STRING, 1);
+        type_is(g, r0, STRING, 1);
+        op(g, W_I32_OR);
+        guard(g, at, next);
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_TAG(r1));
+        store32(g, OFF_TAG(r0));
+        local_get(g, LOCAL_SVM);
+        load32(g, OFF_INT(r1));
+        store32(g, OFF_INT(r0));
+        guard_end(g);
+        break;
+
+    case STACK_PUSH:
+        type_is(g, r0, STRING, 1);
+        load32(g, OFF_SP);
+        i32_const(g, STACK_COUNT - 1);
+        op(g, W_I32_GE_S);
+        op(g, W_I32_OR);
+        guard(g, at, next);
+        load32(g, OFF_SP);
+        i32_const(g, 1);
+        op(g, W_I32_ADD);
+        local_set(g, LOCAL_TEMP);
+        local_get(g, LOCAL_SVM);
+        local_get(g, LOCAL_TEMP);
+        store32(g, OFF_SP);
+        push_register(g, r0);
+        guard_end(g);
+        break;
+
+    case STACK_POP:
+        type_is(g, r0, STRING, 1);
+        load32(g, OFF_SP);
+        i32_const(g, 0);
+        op(g, W_I32_LE_S);
+        op(g, W_I32_OR);
+        guard(g, at, next);
+        load32(g, OFF_SP);
+        local_set(g, LOCAL_TEMP);
+        pop_register(g, r0);
+        local_get(g, LOCAL_SVM);
+        local_get(g, LOCAL_TEMP);
+        i32_const(g, 1);
+        op(g, W_I32_SUB);
+        store32(g, OFF_SP);
+        guard_end(g);
+        break;
+
+    case STACK_RET:
+        load32(g, OFF_CSP);
+        i32_const(g, 0);
+        op(g, W_I32_LE_S);
+        guard(g, at, next);
+        load32(g, OFF_CSP);
+        local_tee(g, LOCAL_TEMP);
+        i32_const(g, 4);
+        op(g, W_I32_MUL);
+        local_get(g, LOCAL_SVM);
+        op(g, W_I32_ADD);
+        memory(g, W_I32_LOAD, 2, OFF_CALL_STACK);
+        local_set(g, LOCAL_IP);
+        local_get(g, LOCAL_SVM);
+        local_get(g, LOCAL_TEMP);
+        i32_const(g, 1);
+        op(g, W_I32_SUB);
+        store32(g, OFF_CSP);
+        br(g, W_BR, LEVEL_DISPATCH);
+        guard_end(g);
+        break;
+
+    case STACK_CALL:
+        load32(g, OFF_CSP);
+        i32_const(g, CALL_STACK_COUNT - 1);
+        op(g, W_I32_GE_S);
+        guard(g, at, next);
+        load32(g, OFF_CSP);
+        i32_const(g, 1);
+        op(g, W_I32_ADD);
+        local_set(g, LOCAL_TEMP);
+        local_get(g, LOCAL_SVM);
+        local_get(g, LOCAL_TEMP);
+        store32(g, OFF_CSP);
+        local_get(g, LOCAL_TEMP);
+        i32_const(g, 4);
+        op(g, W_I32_MUL);
+        local_get(g, LOCAL_SVM);
+        op(g, W_I32_ADD);
+        i32_const(g, at + 3);
+        memory(g, W_I32_STORE, 2, OFF_CALL_STACK);
+        jump(g, insn->target);
+        guard_end(g);
+        break;
+
+    default:
+        handler(g, at, next);
+        break;
+    }
+
+fall_through:
+    /**
+     * The instruction after this one follows, unless this was the last.
+     */
+    if (next >= g->svm->size)
+        jump(g, next);
+}
+
+/**
+ * Generate the function body.
+ */
+static void generate_body(struct codegen *g)
+{
+    struct buffer *b = &g->body;
+    struct svm_insn insn;
+    uint32_t size = g->svm->size;
+
+    uleb(b, 1);
+    uleb(b, LOCAL_COUNT - 1);
+    byte(b, W_TYPE_I32);
+
+    enter(g, W_BLOCK); /* $bail */
+    enter(g, W_BLOCK); /* $done */
+    enter(g, W_LOOP);  /* $dispatch */
+
+    local_get(g, LOCAL_IP);
+    i32_const(g, size);
+    op(g, W_I32_GE_U);
+    br(g, W_BR_IF, LEVEL_DONE);
+
+    for (uint32_t n = 0; n < g->count; n++)
+        enter(g, W_BLOCK);
+
+    /**
+     * The block of instruction N is at depth N from here.
+     */
+    local_get(g, LOCAL_IP);
+    op(g, W_BR_TABLE);
+    uleb(b, size);
+    for (uint32_t ip = 0; ip < size; ip++)
+        uleb(b, g->index[ip] != NO_INSN ? g->index[ip] : g->depth - 1 - LEVEL_BAIL);
+    uleb(b, g->depth - 1 - LEVEL_BAIL);
+
+    for (uint32_t ip = 0; ip < size;)
+    {
+        svm_decode_insn(g->svm, ip, &insn);
+        end(g);
+        g->current = g->index[ip];
+        generate(g, ip, &insn);
+        ip = insn.next;
+    }
+
+    end(g); /* $dispatch */
+    end(g); /* $done */
+
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_IP);
+    store32(g, OFF_IP);
+    local_get(g, LOCAL_SVM);
+    i32_const(g, 0);
+    store8(g, OFF_RUNNING);
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_ITERATIONS);
+    store32(g, OFF_ITERATIONS);
+    i32_const(g, 0);
+    op(g, W_RETURN);
+
+    end(g); /* $bail */
+
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_IP);
+    store32(g, OFF_IP);
+    local_get(g, LOCAL_SVM);
+    local_get(g, LOCAL_ITERATIONS);
+    store32(g, OFF_ITERATIONS);
+    i32_const(g, 1);
+
+    op(g, W_END);
+}
+
+/**
+ * Generate a WebAssembly module for the program of a virtual machine.
+ */
+uint8_t *svm_wasm_emit(svm_t *svm, uint32_t *size)
+{
+    static const uint8_t header[] = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00};
+
+    struct codegen g;
+    struct buffer module = {0}, contents = {0};
+    struct svm_insn insn;
+
+    if (!svm || !size)
+        return NULL;
+
+    memset(&g, 0, sizeof(g));
+    g.svm = svm;
+    g.index = malloc(svm->size * sizeof(uint32_t));
+    if (g.index == NULL)
+        return NULL;
+
+    for (uint32_t ip = 0; ip < svm->size; ip++)
+        g.index[ip] = NO_INSN;
+
+    for (uint32_t ip = 0; ip < svm->size;)
+    {
+        svm_decode_insn(svm, ip, &insn);
+        g.index[ip] = g.count++;
+        ip = insn.next;
+    }
+
+    generate_body(&g);
+    free(g.index);
+
+    bytes(&module, header, sizeof(header));
+
+    /**
+     * Types: run and the vm-ops.c handlers.
+     */
+    uleb(&contents, 2);
+    bytes(&contents, (const uint8_t[]){0x60, 1, W_TYPE_I32, 1, W_TYPE_I32}, 5);
+    bytes(&contents, (const uint8_t[]){0x60, 1, W_TYPE_I32, 0}, 4);
+    section(&module, 1, &contents);
+
+    /**
+     * Imports: the memory and function table of the main module.
+     */
+    uleb(&contents, 2);
+    name(&contents, "env");
+    name(&contents, "memory");
+    bytes(&contents, (const uint8_t[]){0x02, 0x00, 1}, 3);
+    name(&contents, "env");
+    name(&contents, "table");
+    bytes(&contents, (const uint8_t[]){0x01, 0x70, 0x00, 0}, 4);
+    section(&module, 2, &contents);
+
+    /**
+     * The function, and its export.
+     */
+    uleb(&contents, 1);
+    uleb(&contents, TYPE_RUN);
+    section(&module, 3, &contents);
+
+    uleb(&contents, 1);
+    name(&contents, "run");
+    byte(&contents, 0x00);
+    uleb(&contents, 0);
+    section(&module, 7, &contents);
+
+    uleb(&contents, 1);
+    uleb(&contents, g.body.len);
+    bytes(&contents, g.body.data, g.body.len);
+    if (g.body.failed)
+        contents.failed = 1;
+    section(&module, 10, &contents);
+    free(g.body.data);
+
+    if (module.failed)
+    {
+        free(module.data);
+        return NULL;
+    }
+
+    *size = module.len;
+    return module.data;
+}
+
+static int enabled = 1;
+
+void svm_wasm_enable(int enable)
+{
+    enabled = enable;
+}
+
+#ifdef __EMSCRIPTEN__
+
+/**
+ * Instantiate a generated module with the memory and function table of
+ * this one.  Browsers only compile small modules synchronously on the main
+ * thread, larger ones are compiled in the background and the interpreter
+ * runs the program until they're ready.
+ */
+EM_JS(int, svm_wasm_instantiate, (const uint8_t *bytes, uint32_t size), {
+    var programs = Module.svmPrograms || (Module.svmPrograms = []);
+    var released = Module.svmReleased || (Module.svmReleased = []);
+    var handle = released.length ? released.pop() : programs.length;
+    var copy = HEAPU8.slice(bytes, bytes + size);
+    var imports = { env: { memory: wasmMemory, table: wasmTable } };
+    var pending = {};
+
+    programs[handle] = pending;
+    try {
+        programs[handle] = new WebAssembly.Instance(new WebAssembly.Module(copy), imports).exports.run;
+    } catch (e) {
+        WebAssembly.instantiate(copy, imports).then(function (result) {
+            if (programs[handle] === pending)
+                programs[handle] = result.instance.exports.run;
+        }, function () {});
+    }
+    return handle;
+});
+
+/**
+ * Run an instantiated module, -1 when it isn't ready.
+ */
+EM_JS(int, svm_wasm_invoke, (int handle, svm_t *svm), {
+    var run = Module.svmPrograms[handle];
+    return typeof run === 'function' ? run(svm) : -1;
+});
+
+/**
+ * Give the slot of a module to the next one, dropping a module which is
+ * still being instantiated once it is.
+ */
+EM_JS(void, svm_wasm_release, (int handle), {
+    Module.svmPrograms[handle] = false;
+    Module.svmReleased.push(handle);
+});
+
+/**
+ * The module of the last machine freed, and the program it was generated
+ * for, so that running one program on a machine after another - as
+ * RunProgram does - generates it once.
+ */
+static struct
+{
+    unsigned char *code;
+    uint32_t size;
+    int handle;
+} spare = {NULL, 0, -1};
+
+static void release_spare(void)
+{
+    if (spare.handle >= 0)
+        svm_wasm_release(spare.handle);
+    free(spare.code);
+    spare.code = NULL;
+    spare.handle = -1;
+}
+
+/**
+ * Release the generated module of a virtual machine, keeping it as the
+ * spare while it still matches the code.
+ */
+void svm_wasm_free(svm_t *svm)
+{
+    if (!svm || !svm->wasm)
+        return;
+
+    int handle = svm->wasm - 1;
+    svm->wasm = 0;
+
+    if (svm->jit_stale || svm->code_written)
+    {
+        svm_wasm_release(handle);
+        return;
+    }
+
+    release_spare();
+    spare.code = malloc(svm->size);
+    if (spare.code == NULL)
+    {
+        svm_wasm_release(handle);
+        return;
+    }
+    memcpy(spare.code, svm->code, svm->size);
+    spare.size = svm->size;
+    spare.handle = handle;
+}
+
+/**
+ * The module for the code of a virtual machine, generating it when the
+ * machine has none or the code has been written to since.
+ */
+static int module_for(svm_t *svm)
+{
+    if (svm->jit_stale && svm->wasm)
+    {
+        svm_wasm_release(svm->wasm - 1);
+        svm->wasm = 0;
+    }
+    svm->jit_stale = 0;
+
+    if (svm->wasm)
+        return svm->wasm - 1;
+
+    if (spare.code && spare.size == svm->size && memcmp(spare.code, svm->code, svm->size) == 0)
+    {
+        svm->wasm = spare.handle + 1;
+        free(spare.code);
+        spare.code = NULL;
+        spare.handle = -1;
+        return svm->wasm - 1;
+    }
+
+    uint32_t size;
+    uint8_t *module = svm_wasm_emit(svm, &size);
+    if (module)
+    {
+        svm->wasm = svm_wasm_instantiate(module, size) + 1;
+        free(module);
+    }
+
+    return svm->wasm - 1;
+}
+
+/**
+ * Run the generated code for the program of a virtual machine.
+ */
+void svm_run_wasm(svm_t *svm)
+{
+    if (!svm)
+        return;
+
+    int handle = enabled && svm->running ? module_for(svm) : -1;
+
+    /**
+     * The module matches the code as it is now, any write from here on
+     * makes it leave.
+     */
+    svm->ip = 0;
+    svm->iterations = 0;
+    svm->fused = 0;
+    svm->quick_hits = 0;
+    svm->quick_misses = 0;
+    svm->code_written = 0;
+
+    int status = handle >= 0 ? svm_wasm_invoke(handle, svm) : -1;
+
+    if (status < 0)
+        svm_run_inline(svm);
+    else if (status > 0)
+    {
+        /**
+         * The module no longer matches a program which modified itself.
+         */
+        if (svm->code_written)
+        {
+            svm_wasm_release(handle);
+            svm->wasm = 0;
+        }
+
+        svm_resume_inline(svm);
+    }
+}
+
+#else
+
+void svm_run_wasm(svm_t *svm)
+{
+    svm_run_inline(svm);
+}
+
+void svm_wasm_free(svm_t *svm)
+{
+    (void)svm;
+}
+
+#endif
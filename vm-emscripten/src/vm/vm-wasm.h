@@ -0,0 +1,60 @@
+#ifndef B8MX3RV6QJ1ZKT9WN4HC7PLDY
+#define B8MX3RV6QJ1ZKT9WN4HC7PLDY
+
+#include "vm.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * The WebAssembly build can have svm_run go through code generated for the
+ * loaded program, see vm-wasm.c, with -DSVM_USE_WASM=1.
+ */
+#ifndef SVM_USE_WASM
+#define SVM_USE_WASM 0
+#endif
+
+/**
+ * Generate a WebAssembly module for the program loaded in a virtual
+ * machine.
+ *
+ * The module imports `env.memory` and `env.table` - the memory and the
+ * function table of the module the virtual machine was built into - and
+ * exports `run(svm)`, which returns 0 when the program has finished and 1
+ * when the run has to be finished by svm_resume_inline().
+ *
+ * Returns a buffer allocated with malloc(), or NULL.
+ */
+uint8_t *svm_wasm_emit(svm_t *cpup, uint32_t *size);
+
+/**
+ * Enable or disable running through generated code, enabled by default in
+ * builds with SVM_USE_WASM.
+ */
+void svm_wasm_enable(int enabled);
+
+/**
+ * Run the generated code for the program of a virtual machine.
+ *
+ * Each machine has a module of its own, generated and instantiated the
+ * first time it runs and again once its code has been written to.  The
+ * module of a machine which is freed is kept for the next machine loaded
+ * with the same program.  Until it is ready, and outside of the
+ * WebAssembly build, the inlined engine runs the program instead.
+ */
+void svm_run_wasm(svm_t *cpup);
+
+/**
+ * Release the generated module of a virtual machine, if any.
+ */
+void svm_wasm_free(svm_t *cpup);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
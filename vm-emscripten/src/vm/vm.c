@@ -1,44 +1,779 @@
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/uio.h>
 
-#include "vm.h"
+#include "vm-engine.h"
+#include "vm-decode.h"
+#include "vm-jit.h"
+#include "vm-trace.h"
+#include "vm-verify.h"
+#include "vm-wasm.h"
 
 /**
- * Initialization function in vm-ops.c.
+ * Initialization function in vm-ops.c, and the choice of handler table.
  */
 void opcode_init(struct svm *cpu);
+void opcode_select(struct svm *cpu);
+
+/**
+ * Record the error, stop the machine, tell the error handler, then
+ * abandon the instruction by unwinding to `svm_run` or `svm_step`.
+ */
+void svm_fault(svm_t *cpup, int code, const char *msg)
+{
+    cpup->error.code = code;
+    cpup->error.ip = cpup->handler_ip;
+    cpup->error.opcode = cpup->code[cpup->handler_ip];
+    cpup->error.message = msg;
+
+    cpup->faulted = 1;
+    cpup->running = 0;
+
+    SVM_EVENT(cpup, SVM_EVENT_FAULT, cpup->handler_ip, code);
+
+    /**
+     * If the user has registered an error-handler tell it, it may also
+     * exit.
+     */
+    if (cpup->error_handler)
+        (*cpup->error_handler)((char *)msg);
+
+    if (cpup->unwind)
+        longjmp(*cpup->unwind, 1);
+
+    /**
+     * NOTE: Nothing to unwind to - an engine was called directly.  If the
+     *       users' handler returned so does svm_fault, and the failing
+     *       handler returns right after it without touching anything
+     *       more; nothing after it runs.
+     */
+    if (cpup->error_handler)
+        return;
+
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
 
 /**
  * This function is called if there is an error in handling
- * a bytecode program - such as a mismatched type, or division by zero.
+ * a bytecode program which has no code of its own.
  */
 void svm_default_error_handler(svm_t *cpup, char *msg)
 {
+    svm_fault(cpup, SVM_ERROR_OTHER, msg);
+}
+
+/**
+ * The default sink: each part to `jsprintf_handler`, as one message.
+ */
+static void output_jsprintf(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    (void)cpup;
+
+    if (!jsprintf_handler)
+        return;
+    if (length)
+        jsprintf_handler((char *)text);
+    if (more_length)
+        jsprintf_handler((char *)more);
+}
+
+void svm_output_writev(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    struct iovec parts[2] = {{(void *)text, length}, {(void *)more, more_length}};
+    struct iovec *part = parts;
+    int count = more_length ? 2 : 1;
+
     /**
-     * If the user has registered an error-handler use that instead
-     * of this function.
+     * Carry on after a short write, to a pipe say.
      */
-    if (cpup->error_handler)
+    while (count > 0)
     {
-        (*cpup->error_handler)(msg);
+        ssize_t written = writev(cpup->output.fd, part, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
 
-        /**
-         * NOTE: If the users' handler doesn't exit then there
-         *       WILL BE UNDEFINED BEHAVIOUR
-         */
+        while (count > 0 && (size_t)written >= part->iov_len)
+        {
+            written -= part->iov_len;
+            part++;
+            count--;
+        }
+        if (count > 0)
+        {
+            part->iov_base = (char *)part->iov_base + written;
+            part->iov_len -= written;
+        }
+    }
+}
+
+static void output_sink(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    struct svm_output *out = &cpup->output;
+
+    out->flushes++;
+    (out->sink ? out->sink : output_jsprintf)(cpup, text, length, more, more_length);
+}
+
+void svm_flush_output(svm_t *cpup)
+{
+    struct svm_output *out = &cpup->output;
+
+    if (!out->length)
         return;
+
+    out->data[out->length] = '\0';
+    output_sink(cpup, out->data, out->length, "", 0);
+    out->length = 0;
+}
+
+void svm_set_output(svm_t *cpup, uint32_t capacity, int policy, svm_output_sink *sink)
+{
+    struct svm_output *out = &cpup->output;
+
+    svm_flush_output(cpup);
+
+    if (capacity && capacity != out->capacity)
+    {
+        free(out->data);
+        out->data = NULL;
+        out->capacity = capacity;
     }
+    out->policy = policy;
+    out->sink = sink;
+}
+
+int svm_printf(svm_t *cpup, const char *fmt, ...)
+{
+    struct svm_output *out = &cpup->output;
+    va_list args;
 
     /**
-     * No error-handler defined, or one was defined which didn't
-     * terminate the program.
-     *
-     * NOTE: Failing to terminate an error-handler will result in undefined
-     * results.
+     * With room for a terminator after a full buffer.
      */
-    fprintf(stderr, "%s\n", msg);
-    exit(1);
+    if (!out->data)
+    {
+        out->data = malloc(out->capacity + 1);
+        if (!out->data)
+        {
+            svm_fault(cpup, SVM_ERROR_ALLOCATION, "Out of memory for the output");
+            return -1;
+        }
+    }
+
+    uint32_t room = out->capacity - out->length;
+
+    va_start(args, fmt);
+    int length = vsnprintf(out->data + out->length, room + 1, fmt, args);
+    va_end(args);
+
+    if (length < 0)
+        return length;
+
+    if ((uint32_t)length <= room)
+        out->length += length;
+    else if (out->policy == SVM_OUTPUT_DROP)
+        out->dropped += length;
+    else if ((uint32_t)length <= out->capacity)
+    {
+        svm_flush_output(cpup);
+
+        va_start(args, fmt);
+        vsnprintf(out->data, out->capacity + 1, fmt, args);
+        va_end(args);
+        out->length = length;
+    }
+    else
+    {
+        /**
+         * Longer than the whole buffer: made on its own, and handed over
+         * after what is buffered.
+         */
+        char *whole = malloc((size_t)length + 1);
+        if (!whole)
+        {
+            svm_fault(cpup, SVM_ERROR_ALLOCATION, "Out of memory for the output");
+            return -1;
+        }
+
+        va_start(args, fmt);
+        vsnprintf(whole, (size_t)length + 1, fmt, args);
+        va_end(args);
+
+        out->data[out->length] = '\0';
+        output_sink(cpup, out->data, out->length, whole, length);
+        out->length = 0;
+        free(whole);
+    }
+
+    if (cpup->tracer)
+        svm_flush_output(cpup);
+
+    return length;
+}
+
+/**
+ * Size of the first block of an arena, later ones double, and what its
+ * allocations are rounded up to - string headers hold a pointer.
+ */
+#define SVM_ARENA_BLOCK 4096
+#define SVM_ARENA_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+/**
+ * Buckets of the interned strings to start with.
+ */
+#define SVM_INTERNED_BUCKETS 64
+
+struct svm_arena_block
+{
+    struct svm_arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/**
+ * Bump-allocate from the current block, else from the next one kept from
+ * an earlier scan, else from a new block put after the current one.
+ */
+static char *arena_alloc(struct svm_arena *arena, size_t size)
+{
+    struct svm_arena_block *block = arena->current;
+
+    size = SVM_ARENA_ALIGN(size);
+    if (block && block->size - block->used >= size)
+    {
+        block->used += size;
+        return block->data + block->used - size;
+    }
+
+    if (block && block->next && block->next->size >= size)
+    {
+        arena->current = block->next;
+        arena->current->used = size;
+        return arena->current->data;
+    }
+
+    size_t want = block ? block->size * 2 : SVM_ARENA_BLOCK;
+    while (want < size)
+        want *= 2;
+
+    struct svm_arena_block *fresh = malloc(sizeof(struct svm_arena_block) + want);
+    if (!fresh)
+        return NULL;
+
+    fresh->size = want;
+    fresh->used = size;
+    if (block)
+    {
+        fresh->next = block->next;
+        block->next = fresh;
+    }
+    else
+    {
+        fresh->next = NULL;
+        arena->first = fresh;
+    }
+    arena->current = fresh;
+
+    return fresh->data;
+}
+
+/**
+ * Forget everything allocated, keeping the blocks.
+ */
+static void arena_rewind(struct svm_arena *arena)
+{
+    for (struct svm_arena_block *block = arena->first; block; block = block->next)
+        block->used = 0;
+    arena->current = arena->first;
+}
+
+static void arena_free(struct svm_arena *arena)
+{
+    while (arena->first)
+    {
+        struct svm_arena_block *next = arena->first->next;
+        free(arena->first);
+        arena->first = next;
+    }
+    arena->current = NULL;
+}
+
+/**
+ * Give back `size` bytes at `p`, if they were the last allocated.
+ */
+static void arena_release(struct svm_arena *arena, void *p, size_t size)
+{
+    struct svm_arena_block *block = arena->current;
+
+    size = SVM_ARENA_ALIGN(size);
+    if (block && block->used >= size && (char *)p == block->data + block->used - size)
+        block->used -= size;
+}
+
+/**
+ * Bytes taken by a string of `length` bytes, with its header and
+ * terminator.
+ */
+static size_t string_size(uint32_t length)
+{
+    return SVM_ARENA_ALIGN(sizeof(struct svm_string) + length + 1);
+}
+
+/**
+ * Eight bytes at a time, multiplying in each word the way FxHash does.
+ */
+static uint32_t string_hash(const char *data, uint32_t length)
+{
+    uint64_t hash = length;
+    uint64_t word;
+    uint32_t i = 0;
+
+    for (; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, data + i, 8);
+        hash = ((hash << 5 | hash >> 59) ^ word) * 0x517CC1B727220A95ull;
+    }
+    if (i < length)
+    {
+        word = 0;
+        memcpy(&word, data + i, length - i);
+        hash = ((hash << 5 | hash >> 59) ^ word) * 0x517CC1B727220A95ull;
+    }
+
+    return (uint32_t)(hash >> 32) ^ (uint32_t)hash;
+}
+
+/**
+ * The interned string equal to `s`, if any.
+ */
+static struct svm_string *find_string(svm_t *cpup, const struct svm_string *s)
+{
+    if (!cpup->interned)
+        return NULL;
+
+    for (struct svm_string *i = cpup->interned[s->hash & cpup->interned_mask]; i; i = i->next)
+    {
+        if (i->length == s->length && i->hash == s->hash && memcmp(i->data, s->data, s->length) == 0)
+            return i;
+    }
+    return NULL;
+}
+
+/**
+ * Add `s` to the interned strings, with twice the buckets once there are
+ * twice as many strings as buckets.  Without a table, or the memory for
+ * a bigger one, strings are left out or chains grow longer - equal strings
+ * still compare equal, just not by pointer.
+ */
+static void intern_string(svm_t *cpup, struct svm_string *s)
+{
+    if (!cpup->interned)
+        return;
+
+    if (cpup->interned_count >= 2 * (cpup->interned_mask + 1))
+    {
+        uint32_t mask = cpup->interned_mask * 2 + 1;
+        struct svm_string **table = calloc(mask + 1, sizeof(struct svm_string *));
+
+        if (table)
+        {
+            for (uint32_t b = 0; b <= cpup->interned_mask; b++)
+            {
+                struct svm_string *i = cpup->interned[b];
+                while (i)
+                {
+                    struct svm_string *next = i->next;
+                    i->next = table[i->hash & mask];
+                    table[i->hash & mask] = i;
+                    i = next;
+                }
+            }
+            free(cpup->interned);
+            cpup->interned = table;
+            cpup->interned_mask = mask;
+        }
+    }
+
+    s->next = cpup->interned[s->hash & cpup->interned_mask];
+    cpup->interned[s->hash & cpup->interned_mask] = s;
+    cpup->interned_count++;
+}
+
+char *svm_string_alloc(svm_t *cpup, size_t length)
+{
+    struct svm_string *s = (struct svm_string *)arena_alloc(&cpup->strings[cpup->live], string_size(length));
+    if (s == NULL)
+    {
+        svm_fault(cpup, SVM_ERROR_ALLOCATION, "RAM allocation failure.");
+        return NULL;
+    }
+
+    s->next = NULL;
+    s->length = length;
+    s->hash = 0;
+    s->data[length] = '\0';
+    return s->data;
+}
+
+char *svm_string_intern(svm_t *cpup, char *str)
+{
+    struct svm_string *s = SVM_STRING_OF(str);
+
+    s->hash = string_hash(s->data, s->length);
+
+    if (!cpup->interned)
+    {
+        cpup->interned = calloc(SVM_INTERNED_BUCKETS, sizeof(struct svm_string *));
+        cpup->interned_mask = cpup->interned ? SVM_INTERNED_BUCKETS - 1 : 0;
+    }
+
+    struct svm_string *found = find_string(cpup, s);
+    if (found)
+    {
+        arena_release(&cpup->strings[cpup->live], s, string_size(s->length));
+        return found->data;
+    }
+
+    intern_string(cpup, s);
+    cpup->string_bytes += string_size(s->length);
+    return str;
+}
+
+char *svm_string_make(svm_t *cpup, const char *data, uint32_t length)
+{
+    struct svm_string key;
+
+    key.length = length;
+    key.hash = string_hash(data, length);
+
+    if (cpup->interned)
+    {
+        for (struct svm_string *i = cpup->interned[key.hash & cpup->interned_mask]; i; i = i->next)
+        {
+            if (i->length == length && i->hash == key.hash && memcmp(i->data, data, length) == 0)
+                return i->data;
+        }
+    }
+
+    char *str = svm_string_alloc(cpup, length);
+    if (str == NULL)
+        return NULL;
+
+    memcpy(str, data, length);
+    return svm_string_intern(cpup, str);
+}
+
+/**
+ * Whether a string is one of the program's literals, which stay where
+ * they are until the machine is freed.
+ */
+static int in_pool(svm_t *cpup, const char *str)
+{
+    return (uintptr_t)str - (uintptr_t)cpup->literal_pool < cpup->literal_pool_size;
+}
+
+/**
+ * Whether the instruction decoded at `ip` is a STRING_STORE or CMP_STRING
+ * with its characters within the program - writes beyond it, and around
+ * the 64k boundary, don't reach the records.
+ */
+static int pooled(svm_t *cpup, uint32_t ip, const struct svm_insn *insn)
+{
+    return (cpup->code[ip] == STRING_STORE || cpup->code[ip] == CMP_STRING) && insn->next <= cpup->size;
+}
+
+/**
+ * Make the pool of the program's string literals, following its
+ * instructions the way svm_predecode() does.  Equal literals are made
+ * once, interned for the while.
+ */
+static int make_literals(svm_t *cpun)
+{
+    struct svm_insn insn;
+    uint32_t count = 0;
+    size_t size = 0;
+    uint32_t ip;
+
+    for (ip = 0; ip < cpun->size; ip = insn.next)
+    {
+        svm_decode_insn(cpun, ip, &insn);
+        if (pooled(cpun, ip, &insn))
+        {
+            count++;
+            size += string_size(insn.next - ip - 4);
+        }
+    }
+
+    if (count == 0)
+        return 0;
+
+    cpun->literal_pool = malloc(size);
+    cpun->literals = malloc(count * sizeof(struct svm_literal));
+    cpun->interned = calloc(SVM_INTERNED_BUCKETS, sizeof(struct svm_string *));
+    if (!cpun->literal_pool || !cpun->literals || !cpun->interned)
+        return -1;
+    cpun->interned_mask = SVM_INTERNED_BUCKETS - 1;
+
+    for (ip = 0; ip < cpun->size; ip = insn.next)
+    {
+        svm_decode_insn(cpun, ip, &insn);
+        if (!pooled(cpun, ip, &insn))
+            continue;
+
+        struct svm_string *s = (struct svm_string *)(cpun->literal_pool + cpun->literal_pool_size);
+
+        s->length = insn.next - ip - 4;
+        memcpy(s->data, cpun->code + ip + 4, s->length);
+        s->data[s->length] = '\0';
+        s->hash = string_hash(s->data, s->length);
+
+        struct svm_string *found = find_string(cpun, s);
+        if (!found)
+        {
+            intern_string(cpun, s);
+            cpun->literal_pool_size += string_size(s->length);
+            found = s;
+        }
+
+        cpun->literals[cpun->literal_count].ip = ip;
+        cpun->literals[cpun->literal_count].offset = found->data - cpun->literal_pool;
+        cpun->literal_count++;
+    }
+
+    memset(cpun->interned, 0, (cpun->interned_mask + 1) * sizeof(struct svm_string *));
+    cpun->interned_count = 0;
+
+    return 0;
+}
+
+/**
+ * Move one string to `*to`, which has room for it, unless an equal one
+ * was moved already or it is a literal.
+ */
+static void promote(svm_t *cpup, struct reg_t *r, char **to)
+{
+    if (!SVM_IS_STRING(*r) || in_pool(cpup, SVM_STRING(*r)))
+        return;
+
+    struct svm_string *s = SVM_STRING_OF(SVM_STRING(*r));
+    struct svm_string *found = find_string(cpup, s);
+
+    if (!found)
+    {
+        found = (struct svm_string *)*to;
+        memcpy(found, s, sizeof(struct svm_string) + s->length + 1);
+        intern_string(cpup, found);
+        *to += string_size(s->length);
+    }
+    svm_set_string(r, found->data);
+}
+
+/**
+ * Move the strings which are still held - in the registers and on the
+ * stack - to the other arena, interned again, and rewind this one with
+ * everything the scan dropped.  Those in the variables belong to the image
+ * by now, see publish_variables().
+ *
+ * Room for all of them is taken at once, if there isn't any the strings
+ * stay where they are until the next scan.
+ */
+static void collect_strings(svm_t *cpup)
+{
+    int depth = cpup->SP < STACK_COUNT ? cpup->SP : STACK_COUNT - 1;
+    size_t need = 0;
+    int i;
+
+#define HELD(r)                                                        \
+    if (SVM_IS_STRING(r) && !in_pool(cpup, SVM_STRING(r)))             \
+        need += string_size(SVM_STRING_OF(SVM_STRING(r))->length);
+
+    for (i = 0; i < REGISTER_COUNT; i++)
+        HELD(cpup->registers[i]);
+    for (i = 1; i <= depth; i++)
+        HELD(cpup->stack[i]);
+
+#undef HELD
+
+    struct svm_arena *from = &cpup->strings[cpup->live];
+    struct svm_arena *to = &cpup->strings[!cpup->live];
+    char *room = NULL;
+
+    if (need)
+    {
+        room = arena_alloc(to, need);
+        if (room == NULL)
+            return;
+    }
+
+    if (cpup->interned)
+        memset(cpup->interned, 0, (cpup->interned_mask + 1) * sizeof(struct svm_string *));
+    cpup->interned_count = 0;
+
+    if (need)
+    {
+        for (i = 0; i < REGISTER_COUNT; i++)
+            promote(cpup, &cpup->registers[i], &room);
+        for (i = 1; i <= depth; i++)
+            promote(cpup, &cpup->stack[i], &room);
+    }
+
+    arena_rewind(from);
+    cpup->live = !cpup->live;
+}
+
+/**
+ * The strings in the variables of a process image: two buffers, the live
+ * one and a spare the next strings are copied into, so the previous ones
+ * stay valid meanwhile.  Once they have grown to what the variables need
+ * nothing is allocated.
+ */
+struct svm_image_strings
+{
+    char *data[2];
+    size_t capacity[2];
+    size_t used[2];
+    uint8_t live;
+};
+
+static int in_buffer(const struct svm_image_strings *s, int which, const char *str)
+{
+    return (uintptr_t)str - (uintptr_t)s->data[which] < s->used[which];
+}
+
+/**
+ * Hand the variables to the image, with copies of their strings in its
+ * buffers unless every one is there already.  Strings are copied by
+ * content, wherever they are - in the machine's arenas, in its literal
+ * pool or in another image - so the image keeps nothing of the machine.
+ *
+ * When there is no room the strings are published as integer zeros.
+ */
+static void publish_variables(svm_t *cpup)
+{
+    struct svm_process_image *image = cpup->image;
+    struct svm_image_strings *s = image->strings;
+    struct reg_t *vars = cpup->io.variables;
+    char *from[VARIABLE_COUNT];
+    size_t need = 0;
+    int copy = 0;
+    int i, j;
+
+    for (i = 0; i < VARIABLE_COUNT; i++)
+    {
+        from[i] = SVM_IS_STRING(vars[i]) ? SVM_STRING(vars[i]) : NULL;
+        if (!from[i])
+            continue;
+
+        need += string_size(SVM_STRING_OF(from[i])->length);
+        if (!s || !in_buffer(s, s->live, from[i]))
+            copy = 1;
+    }
+
+    if (copy)
+    {
+        if (!s)
+        {
+            s = calloc(1, sizeof(struct svm_image_strings));
+            if (!s)
+                goto drop;
+            image->strings = s;
+        }
+
+        /**
+         * A new spare when it is too small, or holds one of the strings -
+         * latched from the image two publishes ago.
+         */
+        int spare = !s->live;
+        char *to = s->data[spare];
+        char *fresh = NULL;
+
+        for (i = 0; i < VARIABLE_COUNT; i++)
+        {
+            if (from[i] && in_buffer(s, spare, from[i]))
+                to = NULL;
+        }
+        if (!to || s->capacity[spare] < need)
+        {
+            fresh = malloc(need);
+            if (!fresh)
+                goto drop;
+            to = fresh;
+        }
+
+        char *at = to;
+        for (i = 0; i < VARIABLE_COUNT; i++)
+        {
+            if (!from[i])
+                continue;
+
+            for (j = 0; j < i && from[j] != from[i]; j++)
+                ;
+            if (j < i)
+            {
+                vars[i] = vars[j];
+                continue;
+            }
+
+            struct svm_string *copied = (struct svm_string *)at;
+            memcpy(copied, SVM_STRING_OF(from[i]), sizeof(struct svm_string) + SVM_STRING_OF(from[i])->length + 1);
+            copied->next = NULL;
+            svm_set_string(&vars[i], copied->data);
+            at += string_size(copied->length);
+        }
+
+        if (fresh)
+        {
+            free(s->data[spare]);
+            s->data[spare] = fresh;
+            s->capacity[spare] = need;
+        }
+        s->used[spare] = at - to;
+        s->live = spare;
+    }
+
+    memcpy(image->variables, vars, sizeof(image->variables));
+    return;
+
+drop:
+    for (i = 0; i < VARIABLE_COUNT; i++)
+    {
+        if (from[i])
+        {
+            vars[i].tag = INTEGER;
+            vars[i].content.integer = 0;
+        }
+    }
+    memcpy(image->variables, vars, sizeof(image->variables));
+}
+
+void svm_image_release(struct svm_process_image *image)
+{
+    if (!image || !image->strings)
+        return;
+
+    for (int i = 0; i < VARIABLE_COUNT; i++)
+    {
+        if (SVM_IS_STRING(image->variables[i]))
+        {
+            image->variables[i].tag = INTEGER;
+            image->variables[i].content.integer = 0;
+        }
+    }
+
+    free(image->strings->data[0]);
+    free(image->strings->data[1]);
+    free(image->strings);
+    image->strings = NULL;
 }
 
 /**
@@ -73,6 +808,8 @@ svm_t *svm_new(unsigned char *code, uint32_t size, void (*fp)(char *msg))
     }
 
     cpun->error_handler = NULL;
+    cpun->output.capacity = SVM_OUTPUT_CAPACITY;
+    cpun->output.fd = 1;
     cpun->ip = 0;
     cpun->running = 1;
     cpun->size = size;
@@ -88,14 +825,42 @@ svm_t *svm_new(unsigned char *code, uint32_t size, void (*fp)(char *msg))
     memset(cpun->code, '\0', 0xFFFF);
     memcpy(cpun->code, code, size);
 
+    /**
+     * Keep the program, so svm_reset() can undo writes to the RAM.
+     */
+    cpun->program = malloc(size);
+    if (cpun->program == NULL)
+    {
+        free(cpun->code);
+        free(cpun);
+        return NULL;
+    }
+    memcpy(cpun->program, code, size);
+
+    /**
+     * Decode the program once, rather than on every execution, with its
+     * string literals made ready to use.
+     */
+    if (make_literals(cpun) != 0 || svm_predecode(cpun) != 0 ||
+        svm_verify(cpun, &cpun->verification) != 0)
+    {
+        free(cpun->literal_pool);
+        free(cpun->literals);
+        free(cpun->interned);
+        free(cpun->insns);
+        free(cpun->program);
+        free(cpun->code);
+        free(cpun);
+        return NULL;
+    }
+
     /**
      * Explicitly zero each register and set to be a number.
      */
     for (i = 0; i < REGISTER_COUNT; i++)
     {
-        cpun->registers[i].type = INTEGER;
+        cpun->registers[i].tag = INTEGER;
         cpun->registers[i].content.integer = 0;
-        cpun->registers[i].content.string = NULL;
     }
 
     /**
@@ -109,19 +874,142 @@ svm_t *svm_new(unsigned char *code, uint32_t size, void (*fp)(char *msg))
     cpun->SP = 0;
     cpun->CSP = 0;
 
+    /**
+     * The machine starts with its own, zeroed, process image.
+     */
+    cpun->own_image.version = SVM_PROCESS_IMAGE_VERSION;
+    cpun->io.version = SVM_PROCESS_IMAGE_VERSION;
+    cpun->image = &cpun->own_image;
+
     /**
      * Set error handler callback.
      */
     cpun->error_handler = fp;
 
     /**
-     * Setup our default opcode-handlers
+     * Setup our default opcode-handlers, without the checks svm_verify()
+     * made already if it accepted the program.
      */
+    cpun->code_verified = cpun->verification.code == SVM_VERIFY_OK;
+    cpun->verified = cpun->code_verified;
     opcode_init(cpun);
 
     return cpun;
 }
 
+/**
+ * Prepare a virtual machine to run its program again.
+ */
+int svm_reset(svm_t *cpup, int what)
+{
+    int i;
+
+    if (!cpup)
+        return -1;
+
+    if (what & SVM_RESET_REGISTERS)
+    {
+        for (i = 0; i < REGISTER_COUNT; i++)
+        {
+            cpup->registers[i].tag = INTEGER;
+            cpup->registers[i].content.integer = 0;
+        }
+        cpup->jmp = 0;
+    }
+
+    if (what & SVM_RESET_STACKS)
+    {
+        cpup->SP = 0;
+        cpup->CSP = 0;
+    }
+
+    if ((what & SVM_RESET_MEMORY) && cpup->memory_written)
+    {
+        memset(cpup->code, '\0', 0xFFFF);
+        memcpy(cpup->code, cpup->program, cpup->size);
+
+        /**
+         * The records and the native code describe the modified program.
+         */
+        svm_jit_free(cpup);
+        svm_wasm_free(cpup);
+        if (svm_predecode(cpup) != 0)
+            return -1;
+
+        cpup->memory_written = 0;
+        cpup->code_verified = cpup->verification.code == SVM_VERIFY_OK;
+    }
+
+    /**
+     * The verified handlers rely on the scan starting with empty stacks.
+     */
+    int verified = cpup->code_verified && cpup->SP == 0 && cpup->CSP == 0;
+    if (verified != cpup->verified)
+    {
+        cpup->verified = verified;
+        opcode_select(cpup);
+    }
+
+    cpup->ip = 0;
+    cpup->running = 1;
+    cpup->faulted = 0;
+    memset(&cpup->error, 0, sizeof(cpup->error));
+
+    return 0;
+}
+
+/**
+ * xorshift32 never leaves zero, so that seed is replaced.
+ */
+void svm_seed(svm_t *cpup, uint32_t seed)
+{
+    if (!cpup)
+        return;
+
+    cpup->random = seed ? seed : 0x9E3779B9;
+}
+
+/**
+ * Attach a process image, NULL for the machine's own.
+ */
+void svm_set_image(svm_t *cpup, struct svm_process_image *image)
+{
+    if (!cpup)
+        return;
+
+    cpup->image = image ? image : &cpup->own_image;
+}
+
+/**
+ * Start of a scan: take the inputs and variables as they are now.
+ */
+void svm_latch_inputs(svm_t *cpup)
+{
+    uint64_t start = cpup->events ? svm_events_now() : 0;
+
+    cpup->io.in = cpup->image->in;
+    memcpy(cpup->io.variables, cpup->image->variables, sizeof(cpup->io.variables));
+
+    SVM_EVENT(cpup, SVM_EVENT_LATCH, cpup->ip, svm_events_now() - start);
+}
+
+/**
+ * End of a scan: hand over the outputs and variables.
+ */
+void svm_publish_outputs(svm_t *cpup)
+{
+    uint64_t start = cpup->events ? svm_events_now() : 0;
+
+    svm_flush_output(cpup);
+    publish_variables(cpup);
+    collect_strings(cpup);
+
+    cpup->image->out = cpup->io.out;
+    cpup->image->scans++;
+
+    SVM_EVENT(cpup, SVM_EVENT_PUBLISH, cpup->ip, svm_events_now() - start);
+}
+
 /**
  * Delete a virtual machine.
  */
@@ -130,29 +1018,64 @@ void svm_free(svm_t *cpup)
     if (!cpup)
         return;
 
+    /**
+     * Before the code goes, the next machine may reuse the module for it.
+     */
+    svm_wasm_free(cpup);
     if (cpup->code)
     {
         free(cpup->code);
         cpup->code = NULL;
     }
+    if (cpup->program)
+    {
+        free(cpup->program);
+        cpup->program = NULL;
+    }
+    if (cpup->insns)
+    {
+        free(cpup->insns);
+        cpup->insns = NULL;
+    }
+    svm_flush_output(cpup);
+    free(cpup->output.data);
+    svm_jit_free(cpup);
+    arena_free(&cpup->strings[0]);
+    arena_free(&cpup->strings[1]);
+    free(cpup->interned);
+    free(cpup->literal_pool);
+    free(cpup->literals);
+    free(cpup->scratch);
+    svm_image_release(&cpup->own_image);
+    svm_events_enable(cpup, 0);
+    svm_profile_enable(cpup, 0);
     free(cpup);
 }
 
 /**
- *  Main virtual machine execution loop.
+ *  Reference virtual machine execution loop.
  *
  *  This function will walk through the code passed to the constructor
  * and attempt to execute each bytecode instruction.
  *
  *  It will keep running forever.
+ *
+ *  `traced` and `profiled` are constants in the callers below, so each of
+ * them gets a copy of the loop with the tracing and the profiling either
+ * always or never done.
  */
-void svm_run(svm_t *cpup)
+static inline void run_loop(svm_t *cpup, const int traced, const int profiled)
 {
     /**
      * How many instructions have we handled?
      */
     int iterations = 0;
 
+    /**
+     * The counter at the end of the last instruction, when profiling.
+     */
+    uint64_t cycles = profiled ? svm_cycles() : 0;
+
     /**
      * If we're called without a valid CPU then we should abort.
      */
@@ -185,15 +1108,19 @@ void svm_run(svm_t *cpup)
          */
         int opcode = cpup->code[cpup->ip];
 
-        if (getenv("DEBUG") != NULL)
-            jsprintf("%04x - Parsing OpCode Hex:%02X\n", cpup->ip, opcode);
+        if (traced)
+            svm_trace(cpup, SVM_TRACE_INSTRUCTIONS, "%04x - Parsing OpCode Hex:%02X\n", cpup->ip, opcode);
 
         /**
          * Call the opcode implementation, if defined.
          */
+        cpup->handler_ip = cpup->ip;
         if (cpup->opcodes[opcode] != NULL)
             cpup->opcodes[opcode](cpup);
 
+        if (profiled)
+            cycles = svm_profile_count(cpup->profile, opcode, cpup->handler_ip, cycles);
+
         /**
          * NOTE: At this point you might be looking for
          *       a line of the form : cpup->ip += 1;
@@ -216,6 +1143,228 @@ void svm_run(svm_t *cpup)
             cpup->running = 0;
     }
 
-    if (getenv("DEBUG") != NULL)
-        jsprintf("Executed %u instructions\n", iterations);
+    cpup->iterations = iterations;
+    cpup->fused = 0;
+    cpup->quick_hits = 0;
+    cpup->quick_misses = 0;
+
+    if (traced)
+        svm_trace(cpup, SVM_TRACE_SUMMARY, "Executed %u instructions\n", iterations);
+}
+
+/**
+ * The reference loop, without tracing.
+ */
+void svm_run_call(svm_t *cpup)
+{
+    run_loop(cpup, 0, 0);
+}
+
+/**
+ * The reference loop, reporting to the attached tracer.
+ */
+void svm_run_traced(svm_t *cpup)
+{
+    run_loop(cpup, 1, 0);
+}
+
+/**
+ * The reference loop, counting into the profile.
+ */
+void svm_run_profiled(svm_t *cpup)
+{
+    if (!cpup || !cpup->profile)
+        return;
+
+    run_loop(cpup, 0, 1);
+}
+
+/**
+ *  Main virtual machine execution loop.
+ *
+ *  Runs the code with the engine selected at build time, see vm-engine.h,
+ * vm-jit.h and vm-wasm.h, or with the traced reference loop when a tracer is
+ * attached and the profiled one when profiling - in between latching the
+ * inputs and publishing the outputs.
+ *
+ *  A failed instruction unwinds to here, skipping the publishing: the
+ * scan is abandoned as a whole.  Setting up the jump once per scan keeps
+ * the cost off the instructions.
+ */
+void svm_run(svm_t *cpup)
+{
+    jmp_buf unwind;
+
+    if (!cpup || cpup->faulted)
+        return;
+
+    SVM_EVENT(cpup, SVM_EVENT_SCAN_BEGIN, 0, cpup->image->scans);
+    svm_latch_inputs(cpup);
+
+    cpup->unwind = &unwind;
+    if (setjmp(unwind) == 0)
+    {
+        if (cpup->tracer)
+            svm_run_traced(cpup);
+        else if (cpup->profile)
+            svm_run_profiled(cpup);
+#if SVM_USE_JIT || SVM_USE_WASM
+        else if (cpup->events)
+            svm_run_inline(cpup);
+#endif
+        else
+#if SVM_USE_JIT
+            svm_run_jit(cpup);
+#elif SVM_USE_WASM
+            svm_run_wasm(cpup);
+#elif SVM_DISPATCH == SVM_DISPATCH_CALL
+            svm_run_call(cpup);
+#else
+            svm_run_inline(cpup);
+#endif
+
+        svm_publish_outputs(cpup);
+    }
+    cpup->unwind = NULL;
+
+    /**
+     * What a failed scan printed before failing.
+     */
+    svm_flush_output(cpup);
+
+    SVM_EVENT(cpup, SVM_EVENT_SCAN_END, cpup->ip, cpup->iterations);
+}
+
+/**
+ *  The reference loop again, stopping after `budget` instructions or a
+ * `yield` - the instruction-pointer is left on the next instruction, so
+ * calling it again carries on from there.  A failed instruction unwinds
+ * to here, and isn't counted.
+ */
+int svm_step(svm_t *cpup, uint32_t budget)
+{
+    jmp_buf unwind;
+    jmp_buf *outer;
+    volatile int status = SVM_STATUS_BUDGET;
+
+    if (!cpup || cpup->faulted)
+        return SVM_STATUS_ERROR;
+
+    outer = cpup->unwind;
+    cpup->unwind = &unwind;
+
+    if (setjmp(unwind) == 0)
+    {
+        uint64_t cycles = cpup->profile ? svm_cycles() : 0;
+
+        for (uint32_t n = 0; n < budget; n++)
+        {
+            if (!cpup->running)
+            {
+                status = SVM_STATUS_EXITED;
+                break;
+            }
+
+            if (cpup->ip >= 0xFFFF)
+                cpup->ip = 0;
+
+            int opcode = cpup->code[cpup->ip];
+            cpup->handler_ip = cpup->ip;
+            if (cpup->opcodes[opcode] != NULL)
+                cpup->opcodes[opcode](cpup);
+
+            if (cpup->profile)
+                cycles = svm_profile_count(cpup->profile, opcode, cpup->handler_ip, cycles);
+
+            cpup->iterations++;
+
+            if (cpup->ip >= cpup->size)
+                cpup->running = 0;
+
+            if (opcode == YIELD && cpup->running)
+            {
+                status = SVM_STATUS_WAITING;
+                break;
+            }
+        }
+    }
+    cpup->unwind = outer;
+
+    if (cpup->faulted)
+    {
+        svm_flush_output(cpup);
+        return SVM_STATUS_ERROR;
+    }
+    if (!cpup->running)
+        return SVM_STATUS_EXITED;
+    return status;
+}
+
+/**
+ * Instructions between two looks at the clock of the watchdog.
+ */
+#define WATCHDOG_SLICE 4096
+
+static uint64_t watchdog_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * A scan in slices, checking the limits after each of them.
+ */
+int svm_run_watched(svm_t *cpup, const struct svm_watchdog *watchdog)
+{
+    if (!cpup)
+        return SVM_STATUS_ERROR;
+
+    uint64_t start = watchdog->max_ns ? watchdog_ns() : 0;
+
+    SVM_EVENT(cpup, SVM_EVENT_SCAN_BEGIN, 0, cpup->image->scans);
+    svm_latch_inputs(cpup);
+
+    cpup->ip = 0;
+    cpup->iterations = 0;
+    cpup->fused = 0;
+    cpup->quick_hits = 0;
+    cpup->quick_misses = 0;
+
+    for (;;)
+    {
+        uint32_t slice = WATCHDOG_SLICE;
+
+        if (watchdog->max_instructions)
+        {
+            uint32_t left = watchdog->max_instructions - cpup->iterations;
+            if (left == 0)
+                break;
+            if (left < slice)
+                slice = left;
+        }
+
+        int status = svm_step(cpup, slice);
+
+        if (status == SVM_STATUS_EXITED)
+            svm_publish_outputs(cpup);
+        if (status == SVM_STATUS_EXITED || status == SVM_STATUS_ERROR)
+        {
+            SVM_EVENT(cpup, SVM_EVENT_SCAN_END, cpup->ip, cpup->iterations);
+            return status;
+        }
+
+        if (watchdog->max_ns && watchdog_ns() - start >= watchdog->max_ns)
+            break;
+    }
+
+    /**
+     * Stopped in the middle, it runs again once reset.
+     */
+    cpup->running = 0;
+    svm_flush_output(cpup);
+
+    SVM_EVENT(cpup, SVM_EVENT_ABORT, cpup->ip, 0);
+    SVM_EVENT(cpup, SVM_EVENT_SCAN_END, cpup->ip, cpup->iterations);
+    return SVM_STATUS_ABORTED;
 }
@@ -2,6 +2,8 @@
 #define L3CD0FRTAO13DNG62HAYNH7VZ
 
 #include <inttypes.h>
+#include <stddef.h>
+#include <setjmp.h>
 #include "mem.h"
 #include "jsprintf.h"
 
@@ -12,9 +14,9 @@ extern "C" {
 
 
 /**
- * Count of registers.
+ * Size of the opcode lookup table, one entry for every byte value.
  */
-#define OPCODE_COUNT 128
+#define OPCODE_COUNT 256
 
 /**
  * Opcodes - set of instructions.
@@ -97,6 +99,7 @@ enum opcode_t
      */
     NOP = 0x50,
     STORE_REG,
+    YIELD,
 
     /**
      * PEEK/POKE operations.
@@ -104,6 +107,9 @@ enum opcode_t
     PEEK = 0x60,
     POKE,
     MEMCPY,
+    MEMSET,
+    MEMCMP,
+    MEMFIND,
 
     /**
      * Stack operations.
@@ -125,6 +131,235 @@ enum opcode_t
 struct svm;
 typedef void opcode_implementation(struct svm *in);
 
+/**
+ * A decoded instruction, see vm-decode.h.
+ */
+struct svm_insn;
+
+/**
+ * Receives the trace of a run, see vm-trace.h.
+ */
+struct svm_tracer;
+
+/**
+ * Events recorded from a run, see vm-trace.h.
+ */
+struct svm_events;
+
+/**
+ * Counters of a profiled run, see vm-trace.h.
+ */
+struct svm_profile;
+
+/**
+ * Native code compiled from the program, see vm-jit.h.
+ */
+struct svm_jit;
+
+/**
+ * A block of the memory strings are allocated from, see `struct svm_arena`.
+ */
+struct svm_arena_block;
+
+/**
+ * Bump allocator for the strings a program makes.  Nothing allocated from
+ * it is freed on its own, the whole arena is rewound at once and keeps its
+ * blocks for the next time.
+ */
+struct svm_arena
+{
+    struct svm_arena_block *first;
+    struct svm_arena_block *current;
+};
+
+/**
+ * The header in front of every string a machine makes, registers point at
+ * `data`.  The length doesn't count the terminator, the hash is of the
+ * `length` bytes, and `next` chains the strings which share a bucket of
+ * `interned`.
+ */
+struct svm_string
+{
+    struct svm_string *next;
+    uint32_t length;
+    uint32_t hash;
+    char data[];
+};
+
+/**
+ * A string literal of the program, `offset` bytes into `literal_pool`,
+ * belonging to the STRING_STORE or CMP_STRING instruction at `ip`.
+ */
+struct svm_literal
+{
+    uint32_t ip;
+    uint32_t offset;
+};
+
+/**
+ * The header of the string a register points at.
+ */
+#define SVM_STRING_OF(p) ((struct svm_string *)((char *)(p) - offsetof(struct svm_string, data)))
+
+/**
+ * Do two strings hold the same bytes?  A machine interns the strings it
+ * makes, so the same pointer is the common case and different lengths or
+ * hashes settle most of the rest.  Strings made by different machines -
+ * met through a shared process image - still compare by content.
+ */
+static inline int svm_string_equal(const char *a, const char *b)
+{
+    const struct svm_string *x = SVM_STRING_OF(a);
+    const struct svm_string *y = SVM_STRING_OF(b);
+
+    if (a == b)
+        return 1;
+    if (x->length != y->length || x->hash != y->hash)
+        return 0;
+
+    for (uint32_t i = 0; i < x->length; i++)
+        if (a[i] != b[i])
+            return 0;
+    return 1;
+}
+
+/**
+ * What went wrong in a failed instruction, see `svm_fault`.
+ *
+ *  SVM_ERROR_REGISTER   - a register operand out of range.
+ *  SVM_ERROR_TYPE       - a register holding the wrong type.
+ *  SVM_ERROR_DIVISION   - division by zero.
+ *  SVM_ERROR_MEMORY     - an address outside the 64k of RAM.
+ *  SVM_ERROR_STACK      - pushing to a full or popping from an empty stack.
+ *  SVM_ERROR_ALLOCATION - the host ran out of memory.
+ *  SVM_ERROR_OTHER      - reported through `svm_default_error_handler`.
+ */
+enum svm_error_code
+{
+    SVM_ERROR_NONE,
+    SVM_ERROR_REGISTER,
+    SVM_ERROR_TYPE,
+    SVM_ERROR_DIVISION,
+    SVM_ERROR_MEMORY,
+    SVM_ERROR_STACK,
+    SVM_ERROR_ALLOCATION,
+    SVM_ERROR_OTHER
+};
+
+/**
+ * The error which stopped a machine: its code, the offset and opcode of
+ * the instruction which failed, and the message given to the error
+ * handler.  `code` is SVM_ERROR_NONE until something fails, and again
+ * after `svm_reset`.
+ */
+struct svm_error
+{
+    int code;
+    uint32_t ip;
+    uint8_t opcode;
+    const char *message;
+};
+
+/**
+ * What `svm_verify` found wrong with a program, at the offset in
+ * `struct svm_verification`.
+ *
+ *  SVM_VERIFY_OK        - nothing, the verified handlers run it.
+ *  SVM_VERIFY_OPCODE    - an opcode which doesn't exist.
+ *  SVM_VERIFY_REGISTER  - a register operand out of range.
+ *  SVM_VERIFY_PORT      - an I/O index out of range.
+ *  SVM_VERIFY_TRUNCATED - an instruction running past the end of the program.
+ *  SVM_VERIFY_TARGET    - a jump or call outside the program, or into the
+ *                         middle of an instruction.
+ *  SVM_VERIFY_STACK     - a path which pops from the empty stack or pushes
+ *                         onto the full one, or a loop or instruction
+ *                         reached with different stack depths.
+ *  SVM_VERIFY_CALLS     - calls nested deeper than the call stack, a
+ *                         recursive call, or `ret` outside of a routine.
+ */
+enum svm_verify_code
+{
+    SVM_VERIFY_OK,
+    SVM_VERIFY_OPCODE,
+    SVM_VERIFY_REGISTER,
+    SVM_VERIFY_PORT,
+    SVM_VERIFY_TRUNCATED,
+    SVM_VERIFY_TARGET,
+    SVM_VERIFY_STACK,
+    SVM_VERIFY_CALLS
+};
+
+/**
+ * The result of verifying a program: its code, the offset of the first
+ * instruction found wrong, how many instructions can be reached from
+ * offset zero and, when verified, the deepest the stack and the call stack
+ * get on any path.
+ */
+struct svm_verification
+{
+    int code;
+    uint32_t ip;
+    uint32_t instructions;
+    uint32_t max_stack;
+    uint32_t max_calls;
+};
+
+/**
+ * What a print does when the output buffer has no room left for it, see
+ * `struct svm_output`.
+ *
+ *  SVM_OUTPUT_FLUSH - hand what is buffered to the sink first, so nothing
+ *                     is lost but the sink may be called more than once in
+ *                     a scan.  A print longer than the whole buffer goes
+ *                     to the sink along with it.
+ *  SVM_OUTPUT_DROP  - drop the print, counting its bytes in `dropped`.  The
+ *                     sink is called at most once a scan, and sees the
+ *                     start of what the program printed.
+ */
+enum svm_output_policy
+{
+    SVM_OUTPUT_FLUSH,
+    SVM_OUTPUT_DROP
+};
+
+/**
+ * Where buffered output goes: `length` bytes at `text`, then `more_length`
+ * at `more` - only ever split between two prints, so each of them is whole
+ * UTF-8.  Both are also terminated, for handlers wanting a C string.
+ */
+typedef void svm_output_sink(struct svm *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length);
+
+/**
+ * Default size of the output buffer.
+ */
+#define SVM_OUTPUT_CAPACITY 4096
+
+/**
+ * What the program printed since the last flush.  The buffer is allocated
+ * by the first print, and emptied into `sink` at the end of every scan -
+ * failed or not - and when a print doesn't fit, as `policy` says.
+ */
+struct svm_output
+{
+    char *data;
+    uint32_t capacity;
+    uint32_t length;
+    uint8_t policy;
+
+    /**
+     * NULL passes the text on to `jsprintf_handler`, see also
+     * `svm_output_writev`, which writes to `fd`.
+     */
+    svm_output_sink *sink;
+    int fd;
+
+    /**
+     * Bytes dropped by SVM_OUTPUT_DROP, and calls of the sink, since the
+     * machine was created.
+     */
+    uint64_t dropped;
+    uint64_t flushes;
+};
 
 /**
  * The Simple Virtual Machine object.
@@ -155,6 +390,43 @@ typedef struct svm {
     unsigned char *code;
     uint32_t size;
 
+    /**
+     * The program as it was loaded, for `svm_reset`.
+     */
+    unsigned char *program;
+
+    /**
+     * Room for a copy whose source and destination overlap at both ends,
+     * allocated by the first one - see op_memcpy().
+     */
+    unsigned char *scratch;
+
+    /**
+     * The code decoded into one record per byte, and the longest
+     * instruction decoded so far.
+     */
+    struct svm_insn *insns;
+    uint16_t insn_span;
+
+    /**
+     * Set once the program has written to its own code during a run of
+     * the native code compiled with `svm_jit_compile` or of the module
+     * generated by vm-wasm.c, if any, and by any write to the code since
+     * that was compiled - by another engine, `svm_step` or the host -
+     * after which it has to be compiled again.  `wasm` is the handle of
+     * the module plus one, 0 without one.
+     */
+    uint8_t code_written;
+    uint8_t jit_stale;
+    struct svm_jit *jit;
+    int wasm;
+
+    /**
+     * Set by any write to the 64k of RAM since the machine was created or
+     * last reset with SVM_RESET_MEMORY.
+     */
+    uint8_t memory_written;
+
     /**
      * The user may define a custom error-handler for when
      * register type-errors occur, or there is a division-by-zero
@@ -171,6 +443,39 @@ typedef struct svm {
      */
     opcode_implementation *opcodes[OPCODE_COUNT];
 
+    /**
+     * The tracer attached with `svm_set_tracer`, if any.
+     */
+    struct svm_tracer *tracer;
+
+    /**
+     * The events recorded since `svm_events_enable`, NULL when it is off.
+     */
+    struct svm_events *events;
+
+    /**
+     * The counters since `svm_profile_enable`, NULL when it is off.
+     */
+    struct svm_profile *profile;
+
+    /**
+     * What the program printed, see `svm_printf`.
+     */
+    struct svm_output output;
+
+    /**
+     * The process image the program works on during a scan, latched from
+     * `image` when it starts and published to it when it ends.
+     */
+    struct svm_process_image io;
+
+    /**
+     * The process image the host sees: `own_image` unless another one was
+     * attached with `svm_set_image`.
+     */
+    struct svm_process_image *image;
+    struct svm_process_image own_image;
+
     /**
      * This is the stack for the virtual machine.  There are
      * only a small number of entries permitted.
@@ -193,10 +498,107 @@ typedef struct svm {
      */
     int CSP;
 
+    /**
+     * Where the strings the machine makes live: `strings[live]`.  Strings
+     * are never written once made, so copies share them, and dropping one
+     * frees nothing.  At the end of every scan those still held by the
+     * registers and the stack are moved to the other arena, those in the
+     * variables copied to the image, and this one is rewound, see
+     * `svm_publish_outputs`.
+     */
+    struct svm_arena strings[2];
+    uint8_t live;
+
+    /**
+     * Every string in `strings[live]`, by hash: making one which is
+     * already there gives back the one there.  `interned_mask` is the
+     * number of buckets less one, zero until the first string.
+     */
+    struct svm_string **interned;
+    uint32_t interned_mask;
+    uint32_t interned_count;
+
+    /**
+     * Bytes of strings made since the machine was created, terminators
+     * and headers included - interned strings made again aren't counted.
+     */
+    uint64_t string_bytes;
+
+    /**
+     * The string literals of the program, with their headers, made once
+     * when it is loaded and kept until the machine is freed - the program
+     * it was loaded with is what svm_reset() restores.  `literals` is in
+     * the order of the instructions, see svm_predecode().
+     */
+    char *literal_pool;
+    size_t literal_pool_size;
+    struct svm_literal *literals;
+    uint32_t literal_count;
+
     /**
      * State - Shouldn't really be here.
      */
     uint8_t running;
+
+    /**
+     * Set when an instruction failed, which stops the machine until it is
+     * reset, with what went wrong in `error`.
+     */
+    uint8_t faulted;
+    struct svm_error error;
+
+    /**
+     * What `svm_verify` found when the program was loaded, and whether the
+     * RAM still holds that program - cleared by a write to its code, set
+     * again when svm_reset() puts it back.
+     */
+    struct svm_verification verification;
+    uint8_t code_verified;
+
+    /**
+     * Whether `opcodes` holds the handlers without the per-instruction
+     * checks of registers, I/O indices and stack depths: while the code is
+     * verified, for scans starting with both stacks empty.
+     */
+    uint8_t verified;
+
+    /**
+     * Where the instruction being handled by a vm-ops.c handler started -
+     * the engines store it on their way into a handler, for `error`.
+     */
+    uint32_t handler_ip;
+
+    /**
+     * Where a failed instruction unwinds to, set by `svm_run` and
+     * `svm_step` for as long as they run.
+     */
+    jmp_buf *unwind;
+
+    /**
+     * State of the generator behind the `random` instruction, see
+     * `svm_seed`.  Every machine has its own, so machines running on
+     * different threads neither race on it nor see each other's numbers.
+     */
+    uint32_t random;
+
+    /**
+     * How many instructions the last `svm_run` handled.
+     */
+    uint32_t iterations;
+
+    /**
+     * How many of those were the second half of a superinstruction, which
+     * is the number of dispatches fusing saved.
+     */
+    uint32_t fused;
+
+    /**
+     * How often type-specialised arithmetic instructions found the operand
+     * types they were specialised for, and how often they didn't and fell
+     * back to the generic instruction.
+     */
+    uint32_t quick_hits;
+    uint32_t quick_misses;
 } svm_t;
 
 /**
@@ -205,9 +607,123 @@ typedef struct svm {
 svm_t *svm_new(unsigned char *code, uint32_t size, void (*fp) (char *msg));
 
 /**
- * This function is called if there is an error in handling
- * a bytecode program - such as a mismatched type, or division by zero.
+ * What `svm_reset` puts back the way `svm_new` left it, anything else is
+ * kept from the previous run.
+ *
+ *  SVM_RESET_REGISTERS - the registers and the Z-flag.
+ *  SVM_RESET_STACKS    - the stack and the call stack.
+ *  SVM_RESET_MEMORY    - the 64k of RAM, which the program may have
+ *                        written to with `poke`, `memcpy` and `memset`.
+ */
+#define SVM_RESET_REGISTERS 0x01
+#define SVM_RESET_STACKS 0x02
+#define SVM_RESET_MEMORY 0x04
+#define SVM_RESET_ALL (SVM_RESET_REGISTERS | SVM_RESET_STACKS | SVM_RESET_MEMORY)
+
+/**
+ * Prepare a virtual machine to run its program again, rewinding the
+ * instruction-pointer and resetting the state selected by `what`.
+ *
+ * Cheaper than `svm_free` followed by `svm_new` - nothing is allocated,
+ * the program is decoded again into the records it has when the RAM has
+ * to be restored after the program wrote to it.
  *
+ * Returns zero on success.
+ */
+int svm_reset(svm_t *cpup, int what);
+
+/**
+ * Attach the process image the machine latches its inputs from and
+ * publishes its outputs to, or go back to its own with NULL.  Machines
+ * may share an image, as long as their scans don't overlap.
+ */
+void svm_set_image(svm_t *cpup, struct svm_process_image *image);
+
+/**
+ * Free the strings of an image the host owns, turning the variables which
+ * held them into integer zeros.  svm_free() does this for the machine's own
+ * image.
+ */
+void svm_image_release(struct svm_process_image *image);
+
+/**
+ * Scan boundaries, done by `svm_run`: copy the inputs and variables of the
+ * attached image into the one the program works on, and its outputs and
+ * variables back.  Callers of the engines below `svm_run` - svm_run_inline,
+ * svm_run_jit, translated programs - do this themselves.
+ *
+ * Publishing also reclaims the strings the scan dropped: those still in a
+ * register or on the stack are copied to the other arena, so string
+ * pointers taken from the machine stay valid until the end of its next
+ * scan.  Those in the variables are copied to the image, which owns them
+ * from then on: they stay valid after the machine is freed, until two more
+ * publishes to the image have changed its strings.
+ */
+void svm_latch_inputs(svm_t *cpup);
+void svm_publish_outputs(svm_t *cpup);
+
+/**
+ * Seed the generator of the `random` instruction, which `svm_new` seeds
+ * from the time.  The same seed gives the same numbers.
+ */
+void svm_seed(svm_t *cpup, uint32_t seed);
+
+/**
+ * Fail the instruction being handled - such as a mismatched type, or
+ * division by zero.  The error is recorded in `error`, the machine is
+ * stopped and the error handler called with the message, then the
+ * instruction is abandoned: `svm_run` or `svm_step` return right away.
+ *
+ * Engines called directly, without either of them around, have nowhere
+ * to unwind to: the instruction completes with whatever it has once the
+ * error handler returns, and without an error handler the process exits.
+ */
+void svm_fault(svm_t *cpup, int code, const char *msg);
+
+/**
+ * Print for the program: format into the output buffer, which is flushed
+ * once a scan rather than calling the host for every print.  With a tracer
+ * attached it is flushed every time, keeping prints in order with the
+ * trace.
+ */
+int svm_printf(svm_t *cpup, const char *fmt, ...);
+
+/**
+ * Hand the buffered output to the sink, if there is any.
+ */
+void svm_flush_output(svm_t *cpup);
+
+/**
+ * Flush, then change the size of the buffer - zero keeps it - the policy
+ * and the sink, NULL for `jsprintf_handler`.
+ */
+void svm_set_output(svm_t *cpup, uint32_t capacity, int policy, svm_output_sink *sink);
+
+/**
+ * A sink writing the output to the file descriptor `output.fd`, standard
+ * output unless changed, with one writev(2) for both parts.
+ */
+void svm_output_writev(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length);
+
+/**
+ * Make a string: `svm_string_alloc` gives room for `length` bytes and the
+ * terminator, until the end of the scan - see `strings` - and failing the
+ * instruction when out of memory.  Once the caller has written them
+ * `svm_string_intern` returns the string to use, either that one or an
+ * equal one made before, in which case the room is given back.  Nothing
+ * may be allocated in between.
+ */
+char *svm_string_alloc(svm_t *cpup, size_t length);
+char *svm_string_intern(svm_t *cpup, char *str);
+
+/**
+ * Make a string of the `length` bytes at `data`, which are only copied
+ * when there is no equal string already.
+ */
+char *svm_string_make(svm_t *cpup, const char *data, uint32_t length);
+
+/**
+ * `svm_fault` with SVM_ERROR_OTHER.
  */
 void svm_default_error_handler(svm_t * cpup, char *msg);
 
@@ -218,9 +734,63 @@ void svm_free(svm_t * cpup);
 
 /**
  *  Main virtual machine execution loop
+ *
+ *  A failed instruction ends the scan there, without publishing its
+ * outputs: `faulted` is set and `error` says what went wrong.  The machine
+ * runs again once reset.
  */
 void svm_run(svm_t * cpup);
 
+/**
+ * What `svm_step` and `svm_run_watched` stopped on.
+ *
+ *  SVM_STATUS_EXITED  - the program exited, or ran past the end of its code.
+ *  SVM_STATUS_BUDGET  - the budget of instructions was used up.
+ *  SVM_STATUS_WAITING - the program yielded with `yield`.
+ *  SVM_STATUS_ERROR   - an instruction failed, see `error`, the machine
+ *                       stays stopped until reset.
+ *  SVM_STATUS_ABORTED - the watchdog stopped the scan.
+ */
+enum svm_status
+{
+    SVM_STATUS_EXITED,
+    SVM_STATUS_BUDGET,
+    SVM_STATUS_WAITING,
+    SVM_STATUS_ERROR,
+    SVM_STATUS_ABORTED
+};
+
+/**
+ * Run at most `budget` instructions with the vm-ops.c handlers, carrying
+ * on from the instruction-pointer and adding to `iterations`.  Calling it
+ * again after SVM_STATUS_BUDGET or SVM_STATUS_WAITING resumes the program
+ * where it stopped.
+ *
+ * It doesn't rewind, latch or publish anything: start a scan with
+ * `svm_reset` and `svm_latch_inputs`, and end it with
+ * `svm_publish_outputs` once it has exited.
+ */
+int svm_step(svm_t *cpup, uint32_t budget);
+
+/**
+ * Limits of a scan run by `svm_run_watched`, zero for none.
+ */
+struct svm_watchdog
+{
+    uint32_t max_instructions;
+    uint64_t max_ns;
+};
+
+/**
+ * `svm_run` in steps, stopping the scan when it goes over the limits of
+ * the watchdog.  The outputs are published only when the program exits,
+ * an aborted or failed scan leaves those of the previous one.  `yield` is
+ * stepped over.
+ *
+ * Returns SVM_STATUS_EXITED, SVM_STATUS_ERROR or SVM_STATUS_ABORTED.
+ */
+int svm_run_watched(svm_t *cpup, const struct svm_watchdog *watchdog);
+
 
 #ifdef __cplusplus
 }
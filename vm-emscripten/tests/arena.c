@@ -0,0 +1,222 @@
+/**
+ * Strings in the per-machine arenas, see `strings` in src/vm/vm.h.
+ *
+ * A program which makes strings every way it can - stores, conversions,
+ * concatenation, copies between registers, the stack and the variables -
+ * is run scan after scan with svm_run(), built for whichever engine.  Once
+ * warmed up a scan must not allocate at all, which is checked by counting
+ * the calls to malloc() and friends, and the strings which outlive a scan
+ * must come through it intact.  The strings a machine publishes to an image
+ * must outlive the machine too, literals as well as those it made.
+ *
+ * Built by `npm run atest`, once for every engine and once more with
+ * AddressSanitizer.
+ */
+#include "snapshot.h"
+
+/**
+ * Calls to the allocator while `counting` is set - not under AddressSanitizer,
+ * which has an allocator of its own, see scripts/testArena.sh.
+ */
+static int counting;
+static unsigned long allocations;
+
+#ifdef __SANITIZE_ADDRESS__
+#define COUNTED 0
+#else
+#define COUNTED 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    allocations += counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocations += counting;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations += counting;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+/**
+ * Scans to warm up with, and to count over.
+ */
+#define WARM_UP 4
+#define SCANS 1000
+
+static unsigned char program[] = {
+    INT_STORE, 0, 50, 0,
+    VARIABLE_LOAD, 5, 0,
+    /* 7 */ STRING_STORE, 1, 3, 0, 'a', 'b', 'c',
+    INT_STORE, 2, 42, 0,
+    INT_TOSTRING, 2,
+    STRING_CONCAT, 3, 1, 2,
+    FLOAT_STORE, 4, 1, 0, 0xFF, 0xFF,
+    FLOAT_TOSTRING, 4,
+    STRING_CONCAT, 3, 3, 4,
+    STORE_REG, 6, 3,
+    STACK_PUSH, 6,
+    STACK_POP, 7,
+    CMP_STRING, 1, 3, 0, 'a', 'b', 'c',
+    DEC, 0,
+    JUMP_NZ, 7, 0,
+    STRING_STORE, 8, 2, 0, '4', '2',
+    STRING_TOINT, 8,
+    VARIABLE_SAVE, 3, 0,
+    STACK_PUSH, 1,
+    EXIT,
+};
+
+static int is_string(struct reg_t *r, const char *expected)
+{
+    return SVM_IS_STRING(*r) && strcmp(SVM_STRING(*r), expected) == 0;
+}
+
+static void check_scans(const char *name, int what)
+{
+    svm_t *cpu = svm_new(program, sizeof(program), error);
+
+    for (int i = 0; i < WARM_UP; i++)
+    {
+        svm_reset(cpu, what);
+        svm_run(cpu);
+    }
+
+    allocations = 0;
+    counting = 1;
+    for (int i = 0; i < SCANS; i++)
+    {
+        svm_reset(cpu, what);
+        svm_run(cpu);
+    }
+    counting = 0;
+
+    if (COUNTED)
+    {
+        printf("%-10s %lu allocations in %d scans\n", name, allocations, SCANS);
+        EXPECT(allocations == 0);
+    }
+
+    /**
+     * What the last scan left, moved out of the arena it was made in.
+     */
+    EXPECT(is_string(&cpu->image->variables[0], "abc422.000000"));
+    EXPECT(is_string(&cpu->registers[5], "abc422.000000"));
+    EXPECT(is_string(&cpu->registers[7], "abc422.000000"));
+    EXPECT(cpu->registers[8].tag == INTEGER && cpu->registers[8].content.integer == 42);
+    EXPECT(cpu->SP == 1 && is_string(&cpu->stack[1], "abc"));
+
+    svm_free(cpu);
+}
+
+/**
+ * Publishes a literal and a string it makes, in that order, and then
+ * another pair when run again with register 0 set.
+ */
+static unsigned char storing[] = {
+    STRING_STORE, 1, 3, 0, 'a', 'b', 'c',
+    INT_STORE, 2, 42, 0,
+    INT_TOSTRING, 2,
+    STRING_CONCAT, 3, 1, 2,
+    VARIABLE_SAVE, 1, 0,
+    VARIABLE_SAVE, 3, 1,
+    EXIT,
+};
+
+static unsigned char storing_again[] = {
+    STRING_STORE, 1, 3, 0, 'x', 'y', 'z',
+    STRING_CONCAT, 3, 1, 1,
+    VARIABLE_SAVE, 1, 0,
+    VARIABLE_SAVE, 3, 1,
+    EXIT,
+};
+
+static unsigned char printing[] = {
+    VARIABLE_LOAD, 1, 0,
+    VARIABLE_LOAD, 2, 1,
+    STRING_PRINT, 1,
+    STRING_PRINT, 2,
+    EXIT,
+};
+
+static struct svm_process_image shared = {SVM_PROCESS_IMAGE_VERSION};
+
+/**
+ * Machines run in turn on one image, each freed before the next one runs,
+ * as `RunProgram` does.
+ */
+static void run_freed(unsigned char *code, uint32_t size)
+{
+    svm_t *cpu = svm_new(code, size, error);
+
+    svm_set_image(cpu, &shared);
+    svm_run(cpu);
+    svm_free(cpu);
+}
+
+static void check_shared(void)
+{
+    jsprintf_handler = capture;
+    output_len = 0;
+
+    run_freed(storing, sizeof(storing));
+    EXPECT(is_string(&shared.variables[0], "abc"));
+    EXPECT(is_string(&shared.variables[1], "abc42"));
+
+    svm_t *cpu = svm_new(printing, sizeof(printing), error);
+    svm_set_image(cpu, &shared);
+    svm_run(cpu);
+    EXPECT(output_len == 8 && memcmp(output, "abcabc42", 8) == 0);
+
+    /**
+     * What it loaded stays with it while others publish, twice, and are
+     * freed, and what they published reaches it.
+     */
+    run_freed(storing_again, sizeof(storing_again));
+    run_freed(storing_again, sizeof(storing_again));
+    EXPECT(is_string(&cpu->registers[1], "abc") && is_string(&cpu->registers[2], "abc42"));
+
+    output_len = 0;
+    svm_reset(cpu, SVM_RESET_ALL);
+    svm_run(cpu);
+    EXPECT(output_len == 9 && memcmp(output, "xyzxyzxyz", 9) == 0);
+    svm_free(cpu);
+
+    printf("%-10s strings outlive the machines which published them\n", "shared");
+
+    svm_image_release(&shared);
+    EXPECT(!SVM_IS_STRING(shared.variables[0]) && !SVM_IS_STRING(shared.variables[1]));
+
+    jsprintf_handler = sink;
+}
+
+int main(void)
+{
+    jsprintf_handler = sink;
+
+    check_scans("reset", SVM_RESET_ALL);
+    check_scans("retained", SVM_RESET_STACKS);
+    check_shared();
+
+    return failed;
+}
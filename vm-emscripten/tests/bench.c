@@ -0,0 +1,480 @@
+/**
+ * The benchmark suite of the virtual machine, linked with the native
+ * library from scripts/makeNative.sh.
+ *
+ *  bench [-e engine] [-r repetitions] [-t seconds] [-o results.json] [program.raw ...]
+ *
+ * Each workload below is a loop taken from one of the examples and made
+ * long enough to time, followed by the programs given on the command line.
+ * Every one is run in scans, reset before each as `RunScans` does, for a
+ * warm-up and then `repetitions` times for at least `seconds` each.  The
+ * instructions and scans per second of the repetitions give the mean,
+ * standard deviation, minimum, median and maximum printed for each, and
+ * written with the build and the machine to the JSON file, for runs to be
+ * compared with each other.
+ *
+ * The engine is `svm_run` as built, or one of `call`, `inline` or `jit`
+ * run between svm_latch_inputs() and svm_publish_outputs().
+ *
+ * Built and run by `npm run bench`.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/vm/vm-engine.h"
+#include "../src/vm/vm-jit.h"
+
+#define REPETITIONS 10
+#define SECONDS 0.2
+
+/**
+ * examples/bench.in, as it is.
+ */
+static unsigned char dispatch[] = {
+    INT_STORE, 1, 50000 & 0xFF, 50000 >> 8,
+    INT_STORE, 2, 1, 0,
+    INT_STORE, 3, 0, 0,
+    INT_STORE, 4, 3, 0,
+    /* 16 */ ADD, 3, 3, 4,
+    XOR, 5, 3, 1,
+    INC, 6,
+    SUB, 1, 1, 2,
+    JUMP_NZ, 16, 0,
+    EXIT,
+};
+
+/**
+ * The loop of examples/arith.in, with a division, on integers and then on
+ * a float of about 2.5 in #1.
+ */
+static unsigned char arithmetic[] = {
+    INT_STORE, 1, 2, 0,
+    INT_STORE, 2, 3, 0,
+    INT_STORE, 9, 2, 0,
+    /* 12 */ INT_STORE, 7, 10000 & 0xFF, 10000 >> 8,
+    /* 16 */ ADD, 0, 1, 2,
+    MUL, 3, 0, 2,
+    SUB, 4, 3, 1,
+    XOR, 5, 4, 2,
+    DIV, 6, 7, 2,
+    DEC, 7,
+    JUMP_NZ, 16, 0,
+    FLOAT_STORE, 1, 2, 0, 0x00, 0xA0,
+    DEC, 9,
+    JUMP_NZ, 12, 0,
+    EXIT,
+};
+
+/**
+ * The loop of examples/concat.in, building the string again each time
+ * round and comparing it with a literal.
+ */
+static unsigned char strings[] = {
+    INT_STORE, 1, 2000 & 0xFF, 2000 >> 8,
+    STRING_STORE, 4, 7, 0, ' ', 'b', 'a', 'n', 'a', 'n', 'a',
+    /* 15 */ STRING_STORE, 3, 0, 0,
+    STRING_CONCAT, 3, 3, 4,
+    STRING_CONCAT, 3, 3, 4,
+    STRING_CONCAT, 3, 3, 4,
+    CMP_STRING, 3, 21, 0,
+    ' ', 'b', 'a', 'n', 'a', 'n', 'a', ' ', 'b', 'a', 'n', 'a', 'n', 'a', ' ', 'b', 'a', 'n', 'a', 'n', 'a',
+    DEC, 1,
+    JUMP_NZ, 15, 0,
+    EXIT,
+};
+
+/**
+ * examples/call.in as a loop: a routine saving a register on the stack
+ * around a call of another one.
+ */
+static unsigned char calls[] = {
+    INT_STORE, 1, 20000 & 0xFF, 20000 >> 8,
+    /* 4 */ STACK_CALL, 13, 0,
+    DEC, 1,
+    JUMP_NZ, 4, 0,
+    EXIT,
+    /* 13 */ STACK_PUSH, 1,
+    STACK_CALL, 21, 0,
+    STACK_POP, 1,
+    STACK_RET,
+    /* 21 */ INC, 2,
+    STACK_RET,
+};
+
+/**
+ * The copy of examples/memcpy.in, a kilobyte at a time between two places
+ * past the program, each copy compared with its source.
+ */
+static unsigned char memory[] = {
+    INT_STORE, 0, 1000 & 0xFF, 1000 >> 8,
+    INT_STORE, 1, 0x00, 0x50,
+    INT_STORE, 2, 0x00, 0x40,
+    INT_STORE, 3, 0x00, 0x04,
+    /* 16 */ MEMCPY, 1, 2, 3,
+    MEMCMP, 1, 2, 3,
+    DEC, 0,
+    JUMP_NZ, 16, 0,
+    EXIT,
+};
+
+/**
+ * A short scan moving every input to an output, as a controller does:
+ * the cost of a scan rather than of instructions.
+ */
+static unsigned char scan[] = {
+    BINARY_LOAD, 0, 0, BINARY_LOAD, 1, 1, BINARY_LOAD, 2, 2, BINARY_LOAD, 3, 3,
+    AND, 4, 0, 1, OR, 5, 2, 3,
+    BINARY_SAVE, 4, 0, BINARY_SAVE, 5, 1, BINARY_SAVE, 0, 2, BINARY_SAVE, 3, 3,
+    ANALOG_LOAD, 6, 0, ANALOG_LOAD, 7, 1,
+    ADD, 8, 6, 7,
+    ANALOG_SAVE, 8, 0, ANALOG_SAVE, 6, 1,
+    VARIABLE_LOAD, 9, 0,
+    INC, 9,
+    VARIABLE_SAVE, 9, 0,
+    EXIT,
+};
+
+/**
+ * Prints of a counting loop, as examples/loop.in does, into the output
+ * buffer and then a sink which drops them.
+ */
+static unsigned char prints[] = {
+    INT_STORE, 0, 200, 0,
+    STRING_STORE, 1, 1, 0, '\n',
+    /* 9 */ INT_PRINT, 0,
+    STRING_PRINT, 1,
+    DEC, 0,
+    JUMP_NZ, 9, 0,
+    EXIT,
+};
+
+struct workload
+{
+    const char *name;
+    const char *category;
+    unsigned char *code;
+    uint32_t size;
+};
+
+static struct workload suite[] = {
+    {"bench", "dispatch", dispatch, sizeof(dispatch)},
+    {"arith", "arithmetic", arithmetic, sizeof(arithmetic)},
+    {"concat", "strings", strings, sizeof(strings)},
+    {"call", "calls", calls, sizeof(calls)},
+    {"memcpy", "memory", memory, sizeof(memory)},
+    {"scan", "io", scan, sizeof(scan)},
+    {"print", "output", prints, sizeof(prints)},
+};
+
+#define SUITE (sizeof(suite) / sizeof(suite[0]))
+
+static const struct
+{
+    const char *name;
+    void (*run)(svm_t *);
+} engines[] = {
+    {"svm_run", NULL},
+    {"call", svm_run_call},
+    {"inline", svm_run_inline},
+    {"jit", svm_run_jit},
+};
+
+/**
+ * What the repetitions of a workload measured.
+ */
+struct summary
+{
+    double mean;
+    double stddev;
+    double min;
+    double median;
+    double max;
+};
+
+struct result
+{
+    const char *name;
+    const char *category;
+    uint32_t instructions;
+    struct summary per_second;
+    struct summary scans;
+};
+
+static void discard(svm_t *cpup, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    (void)cpup;
+    (void)text;
+    (void)length;
+    (void)more;
+    (void)more_length;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int ascending(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Sorts `values`.
+ */
+static struct summary summarise(double *values, int n)
+{
+    struct summary s = {0, 0, 0, 0, 0};
+
+    qsort(values, n, sizeof(double), ascending);
+    for (int i = 0; i < n; i++)
+        s.mean += values[i] / n;
+    for (int i = 0; i < n && n > 1; i++)
+        s.stddev += (values[i] - s.mean) * (values[i] - s.mean) / (n - 1);
+
+    s.stddev = sqrt(s.stddev);
+    s.min = values[0];
+    s.max = values[n - 1];
+    s.median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    return s;
+}
+
+static void run_scan(svm_t *cpu, void (*run)(svm_t *))
+{
+    svm_reset(cpu, SVM_RESET_ALL);
+    if (!run)
+    {
+        svm_run(cpu);
+        return;
+    }
+    svm_latch_inputs(cpu);
+    run(cpu);
+    svm_publish_outputs(cpu);
+}
+
+/**
+ * Scans for at least `seconds`, counting the instructions and scans.
+ */
+static void repetition(svm_t *cpu, void (*run)(svm_t *), double seconds, double *instructions, double *scans)
+{
+    double elapsed;
+    double start = now();
+
+    *instructions = 0;
+    *scans = 0;
+    do
+    {
+        run_scan(cpu, run);
+        *instructions += cpu->iterations;
+        *scans += 1;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+
+    *instructions /= elapsed;
+    *scans /= elapsed;
+}
+
+/**
+ * Measures a workload, once a scan of it has run without failing with
+ * svm_run - the engines run directly have nowhere to unwind to.
+ */
+static int measure(struct workload *w, void (*run)(svm_t *), int repetitions, double seconds, struct result *r)
+{
+    double instructions[repetitions], scans[repetitions];
+    svm_t *cpu = svm_new(w->code, w->size, NULL);
+
+    if (!cpu)
+        return 1;
+
+    svm_set_output(cpu, 0, SVM_OUTPUT_FLUSH, discard);
+    svm_run(cpu);
+    if (cpu->faulted)
+    {
+        fprintf(stderr, "%s: failed at 0x%04X: %s\n", w->name, cpu->error.ip, cpu->error.message);
+        svm_free(cpu);
+        return 1;
+    }
+
+    r->name = w->name;
+    r->category = w->category;
+    r->instructions = cpu->iterations;
+
+    repetition(cpu, run, seconds / 2, &instructions[0], &scans[0]);
+    for (int i = 0; i < repetitions; i++)
+        repetition(cpu, run, seconds, &instructions[i], &scans[i]);
+
+    r->per_second = summarise(instructions, repetitions);
+    r->scans = summarise(scans, repetitions);
+
+    svm_free(cpu);
+    return 0;
+}
+
+static void print_result(const struct result *r)
+{
+    printf("%-24s %-12s %10u %14.0f %6.1f%% %14.0f %12.0f %6.1f%%\n", r->name, r->category, r->instructions,
+           r->per_second.mean, 100 * r->per_second.stddev / r->per_second.mean, r->per_second.median,
+           r->scans.mean, 100 * r->scans.stddev / r->scans.mean);
+}
+
+static void write_summary(FILE *fp, const char *name, const struct summary *s)
+{
+    fprintf(fp, "\"%s\": {\"mean\": %.1f, \"stddev\": %.1f, \"min\": %.1f, \"median\": %.1f, \"max\": %.1f}", name,
+            s->mean, s->stddev, s->min, s->median, s->max);
+}
+
+static void write_string(FILE *fp, const char *text)
+{
+    fputc('"', fp);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*text >= ' ')
+            fputc(*text, fp);
+    }
+    fputc('"', fp);
+}
+
+static int write_results(const char *path, const char *engine, int repetitions, double seconds,
+                         const struct result *results, int n)
+{
+    FILE *fp = fopen(path, "w");
+    char host[256] = "";
+    char date[32];
+    time_t t = time(NULL);
+
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+
+    gethostname(host, sizeof(host) - 1);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+    fprintf(fp, "{\n  \"date\": \"%s\",\n  \"host\": ", date);
+    write_string(fp, host);
+    fprintf(fp, ",\n  \"cpus\": %ld,\n  \"compiler\": ", sysconf(_SC_NPROCESSORS_ONLN));
+    write_string(fp, __VERSION__);
+    fprintf(fp, ",\n  \"dispatch\": %d,\n  \"jit\": %d,\n", SVM_DISPATCH, SVM_USE_JIT);
+    fprintf(fp, "  \"engine\": \"%s\",\n  \"repetitions\": %d,\n  \"seconds\": %g,\n", engine, repetitions, seconds);
+    fprintf(fp, "  \"workloads\": [");
+
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(fp, "%s\n    {\"name\": ", i ? "," : "");
+        write_string(fp, results[i].name);
+        fprintf(fp, ", \"category\": \"%s\", \"instructions_per_scan\": %u,\n     ", results[i].category,
+                results[i].instructions);
+        write_summary(fp, "instructions_per_second", &results[i].per_second);
+        fprintf(fp, ",\n     ");
+        write_summary(fp, "scans_per_second", &results[i].scans);
+        fprintf(fp, "}");
+    }
+
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-e svm_run|call|inline|jit] [-r repetitions] [-t seconds] [-o results.json] [program.raw ...]\n",
+            name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    static unsigned char code[0xFFFF];
+    const char *engine = engines[0].name;
+    void (*run)(svm_t *) = NULL;
+    const char *path = NULL;
+    int repetitions = REPETITIONS;
+    double seconds = SECONDS;
+    int status = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:r:t:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            engine = NULL;
+            for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+            {
+                if (strcmp(optarg, engines[i].name) == 0)
+                {
+                    engine = engines[i].name;
+                    run = engines[i].run;
+                }
+            }
+            if (!engine)
+                usage(argv[0]);
+            break;
+        case 'r':
+            repetitions = atoi(optarg);
+            break;
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (repetitions < 1)
+        usage(argv[0]);
+
+    int n = 0;
+    struct result *results = calloc(SUITE + argc - optind, sizeof(struct result));
+
+    printf("%-24s %-12s %10s %14s %7s %14s %12s %7s\n", "workload", "category", "[i/scan]", "mean [i/s]", "stddev",
+           "median [i/s]", "[scans/s]", "stddev");
+
+    for (size_t i = 0; i < SUITE; i++)
+    {
+        if (measure(&suite[i], run, repetitions, seconds, &results[n]) == 0)
+            print_result(&results[n++]);
+        else
+            status = 1;
+    }
+
+    /**
+     * Then the programs given, each read into the same buffer.
+     */
+    for (int i = optind; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        struct workload w = {argv[i], "example", code, fread(code, 1, sizeof(code), fp)};
+        fclose(fp);
+
+        if (measure(&w, run, repetitions, seconds, &results[n]) == 0)
+            print_result(&results[n++]);
+        else
+            status = 1;
+    }
+
+    if (path && write_results(path, engine, repetitions, seconds, results, n) != 0)
+        status = 1;
+
+    free(results);
+    return status;
+}
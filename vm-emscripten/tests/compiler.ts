@@ -149,6 +149,8 @@ async function compileFromFile(file: string) {
 async function test() {
     try {
         await compileFromFile('examples/add.in');
+        await compileFromFile('examples/arith.in');
+        await compileFromFile('examples/bench.in');
         await compileFromFile('examples/call.in');
         await compileFromFile('examples/compare.in');
         await compileFromFile('examples/concat.in');
@@ -0,0 +1,106 @@
+/**
+ * Native comparison of the execution engines.
+ *
+ * Every program given on the command line is run once with the reference
+ * loop, once with the inlined engine, once traced and - on x86-64 - once
+ * with the JIT, and the observable state (output, registers, flags, stacks
+ * and I/O) must match.  Each program is then run repeatedly with every
+ * engine to report instructions per second, along with the number of
+ * dispatches the inlined engine saved by running superinstructions and the
+ * hit rate of its type-specialised arithmetic.  A run is one scan of the
+ * program on a machine reset between scans, so the speedups are per scan;
+ * the time to create a machine and run its first scan, which is when the
+ * JIT compiles, is reported separately.
+ *
+ * Build and run with `npm run dtest`, after `npm run ctest` has produced
+ * the examples/*.raw files.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-jit.h"
+#include "../src/vm/vm-trace.h"
+
+static unsigned long traced;
+
+static void count(svm_tracer_t *tracer, int level, const char *msg)
+{
+    (void)tracer;
+    (void)level;
+    (void)msg;
+    traced++;
+}
+
+/**
+ * svm_run with a tracer attached, which must not change the results.
+ */
+static void run_traced(svm_t *cpu)
+{
+    static svm_tracer_t tracer = {SVM_TRACE_DETAIL, count, NULL};
+
+    svm_set_tracer(cpu, &tracer);
+    svm_run(cpu);
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char code[0xFFFF];
+    static struct snapshot reference, inlined, tracing, jitted;
+    int failed = 0;
+
+    const char *engine = SVM_DISPATCH == SVM_DISPATCH_THREADED ? "threaded" : "switch";
+
+    printf("%-24s %14s %14s %8s %10s %8s %14s %8s %10s %10s\n", "program", "call [i/s]", engine, "speedup", "fused", "quick", "jit", "speedup",
+           "setup [us]", "jit [us]");
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        uint32_t size = fread(code, 1, sizeof(code), fp);
+        fclose(fp);
+
+        run_once(code, size, svm_run_call, &reference);
+        run_once(code, size, svm_run_inline, &inlined);
+        run_once(code, size, run_traced, &tracing);
+        if (SVM_JIT)
+            run_once(code, size, svm_run_jit, &jitted);
+
+        if (!compare(argv[i], &reference, &inlined) ||
+            !compare(argv[i], &reference, &tracing) || !traced ||
+            (SVM_JIT && !compare(argv[i], &reference, &jitted)))
+        {
+            failed++;
+            continue;
+        }
+
+        double call = bench(code, size, svm_run_call);
+        double fast = bench(code, size, svm_run_inline);
+
+        uint32_t quick = inlined.cpu.quick_hits + inlined.cpu.quick_misses;
+
+        printf("%-24s %14.0f %14.0f %7.2fx %10u", argv[i], call, fast, fast / call, inlined.cpu.fused);
+        if (quick)
+            printf(" %7.1f%%", 100.0 * inlined.cpu.quick_hits / quick);
+        else
+            printf(" %8s", "-");
+
+        if (SVM_JIT)
+        {
+            double jit = bench(code, size, svm_run_jit);
+            printf(" %14.0f %7.2fx", jit, jit / call);
+        }
+        else
+            printf(" %14s %8s", "-", "-");
+
+        printf(" %10.1f", setup(code, size, svm_run_inline) * 1e6);
+        if (SVM_JIT)
+            printf(" %10.1f\n", setup(code, size, svm_run_jit) * 1e6);
+        else
+            printf(" %10s\n", "-");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+/**
+ * The event recorder, see `struct svm_events` in src/vm/vm-trace.h.
+ *
+ * Scans of a program with nested calls must record the same events from
+ * the inline engine and from the handlers, a fault must end the calls it
+ * left open in the export, and a full ring must keep the latest events.
+ * The trace of a few scans is written to the file given on the command
+ * line, for the script to check it is JSON, then the cost of recording is
+ * measured on a loop of calls.
+ *
+ * Built by `npm run etest`.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-trace.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+/**
+ * Two calls of a routine which calls another one.
+ */
+static unsigned char calls[] = {
+    STACK_CALL, 10, 0,
+    STACK_CALL, 10, 0,
+    EXIT,
+    NOP, NOP, NOP,
+    /* 10 */ STACK_CALL, 14, 0,
+    STACK_RET,
+    /* 14 */ INC, 1,
+    STACK_RET,
+};
+
+/**
+ * A call which fails.
+ */
+static unsigned char failing[] = {
+    STACK_CALL, 4, 0,
+    EXIT,
+    /* 4 */ STACK_POP, 1,
+    STACK_RET,
+};
+
+struct expected
+{
+    int type;
+    uint32_t ip;
+    uint32_t arg;
+};
+
+static const struct expected scan_of_calls[] = {
+    {SVM_EVENT_SCAN_BEGIN, 0, 0},
+    {SVM_EVENT_LATCH, 0, 0},
+    {SVM_EVENT_CALL, 0, 10},
+    {SVM_EVENT_CALL, 10, 14},
+    {SVM_EVENT_RET, 16, 13},
+    {SVM_EVENT_RET, 13, 3},
+    {SVM_EVENT_CALL, 3, 10},
+    {SVM_EVENT_CALL, 10, 14},
+    {SVM_EVENT_RET, 16, 13},
+    {SVM_EVENT_RET, 13, 6},
+    {SVM_EVENT_PUBLISH, 0, 0},
+    {SVM_EVENT_SCAN_END, 7, 11},
+};
+
+#define SCAN_EVENTS (sizeof(scan_of_calls) / sizeof(scan_of_calls[0]))
+
+/**
+ * The `n` events from the `first` recorded, against `expected` - with
+ * their arguments, except for timings and scan numbers.
+ */
+static int same_events(svm_t *cpu, uint64_t first, const struct expected *expected, size_t n)
+{
+    struct svm_events *events = cpu->events;
+    uint64_t ns = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const struct svm_event *e = &events->ring[(first + i) & events->mask];
+        int timed = e->type == SVM_EVENT_LATCH || e->type == SVM_EVENT_PUBLISH;
+
+        if (e->type != expected[i].type || e->ns < ns)
+            return 0;
+        if (!timed && e->type != SVM_EVENT_SCAN_BEGIN && (e->ip != expected[i].ip || e->arg != expected[i].arg))
+            return 0;
+        ns = e->ns;
+    }
+    return 1;
+}
+
+static int occurrences(const char *text, const char *what)
+{
+    int n = 0;
+
+    for (const char *p = strstr(text, what); p; p = strstr(p + 1, what))
+        n++;
+    return n;
+}
+
+static char json[1 << 20];
+
+static void check_calls(void)
+{
+    svm_t *cpu = svm_new(calls, sizeof(calls), NULL);
+
+    /**
+     * Nothing until enabled, and nothing exported either.
+     */
+    svm_run(cpu);
+    EXPECT(cpu->events == NULL);
+    EXPECT(svm_events_export(cpu, 1, json, sizeof(json)) == strlen(json) && occurrences(json, "\"ph\"") == 0);
+
+    EXPECT(svm_events_enable(cpu, 50) == 0 && cpu->events->mask == 63);
+    svm_reset(cpu, SVM_RESET_ALL);
+    svm_run(cpu);
+    EXPECT(cpu->events->count == SCAN_EVENTS && same_events(cpu, 0, scan_of_calls, SCAN_EVENTS));
+    EXPECT(cpu->events->ring[0].arg == 1);
+
+    /**
+     * The handlers record the calls too.
+     */
+    svm_reset(cpu, SVM_RESET_ALL);
+    svm_run_call(cpu);
+    EXPECT(cpu->events->count == SCAN_EVENTS + 8 && same_events(cpu, SCAN_EVENTS, scan_of_calls + 2, 8));
+    printf("%-10s %llu events\n", "calls", (unsigned long long)cpu->events->count);
+
+    /**
+     * A ring of eight keeps the end of the last scan: four returns and
+     * calls without their beginning, left out of the export.
+     */
+    EXPECT(svm_events_enable(cpu, 8) == 0 && cpu->events->count == 0);
+    for (int scan = 0; scan < 3; scan++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+    }
+    EXPECT(cpu->events->count == 3 * SCAN_EVENTS);
+    EXPECT(same_events(cpu, 3 * SCAN_EVENTS - 8, scan_of_calls + SCAN_EVENTS - 8, 8));
+
+    svm_events_export(cpu, 1, json, sizeof(json));
+    EXPECT(occurrences(json, "\"ph\":\"B\"") == 2 && occurrences(json, "\"ph\":\"E\"") == 2);
+    EXPECT(occurrences(json, "\"ph\":\"X\"") == 1);
+
+    /**
+     * Exported like snprintf(), cut short but terminated.
+     */
+    size_t length = svm_events_export(cpu, 1, json, sizeof(json));
+    EXPECT(svm_events_export(cpu, 1, json, 20) == length && strlen(json) == 19);
+    EXPECT(svm_events_export(cpu, 1, NULL, 0) == length);
+
+    EXPECT(svm_events_enable(cpu, 0) == 0 && cpu->events == NULL);
+    svm_free(cpu);
+}
+
+static void check_fault(void)
+{
+    static const struct expected scan_of_failing[] = {
+        {SVM_EVENT_SCAN_BEGIN, 0, 0},
+        {SVM_EVENT_LATCH, 0, 0},
+        {SVM_EVENT_CALL, 0, 4},
+        {SVM_EVENT_FAULT, 4, SVM_ERROR_STACK},
+        {SVM_EVENT_SCAN_END, 4, 1},
+    };
+    svm_t *cpu = svm_new(failing, sizeof(failing), NULL);
+
+    svm_events_enable(cpu, 16);
+    svm_run(cpu);
+    EXPECT(cpu->faulted && cpu->events->count == 5);
+    EXPECT(same_events(cpu, 0, scan_of_failing, 3) && same_events(cpu, 3, scan_of_failing + 3, 1));
+
+    /**
+     * The end of the scan ends the call first.
+     */
+    svm_events_export(cpu, 1, json, sizeof(json));
+    EXPECT(occurrences(json, "\"ph\":\"B\"") == 2 && occurrences(json, "\"ph\":\"E\"") == 2);
+    EXPECT(occurrences(json, "\"name\":\"fault\"") == 1);
+
+    svm_free(cpu);
+}
+
+/**
+ * Scans of both programs, the failing one stopping the machine it runs on.
+ */
+static int write_trace(const char *path)
+{
+    svm_t *cpu = svm_new(calls, sizeof(calls), NULL);
+    svm_t *other = svm_new(failing, sizeof(failing), NULL);
+
+    svm_events_enable(cpu, 256);
+    svm_events_enable(other, 256);
+    for (int scan = 0; scan < 4; scan++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+    }
+    svm_run(other);
+
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+
+    /**
+     * Merged into one list, one thread for each machine.
+     */
+    size_t length = svm_events_export(cpu, 1, json, sizeof(json));
+    fwrite(json, 1, length - 4, fp);
+    svm_events_export(other, 2, json, sizeof(json));
+    fprintf(fp, ",%s", strchr(json, '\n') + 1);
+    fclose(fp);
+
+    svm_free(cpu);
+    svm_free(other);
+    return 0;
+}
+
+/**
+ * A loop of calls, as many as fit an INT_STORE.
+ */
+static unsigned char loop[] = {
+    INT_STORE, 0, 0xFF, 0xFF,
+    /* 4 */ STACK_CALL, 13, 0,
+    DEC, 0,
+    JUMP_NZ, 4, 0,
+    EXIT,
+    /* 13 */ INC, 1,
+    STACK_RET,
+};
+
+#define LOOPS 0xFFFF
+
+/**
+ * Nanoseconds per call and return, recording into `capacity` events.
+ */
+static double per_call(void (*run)(svm_t *), uint32_t capacity)
+{
+    svm_t *cpu = svm_new(loop, sizeof(loop), NULL);
+    double scans = 0;
+    double elapsed;
+    double start = now();
+
+    svm_events_enable(cpu, capacity);
+    do
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_latch_inputs(cpu);
+        run(cpu);
+        svm_publish_outputs(cpu);
+        scans++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    svm_free(cpu);
+    return elapsed * 1e9 / (scans * LOOPS);
+}
+
+int main(int argc, char *argv[])
+{
+    jsprintf_handler = sink;
+
+    check_calls();
+    check_fault();
+    if (failed)
+        return failed;
+
+    if (argc > 1 && write_trace(argv[1]) != 0)
+        return 1;
+
+    printf("\n%-10s %14s %14s\n", "engine", "off [ns/call]", "on [ns/call]");
+    printf("%-10s %14.1f %14.1f\n", "call", per_call(svm_run_call, 0), per_call(svm_run_call, 4096));
+    printf("%-10s %14.1f %14.1f\n", "inline", per_call(svm_run_inline, 0), per_call(svm_run_inline, 4096));
+
+    return failed;
+}
@@ -11,6 +11,10 @@ VM().then(vm => {
     
     console.log('examples/add.raw');
     vm.RunProgram(readFileSync('examples/add.raw'));
+    console.log('examples/arith.raw');
+    vm.RunProgram(readFileSync('examples/arith.raw'));
+    console.log('examples/bench.raw');
+    vm.RunProgram(readFileSync('examples/bench.raw'));
     console.log('examples/call.raw');
     vm.RunProgram(readFileSync('examples/call.raw'));
     console.log('examples/compare.raw');
@@ -0,0 +1,197 @@
+/**
+ * Failing instructions, see svm_fault() in src/vm/vm.h.
+ *
+ * Small programs which fail in each of the ways an instruction can are run
+ * with svm_run() - with whichever engine it was built for - and with
+ * svm_step().  Each must stop on the failing instruction with the right
+ * error, leave the outputs of the previous scan alone, and run again once
+ * reset.  Run by the reference loop directly, with nothing to unwind to,
+ * the failing instruction must stop without touching memory outside the
+ * machine.
+ *
+ * Built by `npm run ftest`, once for every engine and once more with
+ * AddressSanitizer.
+ */
+#include "snapshot.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+static int reported;
+
+static void returning(char *msg)
+{
+    (void)msg;
+    reported++;
+}
+
+struct failure
+{
+    const char *name;
+    unsigned char code[16];
+    uint32_t size;
+    int error;
+    uint32_t ip;
+};
+
+static const struct failure failures[] = {
+    {"division by zero", {INT_STORE, 0, 1, 0, NOP, DIV, 0, 0, 1, EXIT}, 10, SVM_ERROR_DIVISION, 5},
+    {"type", {NOP, STRING_PRINT, 0, EXIT}, 4, SVM_ERROR_TYPE, 1},
+    {"register", {NOP, INT_STORE, REGISTER_COUNT, 0, 0, EXIT}, 6, SVM_ERROR_REGISTER, 1},
+    {"stack", {NOP, NOP, STACK_POP, 0, EXIT}, 5, SVM_ERROR_STACK, 2},
+    {"call stack", {STACK_RET}, 1, SVM_ERROR_STACK, 0},
+    {"memory", {INT_STORE, 1, 0xFF, 0xFF, INC, 1, POKE, 0, 1, EXIT}, 10, SVM_ERROR_MEMORY, 6},
+};
+
+static void check_failure(const struct failure *f)
+{
+    unsigned char code[16];
+    memcpy(code, f->code, sizeof(code));
+
+    svm_t *cpu = svm_new(code, f->size, returning);
+
+    for (int round = 0; round < 2; round++)
+    {
+        reported = 0;
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+
+        if (!cpu->faulted || cpu->error.code != f->error || cpu->error.ip != f->ip ||
+            cpu->error.opcode != f->code[f->ip] || reported != 1 || cpu->unwind)
+        {
+            fprintf(stderr, "%s: error %d at %04x (%02X), expected %d at %04x\n", f->name, cpu->error.code,
+                    cpu->error.ip, cpu->error.opcode, f->error, f->ip);
+            failed = 1;
+        }
+
+        svm_reset(cpu, SVM_RESET_ALL);
+        int status;
+        while ((status = svm_step(cpu, 3)) == SVM_STATUS_BUDGET)
+            ;
+
+        if (status != SVM_STATUS_ERROR || cpu->error.code != f->error || cpu->error.ip != f->ip)
+        {
+            fprintf(stderr, "%s: stepped to status %d, error %d at %04x\n", f->name, status, cpu->error.code,
+                    cpu->error.ip);
+            failed = 1;
+        }
+    }
+
+    svm_free(cpu);
+}
+
+/**
+ * The same machine failing, then running, then failing again: a failed
+ * scan publishes nothing and a reset is all it takes to run again.
+ */
+static void check_reuse(void)
+{
+    /**
+     * @A0 = 12 / %I0
+     */
+    unsigned char code[] = {INT_STORE, 0, 12, 0, BINARY_LOAD, 1, 0, DIV, 0, 0, 1, ANALOG_SAVE, 0, 0, EXIT};
+    svm_t *cpu = svm_new(code, sizeof(code), returning);
+    svm_set_image(cpu, &test_image);
+
+    test_image.out.analog[0] = 42;
+
+    for (int round = 0; round < 3; round++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        test_image.in.binary[0] = 0;
+        svm_run(cpu);
+
+        EXPECT(cpu->faulted && cpu->error.code == SVM_ERROR_DIVISION);
+        EXPECT(cpu->error.ip == 7 && cpu->error.opcode == DIV);
+        EXPECT(test_image.out.analog[0] == (round ? 12 : 42));
+
+        /**
+         * Still stopped without a reset.
+         */
+        svm_run(cpu);
+        EXPECT(cpu->faulted && test_image.out.analog[0] == (round ? 12 : 42));
+
+        svm_reset(cpu, SVM_RESET_ALL);
+        EXPECT(!cpu->faulted && cpu->error.code == SVM_ERROR_NONE);
+
+        test_image.in.binary[0] = 1;
+        svm_run(cpu);
+        EXPECT(!cpu->faulted && test_image.out.analog[0] == 12);
+    }
+
+    svm_free(cpu);
+}
+
+/**
+ * Failures at the edges of the RAM and the stacks, run by svm_run_call()
+ * with an error handler which returns: svm_fault() returns too, and the
+ * handler must give up rather than read or write past them.
+ */
+static void check_returning(void)
+{
+    static unsigned char code[2 * STACK_COUNT + 1];
+    struct
+    {
+        const char *name;
+        unsigned char *code;
+        uint32_t size;
+        int error;
+    } cases[] = {
+        {"peek below", (unsigned char[]){INT_STORE, 1, 0, 0, DEC, 1, PEEK, 0, 1, EXIT}, 10, SVM_ERROR_MEMORY},
+        {"peek above", (unsigned char[]){INT_STORE, 1, 0xFF, 0xFF, PEEK, 0, 1, EXIT}, 8, SVM_ERROR_MEMORY},
+        {"poke above", (unsigned char[]){INT_STORE, 1, 0xFF, 0xFF, POKE, 0, 1, EXIT}, 8, SVM_ERROR_MEMORY},
+        {"pop", (unsigned char[]){STACK_POP, 0, EXIT}, 3, SVM_ERROR_STACK},
+        {"ret", (unsigned char[]){STACK_RET, EXIT}, 2, SVM_ERROR_STACK},
+        {"string", (unsigned char[]){STRING_PRINT, 0, EXIT}, 3, SVM_ERROR_TYPE},
+        {"push", code, 0, SVM_ERROR_STACK},
+        {"call", (unsigned char[]){STACK_CALL, 0, 0}, 3, SVM_ERROR_STACK},
+    };
+
+    for (int i = 0; i < STACK_COUNT; i++)
+    {
+        code[2 * i] = STACK_PUSH;
+        code[2 * i + 1] = 0;
+    }
+    code[2 * STACK_COUNT] = EXIT;
+    cases[6].size = sizeof(code);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        svm_t *cpu = svm_new(cases[i].code, cases[i].size, returning);
+
+        reported = 0;
+        svm_run_call(cpu);
+
+        if (!cpu->faulted || cpu->error.code != cases[i].error || reported != 1)
+        {
+            fprintf(stderr, "%s: error %d, expected %d\n", cases[i].name, cpu->error.code, cases[i].error);
+            failed = 1;
+        }
+        EXPECT(cpu->SP >= 0 && cpu->SP < STACK_COUNT);
+        EXPECT(cpu->CSP >= 0 && cpu->CSP < CALL_STACK_COUNT);
+        svm_free(cpu);
+    }
+}
+
+int main(void)
+{
+    jsprintf_handler = sink;
+
+    for (size_t i = 0; i < sizeof(failures) / sizeof(failures[0]); i++)
+        check_failure(&failures[i]);
+
+    check_reuse();
+    check_returning();
+
+    if (failed)
+        return 1;
+
+    printf("%zu failures stopped as expected\n", sizeof(failures) / sizeof(failures[0]));
+    return 0;
+}
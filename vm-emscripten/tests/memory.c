@@ -0,0 +1,349 @@
+/**
+ * The memory operations - MEMCPY, MEMSET, MEMCMP and MEMFIND.
+ *
+ * Each is first checked against a byte-wise model of the 64k of RAM, on
+ * random operands which wrap around its end and overlap each other, then
+ * on code which writes over itself with every engine, and with the JIT
+ * after svm_step() wrote over the code it compiled.  The throughput of
+ * each is then measured, for sizes from 16 bytes to half the RAM, and for
+ * a move of most of it by a few bytes.
+ *
+ * Built by `npm run xtest`.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-decode.h"
+#include "../src/vm/vm-jit.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+/**
+ * Random operands checked for each operation.
+ */
+#define TRIALS 2000
+
+/**
+ * The RAM as the model sees it.
+ */
+static unsigned char model[0xFFFF];
+
+/**
+ * An address or size operand: mostly within the RAM, sometimes beyond it
+ * or negative, and small often enough for both ranges to overlap.
+ */
+static int operand(void)
+{
+    switch (rand() % 8)
+    {
+    case 0:
+        return -(rand() % 100) - 1;
+    case 1:
+        return 0xFFFF + rand() % 0x20000;
+    case 2:
+    case 3:
+        return rand() % 64;
+    default:
+        return rand() % 0xFFFF;
+    }
+}
+
+/**
+ * Run `opcode` once with the given registers 1-3, on RAM filled at random
+ * with the instruction itself at zero, and the model alongside it.
+ */
+static svm_t *step(svm_t *cpu, uint8_t opcode, int r1, int r2, int r3)
+{
+    uint32_t x = rand() | 1;
+
+    for (uint32_t i = 0; i < 0xFFFF; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        model[i] = x & 0x300 ? x : 0x5A;
+    }
+    model[0] = opcode;
+    model[1] = 1;
+    model[2] = 2;
+    model[3] = 3;
+
+    memcpy(cpu->code, model, 0xFFFF);
+    svm_invalidate(cpu, 0, 0xFFFF);
+    svm_reset(cpu, SVM_RESET_REGISTERS | SVM_RESET_STACKS);
+
+    cpu->registers[1].content.integer = r1;
+    cpu->registers[2].content.integer = r2;
+    cpu->registers[3].content.integer = r3;
+
+    svm_step(cpu, 1);
+    return cpu;
+}
+
+static uint32_t wrap(int adr)
+{
+    return (uint32_t)adr % 0xFFFF;
+}
+
+static uint32_t capped(int size)
+{
+    return size < 0 ? 0 : size > 0xFFFF ? 0xFFFF : size;
+}
+
+static void check_model(svm_t *cpu)
+{
+    static unsigned char copy[0xFFFF];
+
+    for (int t = 0; t < TRIALS; t++)
+    {
+        int dest = operand(), src = operand(), size = operand();
+
+        step(cpu, MEMCPY, dest, src, size);
+        if (dest < 0 || src < 0)
+        {
+            EXPECT(cpu->faulted && cpu->error.code == SVM_ERROR_MEMORY);
+            continue;
+        }
+
+        uint32_t n = capped(size);
+        for (uint32_t i = 0; i < n; i++)
+            copy[i] = model[(wrap(src) + i) % 0xFFFF];
+        for (uint32_t i = 0; i < n; i++)
+            model[(wrap(dest) + i) % 0xFFFF] = copy[i];
+
+        EXPECT(!cpu->faulted && memcmp(cpu->code, model, 0xFFFF) == 0);
+    }
+
+    for (int t = 0; t < TRIALS; t++)
+    {
+        int dest = operand(), value = rand() % 0x400, size = operand();
+
+        step(cpu, MEMSET, dest, value, size);
+        if (dest < 0)
+        {
+            EXPECT(cpu->faulted && cpu->error.code == SVM_ERROR_MEMORY);
+            continue;
+        }
+
+        for (uint32_t i = 0; i < capped(size); i++)
+            model[(wrap(dest) + i) % 0xFFFF] = value;
+
+        EXPECT(!cpu->faulted && memcmp(cpu->code, model, 0xFFFF) == 0);
+    }
+
+    for (int t = 0; t < TRIALS; t++)
+    {
+        int lhs = operand(), rhs = operand(), size = operand();
+
+        /**
+         * Mostly equal ranges, differing in one byte - if any.
+         */
+        if (lhs >= 0 && rhs >= 0)
+        {
+            uint32_t n = capped(size);
+
+            for (uint32_t i = 0; i < n; i++)
+                model[(wrap(lhs) + i) % 0xFFFF] = model[(wrap(rhs) + i) % 0xFFFF];
+            if (n && rand() % 2)
+                model[(wrap(lhs) + rand() % n) % 0xFFFF] ^= 1;
+        }
+
+        step(cpu, MEMCMP, lhs, rhs, size);
+        if (lhs < 0 || rhs < 0)
+        {
+            EXPECT(cpu->faulted && cpu->error.code == SVM_ERROR_MEMORY);
+            continue;
+        }
+
+        int equal = 1;
+        for (uint32_t i = 0; i < capped(size); i++)
+            equal &= model[(wrap(lhs) + i) % 0xFFFF] == model[(wrap(rhs) + i) % 0xFFFF];
+
+        EXPECT(!cpu->faulted && cpu->jmp == equal);
+    }
+
+    for (int t = 0; t < TRIALS; t++)
+    {
+        int adr = operand(), value = 0x5A + 0x100 * (rand() % 4), size = operand();
+
+        step(cpu, MEMFIND, adr, value, size);
+        if (adr < 0)
+        {
+            EXPECT(cpu->faulted && cpu->error.code == SVM_ERROR_MEMORY);
+            continue;
+        }
+
+        int found = -1;
+        for (uint32_t i = 0; i < capped(size) && found < 0; i++)
+        {
+            if (model[(wrap(adr) + i) % 0xFFFF] == 0x5A)
+                found = (wrap(adr) + i) % 0xFFFF;
+        }
+
+        EXPECT(!cpu->faulted && cpu->jmp == (found >= 0));
+        EXPECT(cpu->registers[1].content.integer == (found >= 0 ? found : adr));
+    }
+}
+
+/**
+ * A MEMSET over the INC after it, and a MEMCPY of a NOP over the second
+ * one - only the last INC is left to run.
+ */
+static unsigned char rewrite[] = {
+    INT_STORE, 1, 20, 0,
+    INT_STORE, 2, NOP, 0,
+    INT_STORE, 3, 2, 0,
+    INT_STORE, 4, 26, 0,
+    /* 16 */ MEMSET, 1, 2, 3,
+    /* 20 */ INC, 5,
+    /* 22 */ MEMCPY, 4, 1, 3,
+    /* 26 */ INC, 5,
+    /* 28 */ INC, 5,
+    EXIT,
+};
+
+static void check_rewrite(const char *name, void (*run)(svm_t *))
+{
+    svm_t *cpu = svm_new(rewrite, sizeof(rewrite), error);
+
+    run(cpu);
+    EXPECT(cpu->registers[5].tag == INTEGER && cpu->registers[5].content.integer == 1);
+    printf("%-10s rewrites, count %d\n", name, cpu->registers[5].content.integer);
+
+    svm_free(cpu);
+}
+
+/**
+ * Sets register 1 to the byte at 2, and when binary input 0 is set pokes
+ * a 9 there for the scans after it.
+ */
+static unsigned char patching[] = {
+    INT_STORE, 1, 7, 0,
+    BINARY_LOAD, 2, 0,
+    CMP_IMMEDIATE, 2, 1, 0,
+    JUMP_NZ, 25, 0,
+    INT_STORE, 3, 9, 0,
+    INT_STORE, 4, 2, 0,
+    POKE, 3, 4,
+    /* 25 */ EXIT,
+};
+
+static int patched_scan(svm_t *cpu, int poke, void (*run)(svm_t *))
+{
+    svm_reset(cpu, SVM_RESET_REGISTERS | SVM_RESET_STACKS);
+    cpu->image->in.binary[0] = poke;
+    svm_latch_inputs(cpu);
+    run(cpu);
+    return cpu->registers[1].content.integer;
+}
+
+static void run_stepped(svm_t *cpu)
+{
+    cpu->ip = 0;
+    while (svm_step(cpu, 2) == SVM_STATUS_BUDGET)
+        ;
+}
+
+/**
+ * The JIT compiles the program on the first scan, svm_step() patches it
+ * on the second, and the third must run the patched code - as the
+ * inlined engine does.
+ */
+static void check_stale(void)
+{
+    svm_t *cpu = svm_new(patching, sizeof(patching), error);
+    svm_t *inlined = svm_new(patching, sizeof(patching), error);
+
+    EXPECT(patched_scan(cpu, 0, svm_run_jit) == 7);
+    EXPECT(patched_scan(cpu, 1, run_stepped) == 7);
+    EXPECT(patched_scan(cpu, 0, svm_run_jit) == 9);
+
+    EXPECT(patched_scan(inlined, 0, svm_run_inline) == 7);
+    EXPECT(patched_scan(inlined, 1, run_stepped) == 7);
+    EXPECT(patched_scan(inlined, 0, svm_run_inline) == 9);
+
+    printf("%-10s patched between scans, register %d\n", "jit", cpu->registers[1].content.integer);
+
+    svm_free(cpu);
+    svm_free(inlined);
+}
+
+/**
+ * Times round each loop of the benchmark.
+ */
+#define LOOPS 1000
+
+/**
+ * Runs of `opcode` on registers 1-3, LOOPS at a time.
+ */
+static double throughput(uint8_t opcode, int r1, int r2, int r3)
+{
+    unsigned char code[] = {
+        INT_STORE, 0, LOOPS & 0xFF, LOOPS >> 8,
+        INT_STORE, 1, r1 & 0xFF, r1 >> 8,
+        INT_STORE, 2, r2 & 0xFF, r2 >> 8,
+        INT_STORE, 3, r3 & 0xFF, r3 >> 8,
+        /* 16 */ opcode, 1, 2, 3,
+        DEC, 0,
+        JUMP_NZ, 16, 0,
+        EXIT,
+    };
+    svm_t *cpu = svm_new(code, sizeof(code), error);
+    double runs = 0;
+    double elapsed;
+    double start = now();
+
+    do
+    {
+        svm_reset(cpu, SVM_RESET_REGISTERS | SVM_RESET_STACKS);
+        svm_run(cpu);
+        runs += LOOPS;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    svm_free(cpu);
+
+    return runs * r3 / elapsed / 1e6;
+}
+
+int main(void)
+{
+    static const int sizes[] = {16, 64, 256, 1024, 4096, 16384, 32704};
+
+    svm_t *cpu = svm_new((unsigned char[]){EXIT}, 1, NULL);
+
+    srand(1);
+    check_model(cpu);
+    svm_free(cpu);
+    printf("%-10s %d trials of each operation\n", "model", TRIALS);
+
+    jsprintf_handler = sink;
+
+    check_rewrite("call", svm_run_call);
+    check_rewrite("inline", svm_run_inline);
+    check_rewrite("jit", svm_run_jit);
+    check_stale();
+    if (failed)
+        return failed;
+
+    printf("\n%-16s %14s %14s %14s %14s\n", "bytes", "memcpy [MB/s]", "memset [MB/s]", "memcmp [MB/s]", "memfind [MB/s]");
+
+    /**
+     * Between two halves of the RAM, past the program.
+     */
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        printf("%-16d %14.0f %14.0f %14.0f %14.0f\n", sizes[i], throughput(MEMCPY, 0x8000, 0x40, sizes[i]),
+               throughput(MEMSET, 0x40, 0, sizes[i]), throughput(MEMCMP, 0x8000, 0x40, sizes[i]),
+               throughput(MEMFIND, 0x40, 1, sizes[i]));
+    }
+
+    printf("%-16s %14.0f\n", "60000, moved 16", throughput(MEMCPY, 0x50, 0x40, 60000));
+
+    return failed;
+}
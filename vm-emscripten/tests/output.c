@@ -0,0 +1,263 @@
+/**
+ * The output buffer, see `struct svm_output` in src/vm/vm.h.
+ *
+ * A program printing in a loop must reach the sink whole and in order,
+ * once a scan with the default buffer, in several calls when the buffer
+ * fills with SVM_OUTPUT_FLUSH, and cut after the last print which fitted
+ * with SVM_OUTPUT_DROP.  Prints longer than the buffer, failed scans and
+ * the writev(2) sink are checked too, then the time per print is measured
+ * with a sink call for every print and with one a scan.
+ *
+ * Built by `npm run otest`.
+ */
+#include <unistd.h>
+
+#include "snapshot.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+/**
+ * What reached the sink, and in how many calls.
+ */
+static char received[1 << 16];
+static size_t received_len;
+static int calls;
+
+static void keep(svm_t *cpu, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    (void)cpu;
+
+    if (received_len + length + more_length < sizeof(received))
+    {
+        memcpy(received + received_len, text, length);
+        memcpy(received + received_len + length, more, more_length);
+        received_len += length + more_length;
+    }
+    calls++;
+}
+
+static void count(svm_t *cpu, const char *text, uint32_t length, const char *more, uint32_t more_length)
+{
+    (void)cpu;
+    (void)text;
+    (void)length;
+    (void)more;
+    (void)more_length;
+
+    calls++;
+}
+
+/**
+ * Prints of register 0, from 300 down to 1.
+ */
+static unsigned char prints[] = {
+    INT_STORE, 0, 300 & 0xFF, 300 >> 8,
+    /* 4 */ INT_PRINT, 0,
+    DEC, 0,
+    JUMP_NZ, 4, 0,
+    EXIT,
+};
+
+#define PRINTED 300
+
+/**
+ * What `prints` prints.
+ */
+static size_t expected(char *text)
+{
+    size_t length = 0;
+
+    for (int i = PRINTED; i > 0; i--)
+        length += sprintf(text + length, "0x%04X", i);
+    return length;
+}
+
+static svm_t *machine(unsigned char *code, uint32_t size, uint32_t capacity, int policy)
+{
+    svm_t *cpu = svm_new(code, size, NULL);
+
+    svm_set_output(cpu, capacity, policy, keep);
+    received_len = 0;
+    calls = 0;
+    return cpu;
+}
+
+static void check_policies(void)
+{
+    static char text[1 << 16];
+    size_t length = expected(text);
+
+    svm_t *cpu = machine(prints, sizeof(prints), 0, SVM_OUTPUT_FLUSH);
+    for (int scan = 1; scan <= 3; scan++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+        EXPECT(calls == scan && received_len == length * scan);
+    }
+    EXPECT(memcmp(received, text, length) == 0 && cpu->output.flushes == 3);
+    printf("%-10s %d prints, %d calls\n", "default", 3 * PRINTED, calls);
+    svm_free(cpu);
+
+    cpu = machine(prints, sizeof(prints), 64, SVM_OUTPUT_FLUSH);
+    svm_run(cpu);
+    EXPECT(received_len == length && memcmp(received, text, length) == 0);
+    EXPECT(calls == (int)((length + 59) / 60) && cpu->output.dropped == 0);
+    printf("%-10s %d prints, %d calls\n", "flush", PRINTED, calls);
+    svm_free(cpu);
+
+    /**
+     * Ten prints of six bytes fit, the rest is dropped.
+     */
+    cpu = machine(prints, sizeof(prints), 64, SVM_OUTPUT_DROP);
+    svm_run(cpu);
+    EXPECT(calls == 1 && received_len == 60 && memcmp(received, text, 60) == 0);
+    EXPECT(cpu->output.dropped == length - 60);
+    printf("%-10s %d prints, %d calls, %llu bytes dropped\n", "drop", PRINTED, calls,
+           (unsigned long long)cpu->output.dropped);
+    svm_free(cpu);
+}
+
+/**
+ * A print longer than the buffer, after a short one.
+ */
+static unsigned char long_print[] = {
+    INT_STORE, 0, 7, 0,
+    INT_PRINT, 0,
+    STRING_STORE, 1, 100, 0,
+    'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ', 'f', 'o', 'x', ' ',
+    'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ', 'f', 'o', 'x', ' ',
+    'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ', 'f', 'o', 'x', ' ',
+    'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ', 'f', 'o', 'x', ' ',
+    'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ', 'f', 'o', 'x', '.',
+    STRING_PRINT, 1,
+    INT_PRINT, 0,
+    EXIT,
+};
+
+/**
+ * Prints, then pops from the empty stack.
+ */
+static unsigned char failing[] = {
+    INT_STORE, 0, 1, 0,
+    INT_PRINT, 0,
+    STACK_POP, 1,
+    INT_PRINT, 0,
+    EXIT,
+};
+
+static void check_edges(void)
+{
+    svm_t *cpu = machine(long_print, sizeof(long_print), 32, SVM_OUTPUT_FLUSH);
+    svm_run(cpu);
+    EXPECT(calls == 2 && received_len == 112);
+    EXPECT(memcmp(received, "0x0007The quick", 15) == 0 && memcmp(received + 102, "fox.0x0007", 10) == 0);
+    svm_free(cpu);
+
+    cpu = machine(failing, sizeof(failing), 0, SVM_OUTPUT_FLUSH);
+    svm_run(cpu);
+    EXPECT(cpu->faulted && calls == 1 && received_len == 6 && memcmp(received, "0x0001", 6) == 0);
+    svm_free(cpu);
+
+    /**
+     * Nothing is lost when the machine goes before the end of a scan.
+     */
+    cpu = machine(prints, sizeof(prints), 0, SVM_OUTPUT_FLUSH);
+    svm_step(cpu, 30);
+    EXPECT(calls == 0);
+    svm_free(cpu);
+    EXPECT(calls == 1 && received_len == 60);
+
+    /**
+     * The default sink passes it on to jsprintf_handler().
+     */
+    output_len = 0;
+    jsprintf_handler = capture;
+    cpu = svm_new(long_print, sizeof(long_print), NULL);
+    svm_set_output(cpu, 32, SVM_OUTPUT_FLUSH, NULL);
+    svm_run(cpu);
+    EXPECT(output_len == 112 && memcmp(output + 102, "fox.0x0007", 10) == 0);
+    svm_free(cpu);
+    jsprintf_handler = sink;
+}
+
+static void check_writev(void)
+{
+    static char text[1 << 16];
+    size_t length = expected(text);
+    int fds[2];
+
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        failed = 1;
+        return;
+    }
+
+    svm_t *cpu = svm_new(prints, sizeof(prints), NULL);
+    svm_set_output(cpu, 100, SVM_OUTPUT_FLUSH, svm_output_writev);
+    cpu->output.fd = fds[1];
+    svm_run(cpu);
+    svm_free(cpu);
+    close(fds[1]);
+
+    size_t got = 0;
+    ssize_t n;
+    while ((n = read(fds[0], received + got, sizeof(received) - got)) > 0)
+        got += n;
+    close(fds[0]);
+
+    EXPECT(got == length && memcmp(received, text, length) == 0);
+    printf("%-10s %zu bytes\n", "writev", got);
+}
+
+/**
+ * Nanoseconds per print of `prints`, with the given buffer.
+ */
+static void per_print(uint32_t capacity)
+{
+    svm_t *cpu = svm_new(prints, sizeof(prints), NULL);
+    double scans = 0;
+    double elapsed;
+    double start = now();
+
+    svm_set_output(cpu, capacity, SVM_OUTPUT_FLUSH, count);
+    calls = 0;
+    do
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+        scans++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    printf("%-24u %12.1f %14.1f\n", capacity, elapsed * 1e9 / (scans * PRINTED), calls / scans);
+
+    svm_free(cpu);
+}
+
+int main(void)
+{
+    jsprintf_handler = sink;
+
+    check_policies();
+    check_edges();
+    check_writev();
+    if (failed)
+        return failed;
+
+    /**
+     * Six bytes a print: a buffer of eight is handed over after every one.
+     */
+    printf("\n%-24s %12s %14s\n", "buffer [bytes]", "[ns/print]", "[calls/scan]");
+    per_print(8);
+    per_print(SVM_OUTPUT_CAPACITY);
+
+    return failed;
+}
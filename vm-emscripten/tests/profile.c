@@ -0,0 +1,182 @@
+/**
+ * The profiler, see `struct svm_profile` in src/vm/vm-trace.h.
+ *
+ * A loop must be counted exactly, by opcode and by offset, whether it is
+ * run by `svm_run` or `svm_step`, and without changing what it does.  Each
+ * program given on the command line is then profiled for a scan, its
+ * counts checked against the instructions run, and the report of the last
+ * one printed - followed by what profiling costs per instruction.
+ *
+ * Built by `npm run ptest`, after `npm run ctest` has produced the
+ * examples/*.raw files.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-trace.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+#define LOOPS 1000
+
+static unsigned char loop[] = {
+    INT_STORE, 0, LOOPS & 0xFF, LOOPS >> 8,
+    /* 4 */ INC, 1,
+    DEC, 0,
+    JUMP_NZ, 4, 0,
+    EXIT,
+};
+
+static uint64_t sum(const uint64_t *counts, int n)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < n; i++)
+        total += counts[i];
+    return total;
+}
+
+static uint64_t offsets(struct svm_profile *profile)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < 0xFFFF; i++)
+        total += profile->offsets[i];
+    return total;
+}
+
+/**
+ * The counts of `scans` runs of the loop.
+ */
+static void check_counts(svm_t *cpu, uint64_t scans)
+{
+    struct svm_profile *profile = cpu->profile;
+
+    EXPECT(profile->counts[INT_STORE] == scans && profile->counts[EXIT] == scans);
+    EXPECT(profile->counts[INC] == scans * LOOPS && profile->counts[DEC] == scans * LOOPS);
+    EXPECT(profile->counts[JUMP_NZ] == scans * LOOPS);
+    EXPECT(sum(profile->counts, OPCODE_COUNT) == scans * (3 * LOOPS + 2));
+
+    EXPECT(profile->offsets[0] == scans && profile->offsets[4] == scans * LOOPS);
+    EXPECT(profile->offsets[6] == scans * LOOPS && profile->offsets[8] == scans * LOOPS);
+    EXPECT(profile->offsets[11] == scans && offsets(profile) == scans * (3 * LOOPS + 2));
+
+    EXPECT(profile->cycles[INC] > 0 && profile->cycles[JUMP_NZ] > 0);
+}
+
+static void check_loop(void)
+{
+    svm_t *cpu = svm_new(loop, sizeof(loop), NULL);
+
+    EXPECT(cpu->profile == NULL && svm_profile_enable(cpu, 1) == 0);
+    for (int scan = 0; scan < 2; scan++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+    }
+    EXPECT(cpu->iterations == 3 * LOOPS + 2 && cpu->registers[1].content.integer == LOOPS);
+    check_counts(cpu, 2);
+
+    /**
+     * Stepped, a slice at a time.
+     */
+    svm_reset(cpu, SVM_RESET_ALL);
+    while (svm_step(cpu, 7) == SVM_STATUS_BUDGET)
+        ;
+    check_counts(cpu, 3);
+
+    /**
+     * Started again from zero, and gone once off.
+     */
+    EXPECT(svm_profile_enable(cpu, 1) == 0 && sum(cpu->profile->counts, OPCODE_COUNT) == 0);
+    EXPECT(svm_profile_enable(cpu, 0) == 0 && cpu->profile == NULL);
+    svm_reset(cpu, SVM_RESET_ALL);
+    svm_run(cpu);
+    EXPECT(cpu->registers[1].content.integer == LOOPS);
+
+    svm_free(cpu);
+
+    EXPECT(strcmp(svm_opcode_name(MEMFIND), "MEMFIND") == 0 && svm_opcode_name(0xFF) == NULL);
+    EXPECT(strcmp(svm_opcode_group(ADD), "math") == 0 && strcmp(svm_opcode_group(STACK_CALL), "stack") == 0);
+    EXPECT(strcmp(svm_opcode_group(FLOAT_PRINT), "number") == 0 && strcmp(svm_opcode_group(0xFF), "unknown") == 0);
+}
+
+/**
+ * Instructions per second of `run`, profiling or not.
+ */
+static double speed(unsigned char *code, uint32_t size, void (*run)(svm_t *), int profiled)
+{
+    svm_t *cpu = svm_new(code, size, error);
+    double instructions = 0;
+    double elapsed;
+    double start = now();
+
+    svm_profile_enable(cpu, profiled);
+    do
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        run(cpu);
+        instructions += cpu->iterations;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    svm_free(cpu);
+    return instructions / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    static unsigned char code[0xFFFF];
+    svm_t *cpu = NULL;
+
+    jsprintf_handler = sink;
+
+    check_loop();
+    if (failed)
+        return failed;
+
+    printf("%-24s %12s %12s\n", "program", "instructions", "offsets");
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        size_t size = fread(code, 1, sizeof(code), fp);
+        fclose(fp);
+
+        svm_free(cpu);
+        cpu = svm_new(code, size, error);
+        svm_profile_enable(cpu, 1);
+        svm_run(cpu);
+
+        int hot = 0;
+        for (int at = 0; at < 0xFFFF; at++)
+            hot += cpu->profile->offsets[at] != 0;
+
+        EXPECT(sum(cpu->profile->counts, OPCODE_COUNT) == cpu->iterations);
+        EXPECT(offsets(cpu->profile) == cpu->iterations);
+        printf("%-24s %12u %12d\n", argv[i], cpu->iterations, hot);
+    }
+
+    if (cpu)
+    {
+        printf("\n");
+        svm_profile_report(cpu, stdout, 8);
+        svm_free(cpu);
+    }
+
+    printf("\n%-24s %14s %14s %14s\n", "loop", "inline [i/s]", "call [i/s]", "profiled [i/s]");
+    printf("%-24s %14.0f %14.0f %14.0f\n", "inc, dec, jmpnz", speed(loop, sizeof(loop), svm_run_inline, 0),
+           speed(loop, sizeof(loop), svm_run_call, 0), speed(loop, sizeof(loop), svm_run, 1));
+
+    return failed;
+}
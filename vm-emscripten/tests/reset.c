@@ -0,0 +1,114 @@
+/**
+ * Per-scan cost of keeping a virtual machine and resetting it with
+ * svm_reset(), against creating a new one for every scan as RunProgram
+ * does.
+ *
+ * Each program given on the command line is first run for a number of
+ * scans on one machine, reset with SVM_RESET_ALL before each of them, and
+ * every scan must leave the same state as a run on a new machine.  Both
+ * ways are then timed, along with a program which exits straight away,
+ * which is all overhead.
+ *
+ * Built by `npm run htest`, after `npm run ctest` has produced the
+ * examples/*.raw files.
+ */
+#include "snapshot.h"
+
+/**
+ * How many scans to compare on each machine.
+ */
+#define SCANS 5
+
+/**
+ * Microseconds per scan, creating a new machine for each one or resetting
+ * the same one.
+ */
+static double per_scan(unsigned char *code, uint32_t size, int reuse)
+{
+    double scans = 0;
+    double start = now();
+    double elapsed;
+    svm_t *cpu = reuse ? svm_new(code, size, error) : NULL;
+
+    jsprintf_handler = sink;
+
+    do
+    {
+        if (reuse)
+        {
+            svm_reset(cpu, SVM_RESET_ALL);
+            svm_run(cpu);
+        }
+        else
+        {
+            svm_t *scan = svm_new(code, size, error);
+            svm_run(scan);
+            svm_free(scan);
+        }
+        scans++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    svm_free(cpu);
+
+    return elapsed * 1e6 / scans;
+}
+
+static void report(const char *name, unsigned char *code, uint32_t size)
+{
+    double fresh = per_scan(code, size, 0);
+    double reset = per_scan(code, size, 1);
+
+    printf("%-24s %12.2f %12.2f %12.2f\n", name, fresh, reset, fresh - reset);
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char code[0xFFFF];
+    static struct snapshot fresh, reset;
+    unsigned char exit_only[] = {EXIT};
+
+    printf("%-24s %12s %12s %12s\n", "program", "new [us]", "reset [us]", "saved [us]");
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        uint32_t size = fread(code, 1, sizeof(code), fp);
+        fclose(fp);
+
+        svm_t *cpu = svm_new(code, size, error);
+        svm_set_image(cpu, &test_image);
+
+        for (int scan = 0; scan < SCANS; scan++)
+        {
+            run_once(code, size, svm_run, &fresh);
+
+            reset_io();
+            output_len = 0;
+            jsprintf_handler = capture;
+            svm_reset(cpu, SVM_RESET_ALL);
+            svm_seed(cpu, 1);
+            svm_run(cpu);
+            take_snapshot(cpu, &reset);
+
+            if (!compare(argv[i], &fresh, &reset))
+            {
+                fprintf(stderr, "%s: differs after %d resets\n", argv[i], scan + 1);
+                return 1;
+            }
+        }
+
+        svm_free(cpu);
+
+        report(argv[i], code, size);
+    }
+
+    report("exit", exit_only, sizeof(exit_only));
+
+    return 0;
+}
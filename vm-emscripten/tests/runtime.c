@@ -0,0 +1,176 @@
+/**
+ * Scaling of the multi-machine runtime, see src/vm/vm-runtime.h.
+ *
+ * The programs given on the command line are loaded into INSTANCES
+ * machines, in turn, each with its own inputs and random seed.  The same
+ * machines are then scanned for CYCLES cycles by runtimes of one thread up
+ * to one per core - and at least MIN_THREADS, so the stealing is exercised
+ * on small hosts too.  Every machine must end in the same state whatever
+ * the number of threads, and the throughput and scan times of each run are
+ * reported.
+ *
+ * Built by `npm run mtest`, after `npm run ctest` has produced the
+ * examples/*.raw files.
+ */
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "../src/vm/vm-runtime.h"
+
+#define INSTANCES 256
+#define CYCLES 20
+#define MIN_THREADS 4
+#define MAX_PROGRAMS 64
+
+static unsigned char code[MAX_PROGRAMS][0xFFFF];
+static uint32_t size[MAX_PROGRAMS];
+static const char *name[MAX_PROGRAMS];
+static int programs;
+
+/**
+ * A runtime with every machine loaded and given its inputs.
+ */
+static svm_runtime_t *load(int threads)
+{
+    svm_runtime_t *rt = svm_runtime_new(threads);
+    if (!rt)
+    {
+        fprintf(stderr, "Failed to start %d threads\n", threads);
+        exit(1);
+    }
+
+    for (int i = 0; i < INSTANCES; i++)
+    {
+        int p = i % programs;
+        if (svm_runtime_add(rt, code[p], size[p], error) != i)
+        {
+            fprintf(stderr, "Failed to load %s\n", name[p]);
+            exit(1);
+        }
+
+        svm_t *cpu = svm_runtime_instance(rt, i);
+        io_seed = i + 1;
+        reset_io();
+        cpu->own_image.in = test_image.in;
+        memcpy(cpu->own_image.variables, test_image.variables, sizeof(test_image.variables));
+        svm_seed(cpu, io_seed);
+    }
+
+    return rt;
+}
+
+/**
+ * Run the cycles and print a line about them.
+ */
+static double measure(svm_runtime_t *rt, double single)
+{
+    uint64_t wall = 0;
+    double scans = 0, instructions = 0, busy = 0, max = 0;
+
+    for (int cycle = 0; cycle < CYCLES; cycle++)
+        wall += svm_runtime_scan(rt);
+
+    for (uint32_t i = 0; i < svm_runtime_count(rt); i++)
+    {
+        const struct svm_instance_stats *stats = svm_runtime_stats(rt, i);
+        scans += stats->scans;
+        instructions += stats->instructions;
+        busy += stats->total_ns;
+        if (stats->max_ns > max)
+            max = stats->max_ns;
+    }
+
+    double rate = scans * 1e9 / wall;
+    printf("%8d %12.0f %14.0f %12.2f %12.2f %8.2fx\n", svm_runtime_threads(rt), rate,
+           instructions * 1e9 / wall, busy / scans / 1e3, max / 1e3, single ? rate / single : 1.0);
+
+    return rate;
+}
+
+/**
+ * Scan times of each program on one thread.
+ */
+static void per_program(svm_runtime_t *rt)
+{
+    printf("\n%-24s %10s %12s %12s\n", "program", "instances", "mean [us]", "max [us]");
+
+    for (int p = 0; p < programs; p++)
+    {
+        double scans = 0, busy = 0, max = 0;
+        int instances = 0;
+
+        for (uint32_t i = p; i < svm_runtime_count(rt); i += programs)
+        {
+            const struct svm_instance_stats *stats = svm_runtime_stats(rt, i);
+            scans += stats->scans;
+            busy += stats->total_ns;
+            if (stats->max_ns > max)
+                max = stats->max_ns;
+            instances++;
+        }
+
+        printf("%-24s %10d %12.2f %12.2f\n", name[p], instances, busy / scans / 1e3, max / 1e3);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    static struct snapshot expected, actual;
+
+    if (argc < 2 || argc - 1 > MAX_PROGRAMS)
+    {
+        fprintf(stderr, "Usage: %s program.raw... (at most %d)\n", argv[0], MAX_PROGRAMS);
+        return 1;
+    }
+
+    for (programs = 0; programs < argc - 1; programs++)
+    {
+        name[programs] = argv[programs + 1];
+        FILE *fp = fopen(name[programs], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", name[programs]);
+            return 1;
+        }
+        size[programs] = fread(code[programs], 1, sizeof(code[programs]), fp);
+        fclose(fp);
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int most = cores > MIN_THREADS ? (int)cores : MIN_THREADS;
+
+    jsprintf_handler = sink;
+    output_len = 0;
+
+    printf("%d machines, %d cycles, %ld cores\n", INSTANCES, CYCLES, cores);
+    printf("%8s %12s %14s %12s %12s %9s\n", "threads", "scans/s", "insn/s", "mean [us]", "max [us]", "speedup");
+
+    svm_runtime_t *reference = load(1);
+    double single = measure(reference, 0);
+
+    for (int threads = 2; threads <= most; threads = threads * 2 > most && threads < most ? most : threads * 2)
+    {
+        svm_runtime_t *rt = load(threads);
+        measure(rt, single);
+
+        for (int i = 0; i < INSTANCES; i++)
+        {
+            take_snapshot(svm_runtime_instance(reference, i), &expected);
+            take_snapshot(svm_runtime_instance(rt, i), &actual);
+
+            if (!compare(name[i % programs], &expected, &actual))
+            {
+                fprintf(stderr, "machine %d differs on %d threads\n", i, threads);
+                return 1;
+            }
+        }
+
+        svm_runtime_free(rt);
+    }
+
+    per_program(reference);
+    svm_runtime_free(reference);
+
+    return 0;
+}
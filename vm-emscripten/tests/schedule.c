@@ -0,0 +1,155 @@
+/**
+ * The cyclic task scheduler, see src/vm/vm-sched.h.
+ *
+ * Programs of a known number of instructions are scheduled on a clock of
+ * one microsecond per instruction, which makes every release, start and
+ * end predictable:
+ *
+ *  - three tasks of 1ms, 10ms and 100ms, using 20%, 30% and 20% of the
+ *    time, where each preempts the ones below it,
+ *  - one task which needs 1.5ms every 1ms and overruns every other period,
+ *  - the first set again, run in pieces which don't line up with the
+ *    instructions, which must not change anything.
+ *
+ * Built by `npm run stest`.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-sched.h"
+
+#define US 1000ull
+#define MS (1000 * US)
+
+/**
+ * A program which runs `instructions` instructions, the last one EXIT.
+ */
+static unsigned char *program(uint32_t instructions)
+{
+    unsigned char *code = malloc(instructions);
+
+    memset(code, NOP, instructions - 1);
+    code[instructions - 1] = EXIT;
+    return code;
+}
+
+static int failed;
+
+#define EXPECT(s, task, field, value)                                                   \
+    if (svm_scheduler_stats(s, task)->field != (value))                                 \
+    {                                                                                   \
+        fprintf(stderr, "task %d: %s is %llu, expected %llu\n", task, #field,           \
+                (unsigned long long)svm_scheduler_stats(s, task)->field,                \
+                (unsigned long long)(value));                                           \
+        failed = 1;                                                                     \
+    }
+
+static void report(const char *title, svm_scheduler_t *s, uint32_t tasks)
+{
+    printf("%s\n%6s %9s %9s %9s %9s %12s %12s %12s %12s\n", title, "task", "releases", "scans", "overruns",
+           "preempted", "jitter [us]", "max [us]", "resp. [us]", "max [us]");
+
+    for (uint32_t i = 0; i < tasks; i++)
+    {
+        const struct svm_task_stats *st = svm_scheduler_stats(s, i);
+        double scans = st->completions ? st->completions : 1;
+
+        printf("%6u %9llu %9llu %9llu %9llu %12.1f %12.1f %12.1f %12.1f\n", i,
+               (unsigned long long)st->releases, (unsigned long long)st->completions,
+               (unsigned long long)st->overruns, (unsigned long long)st->preemptions,
+               st->jitter_total_ns / scans / US, st->jitter_max_ns / (double)US,
+               st->response_total_ns / scans / US, st->response_max_ns / (double)US);
+    }
+    printf("\n");
+}
+
+static svm_scheduler_t *periods(unsigned char *fast, unsigned char *mid, unsigned char *slow)
+{
+    svm_scheduler_t *s = svm_scheduler_new(1 * US);
+
+    svm_scheduler_add(s, fast, 200, error, 1 * MS, 3);
+    svm_scheduler_add(s, mid, 3000, error, 10 * MS, 2);
+    svm_scheduler_add(s, slow, 20000, error, 100 * MS, 1);
+    return s;
+}
+
+int main(void)
+{
+    unsigned char *fast = program(200);
+    unsigned char *mid = program(3000);
+    unsigned char *slow = program(20000);
+    unsigned char *long_scan = program(1500);
+
+    jsprintf_handler = sink;
+
+    /**
+     * The 1ms task always runs on release.  The 10ms task waits for it and
+     * is preempted by it three times before it's done at 3.8ms.  The 100ms
+     * task starts then and gets 5ms of every 10ms: it is done at 40ms,
+     * preempted at every millisecond from 4 to 39 it isn't waiting.
+     */
+    svm_scheduler_t *s = periods(fast, mid, slow);
+    svm_scheduler_run(s, 1000 * MS);
+    report("1ms, 10ms and 100ms tasks for one second", s, 3);
+
+    EXPECT(s, 0, releases, 1000);
+    EXPECT(s, 0, completions, 1000);
+    EXPECT(s, 0, jitter_max_ns, 0);
+    EXPECT(s, 0, response_max_ns, 200 * US);
+    EXPECT(s, 0, preemptions, 0);
+
+    EXPECT(s, 1, completions, 100);
+    EXPECT(s, 1, jitter_max_ns, 200 * US);
+    EXPECT(s, 1, response_max_ns, 3800 * US);
+    EXPECT(s, 1, preemptions, 300);
+
+    EXPECT(s, 2, completions, 10);
+    EXPECT(s, 2, overruns, 0);
+    EXPECT(s, 2, jitter_max_ns, 3800 * US);
+    EXPECT(s, 2, response_max_ns, 40 * MS);
+    EXPECT(s, 2, preemptions, 270);
+    EXPECT(s, 2, instructions, 200000);
+
+    /**
+     * Running 1.5ms every 1ms, every other release is dropped.
+     */
+    svm_scheduler_t *over = svm_scheduler_new(1 * US);
+    svm_scheduler_add(over, long_scan, 1500, error, 1 * MS, 0);
+    svm_scheduler_run(over, 10 * MS);
+    report("1.5ms scans every 1ms for 10ms", over, 1);
+
+    EXPECT(over, 0, releases, 10);
+    EXPECT(over, 0, completions, 5);
+    EXPECT(over, 0, overruns, 5);
+    EXPECT(over, 0, jitter_max_ns, 0);
+    EXPECT(over, 0, response_max_ns, 1500 * US);
+
+    /**
+     * The same schedule, whichever way the run is cut up.
+     */
+    svm_scheduler_t *pieces = periods(fast, mid, slow);
+    for (uint64_t until = 333333; until < 1000 * MS; until += 333333)
+        svm_scheduler_run(pieces, until);
+    svm_scheduler_run(pieces, 1000 * MS);
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        if (memcmp(svm_scheduler_stats(s, i), svm_scheduler_stats(pieces, i), sizeof(struct svm_task_stats)) != 0)
+        {
+            fprintf(stderr, "task %u: differs when run in pieces\n", i);
+            failed = 1;
+        }
+    }
+
+    svm_scheduler_free(pieces);
+    svm_scheduler_free(over);
+    svm_scheduler_free(s);
+    free(long_scan);
+    free(slow);
+    free(mid);
+    free(fast);
+
+    if (failed)
+        return 1;
+
+    printf("schedules as expected\n");
+    return 0;
+}
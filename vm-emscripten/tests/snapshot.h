@@ -0,0 +1,274 @@
+#ifndef D3TK8WQ1MZ6RBX4NJ9HV2CLFE
+#define D3TK8WQ1MZ6RBX4NJ9HV2CLFE
+
+/**
+ * Shared by the native tests: runs a program on a fresh virtual machine,
+ * captures everything it can observe or leave behind, and compares two of
+ * those snapshots.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/vm/vm-engine.h"
+
+/**
+ * Minimal time to spend benchmarking each engine on each program.
+ */
+#define BENCH_SECONDS 0.25
+
+static char output[1 << 16];
+static size_t output_len;
+
+static void capture(char *msg)
+{
+    size_t len = strlen(msg);
+    if (output_len + len < sizeof(output))
+    {
+        memcpy(output + output_len, msg, len);
+        output_len += len;
+    }
+}
+
+static void sink(char *msg)
+{
+    (void)msg;
+}
+
+static void error(char *msg)
+{
+    fprintf(stderr, "ERROR running script - %s\n", msg);
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Everything a program can observe or leave behind.
+ */
+struct snapshot
+{
+    char output[sizeof(output)];
+    size_t output_len;
+    svm_t cpu;
+    struct reg_t variables[VARIABLE_COUNT];
+    float analog[ANALOG_OUT_COUNT];
+    uint8_t binary[BINARY_OUT_COUNT];
+    char strings[1 << 16];
+    size_t strings_len;
+};
+
+/**
+ * The process image of the machines run by the tests.
+ */
+static struct svm_process_image test_image = {SVM_PROCESS_IMAGE_VERSION};
+
+/**
+ * Inputs of the next run_once(), fixed when zero and otherwise random from
+ * this seed - which also seeds the `random` instruction, see svm_seed().
+ */
+static unsigned int io_seed;
+
+static void reset_io(void)
+{
+    memset(&test_image.out, 0, sizeof(test_image.out));
+    memset(test_image.variables, 0, sizeof(test_image.variables));
+
+    for (int i = 0; i < ANALOG_IN_COUNT; i++)
+        test_image.in.analog[i] = i * 1.5f;
+    for (int i = 0; i < BINARY_IN_COUNT; i++)
+        test_image.in.binary[i] = i & 1;
+
+    if (!io_seed)
+        return;
+
+    srand(io_seed);
+    for (int i = 0; i < ANALOG_IN_COUNT; i++)
+        test_image.in.analog[i] = (rand() % 20001 - 10000) / 100.0f;
+    for (int i = 0; i < BINARY_IN_COUNT; i++)
+        test_image.in.binary[i] = rand() & 1;
+    for (int i = 0; i < VARIABLE_COUNT; i++)
+    {
+        if (rand() & 1)
+        {
+            test_image.variables[i].tag = INTEGER;
+            test_image.variables[i].content.integer = rand() % 2001 - 1000;
+        }
+        else
+        {
+            test_image.variables[i].tag = FLOAT;
+            test_image.variables[i].content.number = (rand() % 20001 - 10000) / 100.0f;
+        }
+    }
+}
+
+/**
+ * Copy a string out of the machine's arena, which goes with the machine.
+ */
+static void keep_string(struct snapshot *s, struct reg_t *r)
+{
+    if (!SVM_IS_STRING(*r))
+        return;
+
+    size_t len = strlen(SVM_STRING(*r)) + 1;
+    if (s->strings_len + len > sizeof(s->strings))
+    {
+        fprintf(stderr, "snapshot: out of room for strings\n");
+        exit(1);
+    }
+
+    memcpy(s->strings + s->strings_len, SVM_STRING(*r), len);
+    svm_set_string(r, s->strings + s->strings_len);
+    s->strings_len += len;
+}
+
+/**
+ * Capture the state left by a run.
+ */
+static void take_snapshot(svm_t *cpu, struct snapshot *s)
+{
+    memcpy(s->output, output, output_len);
+    s->output_len = output_len;
+    s->cpu = *cpu;
+    memcpy(s->variables, cpu->image->variables, sizeof(s->variables));
+    memcpy(s->analog, cpu->image->out.analog, sizeof(s->analog));
+    memcpy(s->binary, cpu->image->out.binary, sizeof(s->binary));
+
+    s->strings_len = 0;
+    for (int i = 0; i < REGISTER_COUNT; i++)
+        keep_string(s, &s->cpu.registers[i]);
+    for (int i = 1; i <= s->cpu.SP && i < STACK_COUNT; i++)
+        keep_string(s, &s->cpu.stack[i]);
+    for (int i = 0; i < VARIABLE_COUNT; i++)
+        keep_string(s, &s->variables[i]);
+}
+
+static void run_once(unsigned char *code, uint32_t size, void (*run)(svm_t *), struct snapshot *s)
+{
+    reset_io();
+    output_len = 0;
+    jsprintf_handler = capture;
+
+    svm_t *cpu = svm_new(code, size, error);
+    svm_set_image(cpu, &test_image);
+    svm_seed(cpu, io_seed ? io_seed : 1);
+
+    // The engines run on the working copy, the way svm_run() drives them
+    svm_latch_inputs(cpu);
+    run(cpu);
+    svm_publish_outputs(cpu);
+
+    take_snapshot(cpu, s);
+    svm_free(cpu);
+}
+
+static int same_reg(struct reg_t *a, struct reg_t *b)
+{
+    if (SVM_TYPE(*a) != SVM_TYPE(*b))
+        return 0;
+    if (SVM_IS_STRING(*a))
+        return strcmp(SVM_STRING(*a), SVM_STRING(*b)) == 0;
+    return a->content.integer == b->content.integer;
+}
+
+static int compare(const char *file, struct snapshot *a, struct snapshot *b)
+{
+    int ok = 1;
+
+#define CHECK(cond, what)                                  \
+    if (!(cond))                                           \
+    {                                                      \
+        fprintf(stderr, "%s: %s differs\n", file, what);   \
+        ok = 0;                                            \
+    }
+
+    CHECK(a->output_len == b->output_len &&
+              memcmp(a->output, b->output, a->output_len) == 0,
+          "output");
+    CHECK(a->cpu.iterations == b->cpu.iterations, "instruction count");
+    CHECK(a->cpu.jmp == b->cpu.jmp, "Z-flag");
+    CHECK(a->cpu.SP == b->cpu.SP, "stack pointer");
+    CHECK(a->cpu.CSP == b->cpu.CSP, "call stack pointer");
+
+    for (int i = 0; i < REGISTER_COUNT; i++)
+        CHECK(same_reg(&a->cpu.registers[i], &b->cpu.registers[i]), "register");
+    for (int i = 1; i <= a->cpu.SP && i < STACK_COUNT; i++)
+        CHECK(same_reg(&a->cpu.stack[i], &b->cpu.stack[i]), "stack");
+    for (int i = 0; i < VARIABLE_COUNT; i++)
+        CHECK(same_reg(&a->variables[i], &b->variables[i]), "variable");
+
+    CHECK(memcmp(a->analog, b->analog, sizeof(a->analog)) == 0, "analog output");
+    CHECK(memcmp(a->binary, b->binary, sizeof(a->binary)) == 0, "binary output");
+
+#undef CHECK
+
+    return ok;
+}
+
+/**
+ * Instructions per second of one engine on one program, scanning one
+ * machine which is reset between scans as the host does.  The first scan -
+ * which compiles the program for the engines that do - runs before the
+ * clock starts; setup() times it.
+ */
+static double bench(unsigned char *code, uint32_t size, void (*run)(svm_t *))
+{
+    double instructions = 0;
+    double start;
+    double elapsed;
+
+    jsprintf_handler = sink;
+
+    svm_t *cpu = svm_new(code, size, error);
+    svm_latch_inputs(cpu);
+    run(cpu);
+    svm_publish_outputs(cpu);
+
+    start = now();
+    do
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_latch_inputs(cpu);
+        run(cpu);
+        svm_publish_outputs(cpu);
+        instructions += cpu->iterations;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    svm_free(cpu);
+    return instructions / elapsed;
+}
+
+/**
+ * Seconds to create a machine and run its first scan with one engine,
+ * including compiling the program where the engine does.
+ */
+static double setup(unsigned char *code, uint32_t size, void (*run)(svm_t *))
+{
+    int machines = 0;
+    double start = now();
+    double elapsed;
+
+    jsprintf_handler = sink;
+
+    do
+    {
+        svm_t *cpu = svm_new(code, size, error);
+        svm_latch_inputs(cpu);
+        run(cpu);
+        svm_publish_outputs(cpu);
+        svm_free(cpu);
+        machines++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    return elapsed / machines;
+}
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * Stepping with svm_step(), and the watchdog built on it.
+ *
+ * Each program given on the command line is run to the end in steps of a
+ * few different budgets, and must leave the same state as the reference
+ * loop run in one go.  Small programs then check `yield`, the watchdog's
+ * instruction and time limits, and a failing instruction.
+ *
+ * Built by `npm run btest`, after `npm run ctest` has produced the
+ * examples/*.raw files.
+ */
+#include "snapshot.h"
+
+/**
+ * How many sets of random inputs to compare on.
+ */
+#define TRIALS 20
+
+static uint32_t budget;
+
+/**
+ * svm_run_call() a few instructions at a time.
+ */
+static void run_stepped(svm_t *cpu)
+{
+    cpu->ip = 0;
+    cpu->iterations = 0;
+
+    while (svm_step(cpu, budget) != SVM_STATUS_EXITED)
+        ;
+}
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+static void returning(char *msg)
+{
+    (void)msg;
+}
+
+static void check_yield(void)
+{
+    unsigned char code[] = {YIELD, NOP, YIELD, EXIT};
+    svm_t *cpu = svm_new(code, sizeof(code), error);
+
+    EXPECT(svm_step(cpu, 100) == SVM_STATUS_WAITING);
+    EXPECT(cpu->ip == 1 && cpu->iterations == 1);
+    EXPECT(svm_step(cpu, 100) == SVM_STATUS_WAITING);
+    EXPECT(cpu->ip == 3 && cpu->iterations == 3);
+    EXPECT(svm_step(cpu, 100) == SVM_STATUS_EXITED);
+    EXPECT(cpu->iterations == 4);
+    EXPECT(svm_step(cpu, 100) == SVM_STATUS_EXITED);
+    EXPECT(cpu->iterations == 4);
+
+    svm_free(cpu);
+}
+
+static void check_watchdog(void)
+{
+    /**
+     * Save 1 to @A0, then loop forever.
+     */
+    unsigned char code[] = {INT_STORE, 0, 1, 0, ANALOG_SAVE, 0, 0, JUMP_TO, 7, 0};
+    svm_t *cpu = svm_new(code, sizeof(code), error);
+
+    struct svm_watchdog instructions = {1000, 0};
+    EXPECT(svm_run_watched(cpu, &instructions) == SVM_STATUS_ABORTED);
+    EXPECT(cpu->iterations == 1000);
+    EXPECT(cpu->image->out.analog[0] == 0);
+
+    struct svm_watchdog time = {0, 2000000};
+    double start = now();
+    svm_reset(cpu, SVM_RESET_ALL);
+    EXPECT(svm_run_watched(cpu, &time) == SVM_STATUS_ABORTED);
+    double elapsed = now() - start;
+    EXPECT(elapsed >= 0.002 && elapsed < 0.5);
+    EXPECT(cpu->image->out.analog[0] == 0);
+
+    /**
+     * Within its limits, the scan publishes its outputs.
+     */
+    code[7] = EXIT;
+    svm_t *ok = svm_new(code, sizeof(code), error);
+    struct svm_watchdog both = {3, 2000000};
+    EXPECT(svm_run_watched(ok, &both) == SVM_STATUS_EXITED);
+    EXPECT(ok->image->out.analog[0] == 1);
+
+    svm_free(ok);
+    svm_free(cpu);
+}
+
+static void check_error(void)
+{
+    /**
+     * #0 = 1 / #1, with #1 zero.
+     */
+    unsigned char code[] = {INT_STORE, 0, 1, 0, DIV, 0, 0, 1, EXIT};
+    svm_t *cpu = svm_new(code, sizeof(code), returning);
+
+    EXPECT(svm_step(cpu, 100) == SVM_STATUS_ERROR);
+    EXPECT(cpu->iterations == 1);
+    EXPECT(svm_step(cpu, 100) == SVM_STATUS_ERROR);
+    EXPECT(cpu->iterations == 1);
+
+    struct svm_watchdog none = {0, 0};
+    svm_reset(cpu, SVM_RESET_ALL);
+    EXPECT(svm_run_watched(cpu, &none) == SVM_STATUS_ERROR);
+
+    svm_free(cpu);
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char code[0xFFFF];
+    static struct snapshot reference, stepped;
+    static const uint32_t budgets[] = {1, 7, 4096};
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        uint32_t size = fread(code, 1, sizeof(code), fp);
+        fclose(fp);
+
+        for (io_seed = 1; io_seed <= TRIALS; io_seed++)
+        {
+            run_once(code, size, svm_run_call, &reference);
+
+            for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+            {
+                budget = budgets[b];
+                run_once(code, size, run_stepped, &stepped);
+
+                if (!compare(argv[i], &reference, &stepped))
+                {
+                    fprintf(stderr, "%s: differs in steps of %u, inputs from seed %u\n", argv[i], budget, io_seed);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    jsprintf_handler = sink;
+
+    check_yield();
+    check_watchdog();
+    check_error();
+
+    if (failed)
+        return 1;
+
+    printf("%d programs stepped, yield, watchdog and errors as expected\n", argc - 1);
+    return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * Benchmark of string-heavy programs, see `struct svm_string` in
+ * src/vm/vm.h.
+ *
+ * Each program given on the command line is run scan after scan on one
+ * machine, reporting the time per scan and the bytes of strings made per
+ * scan - literals come from the program's pool, and results equal to a
+ * string made before are interned rather than copied.  Loops which store,
+ * copy and compare strings are then timed on each engine, after checking
+ * that literals the program writes over are read again.
+ *
+ * Built by `npm run itest`, after `npm run ctest` has produced the
+ * examples/*.raw files.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-jit.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+/**
+ * Scans to warm up with before measuring.
+ */
+#define WARM_UP 4
+
+static void report(const char *name, unsigned char *code, uint32_t size)
+{
+    svm_t *cpu = svm_new(code, size, error);
+    double scans = 0;
+    double elapsed;
+
+    jsprintf_handler = sink;
+
+    for (int i = 0; i < WARM_UP; i++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+    }
+
+    uint64_t bytes = cpu->string_bytes;
+    double start = now();
+    do
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_run(cpu);
+        scans++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    printf("%-24s %12.2f %14.0f\n", name, elapsed * 1e6 / scans, (cpu->string_bytes - bytes) / scans);
+
+    svm_free(cpu);
+}
+
+/**
+ * Times round each loop, at most 0xFFFF for INT_STORE.
+ */
+#define LOOPS_LO 0x60
+#define LOOPS_HI 0xEA
+
+#define LONG_STRING 'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ', \
+                    'f', 'o', 'x', ' ', 'j', 'u', 'm', 'p', 's', ' ', 'o', 'v', 'e', 'r', ' ', 't',  \
+                    'h', 'e', ' ', 'l', 'a', 'z', 'y', ' ', 'd', 'o', 'g'
+
+/**
+ * Literals stored again and again.
+ */
+static unsigned char stores[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    /* 4 */ STRING_STORE, 1, 43, 0, LONG_STRING,
+    STRING_STORE, 2, 1, 0, '!',
+    DEC, 0,
+    JUMP_NZ, 4, 0,
+    EXIT,
+};
+
+/**
+ * Copies of a string between registers and the stack.
+ */
+static unsigned char copies[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    STRING_STORE, 1, 43, 0, LONG_STRING,
+    /* 51 */ STORE_REG, 2, 1,
+    STACK_PUSH, 2,
+    STACK_POP, 3,
+    STORE_REG, 4, 3,
+    DEC, 0,
+    JUMP_NZ, 51, 0,
+    EXIT,
+};
+
+/**
+ * Equal strings made apart, compared with each other and with a literal.
+ */
+static unsigned char compares[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    STRING_STORE, 1, 43, 0, LONG_STRING,
+    STRING_STORE, 2, 43, 0, LONG_STRING,
+    /* 98 */ CMP_REG, 1, 2,
+    CMP_STRING, 2, 43, 0, LONG_STRING,
+    CMP_REG, 1, 0,
+    DEC, 0,
+    JUMP_NZ, 98, 0,
+    EXIT,
+};
+
+/**
+ * Concatenations giving the same string every time round.
+ */
+static unsigned char concats[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    STRING_STORE, 1, 43, 0, LONG_STRING,
+    STRING_STORE, 2, 1, 0, '!',
+    /* 56 */ STRING_CONCAT, 3, 1, 2,
+    STRING_STORE, 4, 1, 0, '\n',
+    DEC, 0,
+    JUMP_NZ, 56, 0,
+    EXIT,
+};
+
+struct loop
+{
+    const char *name;
+    unsigned char *code;
+    uint32_t size;
+};
+
+static const struct loop loops[] = {
+    {"stores", stores, sizeof(stores)},
+    {"copies", copies, sizeof(copies)},
+    {"compares", compares, sizeof(compares)},
+    {"concats", concats, sizeof(concats)},
+};
+
+/**
+ * Twice round a STRING_STORE and a CMP_STRING, writing 'X' over the middle
+ * of both literals in between: "abc" becomes "aXc", and "aYc" too, so only
+ * the second comparison is equal - unequal ones are counted in register 5.
+ */
+static unsigned char pokes[] = {
+    INT_STORE, 0, 'X', 0,
+    INT_STORE, 1, 21, 0,
+    INT_STORE, 6, 30, 0,
+    INT_STORE, 4, 2, 0,
+    /* 16 */ STRING_STORE, 2, 3, 0, 'a', 'b', 'c',
+    STACK_PUSH, 2,
+    /* 25 */ CMP_STRING, 2, 3, 0, 'a', 'Y', 'c',
+    JUMP_Z, 37, 0,
+    INC, 5,
+    /* 37 */ POKE, 0, 1,
+    POKE, 0, 6,
+    DEC, 4,
+    JUMP_NZ, 16, 0,
+    EXIT,
+};
+
+static int is_string(struct reg_t *r, const char *expected)
+{
+    return SVM_IS_STRING(*r) && strcmp(SVM_STRING(*r), expected) == 0;
+}
+
+/**
+ * Literals written over must be read again, on every engine, and be back
+ * once svm_reset() has restored the program.
+ */
+static void check_pokes(const char *name, void (*run)(svm_t *))
+{
+    svm_t *cpu = svm_new(pokes, sizeof(pokes), error);
+
+    for (int scan = 0; scan < 2; scan++)
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        run(cpu);
+
+        if (scan == 0)
+            printf("%-10s pokes '%s', '%s'\n", name, SVM_STRING(cpu->stack[1]), SVM_STRING(cpu->stack[2]));
+
+        EXPECT(cpu->SP == 2 && is_string(&cpu->stack[1], "abc") && is_string(&cpu->stack[2], "aXc"));
+        EXPECT(cpu->registers[5].tag == INTEGER && cpu->registers[5].content.integer == 1);
+    }
+
+    svm_free(cpu);
+}
+
+int main(int argc, char *argv[])
+{
+    static struct snapshot reference, other;
+    static unsigned char code[0xFFFF];
+
+    jsprintf_handler = sink;
+
+    check_pokes("call", svm_run_call);
+    check_pokes("inline", svm_run_inline);
+    check_pokes("jit", svm_run_jit);
+    if (failed)
+        return failed;
+
+    printf("\n%-24s %12s %14s\n", "program", "[us/scan]", "[bytes/scan]");
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        size_t size = fread(code, 1, sizeof(code), fp);
+        fclose(fp);
+
+        report(argv[i], code, size);
+    }
+
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++)
+        report(loops[i].name, loops[i].code, loops[i].size);
+
+    printf("\n%-24s %14s %14s %14s\n", "loop", "call [i/s]", "inline [i/s]", "jit [i/s]");
+
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++)
+    {
+        const struct loop *l = &loops[i];
+
+        run_once(l->code, l->size, svm_run_call, &reference);
+        run_once(l->code, l->size, svm_run_inline, &other);
+        if (!compare(l->name, &reference, &other))
+            return 1;
+        run_once(l->code, l->size, svm_run_jit, &other);
+        if (!compare(l->name, &reference, &other))
+            return 1;
+
+        printf("%-24s %14.0f %14.0f %14.0f\n", l->name, bench(l->code, l->size, svm_run_call),
+               bench(l->code, l->size, svm_run_inline), bench(l->code, l->size, svm_run_jit));
+    }
+
+    return 0;
+}
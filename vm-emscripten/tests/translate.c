@@ -0,0 +1,63 @@
+/**
+ * Differential test of a program translated to C by svm2c.
+ *
+ * The program given on the command line is run with the reference loop
+ * and with its translation, `svm_run_translated`, on the same random
+ * inputs for a number of trials, and the observable state (output,
+ * registers, flags, stacks and I/O) must match every time.  Both are then
+ * run repeatedly to report instructions per second.
+ *
+ * Built for every example by `npm run ttest`, after `npm run ctest` has
+ * produced the examples/*.raw files.
+ */
+#include "snapshot.h"
+
+/**
+ * How many sets of random inputs to compare on.
+ */
+#define TRIALS 100
+
+/**
+ * The translation, see scripts/testTranslate.sh.
+ */
+void svm_run_translated(svm_t *cpup);
+
+int main(int argc, char **argv)
+{
+    static unsigned char code[0xFFFF];
+    static struct snapshot reference, translated;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s program.raw\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+    uint32_t size = fread(code, 1, sizeof(code), fp);
+    fclose(fp);
+
+    for (io_seed = 1; io_seed <= TRIALS; io_seed++)
+    {
+        run_once(code, size, svm_run_call, &reference);
+        run_once(code, size, svm_run_translated, &translated);
+
+        if (!compare(argv[1], &reference, &translated))
+        {
+            fprintf(stderr, "%s: differs with inputs from seed %u\n", argv[1], io_seed);
+            return 1;
+        }
+    }
+
+    double call = bench(code, size, svm_run_call);
+    double fast = bench(code, size, svm_run_translated);
+
+    printf("%-24s %8d %14.0f %14.0f %7.2fx\n", argv[1], TRIALS, call, fast, fast / call);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Microbenchmark of the register representation, see struct reg_t in
+ * src/vm/mem.h.
+ *
+ * Loops which do little but copy values around - pushing and popping,
+ * integer arithmetic, saving and loading variables - are run with each
+ * engine, which must agree on the state they leave, and timed.  The sizes
+ * of a value and of a machine are printed along with them.
+ *
+ * Built by `npm run vtest`.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-jit.h"
+
+/**
+ * Times round each loop, at most 0xFFFF for INT_STORE.
+ */
+#define LOOPS_LO 0x60
+#define LOOPS_HI 0xEA
+
+static unsigned char stack[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    INT_STORE, 1, 7, 0,
+    /* 8 */ STACK_PUSH, 1,
+    STACK_PUSH, 1,
+    STACK_POP, 2,
+    STACK_POP, 3,
+    DEC, 0,
+    JUMP_NZ, 8, 0,
+    EXIT,
+};
+
+static unsigned char arithmetic[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    INT_STORE, 1, 3, 0,
+    INT_STORE, 2, 0, 0,
+    /* 12 */ ADD, 2, 2, 1,
+    MUL, 3, 2, 1,
+    XOR, 4, 3, 2,
+    SUB, 2, 4, 1,
+    DEC, 0,
+    JUMP_NZ, 12, 0,
+    EXIT,
+};
+
+static unsigned char variables[] = {
+    INT_STORE, 0, LOOPS_LO, LOOPS_HI,
+    INT_STORE, 1, 5, 0,
+    /* 8 */ VARIABLE_SAVE, 1, 0,
+    VARIABLE_LOAD, 2, 0,
+    STORE_REG, 3, 2,
+    VARIABLE_SAVE, 3, 1,
+    DEC, 0,
+    JUMP_NZ, 8, 0,
+    EXIT,
+};
+
+struct loop
+{
+    const char *name;
+    unsigned char *code;
+    uint32_t size;
+};
+
+static const struct loop loops[] = {
+    {"push/pop", stack, sizeof(stack)},
+    {"arithmetic", arithmetic, sizeof(arithmetic)},
+    {"variables", variables, sizeof(variables)},
+};
+
+int main(void)
+{
+    static struct snapshot reference, other;
+
+    printf("sizeof(struct reg_t) = %zu, sizeof(svm_t) = %zu, sizeof(struct svm_process_image) = %zu\n\n",
+           sizeof(struct reg_t), sizeof(svm_t), sizeof(struct svm_process_image));
+    printf("%-12s %14s %14s %14s\n", "loop", "call [i/s]", "inline [i/s]", "jit [i/s]");
+
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++)
+    {
+        const struct loop *l = &loops[i];
+
+        run_once(l->code, l->size, svm_run_call, &reference);
+        run_once(l->code, l->size, svm_run_inline, &other);
+        if (!compare(l->name, &reference, &other))
+            return 1;
+        run_once(l->code, l->size, svm_run_jit, &other);
+        if (!compare(l->name, &reference, &other))
+            return 1;
+
+        printf("%-12s %14.0f %14.0f %14.0f\n", l->name, bench(l->code, l->size, svm_run_call),
+               bench(l->code, l->size, svm_run_inline), bench(l->code, l->size, svm_run_jit));
+    }
+
+    return 0;
+}
@@ -0,0 +1,357 @@
+/**
+ * The verifier, see src/vm/vm-verify.h, and the handlers it lets verified
+ * programs run on.
+ *
+ * Each kind of program it turns down must be found at the offset of the
+ * instruction at fault, and the stack and call depths of the programs it
+ * accepts must be exact.  A machine must leave the verified handlers when
+ * its program writes to its code or a scan starts with something on the
+ * stack, and come back to them after svm_reset().  Each program given on
+ * the command line must then end the same on the verified and the checked
+ * handlers, and both are timed on a loop of handled instructions, with
+ * the call loop and with the inlined engine.
+ *
+ * Built by `npm run ktest`, after `npm run ctest` has produced the
+ * examples/*.raw files.
+ */
+#include "snapshot.h"
+#include "../src/vm/vm-decode.h"
+#include "../src/vm/vm-trace.h"
+#include "../src/vm/vm-verify.h"
+
+static int failed;
+
+#define EXPECT(cond)                                                 \
+    if (!(cond))                                                     \
+    {                                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+        failed = 1;                                                  \
+    }
+
+/**
+ * A program and the verdict on it.
+ */
+struct verdict
+{
+    const char *name;
+    unsigned char code[64];
+    uint32_t size;
+    int expected;
+    uint32_t ip;
+};
+
+#define PROGRAM(...) {__VA_ARGS__}, sizeof((unsigned char[]){__VA_ARGS__})
+
+static const struct verdict verdicts[] = {
+    {"unknown", PROGRAM(INT_STORE, 1, 2, 0, 0xFE, EXIT), SVM_VERIFY_OPCODE, 4},
+    {"register", PROGRAM(INC, 1, ADD, 3, 1, REGISTER_COUNT, EXIT), SVM_VERIFY_REGISTER, 2},
+    {"port", PROGRAM(BINARY_LOAD, 1, 0, ANALOG_SAVE, 1, ANALOG_OUT_COUNT, EXIT), SVM_VERIFY_PORT, 3},
+    {"truncated", PROGRAM(INC, 1, STRING_STORE, 1, 9, 0, 'a', 'b'), SVM_VERIFY_TRUNCATED, 2},
+    {"outside", PROGRAM(JUMP_TO, 0x00, 0x50), SVM_VERIFY_TARGET, 0},
+    {"overlap", PROGRAM(INT_STORE, 1, 2, 0, JUMP_TO, 2, 0), SVM_VERIFY_TARGET, 2},
+    {"underflow", PROGRAM(INC, 1, STACK_POP, 1, EXIT), SVM_VERIFY_STACK, 2},
+    {"loop", PROGRAM(/* 0 */ STACK_PUSH, 1, DEC, 1, JUMP_NZ, 0, 0, EXIT), SVM_VERIFY_STACK, 0},
+    {"returns", PROGRAM(STACK_CALL, 4, 0, EXIT,
+                        /* 4 */ JUMP_Z, 9, 0, STACK_PUSH, 1,
+                        /* 9 */ STACK_RET),
+     SVM_VERIFY_STACK, 9},
+    {"shared", PROGRAM(STACK_CALL, 7, 0, JUMP_TO, 8, 0, EXIT,
+                       /* 7 */ NOP,
+                       /* 8 */ STACK_RET),
+     SVM_VERIFY_STACK, 8},
+    {"ret", PROGRAM(INC, 1, STACK_RET), SVM_VERIFY_CALLS, 2},
+    {"recursion", PROGRAM(STACK_CALL, 4, 0, EXIT,
+                          /* 4 */ DEC, 1,
+                          JUMP_Z, 12, 0,
+                          STACK_CALL, 4, 0,
+                          /* 12 */ STACK_RET),
+     SVM_VERIFY_CALLS, 9},
+};
+
+#define VERDICTS (sizeof(verdicts) / sizeof(verdicts[0]))
+
+/**
+ * Pushes two arguments for a routine which pops them and pushes its
+ * result, the way the block compiler calls blocks, then a routine two
+ * calls deep.
+ */
+static unsigned char blocks[] = {
+    INT_STORE, 1, 2, 0,
+    INT_STORE, 2, 3, 0,
+    STACK_PUSH, 1,
+    STACK_PUSH, 2,
+    STACK_CALL, 23, 0,
+    STACK_POP, 3,
+    STACK_CALL, 34, 0,
+    IS_INTEGER, 3,
+    EXIT,
+    /* 23 */ STACK_POP, 4,
+    STACK_POP, 5,
+    ADD, 4, 4, 5,
+    STACK_PUSH, 4,
+    STACK_RET,
+    /* 34 */ STACK_PUSH, 3,
+    STACK_CALL, 42, 0,
+    STACK_POP, 3,
+    STACK_RET,
+    /* 42 */ STACK_PUSH, 3,
+    STACK_PUSH, 3,
+    STACK_POP, 6,
+    STACK_POP, 6,
+    STACK_RET,
+};
+
+static void check_verdicts(void)
+{
+    for (size_t i = 0; i < VERDICTS; i++)
+    {
+        const struct verdict *v = &verdicts[i];
+        svm_t *cpu = svm_new((unsigned char *)v->code, v->size, NULL);
+
+        EXPECT(cpu->verification.code == v->expected && cpu->verification.ip == v->ip);
+        EXPECT(!cpu->verified);
+        if (cpu->verification.code != v->expected || cpu->verification.ip != v->ip)
+            fprintf(stderr, "%s: code %d at 0x%04X\n", v->name, cpu->verification.code, cpu->verification.ip);
+        svm_free(cpu);
+    }
+    printf("%-10s %zu programs turned down\n", "verdicts", VERDICTS);
+
+    svm_t *cpu = svm_new(blocks, sizeof(blocks), NULL);
+    EXPECT(cpu->verification.code == SVM_VERIFY_OK && cpu->verified);
+    EXPECT(cpu->verification.max_stack == 3 && cpu->verification.max_calls == 2);
+    EXPECT(cpu->verification.instructions == 23);
+    svm_run(cpu);
+    EXPECT(!cpu->faulted && cpu->registers[3].content.integer == 5 && cpu->SP == 0);
+    printf("%-10s stack %u, calls %u\n", "blocks", cpu->verification.max_stack, cpu->verification.max_calls);
+    svm_free(cpu);
+
+    /**
+     * The deepest the stacks can go, and one more.
+     */
+    static unsigned char pushes[2 * STACK_COUNT + 1];
+    for (int n = STACK_COUNT - 1; n <= STACK_COUNT; n++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            pushes[2 * i] = STACK_PUSH;
+            pushes[2 * i + 1] = 1;
+        }
+        pushes[2 * n] = EXIT;
+
+        cpu = svm_new(pushes, 2 * n + 1, NULL);
+        EXPECT(n < STACK_COUNT ? cpu->verified && cpu->verification.max_stack == (uint32_t)n
+                               : cpu->verification.code == SVM_VERIFY_STACK && cpu->verification.ip == 2 * n - 2);
+        svm_free(cpu);
+    }
+
+    static unsigned char calls[4 * CALL_STACK_COUNT + 1];
+    for (int n = CALL_STACK_COUNT - 1; n <= CALL_STACK_COUNT; n++)
+    {
+        /**
+         * Each routine calls the next, after the exit.
+         */
+        calls[0] = STACK_CALL;
+        calls[1] = 4;
+        calls[2] = 0;
+        calls[3] = EXIT;
+        for (int i = 1; i < n; i++)
+        {
+            calls[4 * i] = STACK_CALL;
+            calls[4 * i + 1] = (4 * (i + 1)) & 0xFF;
+            calls[4 * i + 2] = (4 * (i + 1)) >> 8;
+            calls[4 * i + 3] = STACK_RET;
+        }
+        calls[4 * n] = STACK_RET;
+
+        cpu = svm_new(calls, 4 * n + 1, NULL);
+        EXPECT(n < CALL_STACK_COUNT ? cpu->verified && cpu->verification.max_calls == (uint32_t)n
+                                    : cpu->verification.code == SVM_VERIFY_CALLS);
+        svm_free(cpu);
+    }
+}
+
+/**
+ * Pokes a NOP over its EXIT on its second scan, when the variable it
+ * counts its scans in says so.
+ */
+static unsigned char poking[] = {
+    VARIABLE_LOAD, 1, 0,
+    INC, 1,
+    VARIABLE_SAVE, 1, 0,
+    CMP_IMMEDIATE, 1, 2, 0,
+    JUMP_NZ, 26, 0,
+    INT_STORE, 2, NOP, 0,
+    INT_STORE, 3, 26, 0,
+    POKE, 2, 3,
+    /* 26 */ EXIT,
+};
+
+static unsigned char pushing[] = {
+    STACK_PUSH, 1,
+    EXIT,
+};
+
+static void check_switching(void)
+{
+    svm_t *checked = svm_new((unsigned char[]){STACK_POP, 1}, 2, NULL);
+    svm_t *cpu = svm_new(poking, sizeof(poking), NULL);
+
+    /**
+     * Different handlers for what has checks to leave out.
+     */
+    EXPECT(!checked->verified && cpu->verified);
+    EXPECT(cpu->opcodes[STACK_PUSH] != checked->opcodes[STACK_PUSH]);
+    EXPECT(cpu->opcodes[BINARY_LOAD] != checked->opcodes[BINARY_LOAD]);
+
+    /**
+     * The first scan doesn't poke, the second does.  Jumping over the poke
+     * rather than to it keeps the program verified.
+     */
+    svm_run(cpu);
+    EXPECT(cpu->verified && cpu->image->variables[0].content.integer == 1);
+    svm_reset(cpu, SVM_RESET_ALL);
+    svm_run(cpu);
+    EXPECT(!cpu->verified && !cpu->code_verified && cpu->opcodes[STACK_PUSH] == checked->opcodes[STACK_PUSH]);
+
+    /**
+     * Kept by a reset which keeps the RAM, the program is back with the
+     * next reset which doesn't.
+     */
+    svm_reset(cpu, SVM_RESET_REGISTERS | SVM_RESET_STACKS);
+    EXPECT(!cpu->verified);
+    svm_reset(cpu, SVM_RESET_ALL);
+    EXPECT(cpu->verified && cpu->opcodes[STACK_PUSH] != checked->opcodes[STACK_PUSH]);
+
+    /**
+     * A tracer has handlers of its own, and gives the verified ones back.
+     */
+    svm_set_tracer(cpu, &(svm_tracer_t){SVM_TRACE_NONE, NULL, NULL});
+    EXPECT(cpu->opcodes[STACK_PUSH] != checked->opcodes[STACK_PUSH]);
+    svm_set_tracer(cpu, NULL);
+    EXPECT(cpu->verified && cpu->opcodes[STACK_PUSH] != checked->opcodes[STACK_PUSH]);
+    svm_free(cpu);
+
+    /**
+     * A stack kept from one scan to the next is never verified.
+     */
+    cpu = svm_new(pushing, sizeof(pushing), NULL);
+    svm_run(cpu);
+    EXPECT(cpu->verified && cpu->SP == 1);
+    svm_reset(cpu, SVM_RESET_REGISTERS | SVM_RESET_MEMORY);
+    EXPECT(!cpu->verified);
+    svm_reset(cpu, SVM_RESET_ALL);
+    EXPECT(cpu->verified);
+    svm_free(cpu);
+
+    svm_free(checked);
+    printf("%-10s handlers switched\n", "switching");
+}
+
+/**
+ * An engine - svm_run_call() until the timings switch to the inlined one -
+ * on the handlers the machine would use, or on the checked ones.
+ */
+static void (*engine)(svm_t *) = svm_run_call;
+
+static void run_verified(svm_t *cpu)
+{
+    EXPECT(cpu->verified);
+    engine(cpu);
+}
+
+static void run_checked(svm_t *cpu)
+{
+    svm_invalidate(cpu, 0, 1);
+    EXPECT(!cpu->verified);
+    engine(cpu);
+}
+
+/**
+ * A loop of handled instructions.
+ */
+static unsigned char loop[] = {
+    INT_STORE, 0, 0xFF, 0xFF,
+    INT_STORE, 1, 3, 0,
+    /* 8 */ STACK_PUSH, 1,
+    STACK_POP, 2,
+    ADD, 3, 1, 2,
+    BINARY_LOAD, 4, 0,
+    STACK_CALL, 28, 0,
+    DEC, 0,
+    JUMP_NZ, 8, 0,
+    EXIT,
+    /* 28 */ INC, 5,
+    STACK_RET,
+};
+
+static double speed(void (*run)(svm_t *))
+{
+    svm_t *cpu = svm_new(loop, sizeof(loop), error);
+    double instructions = 0;
+    double elapsed;
+    double start = now();
+
+    do
+    {
+        svm_reset(cpu, SVM_RESET_ALL);
+        svm_latch_inputs(cpu);
+        run(cpu);
+        svm_publish_outputs(cpu);
+        instructions += cpu->iterations;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    svm_free(cpu);
+    return instructions / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    static unsigned char code[0xFFFF];
+    static struct snapshot verified, checked;
+
+    check_verdicts();
+    check_switching();
+    if (failed)
+        return failed;
+
+    printf("\n%-24s %8s %8s %8s\n", "program", "verdict", "stack", "calls");
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        size_t size = fread(code, 1, sizeof(code), fp);
+        fclose(fp);
+
+        svm_t *cpu = svm_new(code, size, error);
+        struct svm_verification v = cpu->verification;
+        svm_free(cpu);
+
+        printf("%-24s %8d %8u %8u\n", argv[i], v.code, v.max_stack, v.max_calls);
+        if (v.code != SVM_VERIFY_OK)
+            continue;
+
+        run_once(code, size, run_verified, &verified);
+        run_once(code, size, run_checked, &checked);
+        if (!compare(argv[i], &verified, &checked))
+            failed = 1;
+    }
+
+    jsprintf_handler = sink;
+
+    /**
+     * The inlined engine handles these in place, with checks of its own,
+     * so it is the loops calling through the handlers which gain.
+     */
+    printf("\n%-24s %14s %14s\n", "push, pop, add, call", "checked [i/s]", "verified [i/s]");
+    printf("%-24s %14.0f %14.0f\n", "call", speed(run_checked), speed(run_verified));
+    engine = svm_run_inline;
+    printf("%-24s %14.0f %14.0f\n", "inline", speed(run_checked), speed(run_verified));
+
+    return failed;
+}
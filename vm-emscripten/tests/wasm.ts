@@ -0,0 +1,71 @@
+import VM from '../dist/vm.js'
+import { readFileSync } from 'fs'
+
+// random.raw draws different numbers every run, system.raw runs a shell command
+const PROGRAMS = ['add', 'arith', 'bench', 'call', 'compare', 'concat', 'dec', 'equal',
+    'jump', 'loop', 'memcpy', 'mul', 'poke', 'stack', 'types'];
+
+const RUNS = 1000;
+
+let output: string[] = [];
+
+global.createStdoutQ8YQPV9U = function(msg) {
+    output.push(msg)
+}
+
+// Modules too large to be compiled synchronously are instantiated in the background
+const tick = () => new Promise(resolve => setTimeout(resolve, 10));
+
+function run(vm, program: Uint8Array, variables): string {
+    output = [];
+    vm.setVariables(variables);
+    vm.RunProgram(program);
+    return output.join('');
+}
+
+VM().then(async vm => {
+    let failed = 0;
+
+    vm.SetTraceLevel(0);
+
+    for (const name of PROGRAMS) {
+        const program = readFileSync(`examples/${name}.raw`);
+        const variables = vm.getVariables();
+
+        vm.SetWasmCodegen(false);
+        const expected = run(vm, program, variables);
+
+        vm.SetWasmCodegen(true);
+        run(vm, program, variables);
+        await tick();
+        const actual = run(vm, program, variables);
+
+        if (actual !== expected) {
+            console.log(`examples/${name}.raw: FAIL`);
+            console.log(`--- interpreter\n${expected}\n--- generated\n${actual}`);
+            failed++;
+        }
+        else {
+            console.log(`examples/${name}.raw: OK`);
+        }
+    }
+
+    const bench = readFileSync('examples/bench.raw');
+    const variables = vm.getVariables();
+
+    for (const enabled of [false, true]) {
+        vm.SetWasmCodegen(enabled);
+        run(vm, bench, variables);
+        await tick();
+
+        const start = performance.now();
+        for (let i = 0; i < RUNS; i++) {
+            run(vm, bench, variables);
+        }
+        const elapsed = performance.now() - start;
+
+        console.log(`bench.raw ${enabled ? 'generated' : 'interpreter'}: ${(elapsed * 1000 / RUNS).toFixed(1)} us/scan`);
+    }
+
+    process.exit(failed ? 1 : 0);
+})